@@ -347,11 +347,13 @@ void cliprdr_process_format_data_response(cliprdrPlugin* cliprdr, STREAM* s, UIN
 	cb_event = (RDP_CB_DATA_RESPONSE_EVENT*) freerdp_event_new(RDP_EVENT_CLASS_CLIPRDR,
 		RDP_EVENT_TYPE_CB_DATA_RESPONSE, NULL, NULL);
 
-	if (dataLen > 0)
+	if ((dataLen > 0) && (stream_get_left(s) >= dataLen))
 	{
+		/* the reassembled PDU is handed over in place rather than copied */
 		cb_event->size = dataLen;
-		cb_event->data = (BYTE*) malloc(dataLen);
-		memcpy(cb_event->data, stream_get_tail(s), dataLen);
+		cb_event->data = stream_get_head(s);
+		MoveMemory(cb_event->data, stream_get_tail(s), dataLen);
+		stream_detach(s);
 	}
 
 	svc_plugin_send_event((rdpSvcPlugin*) cliprdr, (RDP_EVENT*) cb_event);
@@ -575,33 +575,51 @@ static void drive_process_irp(DRIVE_DEVICE* disk, IRP* irp)
 	}
 }
 
+/**
+ * IRPs are taken off the list in one batch and processed in the order they
+ * were received, so that sequential reads reach the host file in sequence.
+ * When stopping, the rest of the batch goes back to the list to be discarded.
+ */
+
 static void drive_process_irp_list(DRIVE_DEVICE* disk)
 {
 	IRP* irp;
+	ULONG count;
+	PSLIST_ENTRY entry;
+	PSLIST_ENTRY last;
 
-	while (1)
+	while ((entry = InterlockedFlushSListFifo(disk->pIrpList)) != NULL)
 	{
-		if (WaitForSingleObject(disk->stopEvent, 0) == WAIT_OBJECT_0)
-			break;
+		while (entry)
+		{
+			if (WaitForSingleObject(disk->stopEvent, 0) == WAIT_OBJECT_0)
+			{
+				for (last = entry, count = 1; last->Next; last = last->Next)
+					count++;
 
-		irp = (IRP*) InterlockedPopEntrySList(disk->pIrpList);
+				InterlockedPushListSListEx(disk->pIrpList, entry, last, count);
+				return;
+			}
 
-		if (irp == NULL)
-			break;
+			irp = (IRP*) entry;
+			entry = entry->Next;
 
-		drive_process_irp(disk, irp);
+			drive_process_irp(disk, irp);
+		}
 	}
 }
 
 static void* drive_thread_func(void* arg)
 {
+	HANDLE hdl[2];
 	DRIVE_DEVICE* disk = (DRIVE_DEVICE*) arg;
 
+	hdl[0] = disk->stopEvent;
+	hdl[1] = disk->irpEvent;
+
 	while (1)
 	{
-		WaitForSingleObject(disk->irpEvent, INFINITE);
-
-		if (WaitForSingleObject(disk->stopEvent, 0) == WAIT_OBJECT_0)
+		if (WaitForMultipleObjects(2, hdl, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
 			break;
 
 		ResetEvent(disk->irpEvent);
@@ -627,8 +645,11 @@ static void drive_free(DEVICE* device)
 	DRIVE_DEVICE* disk = (DRIVE_DEVICE*) device;
 
 	SetEvent(disk->stopEvent);
+	WaitForSingleObject(disk->thread, INFINITE);
+
 	CloseHandle(disk->thread);
 	CloseHandle(disk->irpEvent);
+	CloseHandle(disk->stopEvent);
 
 	while ((irp = (IRP*) InterlockedPopEntrySList(disk->pIrpList)) != NULL)
 		irp->Discard(irp);
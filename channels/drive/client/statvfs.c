@@ -36,7 +36,7 @@ int statvfs(const char *path, struct statvfs *buf)
 	DWORD lpTotalNumberOfClusters;
 
 	len = MultiByteToWideChar(CP_ACP, 0, path, -1, NULL, 0);
-	unicodestr = (LPWSTR) malloc(len);
+	unicodestr = (LPWSTR) malloc(len * sizeof(WCHAR));
 	MultiByteToWideChar(CP_ACP, 0, path, -1, unicodestr, len);
 
 	res = GetDiskFreeSpace(unicodestr, &lpSectorsPerCluster, &lpBytesPerSector, &lpNumberOfFreeClusters, &lpTotalNumberOfClusters);
@@ -31,6 +31,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
+#include <winpr/error.h>
 
 #include "channels.h"
 
@@ -61,17 +62,53 @@ void freerdp_channels_dummy()
 #define CLOSE_REQUEST_PDU			0x04
 #define CAPABILITY_REQUEST_PDU			0x05
 
-typedef struct wts_data_item
+/**
+ * Queued PDUs and their buffers come from pools owned by the channel
+ * manager, and the send and receive queues are lock-free: queueing a PDU
+ * costs no malloc() and no lock round-trip once the pools are warm.
+ */
+
+static wts_data_item* wts_data_item_new(WTSVirtualChannelManager* vcm, UINT32 length)
 {
-	UINT16 channel_id;
-	BYTE* buffer;
-	UINT32 length;
-} wts_data_item;
+	wts_data_item* item;
 
-static void wts_data_item_free(wts_data_item* item)
+	item = (wts_data_item*) ObjectPool_Take(vcm->item_pool);
+
+	if (!item)
+		return NULL;
+
+	item->channel_id = 0;
+	item->length = length;
+	item->buffer = BufferPool_Take(vcm->buffer_pool, length);
+
+	if (!item->buffer)
+	{
+		ObjectPool_Return(vcm->item_pool, item);
+		return NULL;
+	}
+
+	return item;
+}
+
+static void wts_data_item_free(WTSVirtualChannelManager* vcm, wts_data_item* item)
 {
-	free(item->buffer);
-	free(item);
+	BufferPool_Return(vcm->buffer_pool, item->buffer);
+	ObjectPool_Return(vcm->item_pool, item);
+}
+
+static void wts_queue_get_fds(wQueue* queue, void** fds, int* fds_count)
+{
+#ifdef _WIN32
+	fds[*fds_count] = (void*) Queue_Event(queue);
+#else
+	int fd = GetEventFileDescriptor(Queue_Event(queue));
+
+	if (fd == -1)
+		return;
+
+	fds[*fds_count] = (void*)(long) fd;
+#endif
+	(*fds_count)++;
 }
 
 void* freerdp_channels_server_find_static_entry(const char* name, const char* entry)
@@ -95,22 +132,49 @@ static rdpPeerChannel* wts_get_dvc_channel_by_id(WTSVirtualChannelManager* vcm,
 	return channel;
 }
 
-static void wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* buffer, UINT32 length)
+/**
+ * Channel data that cannot be queued is not dropped silently: the channel
+ * is marked failed, and once the data queued before is read, reads fail so
+ * that the server tears the channel down.
+ */
+
+static void wts_receive_failed(rdpPeerChannel* channel)
+{
+	printf("wts_queue_receive_data: out of memory, channel %d failed\n", channel->channel_id);
+
+	channel->receive_failed = TRUE;
+
+	if (channel->channel_type == RDP_PEER_CHANNEL_TYPE_DVC)
+		channel->dvc_open_state = DVC_OPEN_STATE_FAILED;
+
+	SetEvent(Queue_Event(channel->receive_queue));
+}
+
+static BOOL wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* buffer, UINT32 length)
 {
 	wts_data_item* item;
 
-	item = (wts_data_item*) malloc(sizeof(wts_data_item));
-	ZeroMemory(item, sizeof(wts_data_item));
+	if (channel->receive_failed)
+		return FALSE;
+
+	item = wts_data_item_new(channel->vcm, length);
+
+	if (!item)
+	{
+		wts_receive_failed(channel);
+		return FALSE;
+	}
 
-	item->length = length;
-	item->buffer = malloc(length);
 	memcpy(item->buffer, buffer, length);
 
-	WaitForSingleObject(channel->mutex, INFINITE);
-	list_enqueue(channel->receive_queue, item);
-	ReleaseMutex(channel->mutex);
+	if (!Queue_Enqueue(channel->receive_queue, item))
+	{
+		wts_data_item_free(channel->vcm, item);
+		wts_receive_failed(channel);
+		return FALSE;
+	}
 
-	wait_obj_set(channel->receive_event);
+	return TRUE;
 }
 
 static void wts_queue_send_item(rdpPeerChannel* channel, wts_data_item* item)
@@ -121,11 +185,8 @@ static void wts_queue_send_item(rdpPeerChannel* channel, wts_data_item* item)
 
 	item->channel_id = channel->channel_id;
 
-	WaitForSingleObject(vcm->mutex, INFINITE);
-	list_enqueue(vcm->send_queue, item);
-	ReleaseMutex(vcm->mutex);
-
-	wait_obj_set(vcm->send_event);
+	if (!Queue_Enqueue(vcm->send_queue, item))
+		wts_data_item_free(vcm, item);
 }
 
 static int wts_read_variable_uint(STREAM* s, int cbLen, UINT32 *val)
@@ -184,7 +245,7 @@ static void wts_read_drdynvc_create_response(rdpPeerChannel* channel, STREAM* s,
 		DEBUG_DVC("ChannelId %d creation succeeded", channel->channel_id);
 		channel->dvc_open_state = DVC_OPEN_STATE_SUCCEEDED;
 	}
-	wait_obj_set(channel->receive_event);
+	SetEvent(Queue_Event(channel->receive_queue));
 }
 
 static void wts_read_drdynvc_data_first(rdpPeerChannel* channel, STREAM* s, int cbLen, UINT32 length)
@@ -356,8 +417,10 @@ static void wts_write_drdynvc_create_request(STREAM *s, UINT32 ChannelId, const
 	stream_write(s, ChannelName, len);
 }
 
-static void WTSProcessChannelData(rdpPeerChannel* channel, int channelId, BYTE* data, int size, int flags, int total_size)
+static BOOL WTSProcessChannelData(rdpPeerChannel* channel, int channelId, BYTE* data, int size, int flags, int total_size)
 {
+	BOOL status = TRUE;
+
 	if (flags & CHANNEL_FLAG_FIRST)
 	{
 		stream_set_pos(channel->receive_data, 0);
@@ -378,10 +441,12 @@ static void WTSProcessChannelData(rdpPeerChannel* channel, int channelId, BYTE*
 		}
 		else
 		{
-			wts_queue_receive_data(channel, stream_get_head(channel->receive_data), stream_get_length(channel->receive_data));
+			status = wts_queue_receive_data(channel, stream_get_head(channel->receive_data), stream_get_length(channel->receive_data));
 		}
 		stream_set_pos(channel->receive_data, 0);
 	}
+
+	return status;
 }
 
 static int WTSReceiveChannelData(freerdp_peer* client, int channelId, BYTE* data, int size, int flags, int total_size)
@@ -401,8 +466,7 @@ static int WTSReceiveChannelData(freerdp_peer* client, int channelId, BYTE* data
 
 		if (channel != NULL)
 		{
-			WTSProcessChannelData(channel, channelId, data, size, flags, total_size);
-			result = TRUE;
+			result = WTSProcessChannelData(channel, channelId, data, size, flags, total_size);
 		}
 	}
 
@@ -420,8 +484,9 @@ WTSVirtualChannelManager* WTSCreateVirtualChannelManager(freerdp_peer* client)
 		ZeroMemory(vcm, sizeof(WTSVirtualChannelManager));
 
 		vcm->client = client;
-		vcm->send_event = wait_obj_new();
-		vcm->send_queue = list_new();
+		vcm->send_queue = Queue_New(256);
+		vcm->item_pool = ObjectPool_New(sizeof(wts_data_item), 256);
+		vcm->buffer_pool = BufferPool_New(64);
 		vcm->mutex = CreateMutex(NULL, FALSE, NULL);
 		vcm->dvc_channel_id_seq = 1;
 		vcm->dvc_channel_list = list_new();
@@ -452,14 +517,14 @@ void WTSDestroyVirtualChannelManager(WTSVirtualChannelManager* vcm)
 			vcm->drdynvc_channel = NULL;
 		}
 
-		wait_obj_free(vcm->send_event);
-
-		while ((item = (wts_data_item*) list_dequeue(vcm->send_queue)) != NULL)
+		while ((item = (wts_data_item*) Queue_Dequeue(vcm->send_queue)) != NULL)
 		{
-			wts_data_item_free(item);
+			wts_data_item_free(vcm, item);
 		}
 
-		list_free(vcm->send_queue);
+		Queue_Free(vcm->send_queue);
+		ObjectPool_Free(vcm->item_pool);
+		BufferPool_Free(vcm->buffer_pool);
 		CloseHandle(vcm->mutex);
 		free(vcm);
 	}
@@ -468,11 +533,11 @@ void WTSDestroyVirtualChannelManager(WTSVirtualChannelManager* vcm)
 void WTSVirtualChannelManagerGetFileDescriptor(WTSVirtualChannelManager* vcm,
 	void** fds, int* fds_count)
 {
-	wait_obj_get_fds(vcm->send_event, fds, fds_count);
+	wts_queue_get_fds(vcm->send_queue, fds, fds_count);
 
 	if (vcm->drdynvc_channel)
 	{
-		wait_obj_get_fds(vcm->drdynvc_channel->receive_event, fds, fds_count);
+		wts_queue_get_fds(vcm->drdynvc_channel->receive_queue, fds, fds_count);
 	}
 }
 
@@ -498,25 +563,19 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptor(WTSVirtualChannelManager* vcm)
 		}
 	}
 
-	wait_obj_clear(vcm->send_event);
-
-	WaitForSingleObject(vcm->mutex, INFINITE);
-
-	while ((item = (wts_data_item*) list_dequeue(vcm->send_queue)) != NULL)
+	while ((item = (wts_data_item*) Queue_Dequeue(vcm->send_queue)) != NULL)
 	{
 		if (vcm->client->SendChannelData(vcm->client, item->channel_id, item->buffer, item->length) == FALSE)
 		{
 			result = FALSE;
 		}
 
-		wts_data_item_free(item);
+		wts_data_item_free(vcm, item);
 
 		if (result == FALSE)
 			break;
 	}
 
-	ReleaseMutex(vcm->mutex);
-
 	return result;
 }
 
@@ -546,9 +605,7 @@ void* WTSVirtualChannelOpenEx(
 		channel->client = client;
 		channel->channel_type = RDP_PEER_CHANNEL_TYPE_DVC;
 		channel->receive_data = stream_new(client->settings->VirtualChannelChunkSize);
-		channel->receive_event = wait_obj_new();
-		channel->receive_queue = list_new();
-		channel->mutex = CreateMutex(NULL, FALSE, NULL);
+		channel->receive_queue = Queue_New(64);
 
 		WaitForSingleObject(vcm->mutex, INFINITE);
 		channel->channel_id = vcm->dvc_channel_id_seq++;
@@ -594,9 +651,7 @@ void* WTSVirtualChannelOpenEx(
 			channel->index = i;
 			channel->channel_type = RDP_PEER_CHANNEL_TYPE_SVC;
 			channel->receive_data = stream_new(client->settings->VirtualChannelChunkSize);
-			channel->receive_event = wait_obj_new();
-			channel->receive_queue = list_new();
-			channel->mutex = CreateMutex(NULL, FALSE, NULL);
+			channel->receive_queue = Queue_New(64);
 
 			client->settings->ChannelDefArray[i].handle = channel;
 		}
@@ -620,7 +675,7 @@ BOOL WTSVirtualChannelQuery(
 	switch (WtsVirtualClass)
 	{
 		case WTSVirtualFileHandle:
-			wait_obj_get_fds(channel->receive_event, fds, &fds_count);
+			wts_queue_get_fds(channel->receive_queue, fds, &fds_count);
 			*ppBuffer = malloc(sizeof(void*));
 			memcpy(*ppBuffer, &fds[0], sizeof(void*));
 			*pBytesReturned = sizeof(void*);
@@ -678,31 +733,42 @@ BOOL WTSVirtualChannelRead(
 	wts_data_item* item;
 	rdpPeerChannel* channel = (rdpPeerChannel*) hChannelHandle;
 
-	item = (wts_data_item*) list_peek(channel->receive_queue);
+	/**
+	 * An item too large for the caller's buffer is kept aside until it is
+	 * read with a large enough buffer, and the event stays signaled for it.
+	 */
+
+	item = channel->receive_pending;
+	channel->receive_pending = NULL;
+
+	if (item == NULL)
+		item = (wts_data_item*) Queue_Dequeue(channel->receive_queue);
 
 	if (item == NULL)
 	{
-		wait_obj_clear(channel->receive_event);
 		*pBytesRead = 0;
+
+		if (channel->receive_failed)
+		{
+			SetEvent(Queue_Event(channel->receive_queue));
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return FALSE;
+		}
+
 		return TRUE;
 	}
 
 	*pBytesRead = item->length;
 
 	if (item->length > BufferSize)
+	{
+		channel->receive_pending = item;
+		SetEvent(Queue_Event(channel->receive_queue));
 		return FALSE;
-
-	/* remove the first element (same as what we just peek) */
-	WaitForSingleObject(channel->mutex, INFINITE);
-	list_dequeue(channel->receive_queue);
-
-	if (list_size(channel->receive_queue) == 0)
-		wait_obj_clear(channel->receive_event);
-
-	ReleaseMutex(channel->mutex);
+	}
 
 	memcpy(Buffer, item->buffer, item->length);
-	wts_data_item_free(item) ;
+	wts_data_item_free(channel->vcm, item);
 
 	return TRUE;
 }
@@ -720,17 +786,24 @@ BOOL WTSVirtualChannelWrite(
 	int cbChId;
 	int first;
 	UINT32 written;
+	UINT32 total = Length;
+
+	if (pBytesWritten != NULL)
+		*pBytesWritten = 0;
 
 	if (channel == NULL)
 		return FALSE;
 
 	if (channel->channel_type == RDP_PEER_CHANNEL_TYPE_SVC)
 	{
-		item = (wts_data_item*) malloc(sizeof(wts_data_item));
-		ZeroMemory(item, sizeof(wts_data_item));
+		item = wts_data_item_new(channel->vcm, Length);
+
+		if (!item)
+		{
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return FALSE;
+		}
 
-		item->buffer = malloc(Length);
-		item->length = Length;
 		memcpy(item->buffer, Buffer, Length);
 
 		wts_queue_send_item(channel, item);
@@ -747,10 +820,20 @@ BOOL WTSVirtualChannelWrite(
 
 		while (Length > 0)
 		{
-			item = (wts_data_item*) malloc(sizeof(wts_data_item));
-			ZeroMemory(item, sizeof(wts_data_item));
+			item = wts_data_item_new(channel->vcm, channel->client->settings->VirtualChannelChunkSize);
+
+			if (!item)
+			{
+				/* chunks already queued cannot be taken back, report how much went out */
+				stream_free(s);
+
+				if (pBytesWritten != NULL)
+					*pBytesWritten = total - Length;
+
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+				return FALSE;
+			}
 
-			item->buffer = malloc(channel->client->settings->VirtualChannelChunkSize);
 			stream_attach(s, item->buffer, channel->client->settings->VirtualChannelChunkSize);
 
 			stream_seek_BYTE(s);
@@ -785,7 +868,7 @@ BOOL WTSVirtualChannelWrite(
 	}
 
 	if (pBytesWritten != NULL)
-		*pBytesWritten = Length;
+		*pBytesWritten = total;
 	return TRUE;
 }
 
@@ -824,22 +907,19 @@ BOOL WTSVirtualChannelClose(
 		if (channel->receive_data)
 			stream_free(channel->receive_data);
 
-		if (channel->receive_event)
-			wait_obj_free(channel->receive_event);
+		if (channel->receive_pending)
+			wts_data_item_free(vcm, channel->receive_pending);
 
 		if (channel->receive_queue)
 		{
-			while ((item = (wts_data_item*) list_dequeue(channel->receive_queue)) != NULL)
+			while ((item = (wts_data_item*) Queue_Dequeue(channel->receive_queue)) != NULL)
 			{
-				wts_data_item_free(item);
+				wts_data_item_free(vcm, item);
 			}
 
-			list_free(channel->receive_queue);
+			Queue_Free(channel->receive_queue);
 		}
 
-		if (channel->mutex)
-			CloseHandle(channel->mutex);
-
 		free(channel);
 	}
 
@@ -25,10 +25,10 @@
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/list.h>
 #include <freerdp/utils/debug.h>
-#include <freerdp/utils/wait_obj.h>
 #include <freerdp/channels/wtsvc.h>
 
 #include <winpr/synch.h>
+#include <winpr/collections.h>
 
 #ifdef WITH_DEBUG_DVC
 #define DEBUG_DVC(fmt, ...) DEBUG_CLASS(DVC, fmt, ## __VA_ARGS__)
@@ -57,6 +57,13 @@ enum
 	DVC_OPEN_STATE_CLOSED = 3
 };
 
+typedef struct wts_data_item
+{
+	UINT16 channel_id;
+	BYTE* buffer;
+	UINT32 length;
+} wts_data_item;
+
 typedef struct rdp_peer_channel rdpPeerChannel;
 struct rdp_peer_channel
 {
@@ -67,9 +74,9 @@ struct rdp_peer_channel
 	UINT16 index;
 
 	STREAM* receive_data;
-	struct wait_obj* receive_event;
-	LIST* receive_queue;
-	HANDLE mutex;
+	wQueue* receive_queue;
+	wts_data_item* receive_pending;
+	BOOL receive_failed;
 
 	BYTE dvc_open_state;
 	UINT32 dvc_total_length;
@@ -78,8 +85,9 @@ struct rdp_peer_channel
 struct WTSVirtualChannelManager
 {
 	freerdp_peer* client;
-	struct wait_obj* send_event;
-	LIST* send_queue;
+	wQueue* send_queue;
+	wObjectPool* item_pool;
+	wBufferPool* buffer_pool;
 	HANDLE mutex;
 
 	rdpPeerChannel* drdynvc_channel;
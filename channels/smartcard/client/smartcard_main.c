@@ -44,8 +44,11 @@ static void smartcard_free(DEVICE* dev)
 	SMARTCARD_DEVICE* smartcard = (SMARTCARD_DEVICE*) dev;
 
 	SetEvent(smartcard->stopEvent);
+	WaitForSingleObject(smartcard->thread, INFINITE);
+
 	CloseHandle(smartcard->thread);
 	CloseHandle(smartcard->irpEvent);
+	CloseHandle(smartcard->stopEvent);
 
 	while ((irp = (IRP*) InterlockedPopEntrySList(smartcard->pIrpList)) != NULL)
 		irp->Discard(irp);
@@ -118,13 +121,15 @@ static void smartcard_process_irp_thread_func(SMARTCARD_IRP_WORKER* irpWorker)
 
 static void* smartcard_thread_func(void* arg)
 {
+	HANDLE hdl[2];
 	SMARTCARD_DEVICE* smartcard = (SMARTCARD_DEVICE*) arg;
 
+	hdl[0] = smartcard->stopEvent;
+	hdl[1] = smartcard->irpEvent;
+
 	while (1)
 	{
-		WaitForSingleObject(smartcard->irpEvent, INFINITE);
-
-		if (WaitForSingleObject(smartcard->stopEvent, 0) == WAIT_OBJECT_0)
+		if (WaitForMultipleObjects(2, hdl, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
 			break;
 
 		ResetEvent(smartcard->irpEvent);
@@ -58,7 +58,15 @@ void df_Pointer_New(rdpContext* context, rdpPointer* pointer)
 			return;
 		}
 
-		if ((pointer->andMaskData != 0) && (pointer->xorMaskData != 0))
+		if (pointer->argbData != NULL)
+		{
+			/* already converted by the pointer cache */
+			int y;
+
+			for (y = 0; y < pointer->height; y++)
+				memcpy(&point[y * pitch], &pointer->argbData[y * pointer->width * 4], pointer->width * 4);
+		}
+		else if ((pointer->andMaskData != 0) && (pointer->xorMaskData != 0))
 		{
 			freerdp_alpha_cursor_convert(point, pointer->xorMaskData, pointer->andMaskData,
 					pointer->width, pointer->height, pointer->xorBpp, dfi->clrconv);
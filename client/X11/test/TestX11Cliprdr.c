@@ -0,0 +1,186 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+/* the conversion of incoming selections is static to the clipboard module and needs no display */
+#include "xf_cliprdr.c"
+
+/**
+ * A selection converted chunk by chunk, as an INCR transfer hands it out,
+ * must give the same bytes as the whole selection converted at once, in
+ * buffers sized to the converted data, whatever the chunk boundaries split:
+ * LF to CRLF expansion, UTF-8 sequences or the BMP file header.
+ */
+
+#define TEST_CLIPRDR_LENGTH	(256 * 1024)
+
+static const char test_text[] =
+	"h\xC3\xA9llo w\xE2\x82\xACrld \xF0\x9F\x98\x80\n"
+	"line\n"
+	"\n"
+	"<body>x</body>";
+
+static UINT32 test_formats[] =
+{
+	CB_FORMAT_RAW,
+	CB_FORMAT_UNICODETEXT,
+	CB_FORMAT_TEXT,
+	CB_FORMAT_DIB,
+	CB_FORMAT_HTML
+};
+
+static int test_chunks[] = { 1, 2, 3, 4, 5, 7, 4096, 65536 };
+
+static BYTE* test_convert(clipboardContext* cb, UINT32 format, BYTE* data, int length, int chunk, int* size)
+{
+	int offset;
+	BYTE* outbuf;
+
+	for (cb->request_index = 0; cb->format_mappings[cb->request_index].format_id != format; cb->request_index++);
+
+	/* an INCR transfer only announces a lower bound of the selection length */
+	xf_cliprdr_begin_requested(cb, chunk ? 16 : length);
+	cb->incr_starts = chunk ? TRUE : FALSE;
+
+	if (chunk == 0)
+		chunk = length;
+
+	for (offset = 0; offset < length; offset += chunk)
+	{
+		if (!xf_cliprdr_append_requested(cb, &data[offset], MIN(chunk, length - offset)))
+		{
+			xf_cliprdr_reset_requested(cb);
+			return NULL;
+		}
+	}
+
+	cb->incr_starts = FALSE;
+
+	outbuf = xf_cliprdr_finish_requested(cb, size);
+
+	/* nothing is handed out with the slack of the growth */
+	if (outbuf && (format != CB_FORMAT_HTML) && (cb->incr_data_size != *size))
+	{
+		printf("format 0x%04X chunk %d: %d bytes in a %d byte buffer\n", format, chunk, *size, cb->incr_data_size);
+		free(outbuf);
+		outbuf = NULL;
+	}
+
+	xf_cliprdr_reset_requested(cb);
+
+	return outbuf;
+}
+
+int TestX11Cliprdr(int argc, char* argv[])
+{
+	int i, j;
+	int size;
+	int length;
+	int count;
+	int expected_size;
+	BYTE* data;
+	BYTE* whole;
+	BYTE* chunked;
+	BYTE* crlf;
+	WCHAR* expected;
+	clipboardContext cb;
+
+	ZeroMemory(&cb, sizeof(clipboardContext));
+
+	for (i = 0; i < ARRAYSIZE(test_formats); i++)
+		cb.format_mappings[i].format_id = test_formats[i];
+
+	cb.num_format_mappings = ARRAYSIZE(test_formats);
+
+	length = TEST_CLIPRDR_LENGTH - (TEST_CLIPRDR_LENGTH % (sizeof(test_text) - 1));
+	data = (BYTE*) malloc(length);
+
+	for (i = 0; i < length; i++)
+		data[i] = test_text[i % (sizeof(test_text) - 1)];
+
+	for (i = 0; i < ARRAYSIZE(test_formats); i++)
+	{
+		whole = test_convert(&cb, test_formats[i], data, length, 0, &expected_size);
+
+		if (!whole)
+		{
+			printf("format 0x%04X: conversion failed\n", test_formats[i]);
+			return -1;
+		}
+
+		for (j = 0; j < ARRAYSIZE(test_chunks); j++)
+		{
+			chunked = test_convert(&cb, test_formats[i], data, length, test_chunks[j], &size);
+
+			if (!chunked || (size != expected_size) || (memcmp(whole, chunked, size) != 0))
+			{
+				printf("format 0x%04X chunk %d: converted selection differs\n", test_formats[i], test_chunks[j]);
+				return -1;
+			}
+
+			free(chunked);
+		}
+
+		free(whole);
+	}
+
+	/* UTF-8 text becomes null terminated UTF-16 with CRLF line endings */
+
+	crlf = (BYTE*) malloc(length * 2);
+	count = lf2crlf(crlf, data, length);
+	expected_size = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR) crlf, count, NULL, 0);
+	expected = (WCHAR*) calloc(expected_size + 1, sizeof(WCHAR));
+	MultiByteToWideChar(CP_UTF8, 0, (LPCSTR) crlf, count, expected, expected_size);
+
+	chunked = test_convert(&cb, CB_FORMAT_UNICODETEXT, data, length, 3, &size);
+
+	if (!chunked || (size != (expected_size + 1) * 2) || (memcmp(chunked, expected, size) != 0))
+	{
+		printf("CB_FORMAT_UNICODETEXT: Actual size: %d, Expected: %d\n", size, (expected_size + 1) * 2);
+		return -1;
+	}
+
+	free(chunked);
+	free(expected);
+
+	/* ANSI text keeps its bytes, with CRLF line endings */
+
+	chunked = test_convert(&cb, CB_FORMAT_TEXT, data, length, 5, &size);
+
+	if (!chunked || (size != count + 1) || (memcmp(chunked, crlf, count) != 0) || (chunked[count] != 0))
+	{
+		printf("CB_FORMAT_TEXT: Actual size: %d, Expected: %d\n", size, count + 1);
+		return -1;
+	}
+
+	free(chunked);
+	free(crlf);
+
+	/* the BMP file header is stripped even when it spans chunks */
+
+	chunked = test_convert(&cb, CB_FORMAT_DIB, data, 14 + 40, 5, &size);
+
+	if (!chunked || (size != 40) || (memcmp(chunked, &data[14], 40) != 0))
+	{
+		printf("CB_FORMAT_DIB: Actual size: %d, Expected: 40\n", size);
+		return -1;
+	}
+
+	free(chunked);
+
+	/* HTML fragments are wrapped with offsets pointing into the result */
+
+	chunked = test_convert(&cb, CB_FORMAT_HTML, (BYTE*) "<b>hi</b>", 9, 2, &size);
+
+	if (!chunked || (size != strlen((char*) chunked) + 1) ||
+			(strncmp((char*) &chunked[atoi(strstr((char*) chunked, "StartFragment:") + 14)], "<b>hi</b>", 9) != 0))
+	{
+		printf("CB_FORMAT_HTML: fragment offset does not point to the fragment\n");
+		return -1;
+	}
+
+	free(chunked);
+	free(data);
+
+	return 0;
+}
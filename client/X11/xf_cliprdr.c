@@ -21,6 +21,7 @@
 #include "config.h"
 #endif
 
+#include <time.h>
 #include <stdlib.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -34,6 +35,12 @@
 
 #include "xf_cliprdr.h"
 
+/* selections larger than this are handed out in chunks through INCR */
+#define CLIPRDR_INCR_CHUNK_SIZE		0x40000
+
+/* an outgoing INCR transfer the requestor stopped reading is dropped after this many seconds */
+#define CLIPRDR_INCR_TIMEOUT		5
+
 typedef struct clipboard_format_mapping clipboardFormatMapping;
 struct clipboard_format_mapping
 {
@@ -74,6 +81,18 @@ struct clipboard_context
 	BOOL incr_starts;
 	BYTE* incr_data;
 	int incr_data_length;
+	int incr_data_size;
+	int incr_skip;
+	BYTE incr_pending[4];
+	int incr_pending_length;
+
+	/* outgoing INCR transfer */
+	int incr_chunk_size;
+	Window incr_requestor;
+	Atom incr_property;
+	Atom incr_target;
+	int incr_offset;
+	time_t incr_time;
 };
 
 void xf_cliprdr_init(xfInfo* xfi, rdpChannels* chanman)
@@ -145,6 +164,7 @@ void xf_cliprdr_init(xfInfo* xfi, rdpChannels* chanman)
 	cb->num_targets = 2;
 
 	cb->incr_atom = XInternAtom(xfi->display, "INCR", FALSE);
+	cb->incr_chunk_size = MIN((int) XMaxRequestSize(xfi->display) * 4 - 32, CLIPRDR_INCR_CHUNK_SIZE);
 }
 
 void xf_cliprdr_uninit(xfInfo* xfi)
@@ -162,22 +182,18 @@ void xf_cliprdr_uninit(xfInfo* xfi)
 	}
 }
 
-static BYTE* lf2crlf(BYTE* data, int* size)
+/* the output needs room for the input and a CR for every LF, returns the number of bytes written */
+
+static int lf2crlf(BYTE* out, BYTE* data, int size)
 {
 	BYTE c;
 	BYTE* outbuf;
-	BYTE* out;
 	BYTE* in_end;
 	BYTE* in;
-	int out_size;
-
-	out_size = (*size) * 2 + 1;
-	outbuf = (BYTE*) malloc(out_size);
-	ZeroMemory(outbuf, out_size);
 
-	out = outbuf;
+	outbuf = out;
 	in = data;
-	in_end = data + (*size);
+	in_end = data + size;
 
 	while (in < in_end)
 	{
@@ -193,10 +209,21 @@ static BYTE* lf2crlf(BYTE* data, int* size)
 		}
 	}
 
-	*out++ = 0;
-	*size = out - outbuf;
+	return out - outbuf;
+}
 
-	return outbuf;
+static int count_lf(BYTE* data, int size)
+{
+	int count = 0;
+	BYTE* end = data + size;
+
+	while ((data = (BYTE*) memchr(data, '\n', end - data)) != NULL)
+	{
+		count++;
+		data++;
+	}
+
+	return count;
 }
 
 static void crlf2lf(BYTE* data, int* size)
@@ -522,179 +549,367 @@ static void xf_cliprdr_get_requested_targets(xfInfo* xfi)
 	}
 }
 
-static BYTE* xf_cliprdr_process_requested_raw(BYTE* data, int* size)
+static void xf_cliprdr_reset_requested(clipboardContext* cb)
 {
-	BYTE* outbuf;
+	free(cb->incr_data);
+	cb->incr_data = NULL;
+	cb->incr_data_length = 0;
+	cb->incr_data_size = 0;
+	cb->incr_skip = 0;
+	cb->incr_pending_length = 0;
+}
 
-	outbuf = (BYTE*) malloc(*size);
-	memcpy(outbuf, data, *size);
-	return outbuf;
+static BOOL xf_cliprdr_reserve_requested(clipboardContext* cb, int length)
+{
+	int size;
+	BYTE* data;
+
+	if (cb->incr_data_length + length <= cb->incr_data_size)
+		return TRUE;
+
+	size = cb->incr_data_length + length;
+
+	/* grow geometrically, a long INCR transfer is not reallocated on every chunk */
+	if (cb->incr_starts)
+		size = MAX(cb->incr_data_size * 2, size);
+
+	data = (BYTE*) realloc(cb->incr_data, size);
+
+	if (data == NULL)
+		return FALSE;
+
+	cb->incr_data = data;
+	cb->incr_data_size = size;
+
+	return TRUE;
 }
 
-static BYTE* xf_cliprdr_process_requested_unicodetext(BYTE* data, int* size)
+/* the converted data is handed out as is, without the slack left by geometric growth */
+
+static void xf_cliprdr_shrink_requested(clipboardContext* cb)
 {
-	char* inbuf;
-	WCHAR* outbuf;
-	int out_size;
+	BYTE* data;
 
-	inbuf = (char*) lf2crlf(data, size);
-	out_size = freerdp_AsciiToUnicodeAlloc(inbuf, &outbuf, 0);
-	free(inbuf);
+	if ((cb->incr_data_length < 1) || (cb->incr_data_length == cb->incr_data_size))
+		return;
 
-	*size = (int) ((out_size + 1) * 2);
+	data = (BYTE*) realloc(cb->incr_data, cb->incr_data_length);
 
-	return (BYTE*) outbuf;
+	if (data == NULL)
+		return;
+
+	cb->incr_data = data;
+	cb->incr_data_size = cb->incr_data_length;
 }
 
-static BYTE* xf_cliprdr_process_requested_text(BYTE* data, int* size)
+/**
+ * The selection is converted as it arrives, size is its length or the
+ * lower bound announced by the owner when it starts an INCR transfer.
+ * Text gets room for a CR every 16 characters, more is made as needed.
+ */
+
+static void xf_cliprdr_begin_requested(clipboardContext* cb, int size)
 {
-	BYTE* outbuf;
+	xf_cliprdr_reset_requested(cb);
 
-	outbuf = lf2crlf(data, size);
+	switch (cb->format_mappings[cb->request_index].format_id)
+	{
+		case CB_FORMAT_UNICODETEXT:
+			size = (size + (size / 16) + 1) * sizeof(WCHAR);
+			break;
 
-	return outbuf;
+		case CB_FORMAT_TEXT:
+			size = size + (size / 16) + 1;
+			break;
+
+		case CB_FORMAT_DIB:
+			/* the BMP file header is not part of a DIB */
+			cb->incr_skip = 14;
+			break;
+
+		case CB_FORMAT_HTML:
+			size = size + 1;
+			break;
+	}
+
+	if (size > 0)
+		xf_cliprdr_reserve_requested(cb, size);
 }
 
-static BYTE* xf_cliprdr_process_requested_dib(BYTE* data, int* size)
+static int utf8_sequence_length(BYTE c)
 {
-	BYTE* outbuf;
+	if ((c & 0xE0) == 0xC0)
+		return 2;
+	else if ((c & 0xF0) == 0xE0)
+		return 3;
+	else if ((c & 0xF8) == 0xF0)
+		return 4;
+
+	return 1;
+}
 
-	/* length should be at least BMP header (14) + sizeof(BITMAPINFOHEADER) */
-	if (*size < 54)
+/**
+ * Converts complete UTF-8 sequences to UTF-16, expanding LF to CRLF in place:
+ * the characters are converted past the room left for the CRs, then moved
+ * down, the write position never overtakes the read position.
+ */
+
+static BOOL xf_cliprdr_append_unicodetext(clipboardContext* cb, BYTE* data, int size)
+{
+	int i, j;
+	int lf;
+	int count;
+	WCHAR c;
+	WCHAR* out;
+
+	if (size < 1)
+		return TRUE;
+
+	count = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR) data, size, NULL, 0);
+	lf = count_lf(data, size);
+
+	if ((count < 1) || !xf_cliprdr_reserve_requested(cb, (count + lf) * sizeof(WCHAR)))
+		return FALSE;
+
+	out = (WCHAR*) &cb->incr_data[cb->incr_data_length];
+	MultiByteToWideChar(CP_UTF8, 0, (LPCSTR) data, size, &out[lf], count);
+
+	for (i = 0, j = 0; i < count; i++)
 	{
-		DEBUG_X11_CLIPRDR("bmp length %d too short", *size);
-		return NULL;
+		c = out[lf + i];
+
+		if (c == '\n')
+			out[j++] = '\r';
+
+		out[j++] = c;
 	}
 
-	*size -= 14;
-	outbuf = (BYTE*) malloc(*size);
-	ZeroMemory(outbuf, *size);
+	cb->incr_data_length += j * sizeof(WCHAR);
 
-	memcpy(outbuf, data + 14, *size);
+	return TRUE;
+}
 
-	return outbuf;
+/* a UTF-8 sequence split across two chunks is held back until it is complete */
+
+static BOOL xf_cliprdr_append_utf8(clipboardContext* cb, BYTE* data, int size)
+{
+	int i;
+	int cut;
+	int need;
+
+	if (cb->incr_pending_length > 0)
+	{
+		need = MIN(utf8_sequence_length(cb->incr_pending[0]) - cb->incr_pending_length, size);
+		CopyMemory(&cb->incr_pending[cb->incr_pending_length], data, need);
+		cb->incr_pending_length += need;
+		data += need;
+		size -= need;
+
+		if (cb->incr_pending_length < utf8_sequence_length(cb->incr_pending[0]))
+			return TRUE;
+
+		cb->incr_pending_length = 0;
+
+		if (!xf_cliprdr_append_unicodetext(cb, cb->incr_pending, utf8_sequence_length(cb->incr_pending[0])))
+			return FALSE;
+	}
+
+	cut = size;
+
+	for (i = size - 1; (i >= 0) && (i >= size - 3); i--)
+	{
+		if ((data[i] & 0xC0) != 0x80)
+		{
+			if (i + utf8_sequence_length(data[i]) > size)
+				cut = i;
+			break;
+		}
+	}
+
+	CopyMemory(cb->incr_pending, &data[cut], size - cut);
+	cb->incr_pending_length = size - cut;
+
+	return xf_cliprdr_append_unicodetext(cb, data, cut);
+}
+
+static BOOL xf_cliprdr_append_requested(clipboardContext* cb, BYTE* data, int size)
+{
+	int skip;
+
+	switch (cb->format_mappings[cb->request_index].format_id)
+	{
+		case CB_FORMAT_UNICODETEXT:
+			return xf_cliprdr_append_utf8(cb, data, size);
+
+		case CB_FORMAT_TEXT:
+			if (!xf_cliprdr_reserve_requested(cb, size + count_lf(data, size)))
+				return FALSE;
+
+			cb->incr_data_length += lf2crlf(&cb->incr_data[cb->incr_data_length], data, size);
+			return TRUE;
+
+		case CB_FORMAT_DIB:
+			skip = MIN(cb->incr_skip, size);
+			cb->incr_skip -= skip;
+			data += skip;
+			size -= skip;
+			break;
+	}
+
+	if (!xf_cliprdr_reserve_requested(cb, size))
+		return FALSE;
+
+	CopyMemory(&cb->incr_data[cb->incr_data_length], data, size);
+	cb->incr_data_length += size;
+
+	return TRUE;
 }
 
-static BYTE* xf_cliprdr_process_requested_html(BYTE* data, int* size)
+#define CLIPRDR_HTML_HEADER \
+	"Version:0.9\r\n" \
+	"StartHTML:%010lu\r\n" \
+	"EndHTML:%010lu\r\n" \
+	"StartFragment:%010lu\r\n" \
+	"EndFragment:%010lu\r\n"
+
+static BYTE* xf_cliprdr_wrap_html(clipboardContext* cb, int* size)
 {
 	char* inbuf;
-	BYTE* in;
+	char* body;
+	char* prefix;
+	char* suffix;
 	BYTE* outbuf;
-	char num[11];
+	int length;
+	unsigned long start_html;
+	unsigned long end_html;
+	unsigned long start_fragment;
+	unsigned long end_fragment;
 
 	inbuf = NULL;
+	length = cb->incr_data_length;
 
-	if (*size > 2)
+	if (length > 2)
 	{
-		if ((BYTE) data[0] == 0xFE && (BYTE) data[1] == 0xFF)
+		if (cb->incr_data[0] == 0xFE && cb->incr_data[1] == 0xFF)
 		{
-			be2le(data, *size);
+			be2le(cb->incr_data, length);
 		}
 
-		if ((BYTE) data[0] == 0xFF && (BYTE) data[1] == 0xFE)
+		if (cb->incr_data[0] == 0xFF && cb->incr_data[1] == 0xFE)
 		{
-			freerdp_UnicodeToAsciiAlloc((WCHAR*) (data + 2), &inbuf, (*size - 2) / 2);
+			freerdp_UnicodeToAsciiAlloc((WCHAR*) (cb->incr_data + 2), &inbuf, (length - 2) / 2);
 		}
 	}
 
 	if (inbuf == NULL)
 	{
-		inbuf = malloc(*size + 1);
-		ZeroMemory(inbuf, *size + 1);
+		if (!xf_cliprdr_reserve_requested(cb, 1))
+			return NULL;
 
-		memcpy(inbuf, data, *size);
+		cb->incr_data[length] = 0;
+		inbuf = (char*) cb->incr_data;
 	}
 
-	outbuf = (BYTE*) malloc(*size + 200);
-	ZeroMemory(outbuf, *size + 200);
+	body = strstr(inbuf, "<body");
 
-	strcpy((char*) outbuf,
-		"Version:0.9\r\n"
-		"StartHTML:0000000000\r\n"
-		"EndHTML:0000000000\r\n"
-		"StartFragment:0000000000\r\n"
-		"EndFragment:0000000000\r\n");
+	if (body == NULL)
+		body = strstr(inbuf, "<BODY");
 
-	in = (BYTE*) strstr((char*) inbuf, "<body");
+	prefix = (body != NULL) ? "<!--StartFragment-->" : "<HTML><BODY><!--StartFragment-->";
+	suffix = (body != NULL) ? "<!--EndFragment-->" : "<!--EndFragment--></BODY></HTML>";
 
-	if (in == NULL)
-	{
-		in = (BYTE*) strstr((char*) inbuf, "<BODY");
-	}
-	/* StartHTML */
-	snprintf(num, sizeof(num), "%010lu", (unsigned long) strlen((char*) outbuf));
-	memcpy(outbuf + 23, num, 10);
-	if (in == NULL)
-	{
-		strcat((char*) outbuf, "<HTML><BODY>");
-	}
-	strcat((char*) outbuf, "<!--StartFragment-->");
-	/* StartFragment */
-	snprintf(num, sizeof(num), "%010lu", (unsigned long) strlen((char*) outbuf));
-	memcpy(outbuf + 69, num, 10);
-	strcat((char*) outbuf, (char*) inbuf);
-	/* EndFragment */
-	snprintf(num, sizeof(num), "%010lu", (unsigned long) strlen((char*) outbuf));
-	memcpy(outbuf + 93, num, 10);
-	strcat((char*) outbuf, "<!--EndFragment-->");
-	if (in == NULL)
+	/* the offsets are zero padded, the header length does not depend on them */
+	start_html = snprintf(NULL, 0, CLIPRDR_HTML_HEADER, 0UL, 0UL, 0UL, 0UL);
+	start_fragment = start_html + strlen(prefix);
+	end_fragment = start_fragment + strlen(inbuf);
+	end_html = end_fragment + strlen(suffix);
+
+	outbuf = (BYTE*) malloc(end_html + 1);
+
+	if (outbuf != NULL)
 	{
-		strcat((char*) outbuf, "</BODY></HTML>");
+		snprintf((char*) outbuf, start_html + 1, CLIPRDR_HTML_HEADER,
+			start_html, end_html, start_fragment, end_fragment);
+		CopyMemory(outbuf + start_html, prefix, start_fragment - start_html);
+		CopyMemory(outbuf + start_fragment, inbuf, end_fragment - start_fragment);
+		CopyMemory(outbuf + end_fragment, suffix, end_html - end_fragment);
+		outbuf[end_html] = 0;
+
+		*size = end_html + 1;
 	}
-	/* EndHTML */
-	snprintf(num, sizeof(num), "%010lu", (unsigned long) strlen((char*) outbuf));
-	memcpy(outbuf + 43, num, 10);
 
-	*size = strlen((char*) outbuf) + 1;
-	free(inbuf);
+	if (inbuf != (char*) cb->incr_data)
+		free(inbuf);
 
 	return outbuf;
 }
 
-static void xf_cliprdr_process_requested_data(xfInfo* xfi, BOOL has_data, BYTE* data, int size)
+static BYTE* xf_cliprdr_finish_requested(clipboardContext* cb, int* size)
 {
 	BYTE* outbuf;
-	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
-
-	if (cb->incr_starts && has_data)
-		return;
-
-	if (!has_data || data == NULL)
-	{
-		xf_cliprdr_send_null_data_response(xfi);
-		return;
-	}
 
 	switch (cb->format_mappings[cb->request_index].format_id)
 	{
-		case CB_FORMAT_RAW:
-		case CB_FORMAT_PNG:
-		case CB_FORMAT_JPEG:
-		case CB_FORMAT_GIF:
-			outbuf = xf_cliprdr_process_requested_raw(data, &size);
+		case CB_FORMAT_TEXT:
+			if (!xf_cliprdr_reserve_requested(cb, 1))
+				return NULL;
+
+			cb->incr_data[cb->incr_data_length++] = 0;
 			break;
 
 		case CB_FORMAT_UNICODETEXT:
-			outbuf = xf_cliprdr_process_requested_unicodetext(data, &size);
-			break;
+			if (!xf_cliprdr_reserve_requested(cb, sizeof(WCHAR)))
+				return NULL;
 
-		case CB_FORMAT_TEXT:
-			outbuf = xf_cliprdr_process_requested_text(data, &size);
+			cb->incr_data[cb->incr_data_length++] = 0;
+			cb->incr_data[cb->incr_data_length++] = 0;
 			break;
 
 		case CB_FORMAT_DIB:
-			outbuf = xf_cliprdr_process_requested_dib(data, &size);
+			/* length should be at least sizeof(BITMAPINFOHEADER) once the BMP header is stripped */
+			if (cb->incr_skip > 0 || cb->incr_data_length < 40)
+			{
+				DEBUG_X11_CLIPRDR("bmp length %d too short", cb->incr_data_length);
+				return NULL;
+			}
 			break;
 
 		case CB_FORMAT_HTML:
-			outbuf = xf_cliprdr_process_requested_html(data, &size);
-			break;
+			return xf_cliprdr_wrap_html(cb, size);
+	}
 
-		default:
-			outbuf = NULL;
-			break;
+	xf_cliprdr_shrink_requested(cb);
+
+	outbuf = cb->incr_data;
+	*size = cb->incr_data_length;
+	cb->incr_data = NULL;
+
+	return outbuf;
+}
+
+static void xf_cliprdr_process_requested_data(xfInfo* xfi, BOOL has_data)
+{
+	int size = 0;
+	BYTE* outbuf = NULL;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (cb->incr_starts && has_data)
+		return;
+
+	cb->incr_starts = FALSE;
+
+	if (has_data)
+		outbuf = xf_cliprdr_finish_requested(cb, &size);
+
+	xf_cliprdr_reset_requested(cb);
+
+	if (!has_data)
+	{
+		xf_cliprdr_send_null_data_response(xfi);
+		return;
 	}
 
+	/* the converted buffer is handed over to the channel as is */
 	if (outbuf)
 		xf_cliprdr_send_data_response(xfi, outbuf, size);
 	else
@@ -708,6 +923,7 @@ static BOOL xf_cliprdr_get_requested_data(xfInfo* xfi, Atom target)
 {
 	Atom type;
 	int format;
+	int size = 0;
 	BYTE* data = NULL;
 	BOOL has_data = FALSE;
 	unsigned long length, bytes_left, dummy;
@@ -740,56 +956,54 @@ static BOOL xf_cliprdr_get_requested_data(xfInfo* xfi, Atom target)
 	else if (type == cb->incr_atom)
 	{
 		DEBUG_X11("INCR started");
-		cb->incr_starts = TRUE;
-		if (cb->incr_data)
+
+		/* the INCR property holds a lower bound of the selection length */
+		if ((XGetWindowProperty(xfi->display, xfi->drawable,
+			cb->property_atom, 0, 1, 0, cb->incr_atom,
+			&type, &format, &length, &dummy, &data) == Success) && (length > 0))
 		{
-			free(cb->incr_data);
-			cb->incr_data = NULL;
+			size = (int) *((long*) data);
 		}
-		cb->incr_data_length = 0;
+
+		if (data)
+		{
+			XFree(data);
+			data = NULL;
+		}
+
+		xf_cliprdr_begin_requested(cb, size);
+		cb->incr_starts = TRUE;
 		/* Data will be followed in PropertyNotify event */
 		has_data = TRUE;
 	}
-	else
+	else if (bytes_left <= 0)
 	{
-		if (bytes_left <= 0)
-		{
-			/* INCR finish */
-			data = cb->incr_data;
-			cb->incr_data = NULL;
-			bytes_left = cb->incr_data_length;
-			cb->incr_data_length = 0;
-			cb->incr_starts = 0;
-			DEBUG_X11("INCR finished");
-			has_data = TRUE;
-		}
-		else if (XGetWindowProperty(xfi->display, xfi->drawable,
-			cb->property_atom, 0, bytes_left, 0, target,
-			&type, &format, &length, &dummy, &data) == Success)
-		{
-			if (cb->incr_starts)
-			{
-				bytes_left = length * format / 8;
-				DEBUG_X11("%d bytes", (int)bytes_left);
-				cb->incr_data = (BYTE*) realloc(cb->incr_data, cb->incr_data_length + bytes_left);
-				memcpy(cb->incr_data + cb->incr_data_length, data, bytes_left);
-				cb->incr_data_length += bytes_left;
-				XFree(data);
-				data = NULL;
-			}
-			has_data = TRUE;
-		}
-		else
-		{
-			DEBUG_X11_CLIPRDR("XGetWindowProperty failed");
-		}
+		/* INCR finish */
+		cb->incr_starts = FALSE;
+		DEBUG_X11("INCR finished");
+		has_data = TRUE;
 	}
-	XDeleteProperty(xfi->display, xfi->drawable, cb->property_atom);
+	else if (XGetWindowProperty(xfi->display, xfi->drawable,
+		cb->property_atom, 0, bytes_left, 0, target,
+		&type, &format, &length, &dummy, &data) == Success)
+	{
+		size = length * format / 8;
+		DEBUG_X11("%d bytes", size);
 
-	xf_cliprdr_process_requested_data(xfi, has_data, data, (int) bytes_left);
+		if (!cb->incr_starts)
+			xf_cliprdr_begin_requested(cb, size);
 
-	if (data)
+		has_data = xf_cliprdr_append_requested(cb, data, size);
 		XFree(data);
+		data = NULL;
+	}
+	else
+	{
+		DEBUG_X11_CLIPRDR("XGetWindowProperty failed");
+	}
+	XDeleteProperty(xfi->display, xfi->drawable, cb->property_atom);
+
+	xf_cliprdr_process_requested_data(xfi, has_data);
 
 	return TRUE;
 }
@@ -824,17 +1038,159 @@ static void xf_cliprdr_provide_targets(xfInfo* xfi, XEvent* respond)
 	}
 }
 
+/**
+ * The requestor of an outgoing INCR transfer is a foreign window that can be
+ * destroyed at any time: errors on it are trapped instead of being fatal.
+ */
+
+static BOOL xf_cliprdr_requestor_error;
+
+static int xf_cliprdr_requestor_error_handler(Display* display, XErrorEvent* event)
+{
+	xf_cliprdr_requestor_error = TRUE;
+	return 0;
+}
+
+static XErrorHandler xf_cliprdr_trap_errors(xfInfo* xfi)
+{
+	/* earlier errors still go to the previous handler */
+	XSync(xfi->display, FALSE);
+	xf_cliprdr_requestor_error = FALSE;
+
+	return XSetErrorHandler(xf_cliprdr_requestor_error_handler);
+}
+
+static BOOL xf_cliprdr_untrap_errors(xfInfo* xfi, XErrorHandler handler)
+{
+	XSync(xfi->display, FALSE);
+	XSetErrorHandler(handler);
+
+	return !xf_cliprdr_requestor_error;
+}
+
+static void xf_cliprdr_end_incr(xfInfo* xfi, BOOL destroyed)
+{
+	XErrorHandler handler;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if (cb->incr_requestor == None)
+		return;
+
+	if (!destroyed)
+	{
+		handler = xf_cliprdr_trap_errors(xfi);
+		XSelectInput(xfi->display, cb->incr_requestor, NoEventMask);
+		xf_cliprdr_untrap_errors(xfi, handler);
+	}
+
+	cb->incr_requestor = None;
+}
+
+static void xf_cliprdr_free_data(xfInfo* xfi)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	/* a transfer still reading from the data cannot be completed */
+	xf_cliprdr_end_incr(xfi, FALSE);
+
+	if (cb->data)
+	{
+		free(cb->data);
+		cb->data = NULL;
+	}
+
+	cb->data_length = 0;
+}
+
+/* the requestor deletes the property every time it has read a chunk, a zero-length chunk ends the transfer */
+
+static void xf_cliprdr_send_incr_chunk(xfInfo* xfi)
+{
+	int length;
+	XErrorHandler handler;
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	length = MIN(cb->incr_chunk_size, cb->data_length - cb->incr_offset);
+
+	handler = xf_cliprdr_trap_errors(xfi);
+
+	XChangeProperty(xfi->display, cb->incr_requestor, cb->incr_property,
+		cb->incr_target, 8, PropModeReplace,
+		&cb->data[cb->incr_offset], length);
+
+	if (!xf_cliprdr_untrap_errors(xfi, handler))
+	{
+		DEBUG_X11_CLIPRDR("INCR requestor gone");
+		xf_cliprdr_end_incr(xfi, TRUE);
+		return;
+	}
+
+	cb->incr_offset += length;
+	cb->incr_time = time(NULL);
+
+	if (length == 0)
+	{
+		DEBUG_X11_CLIPRDR("INCR finished");
+		xf_cliprdr_end_incr(xfi, FALSE);
+	}
+}
+
 static void xf_cliprdr_provide_data(xfInfo* xfi, XEvent* respond)
 {
+	long length;
+	XErrorHandler handler;
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
-	if (respond->xselection.property != None)
+	if (respond->xselection.property == None)
+		return;
+
+	if (cb->data_length <= cb->incr_chunk_size)
 	{
 		XChangeProperty(xfi->display,
 			respond->xselection.requestor,
 			respond->xselection.property,
 			respond->xselection.target, 8, PropModeReplace,
 			(BYTE*) cb->data, cb->data_length);
+		return;
+	}
+
+	if (cb->incr_requestor != None)
+	{
+		/* a requestor that stopped reading does not hold the clipboard forever */
+		if (time(NULL) - cb->incr_time < CLIPRDR_INCR_TIMEOUT)
+		{
+			DEBUG_X11_CLIPRDR("INCR transfer already in progress");
+			respond->xselection.property = None;
+			return;
+		}
+
+		DEBUG_X11_CLIPRDR("INCR transfer timed out");
+		xf_cliprdr_end_incr(xfi, FALSE);
+	}
+
+	/* larger than a single request, the data follows in chunks once the requestor deletes the INCR property */
+	DEBUG_X11_CLIPRDR("INCR started, %d bytes", cb->data_length);
+
+	cb->incr_requestor = respond->xselection.requestor;
+	cb->incr_property = respond->xselection.property;
+	cb->incr_target = respond->xselection.target;
+	cb->incr_offset = 0;
+	cb->incr_time = time(NULL);
+
+	/* StructureNotify reports the requestor being destroyed in the middle of the transfer */
+	handler = xf_cliprdr_trap_errors(xfi);
+
+	XSelectInput(xfi->display, cb->incr_requestor, PropertyChangeMask | StructureNotifyMask);
+
+	length = cb->data_length;
+	XChangeProperty(xfi->display, cb->incr_requestor, cb->incr_property,
+		cb->incr_atom, 32, PropModeReplace, (BYTE*) &length, 1);
+
+	if (!xf_cliprdr_untrap_errors(xfi, handler))
+	{
+		DEBUG_X11_CLIPRDR("INCR requestor gone");
+		cb->incr_requestor = None;
+		respond->xselection.property = None;
 	}
 }
 
@@ -843,11 +1199,7 @@ static void xf_cliprdr_process_cb_format_list_event(xfInfo* xfi, RDP_CB_FORMAT_L
 	int i, j;
 	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
 
-	if (cb->data)
-	{
-		free(cb->data);
-		cb->data = NULL;
-	}
+	xf_cliprdr_free_data(xfi);
 
 	if (cb->formats)
 		free(cb->formats);
@@ -881,11 +1233,14 @@ static void xf_cliprdr_process_cb_format_list_event(xfInfo* xfi, RDP_CB_FORMAT_L
 	XFlush(xfi->display);
 }
 
-static void xf_cliprdr_process_text(clipboardContext* cb, BYTE* data, int size)
+/* the conversions below work in place on the buffer taken over from the event */
+
+static void xf_cliprdr_process_text(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
-	cb->data = (BYTE*) malloc(size);
-	memcpy(cb->data, data, size);
-	cb->data_length = size;
+	cb->data = event->data;
+	cb->data_length = event->size;
+	event->data = NULL;
+	event->size = 0;
 	crlf2lf(cb->data, &cb->data_length);
 }
 
@@ -895,12 +1250,14 @@ static void xf_cliprdr_process_unicodetext(clipboardContext* cb, BYTE* data, int
 	crlf2lf(cb->data, &cb->data_length);
 }
 
-static void xf_cliprdr_process_dib(clipboardContext* cb, BYTE* data, int size)
+static void xf_cliprdr_process_dib(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
 	STREAM* s;
 	UINT16 bpp;
+	BYTE* data;
 	UINT32 offset;
 	UINT32 ncolors;
+	int size = event->size;
 
 	/* size should be at least sizeof(BITMAPINFOHEADER) */
 	if (size < 40)
@@ -910,7 +1267,7 @@ static void xf_cliprdr_process_dib(clipboardContext* cb, BYTE* data, int size)
 	}
 
 	s = stream_new(0);
-	stream_attach(s, data, size);
+	stream_attach(s, event->data, size);
 	stream_seek(s, 14);
 	stream_read_UINT16(s, bpp);
 	stream_read_UINT32(s, ncolors);
@@ -920,26 +1277,38 @@ static void xf_cliprdr_process_dib(clipboardContext* cb, BYTE* data, int size)
 
 	DEBUG_X11_CLIPRDR("offset=%d bpp=%d ncolors=%d", offset, bpp, ncolors);
 
-	s = stream_new(14 + size);
+	/* make room for the BMP file header in front of the DIB */
+	data = (BYTE*) realloc(event->data, 14 + size);
+
+	if (data == NULL)
+		return;
+
+	event->data = NULL;
+	event->size = 0;
+	MoveMemory(data + 14, data, size);
+
+	s = stream_new(0);
+	stream_attach(s, data, 14 + size);
 	stream_write_BYTE(s, 'B');
 	stream_write_BYTE(s, 'M');
 	stream_write_UINT32(s, 14 + size);
 	stream_write_UINT32(s, 0);
 	stream_write_UINT32(s, offset);
-	stream_write(s, data, size);
-
-	cb->data = stream_get_head(s);
-	cb->data_length = stream_get_length(s);
 	stream_detach(s);
 	stream_free(s);
+
+	cb->data = data;
+	cb->data_length = 14 + size;
 }
 
-static void xf_cliprdr_process_html(clipboardContext* cb, BYTE* data, int size)
+static void xf_cliprdr_process_html(clipboardContext* cb, RDP_CB_DATA_RESPONSE_EVENT* event)
 {
 	char* start_str;
 	char* end_str;
 	int start;
 	int end;
+	BYTE* data = event->data;
+	int size = event->size;
 
 	start_str = strstr((char*) data, "StartHTML:");
 	end_str = strstr((char*) data, "EndHTML:");
@@ -956,8 +1325,11 @@ static void xf_cliprdr_process_html(clipboardContext* cb, BYTE* data, int size)
 		return;
 	}
 
-	cb->data = (BYTE*) malloc(size - start + 1);
-	memcpy(cb->data, data + start, end - start);
+	cb->data = data;
+	event->data = NULL;
+	event->size = 0;
+
+	MoveMemory(cb->data, data + start, end - start);
 	cb->data_length = end - start;
 	crlf2lf(cb->data, &cb->data_length);
 }
@@ -980,11 +1352,8 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 	}
 	else
 	{
-		if (cb->data)
-		{
-			free(cb->data);
-			cb->data = NULL;
-		}
+		xf_cliprdr_free_data(xfi);
+
 		switch (cb->data_format)
 		{
 			case CB_FORMAT_RAW:
@@ -998,7 +1367,7 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 				break;
 
 			case CB_FORMAT_TEXT:
-				xf_cliprdr_process_text(cb, event->data, event->size);
+				xf_cliprdr_process_text(cb, event);
 				break;
 
 			case CB_FORMAT_UNICODETEXT:
@@ -1006,11 +1375,11 @@ static void xf_cliprdr_process_cb_data_response_event(xfInfo* xfi, RDP_CB_DATA_R
 				break;
 
 			case CB_FORMAT_DIB:
-				xf_cliprdr_process_dib(cb, event->data, event->size);
+				xf_cliprdr_process_dib(cb, event);
 				break;
 
 			case CB_FORMAT_HTML:
-				xf_cliprdr_process_html(cb, event->data, event->size);
+				xf_cliprdr_process_html(cb, event);
 				break;
 
 			default:
@@ -1163,11 +1532,7 @@ BOOL xf_cliprdr_process_selection_request(xfInfo* xfi, XEvent* xevent)
 				 * Send clipboard data request to the server.
 				 * Response will be postponed after receiving the data
 				 */
-				if (cb->data)
-				{
-					free(cb->data);
-					cb->data = NULL;
-				}
+				xf_cliprdr_free_data(xfi);
 
 				respond->xselection.property = xevent->xselectionrequest.property;
 				cb->respond = respond;
@@ -1226,6 +1591,31 @@ BOOL xf_cliprdr_process_property_notify(xfInfo* xfi, XEvent* xevent)
 	return TRUE;
 }
 
+/* events on the window of an outgoing INCR transfer are not meant for the rest of the client */
+
+BOOL xf_cliprdr_process_requestor_event(xfInfo* xfi, XEvent* xevent)
+{
+	clipboardContext* cb = (clipboardContext*) xfi->clipboard_context;
+
+	if ((cb == NULL) || (cb->incr_requestor == None) || (xevent->xany.window != cb->incr_requestor))
+		return FALSE;
+
+	if (xevent->type == DestroyNotify)
+	{
+		DEBUG_X11_CLIPRDR("INCR requestor destroyed");
+		xf_cliprdr_end_incr(xfi, TRUE);
+	}
+	else if ((xevent->type == PropertyNotify) &&
+		(xevent->xproperty.atom == cb->incr_property) &&
+		(xevent->xproperty.state == PropertyDelete))
+	{
+		DEBUG_X11_CLIPRDR("requestor PropertyNotify");
+		xf_cliprdr_send_incr_chunk(xfi);
+	}
+
+	return TRUE;
+}
+
 void xf_cliprdr_check_owner(xfInfo* xfi)
 {
 	Window owner;
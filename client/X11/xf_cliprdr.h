@@ -29,6 +29,7 @@ BOOL xf_cliprdr_process_selection_notify(xfInfo* xfi, XEvent* xevent);
 BOOL xf_cliprdr_process_selection_request(xfInfo* xfi, XEvent* xevent);
 BOOL xf_cliprdr_process_selection_clear(xfInfo* xfi, XEvent* xevent);
 BOOL xf_cliprdr_process_property_notify(xfInfo* xfi, XEvent* xevent);
+BOOL xf_cliprdr_process_requestor_event(xfInfo* xfi, XEvent* xevent);
 void xf_cliprdr_check_owner(xfInfo* xfi);
 
 #ifdef WITH_DEBUG_X11_CLIPRDR
@@ -873,6 +873,9 @@ BOOL xf_event_process(freerdp* instance, XEvent* event)
 		}
 	}
 
+	if (xf_cliprdr_process_requestor_event(xfi, event))
+		return TRUE;
+
 	if (event->type != MotionNotify)
 		DEBUG_X11("%s Event(%d): wnd=0x%04X", X11_EVENT_STRINGS[event->type], event->type, (UINT32) event->xany.window);
 
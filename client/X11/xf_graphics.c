@@ -217,6 +217,14 @@ void xf_Pointer_New(rdpContext* context, rdpPointer* pointer)
 	ci.xhot = pointer->xPos;
 	ci.yhot = pointer->yPos;
 
+	if (pointer->argbData != NULL)
+	{
+		/* already converted by the pointer cache */
+		ci.pixels = (XcursorPixel*) pointer->argbData;
+		((xfPointer*) pointer)->cursor = XcursorImageLoadCursor(xfi->display, &ci);
+		return;
+	}
+
 	ci.pixels = (XcursorPixel*) malloc(ci.width * ci.height * 4);
 	ZeroMemory(ci.pixels, ci.width * ci.height * 4);
 
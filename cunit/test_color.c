@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/codec/color.h>
@@ -44,6 +45,7 @@ int add_color_suite(void)
 	add_test_function(color_GetRGB16);
 	add_test_function(color_GetBGR_565);
 	add_test_function(color_GetBGR16);
+	add_test_function(color_AlphaCursorConvert);
 
 	return 0;
 }
@@ -150,3 +152,36 @@ void test_color_GetBGR16(void)
 	CU_ASSERT(b == 0xEF);
 }
 
+
+void test_color_AlphaCursorConvert(void)
+{
+	HCLRCONV clrconv;
+	UINT32 argb[6];
+	BYTE andMask[2] = { 0x60, 0x20 };
+	BYTE xorMask24[18] =
+	{
+		0x11, 0x22, 0x33, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+		0x44, 0x55, 0x66, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF
+	};
+	UINT32 xorMask32[6] =
+	{
+		0xFF112233, 0xFFFFFFFF, 0xFF000000,
+		0xFF445566, 0xFF000000, 0xFFFFFFFF
+	};
+	UINT32 expected[6] =
+	{
+		0xFF445566, 0xFF000000, 0xFFFFFFFF,
+		0xFF112233, 0xFFFFFFFF, 0x00000000
+	};
+
+	clrconv = freerdp_clrconv_new(CLRCONV_ALPHA);
+
+	/* masks are bottom-up, white pixels under the AND mask become a pattern */
+	freerdp_alpha_cursor_convert((BYTE*) argb, xorMask24, andMask, 3, 2, 24, clrconv);
+	CU_ASSERT(memcmp(argb, expected, sizeof(expected)) == 0);
+
+	freerdp_alpha_cursor_convert((BYTE*) argb, (BYTE*) xorMask32, andMask, 3, 2, 32, clrconv);
+	CU_ASSERT(memcmp(argb, expected, sizeof(expected)) == 0);
+
+	freerdp_clrconv_free(clrconv);
+}
@@ -29,3 +29,4 @@ void test_color_GetRGB_565(void);
 void test_color_GetRGB16(void);
 void test_color_GetBGR_565(void);
 void test_color_GetBGR16(void);
+void test_color_AlphaCursorConvert(void);
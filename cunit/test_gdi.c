@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
 
 #include <freerdp/gdi/gdi.h>
@@ -34,6 +35,8 @@
 #include <freerdp/gdi/palette.h>
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
+#include <freerdp/gdi/tiled.h>
+#include <freerdp/gdi/band.h>
 #include <freerdp/gdi/32bpp.h>
 
 #include "test_gdi.h"
@@ -74,6 +77,9 @@ int add_gdi_suite(void)
 	add_test_function(gdi_BitBlt_8bpp);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_TiledSurface);
+	add_test_function(gdi_TiledScroll);
+	add_test_function(gdi_BandParallel);
 
 	return 0;
 }
@@ -2989,3 +2995,233 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+static void fill_test_pattern(BYTE* data, int width, int height)
+{
+	int x, y;
+	UINT32* p = (UINT32*) data;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			*p++ = (UINT32) ((y << 16) | x);
+	}
+}
+
+void test_gdi_TiledSurface(void)
+{
+	int y;
+	HGDI_DC hdc;
+	GDI_RECT rect;
+	HGDI_BRUSH hBrush;
+	HGDI_TILED hTiled;
+	HGDI_BITMAP hBitmap;
+	HGDI_BITMAP hImage;
+	BYTE* linear;
+	int width = 300;
+	int height = 200;
+	GDI_COLOR color = 0xFF112233;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+
+	hBitmap = gdi_CreateCompatibleBitmap(hdc, width, height);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBitmap);
+	fill_test_pattern(hBitmap->data, width, height);
+
+	/* the tiled surface mirrors its own copy of the same contents */
+	linear = (BYTE*) malloc(width * height * 4);
+	fill_test_pattern(linear, width, height);
+	hTiled = gdi_CreateTiledSurface(width, height, 4, linear);
+
+	/* solid fill straddling several tiles */
+	gdi_CRgnToRect(50, 30, 100, 70, &rect);
+	hBrush = gdi_CreateSolidBrush(color);
+	gdi_FillRect(hdc, &rect, hBrush);
+	gdi_TiledFillRect(hTiled, 50, 30, 100, 70, gdi_get_color_32bpp(hdc, color));
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+
+	/* vertical scrolls in both directions */
+	gdi_BitBlt(hdc, 0, 0, width, height - 10, hdc, 0, 10, GDI_SRCCOPY);
+	gdi_TiledBitBlt(hTiled, 0, 0, width, height - 10, 0, 10);
+
+	gdi_BitBlt(hdc, 0, 70, width, 100, hdc, 0, 3, GDI_SRCCOPY);
+	gdi_TiledBitBlt(hTiled, 0, 70, width, 100, 0, 3);
+
+	/* horizontal scroll, overlapping within tiles */
+	gdi_BitBlt(hdc, 5, 0, width - 5, height, hdc, 0, 0, GDI_SRCCOPY);
+	gdi_TiledBitBlt(hTiled, 5, 0, width - 5, height, 0, 0);
+
+	/* diagonal overlapping copy */
+	gdi_BitBlt(hdc, 20, 25, 150, 120, hdc, 40, 10, GDI_SRCCOPY);
+	gdi_TiledBitBlt(hTiled, 20, 25, 150, 120, 40, 10);
+
+	/* image upload */
+	hImage = gdi_CreateBitmap(80, 80, 32, (BYTE*) malloc(80 * 80 * 4));
+	fill_test_pattern(hImage->data, 80, 80);
+	gdi_TiledPutImage(hTiled, 200, 100, 80, 80, hImage, 0, 0);
+
+	for (y = 0; y < 80; y++)
+		memcpy(&hBitmap->data[((100 + y) * width + 200) * 4], &hImage->data[y * 80 * 4], 80 * 4);
+
+	gdi_TiledLinearize(hTiled, 0, 0, width, height);
+	CU_ASSERT(memcmp(linear, hBitmap->data, width * height * 4) == 0);
+
+	/* writes through the linear buffer are picked up by later tile operations */
+	gdi_TiledLockLinear(hTiled, 0, 0, 10, 10);
+	memset(linear, 0xAB, 10 * 4);
+	memset(hBitmap->data, 0xAB, 10 * 4);
+
+	gdi_BitBlt(hdc, 100, 150, 20, 20, hdc, 0, 0, GDI_SRCCOPY);
+	gdi_TiledBitBlt(hTiled, 100, 150, 20, 20, 0, 0);
+
+	gdi_TiledLinearize(hTiled, 0, 0, width, height);
+	CU_ASSERT(memcmp(linear, hBitmap->data, width * height * 4) == 0);
+
+	gdi_DeleteTiledSurface(hTiled);
+	gdi_DeleteObject((HGDIOBJECT) hImage);
+	free(linear);
+}
+
+static long int elapsed_usec(struct timeval* start_time, struct timeval* end_time)
+{
+	return ((end_time->tv_sec - start_time->tv_sec) * 1000000) + (end_time->tv_usec - start_time->tv_usec);
+}
+
+void test_gdi_TiledScroll(void)
+{
+	int i, y;
+	int badRows;
+	HGDI_DC hdc;
+	HGDI_TILED hTiled;
+	HGDI_BITMAP hBitmap;
+	struct timeval start_time;
+	struct timeval end_time;
+	long int linear_usec;
+	long int tiled_usec;
+	int width = 7680;
+	int height = 2160;
+	int band = 256;
+	int iterations = 20;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+
+	hBitmap = gdi_CreateCompatibleBitmap(hdc, width, height);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBitmap);
+	fill_test_pattern(hBitmap->data, width, height);
+
+	hTiled = gdi_CreateTiledSurface(width, height, 4, NULL);
+	gdi_TiledPutImage(hTiled, 0, 0, width, height, hBitmap, 0, 0);
+
+	/* scroll a narrow window on a multi-monitor desktop, one line at a time */
+
+	gettimeofday(&start_time, NULL);
+
+	for (i = 0; i < iterations; i++)
+		gdi_BitBlt(hdc, 1024, 0, band, height - 1, hdc, 1024, 1, GDI_SRCCOPY);
+
+	gettimeofday(&end_time, NULL);
+	linear_usec = elapsed_usec(&start_time, &end_time);
+
+	gettimeofday(&start_time, NULL);
+
+	for (i = 0; i < iterations; i++)
+		gdi_TiledBitBlt(hTiled, 1024, 0, band, height - 1, 1024, 1);
+
+	gettimeofday(&end_time, NULL);
+	tiled_usec = elapsed_usec(&start_time, &end_time);
+
+	printf("\ntest_gdi_TiledScroll: %dx%d scroll of %dx%d: linear %ld us, tiled %ld us\n",
+			width, height, band, height - 1, linear_usec / iterations, tiled_usec / iterations);
+
+	/* both layouts must agree afterwards */
+	badRows = 0;
+
+	for (y = 0; y < height; y++)
+	{
+		if (memcmp(gdi_get_tile_pointer(hTiled, 1024, y),
+				&hBitmap->data[(y * width + 1024) * 4], GDI_TILE_SIZE * 4) != 0)
+			badRows++;
+	}
+
+	CU_ASSERT(badRows == 0);
+
+	gdi_DeleteTiledSurface(hTiled);
+	gdi_DeleteObject((HGDIOBJECT) hBitmap);
+	gdi_DeleteDC(hdc);
+}
+
+void test_gdi_BandParallel(void)
+{
+	HGDI_DC hdc[2];
+	HGDI_DC hdcSrc;
+	HGDI_BANDS hBands;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBitmap[2];
+	HGDI_BITMAP hSource;
+	HGDI_BITMAP hPattern;
+	GDI_RECT rects[3];
+	BYTE pattern[8 * 8 * 4];
+	int width = 640;
+	int height = 480;
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		hdc[i] = gdi_GetDC();
+		hdc[i]->bytesPerPixel = 4;
+		hdc[i]->bitsPerPixel = 32;
+		hBitmap[i] = gdi_CreateCompatibleBitmap(hdc[i], width, height);
+		gdi_SelectObject(hdc[i], (HGDIOBJECT) hBitmap[i]);
+		fill_test_pattern(hBitmap[i]->data, width, height);
+		gdi_SetClipRgn(hdc[i], 3, 5, width - 20, height - 30);
+	}
+
+	hdcSrc = gdi_GetDC();
+	hdcSrc->bytesPerPixel = 4;
+	hdcSrc->bitsPerPixel = 32;
+	hSource = gdi_CreateCompatibleBitmap(hdcSrc, width, height);
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT) hSource);
+	fill_test_pattern(hSource->data, width, height);
+
+	for (i = 0; i < (int) sizeof(pattern); i++)
+		pattern[i] = (BYTE) (i * 37);
+
+	hPattern = gdi_CreateBitmap(8, 8, 32, pattern);
+
+	/* an explicit worker count exercises the pool even on a single processor */
+	hBands = gdi_CreateBands(3);
+	CU_ASSERT(hBands != NULL);
+
+	gdi_CRgnToRect(-10, 7, 300, 400, &rects[0]);
+	gdi_CRgnToRect(250, 100, 390, 380, &rects[1]);
+	gdi_CRgnToRect(10, 10, 20, 20, &rects[2]);
+
+	hBrush = gdi_CreateSolidBrush(0xFF445566);
+
+	for (i = 0; i < 3; i++)
+		gdi_FillRect(hdc[0], &rects[i], hBrush);
+
+	CU_ASSERT(gdi_BandFillRects(hBands, hdc[1], rects, 3, hBrush) == 0);
+	gdi_DeleteObject((HGDIOBJECT) hBrush);
+
+	/* pattern brushes must stay in phase across band boundaries */
+	hBrush = gdi_CreatePatternBrush(hPattern);
+	hdc[0]->brush = hdc[1]->brush = hBrush;
+
+	gdi_PatBlt(hdc[0], 1, 2, 600, 451, GDI_PATINVERT);
+	CU_ASSERT(gdi_BandPatBlt(hBands, hdc[1], 1, 2, 600, 451, GDI_PATINVERT) == 0);
+
+	gdi_BitBlt(hdc[0], 7, 1, 500, 470, hdcSrc, 20, 3, GDI_MERGECOPY);
+	CU_ASSERT(gdi_BandBitBlt(hBands, hdc[1], 7, 1, 500, 470, hdcSrc, 20, 3, GDI_MERGECOPY) == 0);
+
+	/* small orders are left to the caller */
+	CU_ASSERT(gdi_BandPatBlt(hBands, hdc[1], 0, 0, 16, 16, GDI_PATINVERT) != 0);
+
+	CU_ASSERT(memcmp(hBitmap[0]->data, hBitmap[1]->data, width * height * 4) == 0);
+
+	gdi_DeleteBands(hBands);
+}
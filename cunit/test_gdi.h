@@ -45,3 +45,6 @@ void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_TiledSurface(void);
+void test_gdi_TiledScroll(void);
+void test_gdi_BandParallel(void);
@@ -55,6 +55,8 @@ struct rdp_bitmap_cache
 
 	rdpBitmap* bitmap;
 	rdpUpdate* update;
+	UINT32 decompressions;
+	UINT32 avoidedDecompressions;
 	rdpContext* context;
 	rdpSettings* settings;
 };
@@ -25,6 +25,7 @@
 #include <freerdp/update.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/graphics.h>
+#include <freerdp/codec/color.h>
 #include <freerdp/utils/stream.h>
 
 typedef struct rdp_pointer_cache rdpPointerCache;
@@ -40,6 +41,7 @@ struct rdp_pointer_cache
 
 	rdpUpdate* update;
 	rdpSettings* settings;
+	HCLRCONV clrconv;
 };
 
 FREERDP_API rdpPointer* pointer_cache_get(rdpPointerCache* pointer_cache, UINT32 index);
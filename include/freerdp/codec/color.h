@@ -223,6 +223,12 @@ extern "C" {
 #define	CLRBUF_24BPP		16
 #define	CLRBUF_32BPP		32
 
+/* Keep the software GDI primary surface in 64x64 tiles */
+#define CLRBUF_TILED		64
+
+/* Render large orders in horizontal bands on worker threads */
+#define CLRBUF_PARALLEL		128
+
 struct _CLRCONV
 {
 	int alpha;
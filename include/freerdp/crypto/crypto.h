@@ -81,6 +81,8 @@ typedef struct crypto_sha1_struct* CryptoSha1;
 FREERDP_API CryptoSha1 crypto_sha1_init(void);
 FREERDP_API void crypto_sha1_update(CryptoSha1 sha1, const BYTE* data, UINT32 length);
 FREERDP_API void crypto_sha1_final(CryptoSha1 sha1, BYTE* out_data);
+FREERDP_API void crypto_sha1_reset(CryptoSha1 sha1);
+FREERDP_API void crypto_sha1_digest(CryptoSha1 sha1, BYTE* out_data);
 
 #define	CRYPTO_MD5_DIGEST_LENGTH	MD5_DIGEST_LENGTH
 typedef struct crypto_md5_struct* CryptoMd5;
@@ -88,12 +90,15 @@ typedef struct crypto_md5_struct* CryptoMd5;
 FREERDP_API CryptoMd5 crypto_md5_init(void);
 FREERDP_API void crypto_md5_update(CryptoMd5 md5, const BYTE* data, UINT32 length);
 FREERDP_API void crypto_md5_final(CryptoMd5 md5, BYTE* out_data);
+FREERDP_API void crypto_md5_reset(CryptoMd5 md5);
+FREERDP_API void crypto_md5_digest(CryptoMd5 md5, BYTE* out_data);
 
 typedef struct crypto_rc4_struct* CryptoRc4;
 
 FREERDP_API CryptoRc4 crypto_rc4_init(const BYTE* key, UINT32 length);
 FREERDP_API void crypto_rc4(CryptoRc4 rc4, UINT32 length, const BYTE* in_data, BYTE* out_data);
 FREERDP_API void crypto_rc4_free(CryptoRc4 rc4);
+FREERDP_API void crypto_rc4_set_key(CryptoRc4 rc4, const BYTE* key, UINT32 length);
 
 typedef struct crypto_des3_struct* CryptoDes3;
 
@@ -107,8 +112,10 @@ typedef struct crypto_hmac_struct* CryptoHmac;
 
 FREERDP_API CryptoHmac crypto_hmac_new(void);
 FREERDP_API void crypto_hmac_sha1_init(CryptoHmac hmac, const BYTE *data, UINT32 length);
+FREERDP_API void crypto_hmac_md5_init(CryptoHmac hmac, const BYTE *data, UINT32 length);
 FREERDP_API void crypto_hmac_update(CryptoHmac hmac, const BYTE *data, UINT32 length);
 FREERDP_API void crypto_hmac_final(CryptoHmac hmac, BYTE *out_data, UINT32 length);
+FREERDP_API void crypto_hmac_reset(CryptoHmac hmac);
 FREERDP_API void crypto_hmac_free(CryptoHmac hmac);
 
 typedef struct crypto_cert_struct* CryptoCert;
@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Band-Parallel Rendering
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GDI_BAND_H
+#define __GDI_BAND_H
+
+#include <freerdp/api.h>
+#include <freerdp/gdi/gdi.h>
+
+/* orders smaller than this are cheaper to draw on the calling thread */
+#define GDI_BAND_MIN_PIXELS		(256 * 256)
+
+/* band heights are multiples of this to keep 8x8 brush patterns aligned */
+#define GDI_BAND_MIN_HEIGHT		32
+
+FREERDP_API HGDI_BANDS gdi_CreateBands(int nThreads);
+FREERDP_API void gdi_DeleteBands(HGDI_BANDS hBands);
+
+FREERDP_API int gdi_BandFillRects(HGDI_BANDS hBands, HGDI_DC hdc, GDI_RECT* rects, int count, HGDI_BRUSH hbr);
+FREERDP_API int gdi_BandPatBlt(HGDI_BANDS hBands, HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop);
+FREERDP_API int gdi_BandBitBlt(HGDI_BANDS hBands, HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
+
+#endif /* __GDI_BAND_H */
@@ -106,6 +106,13 @@
 #define GDI_OPAQUE			0x00000001
 #define GDI_TRANSPARENT			0x00000002
 
+/* Tiled Surfaces */
+#define GDI_TILE_SIZE			64
+
+#define GDI_TILE_SYNCED			0x00 /* tile and linear buffer match */
+#define GDI_TILE_LINEAR_STALE		0x01 /* tile is newer than linear buffer */
+#define GDI_TILE_TILED_STALE		0x02 /* linear buffer is newer than tile */
+
 /* GDI Object Types */
 #define GDIOBJECT_BITMAP		0x00
 #define GDIOBJECT_PEN			0x01
@@ -161,6 +168,26 @@ struct _GDI_BITMAP
 typedef struct _GDI_BITMAP GDI_BITMAP;
 typedef GDI_BITMAP* HGDI_BITMAP;
 
+struct _GDI_TILED
+{
+	int width;
+	int height;
+	int bytesPerPixel;
+	int tilesX;
+	int tilesY;
+	int tileScanline;
+	int tileLength;
+	BYTE* data;
+	BYTE* state;
+	BYTE* linear;
+	int scanline;
+};
+typedef struct _GDI_TILED GDI_TILED;
+typedef GDI_TILED* HGDI_TILED;
+
+typedef struct _GDI_BANDS GDI_BANDS;
+typedef GDI_BANDS* HGDI_BANDS;
+
 struct _GDI_PEN
 {
 	BYTE objectType;
@@ -279,6 +306,9 @@ struct rdp_gdi
 	void* nsc_context;
 	gdiBitmap* tile;
 	gdiBitmap* image;
+	BOOL tiling;
+	HGDI_TILED tiled;
+	HGDI_BANDS bands;
 };
 
 FREERDP_API UINT32 gdi_rop3_code(BYTE code);
@@ -286,6 +316,7 @@ FREERDP_API BYTE* gdi_get_bitmap_pointer(HGDI_DC hdcBmp, int x, int y);
 FREERDP_API BYTE* gdi_get_brush_pointer(HGDI_DC hdcBrush, int x, int y);
 FREERDP_API int gdi_is_mono_pixel_set(BYTE* data, int x, int y, int width);
 FREERDP_API void gdi_resize(rdpGdi* gdi, int width, int height);
+FREERDP_API void gdi_linearize(rdpGdi* gdi, int x, int y, int width, int height);
 
 FREERDP_API int gdi_init(freerdp* instance, UINT32 flags, BYTE* buffer);
 FREERDP_API void gdi_free(freerdp* instance);
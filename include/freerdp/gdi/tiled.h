@@ -0,0 +1,38 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Tiled Surfaces
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GDI_TILED_H
+#define __GDI_TILED_H
+
+#include <freerdp/api.h>
+#include <freerdp/gdi/gdi.h>
+
+FREERDP_API HGDI_TILED gdi_CreateTiledSurface(int nWidth, int nHeight, int bytesPerPixel, BYTE* linear);
+FREERDP_API void gdi_DeleteTiledSurface(HGDI_TILED hTiled);
+
+FREERDP_API BYTE* gdi_get_tile_pointer(HGDI_TILED hTiled, int x, int y);
+
+FREERDP_API void gdi_TiledAcquire(HGDI_TILED hTiled, int x, int y, int w, int h);
+FREERDP_API void gdi_TiledLinearize(HGDI_TILED hTiled, int x, int y, int w, int h);
+FREERDP_API void gdi_TiledLockLinear(HGDI_TILED hTiled, int x, int y, int w, int h);
+
+FREERDP_API int gdi_TiledFillRect(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight, UINT32 pixel);
+FREERDP_API int gdi_TiledBitBlt(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight, int nXSrc, int nYSrc);
+FREERDP_API int gdi_TiledPutImage(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_BITMAP hSrc, int nXSrc, int nYSrc);
+
+#endif /* __GDI_TILED_H */
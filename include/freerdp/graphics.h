@@ -63,7 +63,9 @@ struct rdp_bitmap
 
 	BOOL compressed; /* 32 */
 	BOOL ephemeral; /* 33 */
-	UINT32 paddingC[64 - 34]; /* 34 */
+	BYTE* deferredData; /* 34 */
+	UINT32 codecId; /* 36 */
+	UINT32 paddingC[64 - 37]; /* 37 */
 };
 
 FREERDP_API rdpBitmap* Bitmap_Alloc(rdpContext* context);
@@ -104,7 +106,8 @@ struct rdp_pointer
 	UINT32 lengthXorMask; /* 22 */
 	BYTE* xorMaskData; /* 23 */
 	BYTE* andMaskData; /* 24 */
-	UINT32 paddingB[32 - 25]; /* 25 */
+	BYTE* argbData; /* 25 */
+	UINT32 paddingB[32 - 26]; /* 26 */
 };
 
 FREERDP_API rdpPointer* Pointer_Alloc(rdpContext* context);
@@ -35,6 +35,8 @@ typedef BOOL (*psListenerOpen)(freerdp_listener* instance, const char* bind_addr
 typedef BOOL (*psListenerOpenLocal)(freerdp_listener* instance, const char* path);
 typedef BOOL (*psListenerGetFileDescriptor)(freerdp_listener* instance, void** rfds, int* rcount);
 typedef BOOL (*psListenerCheckFileDescriptor)(freerdp_listener* instance);
+typedef BOOL (*psListenerGetShardFileDescriptor)(freerdp_listener* instance, int shard, void** rfds, int* rcount);
+typedef BOOL (*psListenerCheckShardFileDescriptor)(freerdp_listener* instance, int shard);
 typedef void (*psListenerClose)(freerdp_listener* instance);
 typedef void (*psPeerAccepted)(freerdp_listener* instance, freerdp_peer* client);
 
@@ -51,9 +53,21 @@ struct rdp_freerdp_listener
 	psListenerOpenLocal OpenLocal;
 	psListenerGetFileDescriptor GetFileDescriptor;
 	psListenerCheckFileDescriptor CheckFileDescriptor;
+	psListenerGetShardFileDescriptor GetShardFileDescriptor;
+	psListenerCheckShardFileDescriptor CheckShardFileDescriptor;
 	psListenerClose Close;
 
 	psPeerAccepted PeerAccepted;
+
+	/**
+	 * Set before Open. With more than one shard, each address is bound by
+	 * that many SO_REUSEPORT sockets, and every shard can be polled by its
+	 * own thread: PeerAccepted is then called from all of these threads.
+	 * Buffer sizes of 0 keep the system defaults.
+	 */
+	int Shards;
+	UINT32 SendBufferSize;
+	UINT32 ReceiveBufferSize;
 };
 
 FREERDP_API freerdp_listener* freerdp_listener_new(void);
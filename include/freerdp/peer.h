@@ -34,6 +34,9 @@ typedef void (*psPeerContextFree)(freerdp_peer* client, rdpContext* context);
 typedef BOOL (*psPeerInitialize)(freerdp_peer* client);
 typedef BOOL (*psPeerGetFileDescriptor)(freerdp_peer* client, void** rfds, int* rcount);
 typedef BOOL (*psPeerCheckFileDescriptor)(freerdp_peer* client);
+typedef BOOL (*psPeerGetWriteFileDescriptor)(freerdp_peer* client, void** wfds, int* wcount);
+typedef BOOL (*psPeerCanSend)(freerdp_peer* client, UINT32 length);
+typedef BOOL (*psPeerWritable)(freerdp_peer* client);
 typedef BOOL (*psPeerClose)(freerdp_peer* client);
 typedef void (*psPeerDisconnect)(freerdp_peer* client);
 typedef BOOL (*psPeerCapabilities)(freerdp_peer* client);
@@ -79,6 +82,20 @@ struct rdp_freerdp_peer
 	BOOL activated;
 	BOOL authenticated;
 	SEC_WINNT_AUTH_IDENTITY identity;
+
+	/**
+	 * CanSend tells whether length bytes fit in the send queue. Once it has
+	 * said no, GetWriteFileDescriptor returns the socket to wait on, and
+	 * CheckFileDescriptor calls Writable when half of the queue has drained,
+	 * so that frames can be dropped or merged instead of queued.
+	 *
+	 * The queue is only tracked where TCP_INFO and one of SIOCOUTQNSD,
+	 * SIOCOUTQ or FIONWRITE are available: elsewhere, and on gateway
+	 * connections, CanSend always says yes and Writable is never called.
+	 */
+	psPeerGetWriteFileDescriptor GetWriteFileDescriptor;
+	psPeerCanSend CanSend;
+	psPeerWritable Writable;
 };
 
 FREERDP_API void freerdp_peer_context_new(freerdp_peer* client);
@@ -498,7 +498,9 @@ struct rdp_settings
 	ALIGN64 DWORD ServerRandomLength; /* 197 */
 	ALIGN64 BYTE* ServerCertificate; /* 198 */
 	ALIGN64 DWORD ServerCertificateLength; /* 199 */
-	UINT64 padding0256[256 - 200]; /* 200 */
+	ALIGN64 BYTE* ClientRandom; /* 200 */
+	ALIGN64 DWORD ClientRandomLength; /* 201 */
+	UINT64 padding0256[256 - 202]; /* 202 */
 
 	/* Client Network Data */
 	ALIGN64 UINT32 ChannelCount; /* 256 */
@@ -675,7 +677,8 @@ struct rdp_settings
 	ALIGN64 BOOL LocalConnection; /* 1602 */
 	ALIGN64 BOOL AuthenticationOnly; /* 1603 */
 	ALIGN64 BOOL CredentialsFromStdin; /* 1604 */
-	UINT64 padding1664[1664 - 1605]; /* 1605 */
+	ALIGN64 BOOL SoftwareGdiTiled; /* 1605 */
+	UINT64 padding1664[1664 - 1606]; /* 1606 */
 
 	/* Names */
 	ALIGN64 char* ComputerName; /* 1664 */
@@ -712,7 +715,8 @@ struct rdp_settings
 	ALIGN64 char* GatewayDomain; /* 1989 */
 	ALIGN64 UINT32 GatewayCredentialsSource; /* 1990 */
 	ALIGN64 BOOL GatewayUseSameCredentials; /* 1991 */
-	UINT64 padding2048[2048 - 1992]; /* 1992 */
+	ALIGN64 UINT32 GatewayReceiveWindow; /* 1992 */
+	UINT64 padding2048[2048 - 1993]; /* 1993 */
 	UINT64 padding2112[2112 - 2048]; /* 2048 */
 
 	/**
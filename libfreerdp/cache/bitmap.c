@@ -31,6 +31,94 @@
 
 #include <freerdp/cache/bitmap.h>
 
+/**
+ * Cache orders only keep a copy of the (possibly compressed) payload,
+ * the bitmap is decompressed the first time it is referenced. Many entries
+ * are evicted before they are ever used, especially at logon time.
+ */
+
+static BOOL bitmap_cache_defer(rdpBitmap* bitmap,
+		BYTE* data, int bpp, int length, BOOL compressed, int codec_id)
+{
+	bitmap->bpp = bpp;
+	bitmap->length = length;
+	bitmap->compressed = compressed;
+	bitmap->codecId = codec_id;
+
+	bitmap->deferredData = (BYTE*) malloc(length);
+
+	if (bitmap->deferredData == NULL)
+		return FALSE;
+
+	CopyMemory(bitmap->deferredData, data, length);
+
+	return TRUE;
+}
+
+static void bitmap_cache_load(rdpContext* context, rdpBitmap* bitmap,
+		BYTE* data, int bpp, int length, BOOL compressed, int codec_id)
+{
+	if (bitmap_cache_defer(bitmap, data, bpp, length, compressed, codec_id))
+		return;
+
+	/* without a copy to defer, the bitmap is decompressed right away */
+
+	bitmap->Decompress(context, bitmap, data, bitmap->width, bitmap->height,
+			bpp, length, compressed, codec_id);
+
+	bitmap->New(context, bitmap);
+}
+
+static void bitmap_cache_realize(rdpBitmapCache* bitmap_cache, rdpBitmap* bitmap)
+{
+	BYTE* data;
+	rdpContext* context = bitmap_cache->context;
+
+	if (bitmap->deferredData == NULL)
+		return;
+
+	data = bitmap->deferredData;
+	bitmap->deferredData = NULL;
+
+	bitmap->Decompress(context, bitmap, data, bitmap->width, bitmap->height,
+			bitmap->bpp, bitmap->length, bitmap->compressed, bitmap->codecId);
+
+	bitmap->New(context, bitmap);
+
+	free(data);
+
+	bitmap_cache->decompressions++;
+}
+
+static rdpBitmap* bitmap_cache_lookup(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 index)
+{
+	if (id > bitmap_cache->maxCells)
+	{
+		printf("get invalid bitmap cell id: %d\n", id);
+		return NULL;
+	}
+
+	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
+	{
+		index = bitmap_cache->cells[id].number;
+	}
+	else if (index > bitmap_cache->cells[id].number)
+	{
+		printf("get invalid bitmap index %d in cell id: %d\n", index, id);
+		return NULL;
+	}
+
+	return bitmap_cache->cells[id].entries[index];
+}
+
+static void bitmap_cache_evict(rdpBitmapCache* bitmap_cache, rdpBitmap* bitmap)
+{
+	if (bitmap->deferredData != NULL)
+		bitmap_cache->avoidedDecompressions++;
+
+	Bitmap_Free(bitmap_cache->context, bitmap);
+}
+
 void update_gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 {
 	rdpBitmap* bitmap;
@@ -80,17 +168,14 @@ void update_gdi_cache_bitmap(rdpContext* context, CACHE_BITMAP_ORDER* cache_bitm
 
 	Bitmap_SetDimensions(context, bitmap, cache_bitmap->bitmapWidth, cache_bitmap->bitmapHeight);
 
-	bitmap->Decompress(context, bitmap,
-			cache_bitmap->bitmapDataStream, cache_bitmap->bitmapWidth, cache_bitmap->bitmapHeight,
+	bitmap_cache_load(context, bitmap, cache_bitmap->bitmapDataStream,
 			cache_bitmap->bitmapBpp, cache_bitmap->bitmapLength,
 			cache_bitmap->compressed, CODEC_ID_NONE);
 
-	bitmap->New(context, bitmap);
-
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
+	prevBitmap = bitmap_cache_lookup(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex);
 
 	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
+		bitmap_cache_evict(cache->bitmap, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cache_bitmap->cacheId, cache_bitmap->cacheIndex, bitmap);
 }
@@ -111,17 +196,14 @@ void update_gdi_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* cach
 		cache_bitmap_v2->bitmapBpp = context->instance->settings->ColorDepth;
 	}
 
-	bitmap->Decompress(context, bitmap,
-			cache_bitmap_v2->bitmapDataStream, cache_bitmap_v2->bitmapWidth, cache_bitmap_v2->bitmapHeight,
+	bitmap_cache_load(context, bitmap, cache_bitmap_v2->bitmapDataStream,
 			cache_bitmap_v2->bitmapBpp, cache_bitmap_v2->bitmapLength,
 			cache_bitmap_v2->compressed, CODEC_ID_NONE);
 
-	bitmap->New(context, bitmap);
-
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
+	prevBitmap = bitmap_cache_lookup(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex);
 
 	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
+		bitmap_cache_evict(cache->bitmap, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v2->cacheId, cache_bitmap_v2->cacheIndex, bitmap);
 }
@@ -143,17 +225,14 @@ void update_gdi_cache_bitmap_v3(rdpContext* context, CACHE_BITMAP_V3_ORDER* cach
 		cache_bitmap_v3->bitmapData.bpp = context->instance->settings->ColorDepth;
 	}
 
-	bitmap->Decompress(context, bitmap,
-			bitmapData->data, bitmap->width, bitmap->height,
+	bitmap_cache_load(context, bitmap, bitmapData->data,
 			bitmapData->bpp, bitmapData->length, TRUE,
 			bitmapData->codecID);
 
-	bitmap->New(context, bitmap);
-
-	prevBitmap = bitmap_cache_get(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
+	prevBitmap = bitmap_cache_lookup(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex);
 
 	if (prevBitmap != NULL)
-		Bitmap_Free(context, prevBitmap);
+		bitmap_cache_evict(cache->bitmap, prevBitmap);
 
 	bitmap_cache_put(cache->bitmap, cache_bitmap_v3->cacheId, cache_bitmap_v3->cacheIndex, bitmap);
 }
@@ -209,23 +288,10 @@ rdpBitmap* bitmap_cache_get(rdpBitmapCache* bitmap_cache, UINT32 id, UINT32 inde
 {
 	rdpBitmap* bitmap;
 
-	if (id > bitmap_cache->maxCells)
-	{
-		printf("get invalid bitmap cell id: %d\n", id);
-		return NULL;
-	}
-
-	if (index == BITMAP_CACHE_WAITING_LIST_INDEX)
-	{
-		index = bitmap_cache->cells[id].number;
-	}
-	else if (index > bitmap_cache->cells[id].number)
-	{
-		printf("get invalid bitmap index %d in cell id: %d\n", index, id);
-		return NULL;
-	}
+	bitmap = bitmap_cache_lookup(bitmap_cache, id, index);
 
-	bitmap = bitmap_cache->cells[id].entries[index];
+	if (bitmap != NULL)
+		bitmap_cache_realize(bitmap_cache, bitmap);
 
 	return bitmap;
 }
@@ -314,7 +380,7 @@ void bitmap_cache_free(rdpBitmapCache* bitmap_cache)
 
 				if (bitmap != NULL)
 				{
-					Bitmap_Free(bitmap_cache->context, bitmap);
+					bitmap_cache_evict(bitmap_cache, bitmap);
 				}
 			}
 
@@ -26,6 +26,7 @@
 #include <winpr/crt.h>
 
 #include <freerdp/utils/stream.h>
+#include <freerdp/codec/color.h>
 
 #include <freerdp/cache/pointer.h>
 
@@ -51,6 +52,32 @@ void update_pointer_system(rdpContext* context, POINTER_SYSTEM_UPDATE* pointer_s
 	}
 }
 
+/**
+ * Convert the pointer masks to a backend-ready ARGB image once, when the
+ * pointer enters the cache, so that backends do not need to do it themselves.
+ * 8bpp pointers depend on the current palette and are left to the backend.
+ */
+
+static void pointer_cache_convert(rdpPointerCache* pointer_cache, rdpPointer* pointer)
+{
+	if ((pointer->xorMaskData == NULL) || (pointer->andMaskData == NULL))
+		return;
+
+	if ((pointer->xorBpp == 8) || (pointer->width < 1) || (pointer->height < 1))
+		return;
+
+	if (pointer->lengthXorMask < ((pointer->width * pointer->xorBpp + 7) / 8) * pointer->height)
+		return;
+
+	if (pointer->lengthAndMask < ((pointer->width + 7) / 8) * pointer->height)
+		return;
+
+	pointer->argbData = (BYTE*) malloc(pointer->width * pointer->height * 4);
+
+	freerdp_alpha_cursor_convert(pointer->argbData, pointer->xorMaskData, pointer->andMaskData,
+			pointer->width, pointer->height, pointer->xorBpp, pointer_cache->clrconv);
+}
+
 void update_pointer_color(rdpContext* context, POINTER_COLOR_UPDATE* pointer_color)
 {
 	rdpPointer* pointer;
@@ -70,6 +97,7 @@ void update_pointer_color(rdpContext* context, POINTER_COLOR_UPDATE* pointer_col
 		pointer->xorMaskData = pointer_color->xorMaskData;
 		pointer->andMaskData = pointer_color->andMaskData;
 
+		pointer_cache_convert(cache->pointer, pointer);
 		pointer->New(context, pointer);
 		pointer_cache_put(cache->pointer, pointer_color->cacheIndex, pointer);
 		Pointer_Set(context, pointer);
@@ -95,6 +123,7 @@ void update_pointer_new(rdpContext* context, POINTER_NEW_UPDATE* pointer_new)
 		pointer->xorMaskData = pointer_new->colorPtrAttr.xorMaskData;
 		pointer->andMaskData = pointer_new->colorPtrAttr.andMaskData;
 
+		pointer_cache_convert(cache->pointer, pointer);
 		pointer->New(context, pointer);
 		pointer_cache_put(cache->pointer, pointer_new->colorPtrAttr.cacheIndex, pointer);
 		Pointer_Set(context, pointer);
@@ -169,6 +198,7 @@ rdpPointerCache* pointer_cache_new(rdpSettings* settings)
 		pointer_cache->settings = settings;
 		pointer_cache->cacheSize = settings->PointerCacheSize;
 		pointer_cache->update = ((freerdp*) settings->instance)->update;
+		pointer_cache->clrconv = freerdp_clrconv_new(CLRCONV_ALPHA);
 
 		pointer_cache->entries = (rdpPointer**) malloc(sizeof(rdpPointer*) * pointer_cache->cacheSize);
 		ZeroMemory(pointer_cache->entries, sizeof(rdpPointer*) * pointer_cache->cacheSize);
@@ -192,6 +222,7 @@ void pointer_cache_free(rdpPointerCache* pointer_cache)
 				Pointer_Free(pointer_cache->update->context, pointer);
 		}
 
+		freerdp_clrconv_free(pointer_cache->clrconv);
 		free(pointer_cache->entries);
 		free(pointer_cache);
 	}
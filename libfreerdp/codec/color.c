@@ -1021,7 +1021,7 @@ BYTE* freerdp_mono_image_convert(BYTE* srcData, int width, int height, int srcBp
 	return srcData;
 }
 
-void freerdp_alpha_cursor_convert(BYTE* alphaData, BYTE* xorMask, BYTE* andMask, int width, int height, int bpp, HCLRCONV clrconv)
+static void freerdp_alpha_cursor_convert_generic(BYTE* alphaData, BYTE* xorMask, BYTE* andMask, int width, int height, int bpp, HCLRCONV clrconv)
 {
 	int xpixel;
 	int apixel;
@@ -1056,6 +1056,81 @@ void freerdp_alpha_cursor_convert(BYTE* alphaData, BYTE* xorMask, BYTE* andMask,
 	}
 }
 
+/**
+ * Convert a color pointer to a top-down 32bpp ARGB image.
+ * 24bpp and 32bpp pointers, which are the common case for large cursors,
+ * are converted a scanline at a time; other depths go through the per-pixel path.
+ */
+
+void freerdp_alpha_cursor_convert(BYTE* alphaData, BYTE* xorMask, BYTE* andMask, int width, int height, int bpp, HCLRCONV clrconv)
+{
+	int i, j;
+	BYTE* src;
+	BYTE* mask;
+	UINT32* dst;
+	UINT32 xpixel;
+	UINT32 alpha;
+	int andScanline;
+
+	if ((bpp != 24) && (bpp != 32))
+	{
+		freerdp_alpha_cursor_convert_generic(alphaData, xorMask, andMask, width, height, bpp, clrconv);
+		return;
+	}
+
+	andScanline = (width + 7) / 8;
+	alpha = (clrconv->alpha) ? 0xFF000000 : 0;
+
+	for (j = 0; j < height; j++)
+	{
+		src = &xorMask[((height - 1) - j) * width * (bpp / 8)];
+		mask = &andMask[((height - 1) - j) * andScanline];
+		dst = (UINT32*) &alphaData[j * width * 4];
+
+		if (bpp == 32)
+		{
+			UINT32* src32 = (UINT32*) src;
+
+			if (clrconv->alpha)
+			{
+				for (i = 0; i < width; i++)
+					dst[i] = src32[i];
+			}
+			else
+			{
+				for (i = 0; i < width; i++)
+					dst[i] = src32[i] & 0x00FFFFFF;
+			}
+		}
+		else
+		{
+			for (i = 0; i < width; i++)
+			{
+				dst[i] = alpha | (src[0] << 16) | (src[1] << 8) | src[2];
+				src += 3;
+			}
+		}
+
+		for (i = 0; i < width; i++)
+		{
+			if (!(mask[i >> 3] & (0x80 >> (i & 7))))
+				continue;
+
+			xpixel = dst[i];
+
+			if ((xpixel & 0xFFFFFF) == 0xFFFFFF)
+			{
+				/* use pattern (not solid black) for xor area */
+				dst[i] = (((i & 1) == (j & 1)) ? 0xFFFFFF : 0) | 0xFF000000;
+			}
+			else if (xpixel == 0xFF000000)
+			{
+				dst[i] = 0;
+			}
+		}
+	}
+}
+
 void freerdp_image_swap_color_order(BYTE* data, int width, int height)
 {
 	int x, y;
@@ -575,6 +575,32 @@ rdpRsaKey* key_new(const char* keyfile)
 	return key;
 }
 
+rdpRsaKey* key_clone(rdpRsaKey* key)
+{
+	rdpRsaKey* clone;
+
+	clone = (rdpRsaKey*) malloc(sizeof(rdpRsaKey));
+
+	if (clone == NULL)
+		return NULL;
+
+	CopyMemory(clone, key, sizeof(rdpRsaKey));
+
+	clone->Modulus = (BYTE*) malloc(key->ModulusLength);
+	clone->PrivateExponent = (BYTE*) malloc(key->PrivateExponentLength);
+
+	if (!clone->Modulus || !clone->PrivateExponent)
+	{
+		key_free(clone);
+		return NULL;
+	}
+
+	CopyMemory(clone->Modulus, key->Modulus, key->ModulusLength);
+	CopyMemory(clone->PrivateExponent, key->PrivateExponent, key->PrivateExponentLength);
+
+	return clone;
+}
+
 void key_free(rdpRsaKey* key)
 {
 	if (key != NULL)
@@ -55,6 +55,7 @@ rdpCertificate* certificate_new();
 void certificate_free(rdpCertificate* certificate);
 
 rdpRsaKey* key_new(const char *keyfile);
+rdpRsaKey* key_clone(rdpRsaKey* key);
 void key_free(rdpRsaKey* key);
 
 #ifdef WITH_DEBUG_CERTIFICATE
@@ -176,19 +176,25 @@ BOOL rdp_client_disconnect(rdpRdp* rdp)
 	return transport_disconnect(rdp->transport);
 }
 
-BOOL rdp_client_redirect(rdpRdp* rdp)
+/**
+ * Drop the connection and start over with a fresh transport, keeping
+ * the context (and with it the GDI surface and the caches) untouched.
+ * @param rdp RDP module
+ */
+
+static void rdp_client_reset(rdpRdp* rdp)
 {
 	rdpSettings* settings = rdp->settings;
-	rdpRedirection* redirection = rdp->redirection;
 
 	rdp_client_disconnect(rdp);
 
 	/* FIXME: this is a subset of rdp_free */
-	crypto_rc4_free(rdp->rc4_decrypt_key);
-	crypto_rc4_free(rdp->rc4_encrypt_key);
 	crypto_des3_free(rdp->fips_encrypt);
 	crypto_des3_free(rdp->fips_decrypt);
 	crypto_hmac_free(rdp->fips_hmac);
+	rdp->fips_encrypt = NULL;
+	rdp->fips_decrypt = NULL;
+	rdp->fips_hmac = NULL;
 	mcs_free(rdp->mcs);
 	nego_free(rdp->nego);
 	license_free(rdp->license);
@@ -196,7 +202,18 @@ BOOL rdp_client_redirect(rdpRdp* rdp)
 
 	free(settings->ServerRandom);
 	free(settings->ServerCertificate);
+	free(settings->ClientRandom);
 	free(settings->ClientAddress);
+	settings->ServerRandom = NULL;
+	settings->ServerRandomLength = 0;
+	settings->ServerCertificate = NULL;
+	settings->ServerCertificateLength = 0;
+	settings->ClientRandom = NULL;
+	settings->ClientRandomLength = 0;
+	settings->ClientAddress = NULL;
+
+	rdp->do_crypt = FALSE;
+	rdp->do_secure_checksum = FALSE;
 
 	rdp->transport = transport_new(settings);
 	rdp->license = license_new(rdp);
@@ -204,6 +221,15 @@ BOOL rdp_client_redirect(rdpRdp* rdp)
 	rdp->mcs = mcs_new(rdp->transport);
 
 	rdp->transport->layer = TRANSPORT_LAYER_TCP;
+}
+
+BOOL rdp_client_redirect(rdpRdp* rdp)
+{
+	rdpSettings* settings = rdp->settings;
+	rdpRedirection* redirection = rdp->redirection;
+
+	rdp_client_reset(rdp);
+
 	settings->RedirectedSessionId = redirection->sessionID;
 
 	if (redirection->flags & LB_LOAD_BALANCE_INFO)
@@ -250,6 +276,48 @@ BOOL rdp_client_redirect(rdpRdp* rdp)
 	return rdp_client_connect(rdp);
 }
 
+/**
+ * Reconnect to the same server after the transport was lost, presenting
+ * the auto-reconnect cookie received during the previous logon.
+ * @param rdp RDP module
+ * @return TRUE if the session was reactivated
+ */
+
+BOOL rdp_client_reconnect(rdpRdp* rdp)
+{
+	BOOL status;
+	rdpSettings* settings = rdp->settings;
+	ARC_SC_PRIVATE_PACKET* serverCookie = settings->ServerAutoReconnectCookie;
+	ARC_CS_PRIVATE_PACKET* clientCookie = settings->ClientAutoReconnectCookie;
+
+	if (serverCookie->cbLen == 0)
+		return FALSE;
+
+	rdp_client_reset(rdp);
+
+	/* the security verifier is computed when the client info is sent */
+	clientCookie->cbLen = 28;
+	clientCookie->version = AUTO_RECONNECT_VERSION_1;
+	clientCookie->logonId = serverCookie->logonId;
+	ZeroMemory(clientCookie->securityVerifier, sizeof(clientCookie->securityVerifier));
+
+	status = rdp_client_connect(rdp);
+
+	ZeroMemory(clientCookie, sizeof(ARC_CS_PRIVATE_PACKET));
+
+	return status;
+}
+
+/* the auto-reconnect security verifier is bound to the client random */
+
+static void rdp_set_client_random(rdpSettings* settings, BYTE* client_random)
+{
+	free(settings->ClientRandom);
+	settings->ClientRandomLength = CLIENT_RANDOM_LENGTH;
+	settings->ClientRandom = (BYTE*) malloc(CLIENT_RANDOM_LENGTH);
+	CopyMemory(settings->ClientRandom, client_random, CLIENT_RANDOM_LENGTH);
+}
+
 static BOOL rdp_client_establish_keys(rdpRdp* rdp)
 {
 	BYTE* mod;
@@ -296,23 +364,12 @@ static BOOL rdp_client_establish_keys(rdpRdp* rdp)
 		return FALSE;
 	}
 
+	rdp_set_client_random(rdp->settings, client_random);
+
 	rdp->do_crypt = TRUE;
 	if (rdp->settings->SaltedChecksum)
 		rdp->do_secure_checksum = TRUE;
 
-	if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
-	{
-		BYTE fips_ivec[8] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF };
-		rdp->fips_encrypt = crypto_des3_encrypt_init(rdp->fips_encrypt_key, fips_ivec);
-		rdp->fips_decrypt = crypto_des3_decrypt_init(rdp->fips_decrypt_key, fips_ivec);
-
-		rdp->fips_hmac = crypto_hmac_new();
-		return TRUE;
-	}
-
-	rdp->rc4_decrypt_key = crypto_rc4_init(rdp->decrypt_key, rdp->rc4_key_len);
-	rdp->rc4_encrypt_key = crypto_rc4_init(rdp->encrypt_key, rdp->rc4_key_len);
-
 	return TRUE;
 }
 
@@ -368,23 +425,12 @@ static BOOL rdp_server_establish_keys(rdpRdp* rdp, STREAM* s)
 		return FALSE;
 	}
 
+	rdp_set_client_random(rdp->settings, client_random);
+
 	rdp->do_crypt = TRUE;
 	if (rdp->settings->SaltedChecksum)
 		rdp->do_secure_checksum = TRUE;
 
-	if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
-	{
-		BYTE fips_ivec[8] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF };
-		rdp->fips_encrypt = crypto_des3_encrypt_init(rdp->fips_encrypt_key, fips_ivec);
-		rdp->fips_decrypt = crypto_des3_decrypt_init(rdp->fips_decrypt_key, fips_ivec);
-
-		rdp->fips_hmac = crypto_hmac_new();
-		return TRUE;
-	}
-
-	rdp->rc4_decrypt_key = crypto_rc4_init(rdp->decrypt_key, rdp->rc4_key_len);
-	rdp->rc4_encrypt_key = crypto_rc4_init(rdp->encrypt_key, rdp->rc4_key_len);
-
 	return TRUE;
 }
 
@@ -409,10 +455,25 @@ BOOL rdp_client_connect_mcs_connect_response(rdpRdp* rdp, STREAM* s)
 
 BOOL rdp_client_connect_mcs_attach_user_confirm(rdpRdp* rdp, STREAM* s)
 {
+	int i;
+	int count = 0;
+	UINT16 channel_ids[MCS_MAX_CHANNEL_JOINS];
+
 	if (!mcs_recv_attach_user_confirm(rdp->mcs, s))
 		return FALSE;
 
-	if (!mcs_send_channel_join_request(rdp->mcs, rdp->mcs->user_id))
+	/* join the user channel, the I/O channel and every static channel in one flight */
+
+	channel_ids[count++] = rdp->mcs->user_id;
+	channel_ids[count++] = MCS_GLOBAL_CHANNEL_ID;
+
+	for (i = 0; (i < rdp->settings->ChannelCount) && (count < MCS_MAX_CHANNEL_JOINS); i++)
+	{
+		rdp->settings->ChannelDefArray[i].joined = FALSE;
+		channel_ids[count++] = rdp->settings->ChannelDefArray[i].ChannelId;
+	}
+
+	if (!mcs_send_channel_join_requests(rdp->mcs, channel_ids, count))
 		return FALSE;
 
 	rdp->state = CONNECTION_STATE_MCS_CHANNEL_JOIN;
@@ -429,49 +490,37 @@ BOOL rdp_client_connect_mcs_channel_join_confirm(rdpRdp* rdp, STREAM* s)
 	if (!mcs_recv_channel_join_confirm(rdp->mcs, s, &channel_id))
 		return FALSE;
 
-	if (!rdp->mcs->user_channel_joined)
+	/* the requests were pipelined, the confirms may come in any order */
+
+	if (!rdp->mcs->user_channel_joined && (channel_id == rdp->mcs->user_id))
 	{
-		if (channel_id != rdp->mcs->user_id)
-			return FALSE;
 		rdp->mcs->user_channel_joined = TRUE;
-
-		if (!mcs_send_channel_join_request(rdp->mcs, MCS_GLOBAL_CHANNEL_ID))
-			return FALSE;
 	}
-	else if (!rdp->mcs->global_channel_joined)
+	else if (!rdp->mcs->global_channel_joined && (channel_id == MCS_GLOBAL_CHANNEL_ID))
 	{
-		if (channel_id != MCS_GLOBAL_CHANNEL_ID)
-			return FALSE;
 		rdp->mcs->global_channel_joined = TRUE;
-
-		if (rdp->settings->ChannelCount > 0)
-		{
-			if (!mcs_send_channel_join_request(rdp->mcs, rdp->settings->ChannelDefArray[0].ChannelId))
-				return FALSE;
-
-			all_joined = FALSE;
-		}
 	}
 	else
 	{
 		for (i = 0; i < rdp->settings->ChannelCount; i++)
 		{
-			if (rdp->settings->ChannelDefArray[i].joined)
-				continue;
-
-			if (rdp->settings->ChannelDefArray[i].ChannelId != channel_id)
-				return FALSE;
-
-			rdp->settings->ChannelDefArray[i].joined = TRUE;
-			break;
+			if (!rdp->settings->ChannelDefArray[i].joined && (rdp->settings->ChannelDefArray[i].ChannelId == channel_id))
+				break;
 		}
-		if (i + 1 < rdp->settings->ChannelCount)
+
+		if (i == rdp->settings->ChannelCount)
 		{
-			if (!mcs_send_channel_join_request(rdp->mcs, rdp->settings->ChannelDefArray[i + 1].ChannelId))
-				return FALSE;
+			printf("rdp_client_connect_mcs_channel_join_confirm: unexpected channel %d\n", channel_id);
+			return FALSE;
+		}
+
+		rdp->settings->ChannelDefArray[i].joined = TRUE;
+	}
 
+	for (i = 0; i < rdp->settings->ChannelCount; i++)
+	{
+		if (!rdp->settings->ChannelDefArray[i].joined)
 			all_joined = FALSE;
-		}
 	}
 
 	if (rdp->mcs->user_channel_joined && rdp->mcs->global_channel_joined && all_joined)
@@ -579,8 +628,6 @@ BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s)
 	BOOL status;
 	rdpSettings* settings = rdp->settings;
 
-	transport_set_blocking_mode(rdp->transport, TRUE);
-
 	if (!nego_read_request(rdp->nego, s))
 		return FALSE;
 
@@ -619,22 +666,47 @@ BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s)
 	if (!nego_send_negotiation_response(rdp->nego))
 		return FALSE;
 
+	/**
+	 * The TLS handshake and CredSSP exchange are not performed here: they are
+	 * driven by rdp_server_accept_security() as the client's messages arrive,
+	 * so that a slow client does not hold up the thread serving the peer.
+	 */
+
 	status = FALSE;
 	if (rdp->nego->selected_protocol & PROTOCOL_NLA)
-		status = transport_accept_nla(rdp->transport);
+		status = transport_accept_start(rdp->transport, TRUE);
 	else if (rdp->nego->selected_protocol & PROTOCOL_TLS)
-		status = transport_accept_tls(rdp->transport);
+		status = transport_accept_start(rdp->transport, FALSE);
 	else if (rdp->nego->selected_protocol == PROTOCOL_RDP) /* 0 */
 		status = transport_accept_rdp(rdp->transport);
 
 	if (!status)
 		return FALSE;
 
-	transport_set_blocking_mode(rdp->transport, FALSE);
+	if (rdp->transport->AcceptState == TRANSPORT_ACCEPT_NONE)
+		rdp->state = CONNECTION_STATE_NEGO;
+
+	return TRUE;
+}
+
+/**
+ * Advance the security layer handshake started by rdp_server_accept_nego().
+ * @param rdp rdp module
+ * @return 1 once the handshake is complete, 0 if it waits for the client, -1 on failure
+ */
+
+int rdp_server_accept_security(rdpRdp* rdp)
+{
+	int status;
+
+	status = transport_accept_continue(rdp->transport);
+
+	if (status <= 0)
+		return status;
 
 	rdp->state = CONNECTION_STATE_NEGO;
 
-	return TRUE;
+	return 1;
 }
 
 BOOL rdp_server_accept_mcs_connect_initial(rdpRdp* rdp, STREAM* s)
@@ -690,16 +762,15 @@ BOOL rdp_server_accept_mcs_channel_join_request(rdpRdp* rdp, STREAM* s)
 	UINT16 channel_id;
 	BOOL all_joined = TRUE;
 
-	if (!mcs_recv_channel_join_request(rdp->mcs, s, &channel_id))
-		return FALSE;
+	rdpMcs* mcs = rdp->mcs;
 
-	if (!mcs_send_channel_join_confirm(rdp->mcs, channel_id))
+	if (!mcs_recv_channel_join_request(mcs, s, &channel_id))
 		return FALSE;
 
-	if (channel_id == rdp->mcs->user_id)
-		rdp->mcs->user_channel_joined = TRUE;
+	if (channel_id == mcs->user_id)
+		mcs->user_channel_joined = TRUE;
 	else if (channel_id == MCS_GLOBAL_CHANNEL_ID)
-		rdp->mcs->global_channel_joined = TRUE;
+		mcs->global_channel_joined = TRUE;
 
 	for (i = 0; i < rdp->settings->ChannelCount; i++)
 	{
@@ -710,9 +781,26 @@ BOOL rdp_server_accept_mcs_channel_join_request(rdpRdp* rdp, STREAM* s)
 			all_joined = FALSE;
 	}
 
-	if (rdp->mcs->user_channel_joined && rdp->mcs->global_channel_joined && all_joined)
+	mcs->join_confirms[mcs->join_confirm_count++] = channel_id;
+
+	if (mcs->user_channel_joined && mcs->global_channel_joined && all_joined)
 		rdp->state = CONNECTION_STATE_MCS_CHANNEL_JOIN;
 
+	/**
+	 * Requests pipelined by the client are already waiting in the receive
+	 * buffer: answer them all in a single write once the last one is read.
+	 */
+
+	if ((rdp->state == CONNECTION_STATE_MCS_CHANNEL_JOIN) ||
+			(stream_get_pos(rdp->transport->recv_buffer) == 0) ||
+			(mcs->join_confirm_count == MCS_MAX_CHANNEL_JOINS))
+	{
+		if (!mcs_send_channel_join_confirms(mcs, mcs->join_confirms, mcs->join_confirm_count))
+			return FALSE;
+
+		mcs->join_confirm_count = 0;
+	}
+
 	return TRUE;
 }
 
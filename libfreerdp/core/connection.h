@@ -46,6 +46,7 @@ enum CONNECTION_STATE
 
 BOOL rdp_client_connect(rdpRdp* rdp);
 BOOL rdp_client_redirect(rdpRdp* rdp);
+BOOL rdp_client_reconnect(rdpRdp* rdp);
 BOOL rdp_client_connect_mcs_connect_response(rdpRdp* rdp, STREAM* s);
 BOOL rdp_client_connect_mcs_attach_user_confirm(rdpRdp* rdp, STREAM* s);
 BOOL rdp_client_connect_mcs_channel_join_confirm(rdpRdp* rdp, STREAM* s);
@@ -54,6 +55,7 @@ BOOL rdp_client_connect_demand_active(rdpRdp* rdp, STREAM* s);
 BOOL rdp_client_connect_finalize(rdpRdp* rdp);
 
 BOOL rdp_server_accept_nego(rdpRdp* rdp, STREAM* s);
+int rdp_server_accept_security(rdpRdp* rdp);
 BOOL rdp_server_accept_mcs_connect_initial(rdpRdp* rdp, STREAM* s);
 BOOL rdp_server_accept_mcs_erect_domain_request(rdpRdp* rdp, STREAM* s);
 BOOL rdp_server_accept_mcs_attach_user_request(rdpRdp* rdp, STREAM* s);
@@ -607,11 +607,8 @@ BOOL fastpath_send_input_pdu(rdpFastPath* fastpath, STREAM* s)
 
 		fpInputEvents = stream_get_tail(s) + sec_bytes;
 		fpInputEvents_length = length - 3 - sec_bytes;
-		if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
-			security_salted_mac_signature(rdp, fpInputEvents, fpInputEvents_length, TRUE, stream_get_tail(s));
-		else
-			security_mac_signature(rdp, fpInputEvents, fpInputEvents_length, stream_get_tail(s));
-		security_encrypt(fpInputEvents, fpInputEvents_length, rdp);
+		security_sign_and_encrypt(rdp, fpInputEvents, fpInputEvents_length,
+				(rdp->sec_flags & SEC_SECURE_CHECKSUM) ? TRUE : FALSE, stream_get_tail(s));
 	}
 
 	rdp->sec_flags = 0;
@@ -737,11 +734,8 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, STREAM* s)
 			/* does this work ? */
 			ptr_to_crypt = bm + 3 + sec_bytes;
 			ptr_sig = bm + 3;
-			if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
-				security_salted_mac_signature(rdp, ptr_to_crypt, bytes_to_crypt, TRUE, ptr_sig);
-			else
-				security_mac_signature(rdp, ptr_to_crypt, bytes_to_crypt, ptr_sig);
-			security_encrypt(ptr_to_crypt, bytes_to_crypt, rdp);
+			security_sign_and_encrypt(rdp, ptr_to_crypt, bytes_to_crypt,
+					(rdp->sec_flags & SEC_SECURE_CHECKSUM) ? TRUE : FALSE, ptr_sig);
 		}
 
 		if (transport_write(fastpath->rdp->transport, update) < 0)
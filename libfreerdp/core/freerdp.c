@@ -30,6 +30,7 @@
 #include "extension.h"
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/errorcodes.h>
@@ -163,11 +164,45 @@ BOOL freerdp_get_fds(freerdp* instance, void** rfds, int* rcount, void** wfds, i
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
-	transport_get_fds(rdp->transport, rfds, rcount);
+
+	/* the lost transport stays readable: only wake up for the next attempt */
+	if (rdp->reconnect->pending)
+		reconnect_get_fds(rdp->reconnect, rfds, rcount);
+	else
+		transport_get_fds(rdp->transport, rfds, rcount);
 
 	return TRUE;
 }
 
+static BOOL freerdp_check_reconnect(freerdp* instance)
+{
+	rdpRdp* rdp;
+	rdpReconnect* reconnect;
+
+	rdp = instance->context->rdp;
+	reconnect = rdp->reconnect;
+
+	if (!reconnect_is_due(reconnect))
+		return TRUE;
+
+	printf("auto-reconnect: attempt %d of %d\n", reconnect->retry, reconnect->maxRetries);
+
+	if (rdp_client_reconnect(rdp))
+	{
+		reconnect_stop(reconnect);
+		return TRUE;
+	}
+
+	/* the server refused the session, trying again will not help */
+	if (rdp->disconnect || (rdp->errorInfo != ERRINFO_SUCCESS))
+	{
+		reconnect_stop(reconnect);
+		return FALSE;
+	}
+
+	return reconnect_schedule(reconnect);
+}
+
 BOOL freerdp_check_fds(freerdp* instance)
 {
 	int status;
@@ -175,11 +210,48 @@ BOOL freerdp_check_fds(freerdp* instance)
 
 	rdp = instance->context->rdp;
 
+	if (rdp->reconnect->pending)
+		return freerdp_check_reconnect(instance);
+
 	status = rdp_check_fds(rdp);
 
 	if (status < 0)
+	{
+		/* a session the server did not end itself was cut off by the network */
+		if ((rdp->state == CONNECTION_STATE_ACTIVE) && !rdp->disconnect && (rdp->errorInfo == ERRINFO_SUCCESS))
+			return freerdp_reconnect(instance);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/** Starts re-establishing a session whose transport was lost, using the auto-reconnect cookie
+ *  sent by the server at logon instead of the user's credentials.
+ *  The attempts are made by freerdp_check_fds(), one per call, and freerdp_get_fds() only
+ *  returns the descriptor signaling the next attempt until the session is back. Failed attempts
+ *  are retried with an exponential backoff, up to AutoReconnectMaxRetries times.
+ *  The context is kept as is: PreConnect and PostConnect are not called again,
+ *  so the GDI surface and the caches survive the reconnection.
+ *
+ *  @param instance - pointer to a rdp_freerdp structure of an established connection.
+ *
+ *  @return TRUE if reconnection was started. FALSE if it is disabled or the server sent no cookie.
+ */
+BOOL freerdp_reconnect(freerdp* instance)
+{
+	rdpRdp* rdp;
+	rdpSettings* settings;
+
+	rdp = instance->context->rdp;
+	settings = instance->settings;
+
+	if (!settings->AutoReconnectionEnabled || (settings->ServerAutoReconnectCookie->cbLen == 0))
 		return FALSE;
 
+	reconnect_start(rdp->reconnect, settings->AutoReconnectMaxRetries);
+
 	return TRUE;
 }
 
@@ -193,6 +265,7 @@ BOOL freerdp_disconnect(freerdp* instance)
 	rdpRdp* rdp;
 
 	rdp = instance->context->rdp;
+	reconnect_stop(rdp->reconnect);
 	transport_disconnect(rdp->transport);
 
 	return TRUE;
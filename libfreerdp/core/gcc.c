@@ -896,14 +896,92 @@ const BYTE tssk_exponent[] =
 	0x5b, 0x7b, 0x88, 0xc0
 };
 
-void gcc_write_server_security_data(STREAM* s, rdpSettings* settings)
+/**
+ * Create the server proprietary certificate for the given RSA key, signed
+ * with the Terminal Services signing key. It only depends on the key, so it
+ * can be created once and sent to every client.
+ * @param key server RSA key
+ * @param length receives the certificate length
+ * @return newly allocated certificate
+ */
+
+BYTE* gcc_create_server_certificate(rdpRsaKey* key, UINT32* length)
 {
+	STREAM* s;
+	BYTE* data;
 	CryptoMd5 md5;
-	BYTE* sigData;
 	int expLen, keyLen, sigDataLen;
 	BYTE encryptedSignature[TSSK_KEY_LENGTH];
 	BYTE signature[sizeof(initial_signature)];
-	UINT32 headerLen, serverRandomLen, serverCertLen, wPublicKeyBlobLen;
+	UINT32 serverCertLen, wPublicKeyBlobLen;
+
+	keyLen = key->ModulusLength;
+	expLen = sizeof(key->exponent);
+	wPublicKeyBlobLen = 4; /* magic (RSA1) */
+	wPublicKeyBlobLen += 4; /* keylen */
+	wPublicKeyBlobLen += 4; /* bitlen */
+	wPublicKeyBlobLen += 4; /* datalen */
+	wPublicKeyBlobLen += expLen;
+	wPublicKeyBlobLen += keyLen;
+	wPublicKeyBlobLen += 8; /* 8 bytes of zero padding */
+
+	serverCertLen = 4; /* dwVersion */
+	serverCertLen += 4; /* dwSigAlgId */
+	serverCertLen += 4; /* dwKeyAlgId */
+	serverCertLen += 2; /* wPublicKeyBlobType */
+	serverCertLen += 2; /* wPublicKeyBlobLen */
+	serverCertLen += wPublicKeyBlobLen;
+	serverCertLen += 2; /* wSignatureBlobType */
+	serverCertLen += 2; /* wSignatureBlobLen */
+	serverCertLen += sizeof(encryptedSignature); /* SignatureBlob */
+	serverCertLen += 8; /* 8 bytes of zero padding */
+
+	s = stream_new(serverCertLen);
+
+	stream_write_UINT32(s, CERT_CHAIN_VERSION_1); /* dwVersion (4 bytes) */
+	stream_write_UINT32(s, SIGNATURE_ALG_RSA); /* dwSigAlgId */
+	stream_write_UINT32(s, KEY_EXCHANGE_ALG_RSA); /* dwKeyAlgId */
+	stream_write_UINT16(s, BB_RSA_KEY_BLOB); /* wPublicKeyBlobType */
+
+	stream_write_UINT16(s, wPublicKeyBlobLen); /* wPublicKeyBlobLen */
+	stream_write(s, "RSA1", 4); /* magic */
+	stream_write_UINT32(s, keyLen + 8); /* keylen */
+	stream_write_UINT32(s, keyLen * 8); /* bitlen */
+	stream_write_UINT32(s, keyLen - 1); /* datalen */
+
+	stream_write(s, key->exponent, expLen);
+	stream_write(s, key->Modulus, keyLen);
+	stream_write_zero(s, 8);
+
+	sigDataLen = stream_get_length(s);
+
+	stream_write_UINT16(s, BB_RSA_SIGNATURE_BLOB); /* wSignatureBlobType */
+	stream_write_UINT16(s, keyLen + 8); /* wSignatureBlobLen */
+
+	memcpy(signature, initial_signature, sizeof(initial_signature));
+
+	md5 = crypto_md5_init();
+	crypto_md5_update(md5, stream_get_head(s), sigDataLen);
+	crypto_md5_final(md5, signature);
+
+	crypto_rsa_private_encrypt(signature, sizeof(signature), TSSK_KEY_LENGTH,
+		tssk_modulus, tssk_privateExponent, encryptedSignature);
+
+	stream_write(s, encryptedSignature, sizeof(encryptedSignature));
+	stream_write_zero(s, 8);
+
+	data = stream_get_head(s);
+	*length = serverCertLen;
+
+	stream_detach(s);
+	stream_free(s);
+
+	return data;
+}
+
+void gcc_write_server_security_data(STREAM* s, rdpSettings* settings)
+{
+	UINT32 headerLen, serverRandomLen, serverCertLen;
 
 	if (!settings->DisableEncryption)
 	{
@@ -927,8 +1005,6 @@ void gcc_write_server_security_data(STREAM* s, rdpSettings* settings)
 		settings->EncryptionLevel = ENCRYPTION_LEVEL_CLIENT_COMPATIBLE;
 
 	headerLen = 12;
-	keyLen = 0;
-	wPublicKeyBlobLen = 0;
 	serverRandomLen = 0;
 	serverCertLen = 0;
 
@@ -937,26 +1013,15 @@ void gcc_write_server_security_data(STREAM* s, rdpSettings* settings)
 	{
 		serverRandomLen = 32;
 
-		keyLen = settings->RdpServerRsaKey->ModulusLength;
-		expLen = sizeof(settings->RdpServerRsaKey->exponent);
-		wPublicKeyBlobLen = 4; /* magic (RSA1) */
-		wPublicKeyBlobLen += 4; /* keylen */
-		wPublicKeyBlobLen += 4; /* bitlen */
-		wPublicKeyBlobLen += 4; /* datalen */
-		wPublicKeyBlobLen += expLen;
-		wPublicKeyBlobLen += keyLen;
-		wPublicKeyBlobLen += 8; /* 8 bytes of zero padding */
-
-		serverCertLen = 4; /* dwVersion */
-		serverCertLen += 4; /* dwSigAlgId */
-		serverCertLen += 4; /* dwKeyAlgId */
-		serverCertLen += 2; /* wPublicKeyBlobType */
-		serverCertLen += 2; /* wPublicKeyBlobLen */
-		serverCertLen += wPublicKeyBlobLen;
-		serverCertLen += 2; /* wSignatureBlobType */
-		serverCertLen += 2; /* wSignatureBlobLen */
-		serverCertLen += sizeof(encryptedSignature); /* SignatureBlob */
-		serverCertLen += 8; /* 8 bytes of zero padding */
+		/* the certificate may have been created in advance along with the key */
+
+		if (settings->ServerCertificate == NULL)
+		{
+			settings->ServerCertificate = gcc_create_server_certificate(settings->RdpServerRsaKey, &serverCertLen);
+			settings->ServerCertificateLength = settings->ServerCertificate ? serverCertLen : 0;
+		}
+
+		serverCertLen = settings->ServerCertificateLength;
 
 		headerLen += sizeof(serverRandomLen);
 		headerLen += sizeof(serverCertLen);
@@ -983,39 +1048,7 @@ void gcc_write_server_security_data(STREAM* s, rdpSettings* settings)
 	crypto_nonce(settings->ServerRandom, serverRandomLen);
 	stream_write(s, settings->ServerRandom, serverRandomLen);
 
-	sigData = stream_get_tail(s);
-
-	stream_write_UINT32(s, CERT_CHAIN_VERSION_1); /* dwVersion (4 bytes) */
-	stream_write_UINT32(s, SIGNATURE_ALG_RSA); /* dwSigAlgId */
-	stream_write_UINT32(s, KEY_EXCHANGE_ALG_RSA); /* dwKeyAlgId */
-	stream_write_UINT16(s, BB_RSA_KEY_BLOB); /* wPublicKeyBlobType */
-
-	stream_write_UINT16(s, wPublicKeyBlobLen); /* wPublicKeyBlobLen */
-	stream_write(s, "RSA1", 4); /* magic */
-	stream_write_UINT32(s, keyLen + 8); /* keylen */
-	stream_write_UINT32(s, keyLen * 8); /* bitlen */
-	stream_write_UINT32(s, keyLen - 1); /* datalen */
-
-	stream_write(s, settings->RdpServerRsaKey->exponent, expLen);
-	stream_write(s, settings->RdpServerRsaKey->Modulus, keyLen);
-	stream_write_zero(s, 8);
-
-	sigDataLen = stream_get_tail(s) - sigData;
-
-	stream_write_UINT16(s, BB_RSA_SIGNATURE_BLOB); /* wSignatureBlobType */
-	stream_write_UINT16(s, keyLen + 8); /* wSignatureBlobLen */
-
-	memcpy(signature, initial_signature, sizeof(initial_signature));
-
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, sigData, sigDataLen);
-	crypto_md5_final(md5, signature);
-
-	crypto_rsa_private_encrypt(signature, sizeof(signature), TSSK_KEY_LENGTH,
-		tssk_modulus, tssk_privateExponent, encryptedSignature);
-
-	stream_write(s, encryptedSignature, sizeof(encryptedSignature));
-	stream_write_zero(s, 8);
+	stream_write(s, settings->ServerCertificate, serverCertLen);
 }
 
 /**
@@ -44,6 +44,7 @@ void gcc_write_server_core_data(STREAM* s, rdpSettings *settings);
 BOOL gcc_read_client_security_data(STREAM* s, rdpSettings *settings, UINT16 blockLength);
 void gcc_write_client_security_data(STREAM* s, rdpSettings *settings);
 BOOL gcc_read_server_security_data(STREAM* s, rdpSettings *settings);
+BYTE* gcc_create_server_certificate(rdpRsaKey* key, UINT32* length);
 void gcc_write_server_security_data(STREAM* s, rdpSettings *settings);
 BOOL gcc_read_client_network_data(STREAM* s, rdpSettings *settings, UINT16 blockLength);
 void gcc_write_client_network_data(STREAM* s, rdpSettings *settings);
@@ -39,6 +39,7 @@ rdpBitmap* Bitmap_Alloc(rdpContext* context)
 	{
 		memcpy(bitmap, context->graphics->Bitmap_Prototype, sizeof(rdpBitmap));
 		bitmap->data = NULL;
+		bitmap->deferredData = NULL;
 	}
 
 	return bitmap;
@@ -53,7 +54,11 @@ void Bitmap_Free(rdpContext* context, rdpBitmap* bitmap)
 {
 	if (bitmap != NULL)
 	{
-		bitmap->Free(context, bitmap);
+		/* bitmaps still holding a deferred payload were never realized */
+		if (bitmap->deferredData != NULL)
+			free(bitmap->deferredData);
+		else
+			bitmap->Free(context, bitmap);
 
 		if (bitmap->data != NULL)
 			free(bitmap->data);
@@ -122,6 +127,9 @@ void Pointer_Free(rdpContext* context, rdpPointer* pointer)
 		if (pointer->andMaskData)
 			free(pointer->andMaskData);
 
+		if (pointer->argbData)
+			free(pointer->argbData);
+
 		free(pointer);
 	}
 }
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+
 #include <freerdp/utils/unicode.h>
 
 #include "timezone.h"
@@ -101,6 +103,35 @@ void rdp_write_client_auto_reconnect_cookie(STREAM* s, rdpSettings* settings)
 	stream_write(s, autoReconnectCookie->securityVerifier, 16); /* SecurityVerifier */
 }
 
+/**
+ * Compute the security verifier of the Client Auto Reconnect Cookie.\n
+ * SecurityVerifier = HMAC_MD5(arcRandomBits, ClientRandom), where the
+ * client random is all zeros unless Standard RDP Security is in use.
+ * @param settings settings
+ */
+
+void rdp_compute_client_auto_reconnect_cookie(rdpSettings* settings)
+{
+	CryptoHmac hmac;
+	BYTE client_random[32];
+	ARC_SC_PRIVATE_PACKET* serverCookie;
+	ARC_CS_PRIVATE_PACKET* clientCookie;
+
+	serverCookie = settings->ServerAutoReconnectCookie;
+	clientCookie = settings->ClientAutoReconnectCookie;
+
+	ZeroMemory(client_random, sizeof(client_random));
+
+	if (settings->ClientRandom && (settings->ClientRandomLength == sizeof(client_random)))
+		CopyMemory(client_random, settings->ClientRandom, sizeof(client_random));
+
+	hmac = crypto_hmac_new();
+	crypto_hmac_md5_init(hmac, serverCookie->arcRandomBits, sizeof(serverCookie->arcRandomBits));
+	crypto_hmac_update(hmac, client_random, sizeof(client_random));
+	crypto_hmac_final(hmac, clientCookie->securityVerifier, sizeof(clientCookie->securityVerifier));
+	crypto_hmac_free(hmac);
+}
+
 /**
  * Read Extended Info Packet (TS_EXTENDED_INFO_PACKET).\n
  * @msdn{cc240476}
@@ -178,6 +209,9 @@ void rdp_write_extended_info_packet(STREAM* s, rdpSettings* settings)
 
 	cbAutoReconnectLen = (int) settings->ClientAutoReconnectCookie->cbLen;
 
+	if (cbAutoReconnectLen > 0)
+		rdp_compute_client_auto_reconnect_cookie(settings);
+
 	stream_write_UINT16(s, clientAddressFamily); /* clientAddressFamily */
 
 	stream_write_UINT16(s, cbClientAddress + 2); /* cbClientAddress */
@@ -21,13 +21,19 @@
 #include "config.h"
 #endif
 
+#include <ctype.h>
+
 #include <winpr/crt.h>
 
+#include <freerdp/utils/file.h>
+
 #include "redirection.h"
 #include "certificate.h"
 
 #include "license.h"
 
+static const char license_store_dir[] = "licenses";
+
 #ifdef WITH_DEBUG_LICENSE
 static const char* const LICENSE_MESSAGE_STRINGS[] =
 {
@@ -207,7 +213,14 @@ BOOL license_recv(rdpLicense* license, STREAM* s)
 	{
 		case LICENSE_REQUEST:
 			license_read_license_request_packet(license, s);
-			license_send_new_license_request_packet(license);
+
+			if (license_read_stored_license(license))
+			{
+				if (!license_send_license_info_packet(license))
+					return FALSE;
+			}
+			else
+				license_send_new_license_request_packet(license);
 			break;
 
 		case PLATFORM_CHALLENGE:
@@ -601,6 +614,209 @@ void license_free_scope_list(SCOPE_LIST* scopeList)
 	free(scopeList);
 }
 
+/**
+ * Get the path of a stored license.\n
+ * Licenses issued to the client are kept in the licenses directory of the
+ * configuration path, in one file per server hostname and license scope.
+ * @param license license module
+ * @param scope license scope
+ * @return path, or NULL if the server hostname is not known
+ */
+
+static char* license_get_stored_license_path(rdpLicense* license, char* scope)
+{
+	int i;
+	char* name;
+	char* path;
+	char* store_path;
+	rdpSettings* settings;
+
+	settings = license->rdp->settings;
+
+	if (settings->ServerHostname == NULL)
+		return NULL;
+
+	store_path = freerdp_construct_path(freerdp_get_config_path(settings), (char*) license_store_dir);
+
+	if (store_path == NULL)
+		return NULL;
+
+	if (freerdp_check_file_exists(store_path) == FALSE)
+		freerdp_mkdir(store_path);
+
+	name = (char*) malloc(strlen(settings->ServerHostname) + strlen(scope) + 6);
+
+	if (name == NULL)
+	{
+		free(store_path);
+		return NULL;
+	}
+
+	sprintf(name, "%s_%s.lic", settings->ServerHostname, scope);
+
+	/* the scope comes from the server: keep the name to a single path component */
+	for (i = 0; name[i] != '\0'; i++)
+	{
+		if (!isalnum((unsigned char) name[i]) && (name[i] != '.') && (name[i] != '-'))
+			name[i] = '_';
+	}
+
+	path = freerdp_construct_path(store_path, name);
+
+	free(store_path);
+	free(name);
+
+	return path;
+}
+
+/**
+ * Look up a stored license for one of the scopes of the license request.\n
+ * On success, the license is loaded into license->license_info.
+ * @param license license module
+ * @return TRUE if a license was found
+ */
+
+BOOL license_read_stored_license(rdpLicense* license)
+{
+	UINT32 i;
+	FILE* fp;
+	long size;
+	char* path;
+	char* scope;
+	BYTE* data;
+	LICENSE_BLOB* blob;
+
+	for (i = 0; i < license->scope_list->count; i++)
+	{
+		blob = &license->scope_list->array[i];
+
+		scope = (char*) malloc(blob->length + 1);
+
+		if (scope == NULL)
+			return FALSE;
+
+		memcpy(scope, blob->data, blob->length);
+		scope[blob->length] = '\0';
+
+		path = license_get_stored_license_path(license, scope);
+		fp = (path != NULL) ? fopen(path, "rb") : NULL;
+		free(path);
+
+		if (fp == NULL)
+		{
+			free(scope);
+			continue;
+		}
+
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		if ((size > 0) && (size <= 0xFFFF))
+		{
+			data = (BYTE*) malloc(size);
+
+			if (data && (fread(data, size, 1, fp) == 1))
+			{
+				fclose(fp);
+
+				free(license->license_info->data);
+				license->license_info->data = data;
+				license->license_info->length = (UINT16) size;
+
+				free(license->license_scope);
+				license->license_scope = scope;
+
+				return TRUE;
+			}
+
+			free(data);
+		}
+
+		fclose(fp);
+		free(scope);
+	}
+
+	return FALSE;
+}
+
+/**
+ * Store a license issued by the server, replacing the previous one for the scope.
+ * @param license license module
+ * @param scope license scope
+ * @param data license (pbLicenseInfo)
+ * @param length license length
+ */
+
+void license_write_stored_license(rdpLicense* license, char* scope, BYTE* data, int length)
+{
+	FILE* fp;
+	size_t status;
+	char* path;
+	char* temp_path;
+
+	path = license_get_stored_license_path(license, scope);
+
+	if (path == NULL)
+		return;
+
+	temp_path = (char*) malloc(strlen(path) + 5);
+
+	if (temp_path == NULL)
+	{
+		free(path);
+		return;
+	}
+
+	sprintf(temp_path, "%s.tmp", path);
+
+	fp = fopen(temp_path, "wb");
+
+	if (fp == NULL)
+	{
+		printf("license_write_stored_license: error opening [%s] for writing\n", temp_path);
+	}
+	else
+	{
+		status = fwrite(data, length, 1, fp);
+
+		if (fclose(fp) != 0)
+			status = 0;
+
+		if (status != 1)
+		{
+			printf("license_write_stored_license: error writing [%s]\n", temp_path);
+			remove(temp_path);
+		}
+		else if (rename(temp_path, path) != 0)
+		{
+			printf("license_write_stored_license: error renaming [%s]\n", temp_path);
+			remove(temp_path);
+		}
+	}
+
+	free(temp_path);
+	free(path);
+}
+
+/**
+ * Forget a stored license the server did not accept.
+ * @param license license module
+ * @param scope license scope
+ */
+
+void license_delete_stored_license(rdpLicense* license, char* scope)
+{
+	char* path;
+
+	path = license_get_stored_license_path(license, scope);
+
+	if (path != NULL)
+		remove(path);
+
+	free(path);
+}
+
 /**
  * Read a LICENSE_REQUEST packet.\n
  * @msdn{cc241914}
@@ -658,6 +874,120 @@ void license_read_platform_challenge_packet(rdpLicense* license, STREAM* s)
 	license_decrypt_platform_challenge(license);
 }
 
+/**
+ * Read the license of a NEW_LICENSE or UPGRADE_LICENSE packet.\n
+ * The license is decrypted, its MAC verified and it is stored for the scope
+ * it was issued for.
+ * @msdn{cc241926}
+ * @param license license module
+ * @param s stream
+ */
+
+static void license_read_issued_license(rdpLicense* license, STREAM* s)
+{
+	STREAM* ls;
+	BYTE* data;
+	char* scope;
+	CryptoRc4 rc4;
+	UINT16 wBlobType;
+	UINT16 wBlobLen;
+	UINT32 dwVersion;
+	UINT32 cbScope;
+	UINT32 cbCompanyName;
+	UINT32 cbProductId;
+	UINT32 cbLicenseInfo;
+	BOOL complete = FALSE;
+	BYTE mac_data[16];
+
+	if (stream_get_left(s) < 4)
+		return;
+
+	/* EncryptedLicenseInfo */
+	stream_read_UINT16(s, wBlobType); /* wBlobType (2 bytes) */
+	stream_read_UINT16(s, wBlobLen); /* wBlobLen (2 bytes) */
+
+	if (stream_get_left(s) < wBlobLen + 16)
+	{
+		printf("license_read_issued_license: truncated packet\n");
+		return;
+	}
+
+	data = (BYTE*) malloc(wBlobLen);
+
+	if (data == NULL)
+		return;
+
+	rc4 = crypto_rc4_init(license->licensing_encryption_key, LICENSING_ENCRYPTION_KEY_LENGTH);
+	crypto_rc4(rc4, wBlobLen, stream_get_tail(s), data);
+	crypto_rc4_free(rc4);
+
+	stream_seek(s, wBlobLen);
+
+	/* MACData (16 bytes) */
+	security_mac_data(license->mac_salt_key, data, wBlobLen, mac_data);
+
+	if (memcmp(stream_get_tail(s), mac_data, 16) != 0)
+	{
+		printf("license_read_issued_license: invalid MAC, license not stored\n");
+		free(data);
+		return;
+	}
+
+	stream_seek(s, 16);
+
+	/* NEW_LICENSE_INFO */
+	ls = stream_new(0);
+	stream_attach(ls, data, wBlobLen);
+	scope = NULL;
+
+	if (stream_get_left(ls) < 8)
+		goto out;
+
+	stream_read_UINT32(ls, dwVersion); /* dwVersion (4 bytes) */
+	stream_read_UINT32(ls, cbScope); /* cbScope (4 bytes) */
+
+	if ((stream_get_left(ls) < 4) || (cbScope > (UINT32) stream_get_left(ls) - 4))
+		goto out;
+
+	scope = (char*) malloc(cbScope + 1);
+
+	if (scope == NULL)
+		goto out;
+
+	stream_read(ls, scope, cbScope); /* pbScope */
+	scope[cbScope] = '\0';
+
+	stream_read_UINT32(ls, cbCompanyName); /* cbCompanyName (4 bytes) */
+
+	if ((stream_get_left(ls) < 4) || (cbCompanyName > (UINT32) stream_get_left(ls) - 4))
+		goto out;
+
+	stream_seek(ls, cbCompanyName); /* pbCompanyName */
+	stream_read_UINT32(ls, cbProductId); /* cbProductId (4 bytes) */
+
+	if ((stream_get_left(ls) < 4) || (cbProductId > (UINT32) stream_get_left(ls) - 4))
+		goto out;
+
+	stream_seek(ls, cbProductId); /* pbProductId */
+	stream_read_UINT32(ls, cbLicenseInfo); /* cbLicenseInfo (4 bytes) */
+
+	if ((cbLicenseInfo < 1) || (cbLicenseInfo > (UINT32) stream_get_left(ls)))
+		goto out;
+
+	DEBUG_LICENSE("storing license version 0x%08X for scope %s", dwVersion, scope);
+	license_write_stored_license(license, scope, stream_get_tail(ls), cbLicenseInfo); /* pbLicenseInfo */
+	complete = TRUE;
+
+out:
+	if (!complete)
+		printf("license_read_issued_license: truncated license information\n");
+
+	free(scope);
+	stream_detach(ls);
+	stream_free(ls);
+	free(data);
+}
+
 /**
  * Read a NEW_LICENSE packet.\n
  * @msdn{cc241926}
@@ -668,6 +998,7 @@ void license_read_platform_challenge_packet(rdpLicense* license, STREAM* s)
 void license_read_new_license_packet(rdpLicense* license, STREAM* s)
 {
 	DEBUG_LICENSE("Receiving New License Packet");
+	license_read_issued_license(license, s);
 	license->state = LICENSE_STATE_COMPLETED;
 }
 
@@ -681,6 +1012,7 @@ void license_read_new_license_packet(rdpLicense* license, STREAM* s)
 void license_read_upgrade_license_packet(rdpLicense* license, STREAM* s)
 {
 	DEBUG_LICENSE("Receiving Upgrade License Packet");
+	license_read_issued_license(license, s);
 	license->state = LICENSE_STATE_COMPLETED;
 }
 
@@ -711,6 +1043,19 @@ void license_read_error_alert_packet(rdpLicense* license, STREAM* s)
 		return;
 	}
 
+	if (license->license_info_sent)
+	{
+		/* the stored license was refused: forget it and ask for a new one */
+		license_delete_stored_license(license, license->license_scope);
+		license->license_info_sent = FALSE;
+
+		if ((dwStateTransition == ST_RESET_PHASE_TO_START) || (dwStateTransition == ST_RESEND_LAST_MESSAGE))
+		{
+			license_send_new_license_request_packet(license);
+			return;
+		}
+	}
+
 	switch (dwStateTransition)
 	{
 		case ST_TOTAL_ABORT:
@@ -799,6 +1144,70 @@ void license_send_new_license_request_packet(rdpLicense* license)
 	license->client_machine_name->length = 0;
 }
 
+/**
+ * Write a LICENSE_INFO packet.\n
+ * @msdn{cc241917}
+ * @param license license module
+ * @param s stream
+ * @param mac_data signature
+ */
+
+void license_write_license_info_packet(rdpLicense* license, STREAM* s, BYTE* mac_data)
+{
+	stream_write_UINT32(s, KEY_EXCHANGE_ALG_RSA); /* PreferredKeyExchangeAlg (4 bytes) */
+	license_write_platform_id(license, s); /* PlatformId (4 bytes) */
+	stream_write(s, license->client_random, 32); /* ClientRandom (32 bytes) */
+	license_write_padded_binary_blob(s, license->encrypted_premaster_secret); /* EncryptedPreMasterSecret */
+	license_write_binary_blob(s, license->license_info); /* LicenseInfo */
+	license_write_binary_blob(s, license->encrypted_hwid); /* EncryptedHWID */
+	stream_write(s, mac_data, 16); /* MACData */
+}
+
+/**
+ * Send a LICENSE_INFO packet with the license loaded by license_read_stored_license().\n
+ * @msdn{cc241917}
+ * @param license license module
+ * @return FALSE if the packet could not be built
+ */
+
+BOOL license_send_license_info_packet(rdpLicense* license)
+{
+	STREAM* s;
+	BYTE* buffer;
+	CryptoRc4 rc4;
+	BYTE mac_data[16];
+
+	DEBUG_LICENSE("Sending License Info Packet, scope %s", license->license_scope);
+
+	/* MACData is computed over the unencrypted HWID */
+	security_mac_data(license->mac_salt_key, license->hwid, HWID_LENGTH, mac_data);
+
+	buffer = (BYTE*) malloc(HWID_LENGTH);
+
+	if (!buffer)
+		return FALSE;
+
+	rc4 = crypto_rc4_init(license->licensing_encryption_key, LICENSING_ENCRYPTION_KEY_LENGTH);
+	crypto_rc4(rc4, HWID_LENGTH, license->hwid, buffer);
+	crypto_rc4_free(rc4);
+
+	free(license->encrypted_hwid->data);
+	license->encrypted_hwid->type = BB_ENCRYPTED_DATA_BLOB;
+	license->encrypted_hwid->data = buffer;
+	license->encrypted_hwid->length = HWID_LENGTH;
+
+	s = license_send_stream_init(license);
+	stream_check_size(s, license->license_info->length + 256);
+
+	license_write_license_info_packet(license, s, mac_data);
+
+	license_send(license, s, LICENSE_INFO);
+
+	license->license_info_sent = TRUE;
+
+	return TRUE;
+}
+
 /**
  * Write Client Challenge Response Packet.\n
  * @msdn{cc241922}
@@ -845,10 +1254,16 @@ void license_send_platform_challenge_response_packet(rdpLicense* license)
 	free(buffer);
 
 	buffer = (BYTE*) malloc(HWID_LENGTH);
+
+	if (!buffer)
+		return FALSE;
+
 	rc4 = crypto_rc4_init(license->licensing_encryption_key, LICENSING_ENCRYPTION_KEY_LENGTH);
 	crypto_rc4(rc4, HWID_LENGTH, license->hwid, buffer);
 	crypto_rc4_free(rc4);
 
+	free(license->encrypted_hwid->data);
+
 #ifdef WITH_DEBUG_LICENSE
 	printf("Licensing Encryption Key:\n");
 	freerdp_hexdump(license->licensing_encryption_key, 16);
@@ -921,6 +1336,7 @@ rdpLicense* license_new(rdpRdp* rdp)
 		license->encrypted_platform_challenge = license_new_binary_blob(BB_ANY_BLOB);
 		license->encrypted_premaster_secret = license_new_binary_blob(BB_ANY_BLOB);
 		license->encrypted_hwid = license_new_binary_blob(BB_ENCRYPTED_DATA_BLOB);
+		license->license_info = license_new_binary_blob(BB_DATA_BLOB);
 		license->scope_list = license_new_scope_list();
 		license_generate_randoms(license);
 	}
@@ -948,7 +1364,9 @@ void license_free(rdpLicense* license)
 		license_free_binary_blob(license->encrypted_platform_challenge);
 		license_free_binary_blob(license->encrypted_premaster_secret);
 		license_free_binary_blob(license->encrypted_hwid);
+		license_free_binary_blob(license->license_info);
 		license_free_scope_list(license->scope_list);
+		free(license->license_scope);
 		free(license);
 	}
 }
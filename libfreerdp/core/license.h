@@ -153,7 +153,10 @@ struct rdp_license
 	LICENSE_BLOB* encrypted_premaster_secret;
 	LICENSE_BLOB* encrypted_platform_challenge;
 	LICENSE_BLOB* encrypted_hwid;
+	LICENSE_BLOB* license_info;
 	SCOPE_LIST* scope_list;
+	char* license_scope;
+	BOOL license_info_sent;
 };
 
 BOOL license_recv(rdpLicense* license, STREAM* s);
@@ -181,20 +184,27 @@ void license_read_scope_list(STREAM* s, SCOPE_LIST* scopeList);
 
 void license_read_license_request_packet(rdpLicense* license, STREAM* s);
 void license_read_platform_challenge_packet(rdpLicense* license, STREAM* s);
-void license_read_new_license_packet(rdpLicense* license, STREAM* s);
+FREERDP_TEST_API void license_read_new_license_packet(rdpLicense* license, STREAM* s);
 void license_read_upgrade_license_packet(rdpLicense* license, STREAM* s);
 void license_read_error_alert_packet(rdpLicense* license, STREAM* s);
 
+FREERDP_TEST_API BOOL license_read_stored_license(rdpLicense* license);
+void license_write_stored_license(rdpLicense* license, char* scope, BYTE* data, int length);
+FREERDP_TEST_API void license_delete_stored_license(rdpLicense* license, char* scope);
+
 void license_write_new_license_request_packet(rdpLicense* license, STREAM* s);
 void license_send_new_license_request_packet(rdpLicense* license);
 
+void license_write_license_info_packet(rdpLicense* license, STREAM* s, BYTE* mac_data);
+BOOL license_send_license_info_packet(rdpLicense* license);
+
 void license_write_platform_challenge_response_packet(rdpLicense* license, STREAM* s, BYTE* mac_data);
 void license_send_platform_challenge_response_packet(rdpLicense* license);
 
 BOOL license_send_valid_client_error_packet(rdpLicense* license);
 
-rdpLicense* license_new(rdpRdp* rdp);
-void license_free(rdpLicense* license);
+FREERDP_TEST_API rdpLicense* license_new(rdpRdp* rdp);
+FREERDP_TEST_API void license_free(rdpLicense* license);
 
 #ifdef WITH_DEBUG_LICENSE
 #define DEBUG_LICENSE(fmt, ...) DEBUG_CLASS(LICENSE, fmt, ## __VA_ARGS__)
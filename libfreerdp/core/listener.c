@@ -21,7 +21,12 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_ACCEPT4
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
@@ -38,6 +43,7 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <net/if.h>
 #else
 #define close(_fd) closesocket(_fd)
@@ -75,21 +81,106 @@ static const char *inet_ntop(int af, const void* src, char* dst, socklen_t cnt)
 #endif
 #endif
 
+static int freerdp_listener_socket(freerdp_listener* instance, struct addrinfo* ai, int shards)
+{
+	int status;
+	int sockfd;
+	int option_value;
+#ifdef _WIN32
+	u_long arg;
+#endif
+
+	sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+	if (sockfd == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	option_value = 1;
+
+	if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (void*) &option_value, sizeof(option_value)) == -1)
+		perror("setsockopt");
+
+#ifdef SO_REUSEPORT
+	if (shards > 1)
+	{
+		if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &option_value, sizeof(option_value)) == -1)
+			perror("setsockopt");
+	}
+#endif
+
+	/**
+	 * Accepted sockets inherit these options, which saves setting them on every
+	 * connection. The receive buffer also has to be sized before the handshake
+	 * for the window scale to account for it.
+	 */
+
+	setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (void*) &option_value, sizeof(option_value));
+
+	if (instance->SendBufferSize > 0)
+	{
+		option_value = instance->SendBufferSize;
+
+		if (setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, (void*) &option_value, sizeof(option_value)) == -1)
+			perror("setsockopt");
+	}
+
+	if (instance->ReceiveBufferSize > 0)
+	{
+		option_value = instance->ReceiveBufferSize;
+
+		if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (void*) &option_value, sizeof(option_value)) == -1)
+			perror("setsockopt");
+	}
+
+#ifndef _WIN32
+	fcntl(sockfd, F_SETFL, O_NONBLOCK);
+#else
+	arg = 1;
+	ioctlsocket(sockfd, FIONBIO, &arg);
+#endif
+
+	status = bind(sockfd, ai->ai_addr, ai->ai_addrlen);
+
+	if (status != 0)
+	{
+#ifdef _WIN32
+		_tprintf(L"bind() failed with error: %u\n", WSAGetLastError());
+		WSACleanup();
+#else
+		perror("bind");
+		close(sockfd);
+#endif
+		return -1;
+	}
+
+	status = listen(sockfd, SOMAXCONN);
+
+	if (status != 0)
+	{
+		perror("listen");
+		close(sockfd);
+		return -1;
+	}
+
+	return sockfd;
+}
+
 static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_address, UINT16 port)
 {
 	rdpListener* listener = (rdpListener*) instance->listener;
 	int status;
 	int sockfd;
+	int shard;
+	int shards;
 	char servname[10];
 	struct addrinfo hints = { 0 };
 	struct addrinfo* res;
 	struct addrinfo* ai;
-	int option_value;
 	void* sin_addr;
 	char buf[50];
-#ifdef _WIN32
-	u_long arg;
-#endif
 
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_STREAM;
@@ -97,6 +188,21 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 	if (bind_address == NULL)
 		hints.ai_flags = AI_PASSIVE;
 
+	shards = instance->Shards;
+
+	if (shards < 1)
+		shards = 1;
+	else if (shards > LISTENER_MAX_SHARDS)
+		shards = LISTENER_MAX_SHARDS;
+
+#ifndef SO_REUSEPORT
+	if (shards > 1)
+	{
+		printf("SO_REUSEPORT is not supported, listening on a single shard.\n");
+		shards = 1;
+	}
+#endif
+
 	snprintf(servname, sizeof(servname), "%d", port);
 	status = getaddrinfo(bind_address, servname, &hints, &res);
 
@@ -110,62 +216,35 @@ static BOOL freerdp_listener_open(freerdp_listener* instance, const char* bind_a
 		return FALSE;
 	}
 
-	for (ai = res; ai && listener->num_sockfds < 5; ai = ai->ai_next)
+	for (ai = res; ai && (listener->num_sockfds + shards <= LISTENER_MAX_SOCKETS); ai = ai->ai_next)
 	{
 		if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
 			continue;
 
-		sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-
-		if (sockfd == -1)
+		for (shard = 0; shard < shards; shard++)
 		{
-			perror("socket");
-			continue;
-		}
-
-		option_value = 1;
-
-		if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (void*) &option_value, sizeof(option_value)) == -1)
-			perror("setsockopt");
+			sockfd = freerdp_listener_socket(instance, ai, shards);
 
-#ifndef _WIN32
-		fcntl(sockfd, F_SETFL, O_NONBLOCK);
-#else
-		arg = 1;
-		ioctlsocket(sockfd, FIONBIO, &arg);
-#endif
+			if (sockfd == -1)
+				break;
 
-		status = bind(sockfd, ai->ai_addr, ai->ai_addrlen);
-
-		if (status != 0)
-		{
-#ifdef _WIN32
-			_tprintf(L"bind() failed with error: %u\n", WSAGetLastError());
-			WSACleanup();
-#else
-			perror("bind");
-			close(sockfd);
-#endif
-			continue;
+			listener->sockfds[listener->num_sockfds] = sockfd;
+			listener->shards[listener->num_sockfds] = shard;
+			listener->num_sockfds++;
 		}
 
-		status = listen(sockfd, 10);
-
-		if (status != 0)
-		{
-			perror("listen");
-			close(sockfd);
+		if (shard < 1)
 			continue;
-		}
-
-		listener->sockfds[listener->num_sockfds++] = sockfd;
 
 		if (ai->ai_family == AF_INET)
 			sin_addr = &(((struct sockaddr_in*) ai->ai_addr)->sin_addr);
 		else
 			sin_addr = &(((struct sockaddr_in6*) ai->ai_addr)->sin6_addr);
 
-		printf("Listening on %s port %s.\n", inet_ntop(ai->ai_family, sin_addr, buf, sizeof(buf)), servname);
+		if (shard > 1)
+			printf("Listening on %s port %s, %d shards.\n", inet_ntop(ai->ai_family, sin_addr, buf, sizeof(buf)), servname, shard);
+		else
+			printf("Listening on %s port %s.\n", inet_ntop(ai->ai_family, sin_addr, buf, sizeof(buf)), servname);
 	}
 
 	freeaddrinfo(res);
@@ -189,6 +268,12 @@ static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char*
 		return FALSE;
 	}
 
+	if (listener->num_sockfds >= LISTENER_MAX_SOCKETS)
+	{
+		close(sockfd);
+		return FALSE;
+	}
+
 	fcntl(sockfd, F_SETFL, O_NONBLOCK);
 
 	addr.sun_family = AF_UNIX;
@@ -213,7 +298,9 @@ static BOOL freerdp_listener_open_local(freerdp_listener* instance, const char*
 		return FALSE;
 	}
 
-	listener->sockfds[listener->num_sockfds++] = sockfd;
+	listener->sockfds[listener->num_sockfds] = sockfd;
+	listener->shards[listener->num_sockfds] = 0;
+	listener->num_sockfds++;
 
 	printf("Listening on socket %s.\n", addr.sun_path);
 
@@ -254,23 +341,46 @@ static BOOL freerdp_listener_get_fds(freerdp_listener* instance, void** rfds, in
 	return TRUE;
 }
 
-static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
+static BOOL freerdp_listener_get_shard_fds(freerdp_listener* instance, int shard, void** rfds, int* rcount)
 {
 	int i;
+	BOOL found = FALSE;
+	rdpListener* listener = (rdpListener*) instance->listener;
+
+	for (i = 0; i < listener->num_sockfds; i++)
+	{
+		if (listener->shards[i] != shard)
+			continue;
+
+		rfds[*rcount] = (void*)(long)(listener->sockfds[i]);
+		(*rcount)++;
+		found = TRUE;
+	}
+
+	return found;
+}
+
+/**
+ * Accepts every pending connection: a single wakeup may stand for many
+ * connections when clients arrive in bursts.
+ */
+
+static BOOL freerdp_listener_accept(freerdp_listener* instance, int sockfd)
+{
 	void* sin_addr;
 	int peer_sockfd;
 	freerdp_peer* client;
 	socklen_t peer_addr_size;
 	struct sockaddr_storage peer_addr;
-	rdpListener* listener = (rdpListener*) instance->listener;
 
-	if (listener->num_sockfds < 1)
-		return FALSE;
-
-	for (i = 0; i < listener->num_sockfds; i++)
+	while (1)
 	{
 		peer_addr_size = sizeof(peer_addr);
-		peer_sockfd = accept(listener->sockfds[i], (struct sockaddr*) &peer_addr, &peer_addr_size);
+#ifdef HAVE_ACCEPT4
+		peer_sockfd = accept4(sockfd, (struct sockaddr*) &peer_addr, &peer_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		peer_sockfd = accept(sockfd, (struct sockaddr*) &peer_addr, &peer_addr_size);
+#endif
 
 		if (peer_sockfd == -1)
 		{
@@ -279,15 +389,27 @@ static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 
 			/* No data available */
 			if (wsa_error == WSAEWOULDBLOCK)
+				return TRUE;
+
+			if (wsa_error == WSAECONNRESET)
 				continue;
 #else
 			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return TRUE;
+
+			/* the client went away while queued */
+			if (errno == EINTR || errno == ECONNABORTED)
 				continue;
 #endif
 			perror("accept");
 			return FALSE;
 		}
 
+#if !defined(HAVE_ACCEPT4) && !defined(_WIN32)
+		fcntl(peer_sockfd, F_SETFL, O_NONBLOCK);
+		fcntl(peer_sockfd, F_SETFD, FD_CLOEXEC);
+#endif
+
 		client = freerdp_peer_new(peer_sockfd);
 
 		sin_addr = NULL;
@@ -305,10 +427,45 @@ static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
 
 		IFCALL(instance->PeerAccepted, instance, client);
 	}
+}
+
+static BOOL freerdp_listener_check_fds(freerdp_listener* instance)
+{
+	int i;
+	rdpListener* listener = (rdpListener*) instance->listener;
+
+	if (listener->num_sockfds < 1)
+		return FALSE;
+
+	for (i = 0; i < listener->num_sockfds; i++)
+	{
+		if (!freerdp_listener_accept(instance, listener->sockfds[i]))
+			return FALSE;
+	}
 
 	return TRUE;
 }
 
+static BOOL freerdp_listener_check_shard_fds(freerdp_listener* instance, int shard)
+{
+	int i;
+	BOOL found = FALSE;
+	rdpListener* listener = (rdpListener*) instance->listener;
+
+	for (i = 0; i < listener->num_sockfds; i++)
+	{
+		if (listener->shards[i] != shard)
+			continue;
+
+		if (!freerdp_listener_accept(instance, listener->sockfds[i]))
+			return FALSE;
+
+		found = TRUE;
+	}
+
+	return found;
+}
+
 freerdp_listener* freerdp_listener_new(void)
 {
 	freerdp_listener* instance;
@@ -321,6 +478,8 @@ freerdp_listener* freerdp_listener_new(void)
 	instance->OpenLocal = freerdp_listener_open_local;
 	instance->GetFileDescriptor = freerdp_listener_get_fds;
 	instance->CheckFileDescriptor = freerdp_listener_check_fds;
+	instance->GetShardFileDescriptor = freerdp_listener_get_shard_fds;
+	instance->CheckShardFileDescriptor = freerdp_listener_check_shard_fds;
 	instance->Close = freerdp_listener_close;
 
 	listener = (rdpListener*) malloc(sizeof(rdpListener));
@@ -25,11 +25,15 @@ typedef struct rdp_listener rdpListener;
 #include "rdp.h"
 #include <freerdp/listener.h>
 
+#define LISTENER_MAX_SOCKETS	64
+#define LISTENER_MAX_SHARDS	16
+
 struct rdp_listener
 {
 	freerdp_listener* instance;
 
- 	int sockfds[5];
+	int sockfds[LISTENER_MAX_SOCKETS];
+	int shards[LISTENER_MAX_SOCKETS];
 	int num_sockfds;
 };
 
@@ -719,16 +719,36 @@ BOOL mcs_recv_channel_join_request(rdpMcs* mcs, STREAM* s, UINT16* channel_id)
  * @param channel_id channel id
  */
 
+static void mcs_write_channel_join_request(rdpMcs* mcs, STREAM* s, UINT16 channel_id)
+{
+	mcs_write_domain_mcspdu_header(s, DomainMCSPDU_ChannelJoinRequest, 12, 0);
+
+	per_write_integer16(s, mcs->user_id, MCS_BASE_CHANNEL_ID);
+	per_write_integer16(s, channel_id, 0);
+}
+
 BOOL mcs_send_channel_join_request(rdpMcs* mcs, UINT16 channel_id)
 {
+	return mcs_send_channel_join_requests(mcs, &channel_id, 1);
+}
+
+/**
+ * Send several MCS Channel Join Requests at once, without waiting for
+ * the confirms in between. The server may confirm them in any order.
+ * @param mcs mcs module
+ * @param channel_ids channel ids
+ * @param count number of channels
+ */
+
+BOOL mcs_send_channel_join_requests(rdpMcs* mcs, UINT16* channel_ids, int count)
+{
+	int index;
 	STREAM* s;
-	UINT16 length = 12;
-	s = transport_send_stream_init(mcs->transport, 12);
 
-	mcs_write_domain_mcspdu_header(s, DomainMCSPDU_ChannelJoinRequest, length, 0);
+	s = transport_send_stream_init(mcs->transport, 12 * count);
 
-	per_write_integer16(s, mcs->user_id, MCS_BASE_CHANNEL_ID);
-	per_write_integer16(s, channel_id, 0);
+	for (index = 0; index < count; index++)
+		mcs_write_channel_join_request(mcs, s, channel_ids[index]);
 
 	if (transport_write(mcs->transport, s) < 0)
 		return FALSE;
@@ -768,20 +788,40 @@ BOOL mcs_recv_channel_join_confirm(rdpMcs* mcs, STREAM* s, UINT16* channel_id)
  * @param mcs mcs module
  */
 
-BOOL mcs_send_channel_join_confirm(rdpMcs* mcs, UINT16 channel_id)
+static void mcs_write_channel_join_confirm(rdpMcs* mcs, STREAM* s, UINT16 channel_id)
 {
-	STREAM* s;
-	UINT16 length = 15;
-	s = transport_send_stream_init(mcs->transport, 15);
-
-	mcs_write_domain_mcspdu_header(s, DomainMCSPDU_ChannelJoinConfirm, length, 2);
+	mcs_write_domain_mcspdu_header(s, DomainMCSPDU_ChannelJoinConfirm, 15, 2);
 
 	per_write_enumerated(s, 0, MCS_Result_enum_length); /* result */
 	per_write_integer16(s, mcs->user_id, MCS_BASE_CHANNEL_ID); /* initiator (UserId) */
 	per_write_integer16(s, channel_id, 0); /* requested (ChannelId) */
 	per_write_integer16(s, channel_id, 0); /* channelId */
+}
 
-	transport_write(mcs->transport, s);
+BOOL mcs_send_channel_join_confirm(rdpMcs* mcs, UINT16 channel_id)
+{
+	return mcs_send_channel_join_confirms(mcs, &channel_id, 1);
+}
+
+/**
+ * Send several MCS Channel Join Confirms at once.
+ * @param mcs mcs module
+ * @param channel_ids channel ids
+ * @param count number of channels
+ */
+
+BOOL mcs_send_channel_join_confirms(rdpMcs* mcs, UINT16* channel_ids, int count)
+{
+	int index;
+	STREAM* s;
+
+	s = transport_send_stream_init(mcs->transport, 15 * count);
+
+	for (index = 0; index < count; index++)
+		mcs_write_channel_join_confirm(mcs, s, channel_ids[index]);
+
+	if (transport_write(mcs->transport, s) < 0)
+		return FALSE;
 
 	return TRUE;
 }
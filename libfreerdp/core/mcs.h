@@ -110,6 +110,11 @@ typedef struct
 	UINT32 protocolVersion;
 } DomainParameters;
 
+#define MCS_SEND_DATA_HEADER_MAX_LENGTH		8
+
+/* user channel, I/O channel and up to 32 static virtual channels */
+#define MCS_MAX_CHANNEL_JOINS			34
+
 struct rdp_mcs
 {
 	UINT16 user_id;
@@ -121,10 +126,12 @@ struct rdp_mcs
 
 	BOOL user_channel_joined;
 	BOOL global_channel_joined;
+
+	int join_confirm_count;
+	UINT16 join_confirms[MCS_MAX_CHANNEL_JOINS];
 };
 typedef struct rdp_mcs rdpMcs;
 
-#define MCS_SEND_DATA_HEADER_MAX_LENGTH		8
 
 #define MCS_TYPE_CONNECT_INITIAL		0x65
 #define MCS_TYPE_CONNECT_RESPONSE		0x66
@@ -144,8 +151,10 @@ BOOL mcs_recv_attach_user_confirm(rdpMcs* mcs, STREAM* s);
 BOOL mcs_send_attach_user_confirm(rdpMcs* mcs);
 BOOL mcs_recv_channel_join_request(rdpMcs* mcs, STREAM* s, UINT16* channel_id);
 BOOL mcs_send_channel_join_request(rdpMcs* mcs, UINT16 channel_id);
+BOOL mcs_send_channel_join_requests(rdpMcs* mcs, UINT16* channel_ids, int count);
 BOOL mcs_recv_channel_join_confirm(rdpMcs* mcs, STREAM* s, UINT16* channel_id);
 BOOL mcs_send_channel_join_confirm(rdpMcs* mcs, UINT16 channel_id);
+BOOL mcs_send_channel_join_confirms(rdpMcs* mcs, UINT16* channel_ids, int count);
 BOOL mcs_send_disconnect_provider_ultimatum(rdpMcs* mcs);
 BOOL mcs_read_domain_mcspdu_header(STREAM* s, enum DomainMCSPDU* domainMCSPDU, UINT16* length);
 void mcs_write_domain_mcspdu_header(STREAM* s, enum DomainMCSPDU domainMCSPDU, UINT16 length, BYTE options);
@@ -94,6 +94,7 @@
 
 void credssp_send(rdpCredssp* credssp);
 int credssp_recv(rdpCredssp* credssp);
+int credssp_decode_ts_request(rdpCredssp* credssp, STREAM* s);
 void credssp_buffer_print(rdpCredssp* credssp);
 void credssp_buffer_free(rdpCredssp* credssp);
 SECURITY_STATUS credssp_encrypt_public_key_echo(rdpCredssp* credssp);
@@ -118,6 +119,10 @@ int credssp_ntlm_client_init(rdpCredssp* credssp)
 
 	if ((settings->Password == NULL) || (settings->Username == NULL))
 	{
+		/* nobody is there to answer a prompt during an automatic reconnection */
+		if (settings->ClientAutoReconnectCookie->cbLen > 0)
+			return 0;
+
 		if (instance->Authenticate)
 		{
 			BOOL proceed = instance->Authenticate(instance,
@@ -373,27 +378,23 @@ int credssp_client_authenticate(rdpCredssp* credssp)
  * @return 1 if authentication is successful
  */
 
-int credssp_server_authenticate(rdpCredssp* credssp)
+/**
+ * Prepare server-side CredSSP: the client's TSRequests are then handed one
+ * at a time to credssp_server_recv(), so that a server can drive many
+ * authentications from a single thread without blocking between legs.
+ * @param credssp
+ * @return 1 if successful, -1 on failure
+ */
+
+int credssp_server_begin(rdpCredssp* credssp)
 {
-	UINT32 cbMaxToken;
-	ULONG fContextReq;
-	ULONG pfContextAttr;
 	SECURITY_STATUS status;
-	CredHandle credentials;
 	TimeStamp expiration;
-	PSecPkgInfo pPackageInfo;
-	SecBuffer input_buffer;
-	SecBuffer output_buffer;
-	SecBufferDesc input_buffer_desc;
-	SecBufferDesc output_buffer_desc;
-	BOOL have_context;
-	BOOL have_input_buffer;
-	BOOL have_pub_key_auth;
 
 	sspi_GlobalInit();
 
 	if (credssp_ntlm_server_init(credssp) == 0)
-		return 0;
+		return -1;
 
 #ifdef WITH_NATIVE_SSPI
 	if (!credssp->SspiModule)
@@ -410,7 +411,7 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 		if (!hSSPI)
 		{
 			_tprintf(_T("Failed to load SSPI module: %s\n"), credssp->SspiModule);
-			return 0;
+			return -1;
 		}
 
 #ifdef UNICODE
@@ -428,32 +429,27 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	}
 #endif
 
-	status = credssp->table->QuerySecurityPackageInfo(NLA_PKG_NAME, &pPackageInfo);
+	status = credssp->table->QuerySecurityPackageInfo(NLA_PKG_NAME, &credssp->pPackageInfo);
 
 	if (status != SEC_E_OK)
 	{
 		printf("QuerySecurityPackageInfo status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 
-	cbMaxToken = pPackageInfo->cbMaxToken;
+	credssp->cbMaxToken = credssp->pPackageInfo->cbMaxToken;
 
 	status = credssp->table->AcquireCredentialsHandle(NULL, NLA_PKG_NAME,
-			SECPKG_CRED_INBOUND, NULL, NULL, NULL, NULL, &credentials, &expiration);
+			SECPKG_CRED_INBOUND, NULL, NULL, NULL, NULL, &credssp->credentials, &expiration);
 
 	if (status != SEC_E_OK)
 	{
 		printf("AcquireCredentialsHandle status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 
-	have_context = FALSE;
-	have_input_buffer = FALSE;
-	have_pub_key_auth = FALSE;
-	ZeroMemory(&input_buffer, sizeof(SecBuffer));
-	ZeroMemory(&output_buffer, sizeof(SecBuffer));
-	ZeroMemory(&input_buffer_desc, sizeof(SecBufferDesc));
-	ZeroMemory(&output_buffer_desc, sizeof(SecBufferDesc));
+	credssp->have_credentials = TRUE;
+	credssp->have_context = FALSE;
 	ZeroMemory(&credssp->ContextSizes, sizeof(SecPkgContext_Sizes));
 
 	/* 
@@ -463,135 +459,146 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	 * ASC_REQ_ALLOCATE_MEMORY
 	 */
 
-	fContextReq = 0;
-	fContextReq |= ASC_REQ_MUTUAL_AUTH;
-	fContextReq |= ASC_REQ_CONFIDENTIALITY;
+	credssp->fContextReq = 0;
+	credssp->fContextReq |= ASC_REQ_MUTUAL_AUTH;
+	credssp->fContextReq |= ASC_REQ_CONFIDENTIALITY;
 
-	fContextReq |= ASC_REQ_CONNECTION;
-	fContextReq |= ASC_REQ_USE_SESSION_KEY;
+	credssp->fContextReq |= ASC_REQ_CONNECTION;
+	credssp->fContextReq |= ASC_REQ_USE_SESSION_KEY;
 
-	fContextReq |= ASC_REQ_REPLAY_DETECT;
-	fContextReq |= ASC_REQ_SEQUENCE_DETECT;
+	credssp->fContextReq |= ASC_REQ_REPLAY_DETECT;
+	credssp->fContextReq |= ASC_REQ_SEQUENCE_DETECT;
 
-	fContextReq |= ASC_REQ_EXTENDED_ERROR;
+	credssp->fContextReq |= ASC_REQ_EXTENDED_ERROR;
 
-	while (TRUE)
-	{
-		input_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		input_buffer_desc.cBuffers = 1;
-		input_buffer_desc.pBuffers = &input_buffer;
-		input_buffer.BufferType = SECBUFFER_TOKEN;
+	credssp->state = CREDSSP_STATE_NEGO;
 
-		/* receive authentication token */
+	return 1;
+}
 
-		input_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		input_buffer_desc.cBuffers = 1;
-		input_buffer_desc.pBuffers = &input_buffer;
-		input_buffer.BufferType = SECBUFFER_TOKEN;
+/**
+ * Process an authentication token from the client and send the answer.
+ * @param credssp
+ * @return 1 once the security context is established, 0 if another token
+ * is expected, -1 on failure
+ */
 
-		if (credssp_recv(credssp) < 0)
-			return -1;
+static int credssp_server_accept_token(rdpCredssp* credssp)
+{
+	ULONG pfContextAttr;
+	SECURITY_STATUS status;
+	TimeStamp expiration;
+	SecBuffer input_buffer;
+	SecBuffer output_buffer;
+	SecBufferDesc input_buffer_desc;
+	SecBufferDesc output_buffer_desc;
+
+	ZeroMemory(&input_buffer, sizeof(SecBuffer));
+	ZeroMemory(&output_buffer, sizeof(SecBuffer));
+
+	input_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	input_buffer_desc.cBuffers = 1;
+	input_buffer_desc.pBuffers = &input_buffer;
+	input_buffer.BufferType = SECBUFFER_TOKEN;
 
 #ifdef WITH_DEBUG_CREDSSP
-		printf("Receiving Authentication Token\n");
-		credssp_buffer_print(credssp);
+	printf("Receiving Authentication Token\n");
+	credssp_buffer_print(credssp);
 #endif
 
-		input_buffer.pvBuffer = credssp->negoToken.pvBuffer;
-		input_buffer.cbBuffer = credssp->negoToken.cbBuffer;
+	input_buffer.pvBuffer = credssp->negoToken.pvBuffer;
+	input_buffer.cbBuffer = credssp->negoToken.cbBuffer;
 
-		if (credssp->negoToken.cbBuffer < 1)
-		{
-			printf("CredSSP: invalid negoToken!\n");
-			return -1;
-		}
+	if (credssp->negoToken.cbBuffer < 1)
+	{
+		printf("CredSSP: invalid negoToken!\n");
+		return -1;
+	}
 
-		output_buffer_desc.ulVersion = SECBUFFER_VERSION;
-		output_buffer_desc.cBuffers = 1;
-		output_buffer_desc.pBuffers = &output_buffer;
-		output_buffer.BufferType = SECBUFFER_TOKEN;
-		output_buffer.cbBuffer = cbMaxToken;
-		output_buffer.pvBuffer = malloc(output_buffer.cbBuffer);
+	output_buffer_desc.ulVersion = SECBUFFER_VERSION;
+	output_buffer_desc.cBuffers = 1;
+	output_buffer_desc.pBuffers = &output_buffer;
+	output_buffer.BufferType = SECBUFFER_TOKEN;
+	output_buffer.cbBuffer = credssp->cbMaxToken;
+	output_buffer.pvBuffer = malloc(output_buffer.cbBuffer);
 
-		status = credssp->table->AcceptSecurityContext(&credentials,
-			have_context? &credssp->context: NULL,
-			&input_buffer_desc, fContextReq, SECURITY_NATIVE_DREP, &credssp->context,
-			&output_buffer_desc, &pfContextAttr, &expiration);
+	status = credssp->table->AcceptSecurityContext(&credssp->credentials,
+		credssp->have_context ? &credssp->context : NULL,
+		&input_buffer_desc, credssp->fContextReq, SECURITY_NATIVE_DREP, &credssp->context,
+		&output_buffer_desc, &pfContextAttr, &expiration);
 
-		credssp->negoToken.pvBuffer = output_buffer.pvBuffer;
-		credssp->negoToken.cbBuffer = output_buffer.cbBuffer;
+	credssp->negoToken.pvBuffer = output_buffer.pvBuffer;
+	credssp->negoToken.cbBuffer = output_buffer.cbBuffer;
 
-		if ((status == SEC_I_COMPLETE_AND_CONTINUE) || (status == SEC_I_COMPLETE_NEEDED))
-		{
-			if (credssp->table->CompleteAuthToken != NULL)
-				credssp->table->CompleteAuthToken(&credssp->context, &output_buffer_desc);
+	if ((status == SEC_I_COMPLETE_AND_CONTINUE) || (status == SEC_I_COMPLETE_NEEDED))
+	{
+		if (credssp->table->CompleteAuthToken != NULL)
+			credssp->table->CompleteAuthToken(&credssp->context, &output_buffer_desc);
 
-			if (status == SEC_I_COMPLETE_NEEDED)
-				status = SEC_E_OK;
-			else if (status == SEC_I_COMPLETE_AND_CONTINUE)
-				status = SEC_I_CONTINUE_NEEDED;
-		}
+		if (status == SEC_I_COMPLETE_NEEDED)
+			status = SEC_E_OK;
+		else if (status == SEC_I_COMPLETE_AND_CONTINUE)
+			status = SEC_I_CONTINUE_NEEDED;
+	}
 
-		if (status == SEC_E_OK)
+	if (status == SEC_E_OK)
+	{
+		if (credssp->table->QueryContextAttributes(&credssp->context, SECPKG_ATTR_SIZES, &credssp->ContextSizes) != SEC_E_OK)
 		{
-			have_pub_key_auth = TRUE;
-
-			if (credssp->table->QueryContextAttributes(&credssp->context, SECPKG_ATTR_SIZES, &credssp->ContextSizes) != SEC_E_OK)
-			{
-				printf("QueryContextAttributes SECPKG_ATTR_SIZES failure\n");
-				return 0;
-			}
-
-			if (credssp_decrypt_public_key_echo(credssp) != SEC_E_OK)
-			{
-				printf("Error: could not verify client's public key echo\n");
-				return -1;
-			}
-
-			sspi_SecBufferFree(&credssp->negoToken);
-			credssp->negoToken.pvBuffer = NULL;
-			credssp->negoToken.cbBuffer = 0;
-
-			credssp_encrypt_public_key_echo(credssp);
+			printf("QueryContextAttributes SECPKG_ATTR_SIZES failure\n");
+			return -1;
 		}
 
-		if ((status != SEC_E_OK) && (status != SEC_I_CONTINUE_NEEDED))
+		if (credssp_decrypt_public_key_echo(credssp) != SEC_E_OK)
 		{
-			printf("AcceptSecurityContext status: 0x%08X\n", status);
+			printf("Error: could not verify client's public key echo\n");
 			return -1;
 		}
 
-		/* send authentication token */
+		sspi_SecBufferFree(&credssp->negoToken);
+		credssp->negoToken.pvBuffer = NULL;
+		credssp->negoToken.cbBuffer = 0;
+
+		credssp_encrypt_public_key_echo(credssp);
+	}
+
+	if ((status != SEC_E_OK) && (status != SEC_I_CONTINUE_NEEDED))
+	{
+		printf("AcceptSecurityContext status: 0x%08X\n", status);
+		return -1;
+	}
+
+	/* send authentication token */
 
 #ifdef WITH_DEBUG_CREDSSP
-		printf("Sending Authentication Token\n");
-		credssp_buffer_print(credssp);
+	printf("Sending Authentication Token\n");
+	credssp_buffer_print(credssp);
 #endif
 
-		credssp_send(credssp);
-		credssp_buffer_free(credssp);
+	credssp_send(credssp);
+	credssp_buffer_free(credssp);
 
-		if (status != SEC_I_CONTINUE_NEEDED)
-			break;
+	credssp->have_context = TRUE;
 
-		have_context = TRUE;
-	}
+	return (status == SEC_I_CONTINUE_NEEDED) ? 0 : 1;
+}
 
-	/* Receive encrypted credentials */
+/**
+ * Decrypt the client's credentials, which conclude the exchange.
+ * @param credssp
+ * @return 1 if successful, -1 on failure
+ */
 
-	if (credssp_recv(credssp) < 0)
-		return -1;
+static int credssp_server_accept_credentials(rdpCredssp* credssp)
+{
+	SECURITY_STATUS status;
 
-	if (credssp_decrypt_ts_credentials(credssp) != SEC_E_OK)
-	{
-		printf("Could not decrypt TSCredentials status: 0x%08X\n", status);
-		return 0;
-	}
+	status = credssp_decrypt_ts_credentials(credssp);
 
 	if (status != SEC_E_OK)
 	{
-		printf("AcceptSecurityContext status: 0x%08X\n", status);
-		return 0;
+		printf("Could not decrypt TSCredentials status: 0x%08X\n", status);
+		return -1;
 	}
 
 	status = credssp->table->ImpersonateSecurityContext(&credssp->context);
@@ -599,7 +606,7 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 	if (status != SEC_E_OK)
 	{
 		printf("ImpersonateSecurityContext status: 0x%08X\n", status);
-		return 0;
+		return -1;
 	}
 	else
 	{
@@ -608,15 +615,85 @@ int credssp_server_authenticate(rdpCredssp* credssp)
 		if (status != SEC_E_OK)
 		{
 			printf("RevertSecurityContext status: 0x%08X\n", status);
-			return 0;
+			return -1;
 		}
 	}
 
-	credssp->table->FreeContextBuffer(pPackageInfo);
+	credssp->table->FreeContextBuffer(credssp->pPackageInfo);
+	credssp->pPackageInfo = NULL;
 
 	return 1;
 }
 
+/**
+ * Advance server-side CredSSP with the TSRequest last decoded from the client.
+ * @param credssp
+ * @return 1 once the client is authenticated, 0 if another TSRequest is
+ * expected, -1 on failure
+ */
+
+static int credssp_server_step(rdpCredssp* credssp)
+{
+	int status;
+
+	switch (credssp->state)
+	{
+		case CREDSSP_STATE_NEGO:
+			status = credssp_server_accept_token(credssp);
+
+			if (status > 0)
+				credssp->state = CREDSSP_STATE_CREDENTIALS;
+
+			return (status < 0) ? -1 : 0;
+
+		case CREDSSP_STATE_CREDENTIALS:
+			if (credssp_server_accept_credentials(credssp) < 0)
+				return -1;
+
+			credssp->state = CREDSSP_STATE_FINAL;
+			return 1;
+
+		default:
+			printf("CredSSP: unexpected TSRequest in state %d\n", credssp->state);
+			return -1;
+	}
+}
+
+/**
+ * Process a complete TSRequest received from the client.
+ * @param credssp
+ * @param s stream holding exactly one TSRequest
+ * @return 1 once the client is authenticated, 0 if another TSRequest is
+ * expected, -1 on failure
+ */
+
+int credssp_server_recv(rdpCredssp* credssp, STREAM* s)
+{
+	if (credssp_decode_ts_request(credssp, s) < 0)
+		return -1;
+
+	return credssp_server_step(credssp);
+}
+
+int credssp_server_authenticate(rdpCredssp* credssp)
+{
+	int status;
+
+	if (credssp_server_begin(credssp) < 0)
+		return -1;
+
+	do
+	{
+		if (credssp_recv(credssp) < 0)
+			return -1;
+
+		status = credssp_server_step(credssp);
+	}
+	while (status == 0);
+
+	return status;
+}
+
 /**
  * Authenticate using CredSSP.
  * @param credssp
@@ -1141,9 +1218,7 @@ void credssp_send(rdpCredssp* credssp)
 int credssp_recv(rdpCredssp* credssp)
 {
 	STREAM* s;
-	int length;
 	int status;
-	UINT32 version;
 
 	s = stream_new(4096);
 
@@ -1157,8 +1232,29 @@ int credssp_recv(rdpCredssp* credssp)
 		return -1;
 	}
 
+	status = credssp_decode_ts_request(credssp, s);
+
+	stream_free(s);
+
+	return status;
+}
+
+/**
+ * Decode a TSRequest.
+ * @param credssp
+ * @param s
+ * @return 0 if successful, -1 on failure
+ */
+
+int credssp_decode_ts_request(rdpCredssp* credssp, STREAM* s)
+{
+	int length;
+	UINT32 version;
+
 	/* TSRequest */
-	ber_read_sequence_tag(s, &length);
+	if (!ber_read_sequence_tag(s, &length))
+		return -1;
+
 	ber_read_contextual_tag(s, 0, &length, TRUE);
 	ber_read_integer(s, &version);
 
@@ -1169,6 +1265,10 @@ int credssp_recv(rdpCredssp* credssp)
 		ber_read_sequence_tag(s, &length); /* NegoDataItem */
 		ber_read_contextual_tag(s, 0, &length, TRUE); /* [0] negoToken */
 		ber_read_octet_string_tag(s, &length); /* OCTET STRING */
+
+		if (stream_get_left(s) < length)
+			return -1;
+
 		sspi_SecBufferAlloc(&credssp->negoToken, length);
 		stream_read(s, credssp->negoToken.pvBuffer, length);
 		credssp->negoToken.cbBuffer = length;
@@ -1178,6 +1278,10 @@ int credssp_recv(rdpCredssp* credssp)
 	if (ber_read_contextual_tag(s, 2, &length, TRUE) != FALSE)
 	{
 		ber_read_octet_string_tag(s, &length); /* OCTET STRING */
+
+		if (stream_get_left(s) < length)
+			return -1;
+
 		sspi_SecBufferAlloc(&credssp->authInfo, length);
 		stream_read(s, credssp->authInfo.pvBuffer, length);
 		credssp->authInfo.cbBuffer = length;
@@ -1187,13 +1291,15 @@ int credssp_recv(rdpCredssp* credssp)
 	if (ber_read_contextual_tag(s, 3, &length, TRUE) != FALSE)
 	{
 		ber_read_octet_string_tag(s, &length); /* OCTET STRING */
+
+		if (stream_get_left(s) < length)
+			return -1;
+
 		sspi_SecBufferAlloc(&credssp->pubKeyAuth, length);
 		stream_read(s, credssp->pubKeyAuth.pvBuffer, length);
 		credssp->pubKeyAuth.cbBuffer = length;
 	}
 
-	stream_free(s);
-
 	return 0;
 }
 
@@ -1296,6 +1402,12 @@ void credssp_free(rdpCredssp* credssp)
 		if (credssp->table)
 			credssp->table->DeleteSecurityContext(&credssp->context);
 
+		if (credssp->have_credentials)
+			credssp->table->FreeCredentialsHandle(&credssp->credentials);
+
+		if (credssp->pPackageInfo)
+			credssp->table->FreeContextBuffer(credssp->pPackageInfo);
+
 		sspi_SecBufferFree(&credssp->PublicKey);
 		sspi_SecBufferFree(&credssp->ts_credentials);
 
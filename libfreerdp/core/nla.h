@@ -35,6 +35,14 @@ typedef struct rdp_credssp rdpCredssp;
 
 #include "transport.h"
 
+enum CREDSSP_STATE
+{
+	CREDSSP_STATE_INITIAL = 0,
+	CREDSSP_STATE_NEGO,
+	CREDSSP_STATE_CREDENTIALS,
+	CREDSSP_STATE_FINAL
+};
+
 struct rdp_credssp
 {
 	BOOL server;
@@ -55,10 +63,21 @@ struct rdp_credssp
 	SEC_WINNT_AUTH_IDENTITY identity;
 	PSecurityFunctionTable table;
 	SecPkgContext_Sizes ContextSizes;
+
+	int state;
+	BOOL have_context;
+	BOOL have_credentials;
+	ULONG fContextReq;
+	UINT32 cbMaxToken;
+	CredHandle credentials;
+	PSecPkgInfo pPackageInfo;
 };
 
 int credssp_authenticate(rdpCredssp* credssp);
 
+int credssp_server_begin(rdpCredssp* credssp);
+int credssp_server_recv(rdpCredssp* credssp, STREAM* s);
+
 rdpCredssp* credssp_new(freerdp* instance, rdpTransport* transport, rdpSettings* settings);
 void credssp_free(rdpCredssp* credssp);
 
@@ -71,9 +71,9 @@ struct rdp_ntlm_http
 	HttpContext* context;
 };
 
-BOOL ntlm_authenticate(rdpNtlm* ntlm);
+FREERDP_TEST_API BOOL ntlm_authenticate(rdpNtlm* ntlm);
 
-BOOL ntlm_client_init(rdpNtlm* ntlm, BOOL confidentiality, char* user, char* domain, char* password);
+FREERDP_TEST_API BOOL ntlm_client_init(rdpNtlm* ntlm, BOOL confidentiality, char* user, char* domain, char* password);
 void ntlm_client_uninit(rdpNtlm* ntlm);
 
 BOOL ntlm_client_make_spn(rdpNtlm* ntlm, LPCTSTR ServiceClass, char* hostname);
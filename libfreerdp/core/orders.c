@@ -361,16 +361,13 @@ static INLINE void update_read_brush(STREAM* s, rdpBrush* brush, BYTE fieldFlags
 	}
 }
 
-static INLINE void update_read_delta_rects(STREAM* s, DELTA_RECT* rectangles, int number)
+static INLINE void update_parse_delta_rects(STREAM* s, DELTA_RECT* rectangles, int number)
 {
 	int i;
 	BYTE flags = 0;
 	BYTE* zeroBits;
 	int zeroBitsSize;
 
-	if (number > 45)
-		number = 45;
-
 	zeroBitsSize = ((number + 1) / 2);
 
 	stream_get_mark(s, zeroBits);
@@ -406,6 +403,45 @@ static INLINE void update_read_delta_rects(STREAM* s, DELTA_RECT* rectangles, in
 	}
 }
 
+/**
+ * The order rectangles are 1-based, which leaves room for 44 of the 45
+ * rectangles the protocol allows: a 45th one is read and dropped, and the
+ * number of rectangles is clamped to match. A clamped number carried over
+ * from a previous order may stand for 45, which only the size of the coded
+ * rectangles tells. The stream is left at the end of those cbData bytes.
+ */
+
+#define DELTA_RECTS_MAX		44
+
+static INLINE void update_read_delta_rects(STREAM* s, DELTA_RECT* rectangles, UINT32* number, UINT32 cbData, BOOL counted)
+{
+	int count;
+	BYTE* mark;
+	BYTE* start;
+	DELTA_RECT deltas[45 + 1];
+
+	count = (*number > 45) ? 45 : *number;
+
+	stream_get_mark(s, start);
+	update_parse_delta_rects(s, deltas, count);
+	stream_get_mark(s, mark);
+
+	if (!counted && (count == DELTA_RECTS_MAX) && (mark - start != cbData))
+	{
+		stream_set_mark(s, start);
+		count = 45;
+		update_parse_delta_rects(s, deltas, count);
+	}
+
+	if (count > DELTA_RECTS_MAX)
+		count = DELTA_RECTS_MAX;
+
+	CopyMemory(rectangles, deltas, sizeof(DELTA_RECT) * (count + 1));
+	*number = count;
+
+	stream_set_mark(s, start + cbData);
+}
+
 static INLINE void update_read_delta_points(STREAM* s, DELTA_POINT* points, int number, INT16 x, INT16 y)
 {
 	int i;
@@ -581,7 +617,8 @@ void update_read_multi_dstblt_order(STREAM* s, ORDER_INFO* orderInfo, MULTI_DSTB
 	if (orderInfo->fieldFlags & ORDER_FIELD_07)
 	{
 		stream_read_UINT16(s, multi_dstblt->cbData);
-		update_read_delta_rects(s, multi_dstblt->rectangles, multi_dstblt->numRectangles);
+		update_read_delta_rects(s, multi_dstblt->rectangles, &multi_dstblt->numRectangles, multi_dstblt->cbData,
+				(orderInfo->fieldFlags & ORDER_FIELD_06) ? TRUE : FALSE);
 	}
 }
 
@@ -616,7 +653,8 @@ void update_read_multi_patblt_order(STREAM* s, ORDER_INFO* orderInfo, MULTI_PATB
 	if (orderInfo->fieldFlags & ORDER_FIELD_14)
 	{
 		stream_read_UINT16(s, multi_patblt->cbData);
-		update_read_delta_rects(s, multi_patblt->rectangles, multi_patblt->numRectangles);
+		update_read_delta_rects(s, multi_patblt->rectangles, &multi_patblt->numRectangles, multi_patblt->cbData,
+				(orderInfo->fieldFlags & ORDER_FIELD_13) ? TRUE : FALSE);
 	}
 }
 
@@ -649,7 +687,8 @@ void update_read_multi_scrblt_order(STREAM* s, ORDER_INFO* orderInfo, MULTI_SCRB
 	if (orderInfo->fieldFlags & ORDER_FIELD_09)
 	{
 		stream_read_UINT16(s, multi_scrblt->cbData);
-		update_read_delta_rects(s, multi_scrblt->rectangles, multi_scrblt->numRectangles);
+		update_read_delta_rects(s, multi_scrblt->rectangles, &multi_scrblt->numRectangles, multi_scrblt->cbData,
+				(orderInfo->fieldFlags & ORDER_FIELD_08) ? TRUE : FALSE);
 	}
 }
 
@@ -693,7 +732,8 @@ void update_read_multi_opaque_rect_order(STREAM* s, ORDER_INFO* orderInfo, MULTI
 	if (orderInfo->fieldFlags & ORDER_FIELD_09)
 	{
 		stream_read_UINT16(s, multi_opaque_rect->cbData);
-		update_read_delta_rects(s, multi_opaque_rect->rectangles, multi_opaque_rect->numRectangles);
+		update_read_delta_rects(s, multi_opaque_rect->rectangles, &multi_opaque_rect->numRectangles, multi_opaque_rect->cbData,
+				(orderInfo->fieldFlags & ORDER_FIELD_08) ? TRUE : FALSE);
 	}
 }
 
@@ -21,14 +21,143 @@
 #include "config.h"
 #endif
 
+#include <sys/stat.h>
+
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
+#include "gcc.h"
 #include "certificate.h"
 
 #include <freerdp/utils/tcp.h>
 
 #include "peer.h"
 
+/**
+ * Server RSA keys are shared by all peers using the same key file: the file
+ * is parsed and checked once, and the proprietary certificate sent in the
+ * GCC server security data is signed once. Entries are never modified, each
+ * peer gets its own copies, and an entry is reloaded when its file changes.
+ */
+
+typedef struct rdp_peer_key rdpPeerKey;
+
+struct rdp_peer_key
+{
+	rdpPeerKey* next;
+	char* keyfile;
+	time_t mtime;
+	off_t size;
+
+	rdpRsaKey* key;
+	BYTE* ServerCertificate;
+	UINT32 ServerCertificateLength;
+};
+
+static SRWLOCK peer_key_lock = SRWLOCK_INIT;
+static rdpPeerKey* peer_keys = NULL;
+
+static void freerdp_peer_key_free(rdpPeerKey* entry)
+{
+	key_free(entry->key);
+	free(entry->ServerCertificate);
+	free(entry->keyfile);
+	free(entry);
+}
+
+static rdpPeerKey* freerdp_peer_key_new(const char* keyfile, struct stat* st)
+{
+	rdpPeerKey* entry;
+
+	entry = (rdpPeerKey*) malloc(sizeof(rdpPeerKey));
+
+	if (!entry)
+		return NULL;
+
+	ZeroMemory(entry, sizeof(rdpPeerKey));
+
+	entry->key = key_new(keyfile);
+
+	if (!entry->key)
+	{
+		free(entry);
+		return NULL;
+	}
+
+	entry->keyfile = _strdup(keyfile);
+	entry->mtime = st->st_mtime;
+	entry->size = st->st_size;
+	entry->ServerCertificate = gcc_create_server_certificate(entry->key, &entry->ServerCertificateLength);
+
+	return entry;
+}
+
+static BOOL freerdp_peer_load_key(rdpSettings* settings)
+{
+	struct stat st;
+	rdpPeerKey* entry;
+	rdpPeerKey** link;
+
+	if (stat(settings->RdpKeyFile, &st) != 0)
+	{
+		printf("unable to load RSA key from %s\n", settings->RdpKeyFile);
+		return FALSE;
+	}
+
+	AcquireSRWLockExclusive(&peer_key_lock);
+
+	for (link = &peer_keys; (entry = *link) != NULL; link = &entry->next)
+	{
+		if (strcmp(entry->keyfile, settings->RdpKeyFile) == 0)
+			break;
+	}
+
+	if (entry && ((entry->mtime != st.st_mtime) || (entry->size != st.st_size)))
+	{
+		*link = entry->next;
+		freerdp_peer_key_free(entry);
+		entry = NULL;
+	}
+
+	if (!entry)
+	{
+		entry = freerdp_peer_key_new(settings->RdpKeyFile, &st);
+
+		if (entry)
+		{
+			entry->next = peer_keys;
+			peer_keys = entry;
+		}
+	}
+
+	if (entry)
+	{
+		settings->RdpServerRsaKey = key_clone(entry->key);
+
+		free(settings->ServerCertificate);
+		settings->ServerCertificate = (BYTE*) malloc(entry->ServerCertificateLength);
+		settings->ServerCertificateLength = 0;
+
+		if (!settings->RdpServerRsaKey || !settings->ServerCertificate)
+		{
+			key_free(settings->RdpServerRsaKey);
+			settings->RdpServerRsaKey = NULL;
+			free(settings->ServerCertificate);
+			settings->ServerCertificate = NULL;
+			entry = NULL;
+		}
+		else
+		{
+			CopyMemory(settings->ServerCertificate, entry->ServerCertificate, entry->ServerCertificateLength);
+			settings->ServerCertificateLength = entry->ServerCertificateLength;
+		}
+	}
+
+	ReleaseSRWLockExclusive(&peer_key_lock);
+
+	return (entry != NULL) ? TRUE : FALSE;
+}
+
 static BOOL freerdp_peer_initialize(freerdp_peer* client)
 {
 	client->context->rdp->settings->ServerMode = TRUE;
@@ -37,10 +166,7 @@ static BOOL freerdp_peer_initialize(freerdp_peer* client)
 	client->context->rdp->state = CONNECTION_STATE_INITIAL;
 
 	if (client->context->rdp->settings->RdpKeyFile != NULL)
-	{
-		client->context->rdp->settings->RdpServerRsaKey =
-		    key_new(client->context->rdp->settings->RdpKeyFile);
-	}
+		freerdp_peer_load_key(client->context->rdp->settings);
 
 	return TRUE;
 }
@@ -53,6 +179,35 @@ static BOOL freerdp_peer_get_fds(freerdp_peer* client, void** rfds, int* rcount)
 	return TRUE;
 }
 
+static BOOL freerdp_peer_get_write_fds(freerdp_peer* client, void** wfds, int* wcount)
+{
+	transport_get_write_fds(client->context->rdp->transport, wfds, wcount);
+
+	return TRUE;
+}
+
+static BOOL freerdp_peer_can_send(freerdp_peer* client, UINT32 length)
+{
+	return transport_can_send(client->context->rdp->transport, length);
+}
+
+static void freerdp_peer_logon(freerdp_peer* client)
+{
+	rdpRdp* rdp = client->context->rdp;
+
+	if (rdp->nego->selected_protocol & PROTOCOL_NLA)
+	{
+		sspi_CopyAuthIdentity(&client->identity, &(rdp->nego->transport->credssp->identity));
+		IFCALLRET(client->Logon, client->authenticated, client, &client->identity, TRUE);
+		credssp_free(rdp->nego->transport->credssp);
+		rdp->nego->transport->credssp = NULL;
+	}
+	else
+	{
+		IFCALLRET(client->Logon, client->authenticated, client, &client->identity, FALSE);
+	}
+}
+
 static BOOL freerdp_peer_check_fds(freerdp_peer* client)
 {
 	int status;
@@ -60,11 +215,32 @@ static BOOL freerdp_peer_check_fds(freerdp_peer* client)
 
 	rdp = client->context->rdp;
 
+	if (rdp->transport->AcceptState != TRANSPORT_ACCEPT_NONE)
+	{
+		/* TLS handshake or CredSSP exchange in progress */
+
+		status = rdp_server_accept_security(rdp);
+
+		if (status < 0)
+			return FALSE;
+
+		if (status == 0)
+			return TRUE;
+
+		freerdp_peer_logon(client);
+	}
+
 	status = rdp_check_fds(rdp);
 
 	if (status < 0)
 		return FALSE;
 
+	if (transport_check_writable(rdp->transport))
+	{
+		if (client->Writable && !client->Writable(client))
+			return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -258,16 +434,10 @@ static BOOL peer_recv_callback(rdpTransport* transport, STREAM* s, void* extra)
 			if (!rdp_server_accept_nego(rdp, s))
 				return FALSE;
 
-			if (rdp->nego->selected_protocol & PROTOCOL_NLA)
-			{
-				sspi_CopyAuthIdentity(&client->identity, &(rdp->nego->transport->credssp->identity));
-				IFCALLRET(client->Logon, client->authenticated, client, &client->identity, TRUE);
-				credssp_free(rdp->nego->transport->credssp);
-			}
-			else
-			{
-				IFCALLRET(client->Logon, client->authenticated, client, &client->identity, FALSE);
-			}
+			/* with TLS or NLA, the logon follows the handshake in freerdp_peer_check_fds() */
+
+			if (rdp->state == CONNECTION_STATE_NEGO)
+				freerdp_peer_logon(client);
 
 			break;
 
@@ -408,6 +578,8 @@ freerdp_peer* freerdp_peer_new(int sockfd)
 		client->Initialize = freerdp_peer_initialize;
 		client->GetFileDescriptor = freerdp_peer_get_fds;
 		client->CheckFileDescriptor = freerdp_peer_check_fds;
+		client->GetWriteFileDescriptor = freerdp_peer_get_write_fds;
+		client->CanSend = freerdp_peer_can_send;
 		client->Close = freerdp_peer_close;
 		client->Disconnect = freerdp_peer_disconnect;
 		client->SendChannelData = freerdp_peer_send_channel_data;
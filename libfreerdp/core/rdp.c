@@ -334,20 +334,15 @@ static UINT32 RdpSecurity_stream_out(rdpRdp* rdp, STREAM* s, int length)
 
 				stream_write_BYTE(s, pad);
 
-				security_hmac_signature(data, length, s->p, rdp);
+				security_fips_sign_and_encrypt(rdp, data, length, pad, s->p);
 				stream_seek(s, 8);
-				security_fips_encrypt(data, length + pad, rdp);
 			}
 			else
 			{
 				data = s->p + 8;
 				length = length - (data - s->data);
-				if (sec_flags & SEC_SECURE_CHECKSUM)
-					security_salted_mac_signature(rdp, data, length, TRUE, s->p);
-				else
-					security_mac_signature(rdp, data, length, s->p);
+				security_sign_and_encrypt(rdp, data, length, (sec_flags & SEC_SECURE_CHECKSUM) ? TRUE : FALSE, s->p);
 				stream_seek(s, 8);
-				security_encrypt(s->p, length, rdp);
 			}
 		}
 
@@ -658,13 +653,7 @@ BOOL rdp_decrypt(rdpRdp* rdp, STREAM* s, int length, UINT16 securityFlags)
 
 		length -= 12;
 
-		if (!security_fips_decrypt(s->p, length, rdp))
-		{
-			printf("FATAL: cannot decrypt\n");
-			return FALSE; /* TODO */
-		}
-
-		if (!security_fips_check_signature(s->p, length - pad, sig, rdp))
+		if (!security_fips_decrypt_and_check(rdp, s->p, length, pad, sig))
 		{
 			printf("FATAL: invalid packet signature\n");
 			return FALSE; /* TODO */
@@ -677,11 +666,7 @@ BOOL rdp_decrypt(rdpRdp* rdp, STREAM* s, int length, UINT16 securityFlags)
 
 	stream_read(s, wmac, sizeof(wmac));
 	length -= sizeof(wmac);
-	security_decrypt(s->p, length, rdp);
-	if (securityFlags & SEC_SECURE_CHECKSUM)
-		security_salted_mac_signature(rdp, s->p, length, FALSE, cmac);
-	else
-		security_mac_signature(rdp, s->p, length, cmac);
+	security_decrypt_and_sign(rdp, s->p, length, (securityFlags & SEC_SECURE_CHECKSUM) ? TRUE : FALSE, cmac);
 	if (memcmp(wmac, cmac, sizeof(wmac)) != 0)
 	{
 		printf("WARNING: invalid packet signature\n");
@@ -936,6 +921,7 @@ rdpRdp* rdp_new(freerdp* instance)
 		rdp->fastpath = fastpath_new(rdp);
 		rdp->nego = nego_new(rdp->transport);
 		rdp->mcs = mcs_new(rdp->transport);
+		rdp->reconnect = reconnect_new();
 		rdp->redirection = redirection_new();
 		rdp->mppc_dec = mppc_dec_new();
 		rdp->mppc_enc = mppc_enc_new(PROTO_RDP_50);
@@ -953,8 +939,6 @@ void rdp_free(rdpRdp* rdp)
 {
 	if (rdp != NULL)
 	{
-		crypto_rc4_free(rdp->rc4_decrypt_key);
-		crypto_rc4_free(rdp->rc4_encrypt_key);
 		crypto_des3_free(rdp->fips_encrypt);
 		crypto_des3_free(rdp->fips_decrypt);
 		crypto_hmac_free(rdp->fips_hmac);
@@ -967,6 +951,7 @@ void rdp_free(rdpRdp* rdp)
 		fastpath_free(rdp->fastpath);
 		nego_free(rdp->nego);
 		mcs_free(rdp->mcs);
+		reconnect_free(rdp->reconnect);
 		redirection_free(rdp->redirection);
 		mppc_dec_free(rdp->mppc_dec);
 		mppc_enc_free(rdp->mppc_enc);
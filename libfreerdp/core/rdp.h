@@ -37,12 +37,14 @@
 #include "security.h"
 #include "transport.h"
 #include "connection.h"
+#include "reconnect.h"
 #include "redirection.h"
 #include "capabilities.h"
 #include "channel.h"
 
 #include <freerdp/freerdp.h>
 #include <freerdp/settings.h>
+#include <freerdp/crypto/crypto.h>
 #include <freerdp/utils/debug.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/codec/mppc_dec.h>
@@ -125,18 +127,21 @@ struct rdp_rdp
 	struct rdp_update* update;
 	struct rdp_fastpath* fastpath;
 	struct rdp_license* license;
+	struct rdp_reconnect* reconnect;
 	struct rdp_redirection* redirection;
 	struct rdp_settings* settings;
 	struct rdp_transport* transport;
 	struct rdp_extension* extension;
 	struct rdp_mppc_dec* mppc_dec;
 	struct rdp_mppc_enc* mppc_enc;
-	struct crypto_rc4_struct* rc4_decrypt_key;
+	struct crypto_rc4_struct rc4_decrypt_key;
 	int decrypt_use_count;
 	int decrypt_checksum_use_count;
-	struct crypto_rc4_struct* rc4_encrypt_key;
+	struct crypto_rc4_struct rc4_encrypt_key;
 	int encrypt_use_count;
 	int encrypt_checksum_use_count;
+	struct crypto_sha1_struct mac_sha1;
+	struct crypto_md5_struct mac_md5;
 	struct crypto_des3_struct* fips_encrypt;
 	struct crypto_des3_struct* fips_decrypt;
 	struct crypto_hmac_struct* fips_hmac;
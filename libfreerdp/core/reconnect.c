@@ -0,0 +1,148 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Automatic Reconnection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+
+#include "reconnect.h"
+
+static VOID CALLBACK reconnect_timer_callback(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+{
+	rdpReconnect* reconnect = (rdpReconnect*) lpParameter;
+
+	wait_obj_set(reconnect->event);
+}
+
+static void reconnect_cancel_timer(rdpReconnect* reconnect)
+{
+	if (reconnect->timer)
+	{
+		DeleteTimerQueueTimer(NULL, reconnect->timer, INVALID_HANDLE_VALUE);
+		reconnect->timer = NULL;
+	}
+}
+
+/**
+ * Begin reconnecting: the first attempt is due right away.
+ * @param reconnect reconnect module
+ * @param maxRetries number of attempts, 0 for the default
+ */
+
+void reconnect_start(rdpReconnect* reconnect, UINT32 maxRetries)
+{
+	reconnect_cancel_timer(reconnect);
+
+	reconnect->pending = TRUE;
+	reconnect->retry = 0;
+	reconnect->maxRetries = (maxRetries > 0) ? maxRetries : RECONNECT_MAX_RETRIES;
+	reconnect->delay = RECONNECT_MIN_DELAY;
+
+	wait_obj_set(reconnect->event);
+}
+
+/**
+ * Check whether the next attempt is due, consuming it if so.
+ * @param reconnect reconnect module
+ * @return TRUE if an attempt is to be made now
+ */
+
+BOOL reconnect_is_due(rdpReconnect* reconnect)
+{
+	if (!reconnect->pending || !wait_obj_is_set(reconnect->event))
+		return FALSE;
+
+	wait_obj_clear(reconnect->event);
+	reconnect->retry++;
+
+	return TRUE;
+}
+
+/**
+ * Schedule the next attempt after a failed one, doubling the delay each time.
+ * @param reconnect reconnect module
+ * @return FALSE once every attempt was made
+ */
+
+BOOL reconnect_schedule(rdpReconnect* reconnect)
+{
+	reconnect_cancel_timer(reconnect);
+
+	if (!reconnect->pending || (reconnect->retry >= reconnect->maxRetries))
+	{
+		reconnect_stop(reconnect);
+		return FALSE;
+	}
+
+	if (!CreateTimerQueueTimer(&reconnect->timer, NULL, reconnect_timer_callback,
+			reconnect, reconnect->delay, 0, WT_EXECUTEONLYONCE))
+	{
+		reconnect->timer = NULL;
+		reconnect_stop(reconnect);
+		return FALSE;
+	}
+
+	reconnect->delay = MIN(reconnect->delay * 2, RECONNECT_MAX_DELAY);
+
+	return TRUE;
+}
+
+void reconnect_stop(rdpReconnect* reconnect)
+{
+	reconnect_cancel_timer(reconnect);
+	wait_obj_clear(reconnect->event);
+	reconnect->pending = FALSE;
+}
+
+void reconnect_get_fds(rdpReconnect* reconnect, void** rfds, int* rcount)
+{
+	wait_obj_get_fds(reconnect->event, rfds, rcount);
+}
+
+rdpReconnect* reconnect_new(void)
+{
+	rdpReconnect* reconnect;
+
+	reconnect = (rdpReconnect*) malloc(sizeof(rdpReconnect));
+
+	if (reconnect != NULL)
+	{
+		ZeroMemory(reconnect, sizeof(rdpReconnect));
+		reconnect->event = wait_obj_new();
+
+		if (reconnect->event == NULL)
+		{
+			free(reconnect);
+			return NULL;
+		}
+	}
+
+	return reconnect;
+}
+
+void reconnect_free(rdpReconnect* reconnect)
+{
+	if (reconnect != NULL)
+	{
+		reconnect_cancel_timer(reconnect);
+		wait_obj_free(reconnect->event);
+		free(reconnect);
+	}
+}
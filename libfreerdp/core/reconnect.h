@@ -0,0 +1,58 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Automatic Reconnection
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RECONNECT_H
+#define __RECONNECT_H
+
+#include <winpr/synch.h>
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/utils/wait_obj.h>
+
+/* auto-reconnect backoff, in milliseconds */
+#define RECONNECT_MAX_RETRIES		20
+#define RECONNECT_MIN_DELAY		500
+#define RECONNECT_MAX_DELAY		16000
+
+/**
+ * Reconnection attempts are made from the event loop, one per call to
+ * freerdp_check_fds(): the event is set once the next attempt is due,
+ * by a timer queue timer while backing off.
+ */
+
+struct rdp_reconnect
+{
+	BOOL pending;
+	UINT32 retry;
+	UINT32 maxRetries;
+	DWORD delay;
+	HANDLE timer;
+	struct wait_obj* event;
+};
+typedef struct rdp_reconnect rdpReconnect;
+
+FREERDP_TEST_API void reconnect_start(rdpReconnect* reconnect, UINT32 maxRetries);
+FREERDP_TEST_API BOOL reconnect_is_due(rdpReconnect* reconnect);
+FREERDP_TEST_API BOOL reconnect_schedule(rdpReconnect* reconnect);
+FREERDP_TEST_API void reconnect_stop(rdpReconnect* reconnect);
+void reconnect_get_fds(rdpReconnect* reconnect, void** rfds, int* rcount);
+
+FREERDP_TEST_API rdpReconnect* reconnect_new(void);
+FREERDP_TEST_API void reconnect_free(rdpReconnect* reconnect);
+
+#endif /* __RECONNECT_H */
@@ -27,9 +27,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
 #include <winpr/crt.h>
 #include <winpr/tchar.h>
 #include <winpr/dsparse.h>
+#include <winpr/thread.h>
 
 #include <openssl/rand.h>
 
@@ -751,42 +756,6 @@ BOOL rpc_get_stub_data_info(rdpRpc* rpc, BYTE* buffer, UINT32* offset, UINT32* l
 	return TRUE;
 }
 
-int rpc_send_enqueue_pdu(rdpRpc* rpc, BYTE* buffer, UINT32 length)
-{
-	RPC_PDU_ENTRY* PduEntry;
-
-	PduEntry = (RPC_PDU_ENTRY*) _aligned_malloc(sizeof(RPC_PDU_ENTRY), MEMORY_ALLOCATION_ALIGNMENT);
-	PduEntry->Buffer = buffer;
-	PduEntry->Length = length;
-
-	InterlockedPushEntrySList(rpc->SendQueue, &(PduEntry->ItemEntry));
-
-	return 0;
-}
-
-int rpc_send_dequeue_pdu(rdpRpc* rpc)
-{
-	int status;
-	RPC_PDU_ENTRY* PduEntry;
-
-	PduEntry = (RPC_PDU_ENTRY*) InterlockedPopEntrySList(rpc->SendQueue);
-
-	status = rpc_in_write(rpc, PduEntry->Buffer, PduEntry->Length);
-
-	/*
-	 * This protocol specifies that only RPC PDUs are subject to the flow control abstract
-	 * data model. RTS PDUs and the HTTP request and response headers are not subject to flow control.
-	 * Implementations of this protocol MUST NOT include them when computing any of the variables
-	 * specified by this abstract data model.
-	 */
-	rpc->VirtualConnection->DefaultInChannel->BytesSent += status;
-	rpc->VirtualConnection->DefaultInChannel->SenderAvailableWindow -= status;
-
-	_aligned_free(PduEntry);
-
-	return status;
-}
-
 int rpc_out_read(rdpRpc* rpc, BYTE* data, int length)
 {
 	int status;
@@ -809,7 +778,11 @@ int rpc_in_write(rdpRpc* rpc, BYTE* data, int length)
 {
 	int status;
 
+	/* flow control acks are written from the thread consuming OUT channel PDUs */
+
+	EnterCriticalSection(&rpc->Lock);
 	status = tls_write_all(rpc->TlsIn, data, length);
+	LeaveCriticalSection(&rpc->Lock);
 
 	return status;
 }
@@ -852,86 +825,277 @@ int rpc_recv_pdu_header(rdpRpc* rpc, BYTE* header)
 	return bytesRead;
 }
 
-int rpc_recv_pdu(rdpRpc* rpc)
+/**
+ * Read a whole fragment from the OUT channel. The fragment is read into a
+ * buffer taken from pool when one is given, or else into *buffer, which is
+ * grown as needed.
+ */
+
+static int rpc_recv_fragment(rdpRpc* rpc, BYTE** buffer, UINT32* size, wBufferPool* pool)
 {
+	BYTE* grown;
 	int status;
-	int headerLength;
-	int bytesRead = 0;
-	rpcconn_hdr_t* header;
+	int bytesRead;
+	BYTE header[32];
+	rpcconn_common_hdr_t* common;
+
+	status = rpc_recv_pdu_header(rpc, header);
 
-	status = rpc_recv_pdu_header(rpc, rpc->buffer);
-    
 	if (status < 1)
+		return (status < 0) ? status : -1;
+
+	bytesRead = status;
+	common = (rpcconn_common_hdr_t*) header;
+
+	if (common->frag_length < bytesRead)
+		return -1;
+
+	if (pool)
 	{
-		printf("rpc_recv_pdu_header: error reading header\n");
-		return status;
-	}
-    
-	headerLength = status;
-	header = (rpcconn_hdr_t*) rpc->buffer;
-	bytesRead += status;
+		*buffer = BufferPool_Take(pool, common->frag_length);
 
-	if (header->common.frag_length > rpc->length)
+		if (*buffer == NULL)
+			return -1;
+	}
+	else if (common->frag_length > *size)
 	{
-		rpc->length = header->common.frag_length;
-		rpc->buffer = (BYTE*) realloc(rpc->buffer, rpc->length);
-		header = (rpcconn_hdr_t*) rpc->buffer;
+		grown = (BYTE*) realloc(*buffer, common->frag_length);
+
+		if (grown == NULL)
+			return -1;
+
+		*buffer = grown;
+		*size = common->frag_length;
 	}
 
-	while (bytesRead < header->common.frag_length)
+	CopyMemory(*buffer, header, bytesRead);
+
+	while (bytesRead < common->frag_length)
 	{
-		status = rpc_out_read(rpc, &rpc->buffer[bytesRead], header->common.frag_length - bytesRead);
+		status = rpc_out_read(rpc, &(*buffer)[bytesRead], common->frag_length - bytesRead);
 
 		if (status < 0)
 		{
-			printf("rpc_recv_pdu: error reading fragment\n");
+			printf("rpc_recv_fragment: error reading fragment\n");
+
+			if (pool)
+				BufferPool_Return(pool, *buffer);
+
 			return status;
 		}
 
 		bytesRead += status;
 	}
 
-	if (!(header->common.pfc_flags & PFC_LAST_FRAG))
-	{
-		printf("Fragmented PDU\n");
-	}
+	if (!(common->pfc_flags & PFC_LAST_FRAG))
+		DEBUG_RPC("Fragmented PDU");
+
+#ifdef WITH_DEBUG_RPC
+	printf("rpc_recv_fragment: length: %d\n", common->frag_length);
+	freerdp_hexdump(*buffer, common->frag_length);
+	printf("\n");
+#endif
+
+	return common->frag_length;
+}
+
+/**
+ * OUT channel flow control: ReceiverAvailableWindow is the room left for
+ * PDUs that have been received but not consumed yet, AvailableWindowAdvertised
+ * what the gateway may still send before it hears from us. An ack is sent
+ * once a quarter of the window can be handed back, so the gateway gets more
+ * credit well before it runs out.
+ */
+
+static void rpc_out_channel_received(rdpRpc* rpc, UINT32 length)
+{
+	RpcOutChannel* channel = rpc->VirtualConnection->DefaultOutChannel;
 
-	if (header->common.ptype == PTYPE_RTS) /* RTS PDU */
+	EnterCriticalSection(&rpc->Lock);
+
+	channel->BytesReceived += length;
+	channel->ReceiverAvailableWindow -= MIN(length, channel->ReceiverAvailableWindow);
+	channel->AvailableWindowAdvertised -= MIN(length, channel->AvailableWindowAdvertised);
+
+	LeaveCriticalSection(&rpc->Lock);
+}
+
+static void rpc_out_channel_consumed(rdpRpc* rpc, UINT32 length)
+{
+	RpcOutChannel* channel = rpc->VirtualConnection->DefaultOutChannel;
+
+	EnterCriticalSection(&rpc->Lock);
+
+	channel->ReceiverAvailableWindow = MIN(channel->ReceiverAvailableWindow + length, channel->ReceiveWindow);
+
+	if (channel->ReceiverAvailableWindow - channel->AvailableWindowAdvertised >= (channel->ReceiveWindow / 4))
+		rts_send_flow_control_ack_pdu(rpc);
+
+	LeaveCriticalSection(&rpc->Lock);
+}
+
+int rpc_recv_pdu(rdpRpc* rpc)
+{
+	int status;
+	rpcconn_hdr_t* header;
+
+	while (TRUE)
 	{
+		status = rpc_recv_fragment(rpc, &rpc->buffer, &rpc->length, NULL);
+
+		if (status < 1)
+		{
+			printf("rpc_recv_pdu: error reading fragment\n");
+			return status;
+		}
+
+		header = (rpcconn_hdr_t*) rpc->buffer;
+
+		if (header->common.ptype != PTYPE_RTS)
+			break;
+
 		if (rpc->VirtualConnection->State < VIRTUAL_CONNECTION_STATE_OPENED)
 			return header->common.frag_length;
 
-		printf("Receiving Out-of-Sequence RTS PDU\n");
-		rts_recv_out_of_sequence_pdu(rpc);
-		return rpc_recv_pdu(rpc);
+		DEBUG_RPC("Receiving Out-of-Sequence RTS PDU");
+		rts_recv_out_of_sequence_pdu(rpc, rpc->buffer, header->common.frag_length);
 	}
-	else if (header->common.ptype == PTYPE_FAULT)
+
+	if (header->common.ptype == PTYPE_FAULT)
 	{
 		rpc_recv_fault_pdu(header);
 		return -1;
 	}
 
-	rpc->VirtualConnection->DefaultOutChannel->BytesReceived += header->common.frag_length;
-	rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow -= header->common.frag_length;
+	/* the caller consumes the PDU right away */
+
+	rpc_out_channel_received(rpc, header->common.frag_length);
+	rpc_out_channel_consumed(rpc, header->common.frag_length);
 
-	printf("BytesReceived: %d ReceiverAvailableWindow: %d ReceiveWindow: %d\n",
-			rpc->VirtualConnection->DefaultOutChannel->BytesReceived,
-			rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow,
-			rpc->ReceiveWindow);
+	return header->common.frag_length;
+}
 
-	if (rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow < (rpc->ReceiveWindow / 2))
+static void* rpc_out_reader_thread(rdpRpc* rpc)
+{
+	int status;
+	BYTE* pdu;
+	rpcconn_hdr_t* header;
+
+	while (TRUE)
 	{
-		printf("Sending Flow Control Ack PDU\n");
-		rts_send_flow_control_ack_pdu(rpc);
+		status = rpc_recv_fragment(rpc, &pdu, NULL, rpc->ReceivePool);
+
+		if (status < 1)
+			break;
+
+		header = (rpcconn_hdr_t*) pdu;
+
+		if (header->common.ptype == PTYPE_RTS)
+		{
+			DEBUG_RPC("Receiving Out-of-Sequence RTS PDU");
+			rts_recv_out_of_sequence_pdu(rpc, pdu, header->common.frag_length);
+			BufferPool_Return(rpc->ReceivePool, pdu);
+			continue;
+		}
+
+		if (header->common.ptype == PTYPE_FAULT)
+		{
+			rpc_recv_fault_pdu(header);
+			BufferPool_Return(rpc->ReceivePool, pdu);
+			break;
+		}
+
+		rpc_out_channel_received(rpc, header->common.frag_length);
+
+		Queue_Enqueue(rpc->ReceiveQueue, pdu);
+		wait_obj_set(rpc->transport->recv_event);
 	}
 
-#ifdef WITH_DEBUG_RPC
-	printf("rpc_recv_pdu: length: %d\n", header->common.frag_length);
-	freerdp_hexdump(rpc->buffer, header->common.frag_length);
-	printf("\n");
+	/* wake up the consumer, it sees the thread is gone once the queue is drained */
+	wait_obj_set(rpc->transport->recv_event);
+
+	return NULL;
+}
+
+/**
+ * Once the receive pipe is set up, the OUT channel is read by a dedicated
+ * thread so that PDUs keep flowing while the transport is busy elsewhere.
+ * Only PDUs carrying data are queued, out-of-sequence RTS PDUs are handled
+ * by the thread itself.
+ */
+
+BOOL rpc_out_reader_start(rdpRpc* rpc)
+{
+	if (rpc->ReaderThread)
+		return TRUE;
+
+	rpc->ReaderThread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) rpc_out_reader_thread, (void*) rpc, 0, NULL);
+
+	return (rpc->ReaderThread != NULL);
+}
+
+void rpc_out_reader_stop(rdpRpc* rpc)
+{
+	if (!rpc->ReaderThread)
+		return;
+
+	/* unblock the pending read, the OUT channel is of no use anymore */
+
+#ifdef _WIN32
+	shutdown(rpc->TlsOut->sockfd, SD_BOTH);
+#else
+	shutdown(rpc->TlsOut->sockfd, SHUT_RDWR);
 #endif
 
-	return header->common.frag_length;
+	WaitForSingleObject(rpc->ReaderThread, INFINITE);
+	CloseHandle(rpc->ReaderThread);
+	rpc->ReaderThread = NULL;
+}
+
+/**
+ * Take the next prefetched PDU, waiting for one when blocking.
+ * @return 1 when a PDU is returned, 0 when none is available yet and
+ * -1 once the OUT channel is closed and all its PDUs have been taken
+ */
+
+int rpc_recv_dequeue_pdu(rdpRpc* rpc, BYTE** pdu, BOOL blocking)
+{
+	HANDLE events[2];
+
+	events[0] = Queue_Event(rpc->ReceiveQueue);
+	events[1] = rpc->ReaderThread;
+
+	while (!(*pdu = (BYTE*) Queue_Dequeue(rpc->ReceiveQueue)))
+	{
+		if (WaitForSingleObject(rpc->ReaderThread, 0) == WAIT_OBJECT_0)
+		{
+			/* the thread may have queued its last PDUs just before exiting */
+
+			if ((*pdu = (BYTE*) Queue_Dequeue(rpc->ReceiveQueue)) != NULL)
+				break;
+
+			return -1;
+		}
+
+		if (!blocking)
+			return 0;
+
+		WaitForMultipleObjects(2, events, FALSE, INFINITE);
+	}
+
+	return 1;
+}
+
+/**
+ * Hand a PDU returned by rpc_recv_dequeue_pdu() back once its stub data has
+ * been consumed, which gives its room in the receive window back to the gateway.
+ */
+
+void rpc_recv_release_pdu(rdpRpc* rpc, BYTE* pdu)
+{
+	rpc_out_channel_consumed(rpc, ((rpcconn_common_hdr_t*) pdu)->frag_length);
+	BufferPool_Return(rpc->ReceivePool, pdu);
 }
 
 int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum)
@@ -944,7 +1108,7 @@ int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum)
 	SecBuffer Buffers[2];
 	SecBufferDesc Message;
 	SECURITY_STATUS encrypt_status;
-	rpcconn_request_hdr_t* request_pdu;
+	rpcconn_request_hdr_t request_pdu;
 
 	ntlm = rpc->ntlm;
 
@@ -954,52 +1118,62 @@ int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum)
 		return -1;
 	}
 
-	request_pdu = (rpcconn_request_hdr_t*) malloc(sizeof(rpcconn_request_hdr_t));
-	ZeroMemory(request_pdu, sizeof(rpcconn_request_hdr_t));
+	ZeroMemory(&request_pdu, sizeof(rpcconn_request_hdr_t));
 
-	rpc_pdu_header_init(rpc, (rpcconn_hdr_t*) request_pdu);
+	rpc_pdu_header_init(rpc, (rpcconn_hdr_t*) &request_pdu);
 
-	request_pdu->ptype = PTYPE_REQUEST;
-	request_pdu->pfc_flags = PFC_FIRST_FRAG | PFC_LAST_FRAG;
-	request_pdu->auth_length = ntlm->ContextSizes.cbMaxSignature;
-	request_pdu->call_id = ++rpc->call_id;
+	request_pdu.ptype = PTYPE_REQUEST;
+	request_pdu.pfc_flags = PFC_FIRST_FRAG | PFC_LAST_FRAG;
+	request_pdu.auth_length = ntlm->ContextSizes.cbMaxSignature;
+	request_pdu.call_id = ++rpc->call_id;
 
 	/* opnum 8 is TsProxySetupReceivePipe, save call_id for checking pipe responses */
 
 	if (opnum == 8)
 		rpc->pipe_call_id = rpc->call_id;
 
-	request_pdu->alloc_hint = length;
-	request_pdu->p_cont_id = 0x0000;
-	request_pdu->opnum = opnum;
-
-	request_pdu->stub_data = data;
+	request_pdu.alloc_hint = length;
+	request_pdu.p_cont_id = 0x0000;
+	request_pdu.opnum = opnum;
 
 	offset = 24;
 	stub_data_pad = 0;
 	stub_data_pad = rpc_offset_align(&offset, 8);
 
 	offset += length;
-	request_pdu->auth_verifier.auth_pad_length = rpc_offset_align(&offset, 4);
-	request_pdu->auth_verifier.auth_type = RPC_C_AUTHN_WINNT;
-	request_pdu->auth_verifier.auth_level = RPC_C_AUTHN_LEVEL_PKT_INTEGRITY;
-	request_pdu->auth_verifier.auth_reserved = 0x00;
-	request_pdu->auth_verifier.auth_context_id = 0x00000000;
-	offset += (8 + request_pdu->auth_length);
+	request_pdu.auth_verifier.auth_pad_length = rpc_offset_align(&offset, 4);
+	request_pdu.auth_verifier.auth_type = RPC_C_AUTHN_WINNT;
+	request_pdu.auth_verifier.auth_level = RPC_C_AUTHN_LEVEL_PKT_INTEGRITY;
+	request_pdu.auth_verifier.auth_reserved = 0x00;
+	request_pdu.auth_verifier.auth_context_id = 0x00000000;
+	offset += (8 + request_pdu.auth_length);
+
+	request_pdu.frag_length = offset;
 
-	request_pdu->frag_length = offset;
+	/* the PDU is built and signed in place in a buffer kept across writes */
 
-	buffer = (BYTE*) malloc(request_pdu->frag_length);
+	if (request_pdu.frag_length > rpc->SendBufferLength)
+	{
+		buffer = (BYTE*) realloc(rpc->SendBuffer, request_pdu.frag_length);
 
-	CopyMemory(buffer, request_pdu, 24);
+		if (buffer == NULL)
+			return -1;
+
+		rpc->SendBuffer = buffer;
+		rpc->SendBufferLength = request_pdu.frag_length;
+	}
+
+	buffer = rpc->SendBuffer;
+
+	CopyMemory(buffer, &request_pdu, 24);
 
 	offset = 24;
 	rpc_offset_pad(&offset, stub_data_pad);
-	CopyMemory(&buffer[offset], request_pdu->stub_data, length);
+	CopyMemory(&buffer[offset], data, length);
 	offset += length;
 
-	rpc_offset_pad(&offset, request_pdu->auth_verifier.auth_pad_length);
-	CopyMemory(&buffer[offset], &request_pdu->auth_verifier.auth_type, 8);
+	rpc_offset_pad(&offset, request_pdu.auth_verifier.auth_pad_length);
+	CopyMemory(&buffer[offset], &request_pdu.auth_verifier.auth_type, 8);
 	offset += 8;
 
 	Buffers[0].BufferType = SECBUFFER_DATA; /* auth_data */
@@ -1009,8 +1183,7 @@ int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum)
 	Buffers[0].cbBuffer = offset;
 
 	Buffers[1].cbBuffer = ntlm->ContextSizes.cbMaxSignature;
-	Buffers[1].pvBuffer = malloc(Buffers[1].cbBuffer);
-	ZeroMemory(Buffers[1].pvBuffer, Buffers[1].cbBuffer);
+	Buffers[1].pvBuffer = &buffer[offset];
 
 	Message.cBuffers = 2;
 	Message.ulVersion = SECBUFFER_VERSION;
@@ -1024,13 +1197,24 @@ int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum)
 		return -1;
 	}
 
-	CopyMemory(&buffer[offset], Buffers[1].pvBuffer, Buffers[1].cbBuffer);
-	offset += Buffers[1].cbBuffer;
+	EnterCriticalSection(&rpc->Lock);
 
-	rpc_send_enqueue_pdu(rpc, buffer, request_pdu->frag_length);
-	status = rpc_send_dequeue_pdu(rpc);
+	status = rpc_in_write(rpc, buffer, request_pdu.frag_length);
 
-	free(buffer);
+	/*
+	 * This protocol specifies that only RPC PDUs are subject to the flow control abstract
+	 * data model. RTS PDUs and the HTTP request and response headers are not subject to flow control.
+	 * Implementations of this protocol MUST NOT include them when computing any of the variables
+	 * specified by this abstract data model.
+	 */
+
+	if (status > 0)
+	{
+		rpc->VirtualConnection->DefaultInChannel->BytesSent += status;
+		rpc->VirtualConnection->DefaultInChannel->SenderAvailableWindow -= status;
+	}
+
+	LeaveCriticalSection(&rpc->Lock);
 
 	if (status < 0)
 		return -1;
@@ -1219,7 +1403,7 @@ rdpRpc* rpc_new(rdpTransport* transport)
 		rpc_ntlm_http_init_channel(rpc, rpc->NtlmHttpIn, TSG_CHANNEL_IN);
 		rpc_ntlm_http_init_channel(rpc, rpc->NtlmHttpOut, TSG_CHANNEL_OUT);
 
-		rpc->length = 20;
+		rpc->length = 0x0FF8;
 		rpc->buffer = (BYTE*) malloc(rpc->length);
 
 		rpc->rpc_vers = 5;
@@ -1234,10 +1418,18 @@ rdpRpc* rpc_new(rdpTransport* transport)
 		rpc->max_xmit_frag = 0x0FF8;
 		rpc->max_recv_frag = 0x0FF8;
 
-		rpc->SendQueue = (PSLIST_HEADER) _aligned_malloc(sizeof(SLIST_HEADER), MEMORY_ALLOCATION_ALIGNMENT);
-		InitializeSListHead(rpc->SendQueue);
+		InitializeCriticalSection(&rpc->Lock);
+
+		rpc->ReceiveQueue = Queue_New(64);
+		rpc->ReceivePool = BufferPool_New(64);
+
+		rpc->ReceiveWindow = RPC_MAX_RECEIVE_WINDOW;
 
-		rpc->ReceiveWindow = 0x00010000;
+		if (rpc->settings->GatewayReceiveWindow)
+		{
+			rpc->ReceiveWindow = MAX(rpc->settings->GatewayReceiveWindow, RPC_MIN_RECEIVE_WINDOW);
+			rpc->ReceiveWindow = MIN(rpc->ReceiveWindow, RPC_MAX_RECEIVE_WINDOW);
+		}
 
 		rpc->ChannelLifetime = 0x40000000;
 		rpc->ChannelLifetimeSet = 0;
@@ -1259,15 +1451,23 @@ void rpc_free(rdpRpc* rpc)
 {
 	if (rpc != NULL)
 	{
-		RPC_PDU_ENTRY* PduEntry;
+		BYTE* pdu;
+
+		rpc_out_reader_stop(rpc);
 
 		ntlm_http_free(rpc->NtlmHttpIn);
 		ntlm_http_free(rpc->NtlmHttpOut);
 
-		while ((PduEntry = (RPC_PDU_ENTRY*) InterlockedPopEntrySList(rpc->SendQueue)) != NULL)
-			_aligned_free(PduEntry);
+		while ((pdu = (BYTE*) Queue_Dequeue(rpc->ReceiveQueue)) != NULL)
+			BufferPool_Return(rpc->ReceivePool, pdu);
+
+		Queue_Free(rpc->ReceiveQueue);
+		BufferPool_Free(rpc->ReceivePool);
+
+		DeleteCriticalSection(&rpc->Lock);
 
-		_aligned_free(rpc->SendQueue);
+		free(rpc->buffer);
+		free(rpc->SendBuffer);
 
 		rpc_client_virtual_connection_free(rpc->VirtualConnection);
 		rpc_virtual_connection_cookie_table_free(rpc->VirtualConnectionCookieTable);
@@ -55,7 +55,9 @@ typedef struct
 #include <time.h>
 
 #include <winpr/sspi.h>
+#include <winpr/synch.h>
 #include <winpr/interlocked.h>
+#include <winpr/collections.h>
 
 #include <freerdp/types.h>
 #include <freerdp/settings.h>
@@ -658,12 +660,14 @@ struct rpc_virtual_connection_cookie_table
 };
 typedef struct rpc_virtual_connection_cookie_table RpcVirtualConnectionCookieTable;
 
-typedef struct _RPC_PDU_ENTRY
-{
-	SLIST_ENTRY ItemEntry;
-	BYTE* Buffer;
-	UINT32 Length;
-} RPC_PDU_ENTRY, *PRPC_PDU_ENTRY;
+/**
+ * ReceiveWindowSize is advertised once per OUT channel and must lie
+ * between 8 KB and 256 KB. Unless configured, the largest window is used
+ * so that the gateway is not throttled on high latency links.
+ */
+
+#define RPC_MIN_RECEIVE_WINDOW		0x00002000
+#define RPC_MAX_RECEIVE_WINDOW		0x00040000
 
 struct rdp_rpc
 {
@@ -692,7 +696,16 @@ struct rdp_rpc
 	UINT16 max_xmit_frag;
 	UINT16 max_recv_frag;
 
-	PSLIST_HEADER SendQueue;
+	BYTE* SendBuffer;
+	UINT32 SendBufferLength;
+
+	/* IN channel writes and flow control state */
+	CRITICAL_SECTION Lock;
+
+	/* PDUs prefetched from the OUT channel by the reader thread */
+	HANDLE ReaderThread;
+	wQueue* ReceiveQueue;
+	wBufferPool* ReceivePool;
 
 	UINT32 ReceiveWindow;
 
@@ -725,6 +738,12 @@ int rpc_recv_pdu_header(rdpRpc* rpc, BYTE* header);
 
 int rpc_recv_pdu(rdpRpc* rpc);
 
+FREERDP_TEST_API BOOL rpc_out_reader_start(rdpRpc* rpc);
+void rpc_out_reader_stop(rdpRpc* rpc);
+
+int rpc_recv_dequeue_pdu(rdpRpc* rpc, BYTE** pdu, BOOL blocking);
+void rpc_recv_release_pdu(rdpRpc* rpc, BYTE* pdu);
+
 int rpc_tsg_write(rdpRpc* rpc, BYTE* data, int length, UINT16 opnum);
 
 rdpRpc* rpc_new(rdpTransport* transport);
@@ -834,11 +834,12 @@ int rts_send_keep_alive_pdu(rdpRpc* rpc)
 
 int rts_send_flow_control_ack_pdu(rdpRpc* rpc)
 {
-	BYTE* buffer;
+	BYTE buffer[56];
 	rpcconn_rts_hdr_t header;
 	UINT32 BytesReceived;
 	UINT32 AvailableWindow;
 	BYTE* ChannelCookie;
+	RpcOutChannel* channel;
 
 	rts_pdu_header_init(&header);
 	header.frag_length = 56;
@@ -847,14 +848,16 @@ int rts_send_flow_control_ack_pdu(rdpRpc* rpc)
 
 	DEBUG_RPC("Sending FlowControlAck RTS PDU");
 
-	BytesReceived = rpc->VirtualConnection->DefaultOutChannel->BytesReceived;
-	AvailableWindow = rpc->VirtualConnection->DefaultOutChannel->AvailableWindowAdvertised;
-	ChannelCookie = (BYTE*) &(rpc->VirtualConnection->DefaultOutChannelCookie);
+	EnterCriticalSection(&rpc->Lock);
 
-	rpc->VirtualConnection->DefaultOutChannel->ReceiverAvailableWindow =
-			rpc->VirtualConnection->DefaultOutChannel->AvailableWindowAdvertised;
+	/* advertise the room left for PDUs not consumed yet */
 
-	buffer = (BYTE*) malloc(header.frag_length);
+	channel = rpc->VirtualConnection->DefaultOutChannel;
+	channel->AvailableWindowAdvertised = channel->ReceiverAvailableWindow;
+
+	BytesReceived = channel->BytesReceived;
+	AvailableWindow = channel->AvailableWindowAdvertised;
+	ChannelCookie = (BYTE*) &(rpc->VirtualConnection->DefaultOutChannelCookie);
 
 	CopyMemory(buffer, ((BYTE*) &header), 20); /* RTS Header (20 bytes) */
 	rts_destination_command_write(&buffer[20], FDOutProxy); /* Destination Command (8 bytes) */
@@ -864,7 +867,7 @@ int rts_send_flow_control_ack_pdu(rdpRpc* rpc)
 
 	rpc_in_write(rpc, buffer, header.frag_length);
 
-	free(buffer);
+	LeaveCriticalSection(&rpc->Lock);
 
 	return 0;
 }
@@ -898,9 +901,15 @@ int rts_recv_flow_control_ack_with_destination_pdu(rdpRpc* rpc, BYTE* buffer, UI
 	offset += rts_flow_control_ack_command_read(rpc, &buffer[offset], length - offset,
 			&BytesReceived, &AvailableWindow, (BYTE*) &ChannelCookie) + 4;
 
-	printf("Destination: %d BytesReceived: %d AvailableWindow: %d\n",
+	DEBUG_RTS("Destination: %d BytesReceived: %d AvailableWindow: %d",
 			Destination, BytesReceived, AvailableWindow);
-	printf("ChannelCookie: " RPC_UUID_FORMAT_STRING "\n", RPC_UUID_FORMAT_ARGUMENTS(ChannelCookie));
+
+	EnterCriticalSection(&rpc->Lock);
+
+	rpc->VirtualConnection->DefaultInChannel->SenderAvailableWindow = AvailableWindow -
+			(rpc->VirtualConnection->DefaultInChannel->BytesSent - BytesReceived);
+
+	LeaveCriticalSection(&rpc->Lock);
 
 	return 0;
 }
@@ -1345,16 +1354,18 @@ int rts_recv_pdu(rdpRpc* rpc)
 	return status;
 }
 
-int rts_recv_out_of_sequence_pdu(rdpRpc* rpc)
+int rts_recv_out_of_sequence_pdu(rdpRpc* rpc, BYTE* buffer, UINT32 length)
 {
 	UINT32 SignatureId;
 	rpcconn_rts_hdr_t* rts;
 	RtsPduSignature signature;
 
-	rts = (rpcconn_rts_hdr_t*) rpc->buffer;
+	rts = (rpcconn_rts_hdr_t*) buffer;
 
 	rts_extract_pdu_signature(rpc, &signature, rts);
+#ifdef WITH_DEBUG_RTS
 	rts_print_pdu_signature(rpc, &signature);
+#endif
 	SignatureId = rts_identify_pdu_signature(rpc, &signature, NULL);
 
 	if (SignatureId == RTS_PDU_FLOW_CONTROL_ACK)
@@ -1363,7 +1374,7 @@ int rts_recv_out_of_sequence_pdu(rdpRpc* rpc)
 	}
 	else if (SignatureId == RTS_PDU_FLOW_CONTROL_ACK_WITH_DESTINATION)
 	{
-		return rts_recv_flow_control_ack_with_destination_pdu(rpc, rpc->buffer, rpc->length);
+		return rts_recv_flow_control_ack_with_destination_pdu(rpc, buffer, length);
 	}
 
 	return 0;
@@ -223,7 +223,7 @@ int rts_send_flow_control_ack_pdu(rdpRpc* rpc);
 int rts_send_ping_pdu(rdpRpc* rpc);
 
 int rts_recv_pdu(rdpRpc* rpc);
-int rts_recv_out_of_sequence_pdu(rdpRpc* rpc);
+int rts_recv_out_of_sequence_pdu(rdpRpc* rpc, BYTE* buffer, UINT32 length);
 
 #ifdef WITH_DEBUG_TSG
 #define WITH_DEBUG_RTS
@@ -23,6 +23,9 @@
 
 #include "security.h"
 
+/* payload bytes hashed then encrypted at a time by the single-pass functions */
+#define SECURITY_BLOCK_LENGTH		2048
+
 /* 0x36 repeated 40 times */
 static const BYTE pad1[40] =
 {
@@ -227,44 +230,66 @@ void security_mac_data(BYTE* mac_salt_key, BYTE* data, UINT32 length, BYTE* outp
 	crypto_md5_final(md5, output);
 }
 
-void security_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BYTE* output)
+/**
+ * The MAC key and pads prefix every signature: rdp->mac_sha1 and rdp->mac_md5
+ * hold the hash states after them, and each signature starts from a copy.
+ */
+
+static void security_mac_prefix(rdpRdp* rdp)
+{
+	crypto_sha1_reset(&rdp->mac_sha1);
+	crypto_sha1_update(&rdp->mac_sha1, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
+	crypto_sha1_update(&rdp->mac_sha1, pad1, sizeof(pad1)); /* pad1 */
+
+	crypto_md5_reset(&rdp->mac_md5);
+	crypto_md5_update(&rdp->mac_md5, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
+	crypto_md5_update(&rdp->mac_md5, pad2, sizeof(pad2)); /* pad2 */
+}
+
+static void security_mac_begin(rdpRdp* rdp, CryptoSha1 sha1, UINT32 length)
 {
-	CryptoMd5 md5;
-	CryptoSha1 sha1;
 	BYTE length_le[4];
-	BYTE md5_digest[CRYPTO_MD5_DIGEST_LENGTH];
-	BYTE sha1_digest[CRYPTO_SHA1_DIGEST_LENGTH];
 
 	security_UINT32_le(length_le, length); /* length must be little-endian */
 
 	/* SHA1_Digest = SHA1(MACKeyN + pad1 + length + data) */
-	sha1 = crypto_sha1_init();
-	crypto_sha1_update(sha1, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
-	crypto_sha1_update(sha1, pad1, sizeof(pad1)); /* pad1 */
+	*sha1 = rdp->mac_sha1;
 	crypto_sha1_update(sha1, length_le, sizeof(length_le)); /* length */
-	crypto_sha1_update(sha1, data, length); /* data */
-	crypto_sha1_final(sha1, sha1_digest);
+}
+
+static void security_mac_end(rdpRdp* rdp, CryptoSha1 sha1, BYTE* use_count_le, BYTE* output)
+{
+	struct crypto_md5_struct md5;
+	BYTE md5_digest[CRYPTO_MD5_DIGEST_LENGTH];
+	BYTE sha1_digest[CRYPTO_SHA1_DIGEST_LENGTH];
+
+	if (use_count_le)
+		crypto_sha1_update(sha1, use_count_le, 4); /* encryptionCount */
+
+	crypto_sha1_digest(sha1, sha1_digest);
 
 	/* MACSignature = First64Bits(MD5(MACKeyN + pad2 + SHA1_Digest)) */
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
-	crypto_md5_update(md5, pad2, sizeof(pad2)); /* pad2 */
-	crypto_md5_update(md5, sha1_digest, sizeof(sha1_digest)); /* SHA1_Digest */
-	crypto_md5_final(md5, md5_digest);
+	md5 = rdp->mac_md5;
+	crypto_md5_update(&md5, sha1_digest, sizeof(sha1_digest)); /* SHA1_Digest */
+	crypto_md5_digest(&md5, md5_digest);
 
 	memcpy(output, md5_digest, 8);
 }
 
+void security_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BYTE* output)
+{
+	struct crypto_sha1_struct sha1;
+
+	security_mac_begin(rdp, &sha1, length);
+	crypto_sha1_update(&sha1, data, length); /* data */
+	security_mac_end(rdp, &sha1, NULL, output);
+}
+
 void security_salted_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BOOL encryption, BYTE* output)
 {
-	CryptoMd5 md5;
-	CryptoSha1 sha1;
-	BYTE length_le[4];
 	BYTE use_count_le[4];
-	BYTE md5_digest[CRYPTO_MD5_DIGEST_LENGTH];
-	BYTE sha1_digest[CRYPTO_SHA1_DIGEST_LENGTH];
+	struct crypto_sha1_struct sha1;
 
-	security_UINT32_le(length_le, length); /* length must be little-endian */
 	if (encryption)
 	{
 		security_UINT32_le(use_count_le, rdp->encrypt_checksum_use_count);
@@ -279,23 +304,9 @@ void security_salted_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BOOL
 		security_UINT32_le(use_count_le, rdp->decrypt_checksum_use_count - 1);
 	}
 
-	/* SHA1_Digest = SHA1(MACKeyN + pad1 + length + data) */
-	sha1 = crypto_sha1_init();
-	crypto_sha1_update(sha1, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
-	crypto_sha1_update(sha1, pad1, sizeof(pad1)); /* pad1 */
-	crypto_sha1_update(sha1, length_le, sizeof(length_le)); /* length */
-	crypto_sha1_update(sha1, data, length); /* data */
-	crypto_sha1_update(sha1, use_count_le, sizeof(use_count_le)); /* encryptionCount */
-	crypto_sha1_final(sha1, sha1_digest);
-
-	/* MACSignature = First64Bits(MD5(MACKeyN + pad2 + SHA1_Digest)) */
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, rdp->sign_key, rdp->rc4_key_len); /* MacKeyN */
-	crypto_md5_update(md5, pad2, sizeof(pad2)); /* pad2 */
-	crypto_md5_update(md5, sha1_digest, sizeof(sha1_digest)); /* SHA1_Digest */
-	crypto_md5_final(md5, md5_digest);
-
-	memcpy(output, md5_digest, 8);
+	security_mac_begin(rdp, &sha1, length);
+	crypto_sha1_update(&sha1, data, length); /* data */
+	security_mac_end(rdp, &sha1, use_count_le, output);
 }
 
 static void security_A(BYTE* master_secret, BYTE* client_random, BYTE* server_random, BYTE* output)
@@ -374,7 +385,8 @@ BOOL security_establish_keys(BYTE* client_random, rdpRdp* rdp)
 		crypto_sha1_final(sha1, client_encrypt_key_t);
 
 		client_encrypt_key_t[20] = client_encrypt_key_t[0];
-		fips_expand_key_bits(client_encrypt_key_t, rdp->fips_encrypt_key);
+		fips_expand_key_bits(client_encrypt_key_t,
+				settings->ServerMode ? rdp->fips_decrypt_key : rdp->fips_encrypt_key);
 
 		sha1 = crypto_sha1_init();
 		crypto_sha1_update(sha1, client_random, 16);
@@ -382,7 +394,8 @@ BOOL security_establish_keys(BYTE* client_random, rdpRdp* rdp)
 		crypto_sha1_final(sha1, client_decrypt_key_t);
 
 		client_decrypt_key_t[20] = client_decrypt_key_t[0];
-		fips_expand_key_bits(client_decrypt_key_t, rdp->fips_decrypt_key);
+		fips_expand_key_bits(client_decrypt_key_t,
+				settings->ServerMode ? rdp->fips_encrypt_key : rdp->fips_decrypt_key);
 
 		sha1 = crypto_sha1_init();
 		crypto_sha1_update(sha1, client_decrypt_key_t, 20);
@@ -432,32 +445,52 @@ BOOL security_establish_keys(BYTE* client_random, rdpRdp* rdp)
 	rdp->encrypt_use_count =0;
 	rdp->encrypt_checksum_use_count =0;
 
+	if (settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
+	{
+		BYTE fips_ivec[8] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0xAB, 0xCD, 0xEF };
+
+		crypto_des3_free(rdp->fips_encrypt);
+		crypto_des3_free(rdp->fips_decrypt);
+		rdp->fips_encrypt = crypto_des3_encrypt_init(rdp->fips_encrypt_key, fips_ivec);
+		rdp->fips_decrypt = crypto_des3_decrypt_init(rdp->fips_decrypt_key, fips_ivec);
+
+		if (!rdp->fips_hmac)
+			rdp->fips_hmac = crypto_hmac_new();
+
+		crypto_hmac_sha1_init(rdp->fips_hmac, rdp->fips_sign_key, 20);
+
+		return TRUE;
+	}
+
+	crypto_rc4_set_key(&rdp->rc4_decrypt_key, rdp->decrypt_key, rdp->rc4_key_len);
+	crypto_rc4_set_key(&rdp->rc4_encrypt_key, rdp->encrypt_key, rdp->rc4_key_len);
+	security_mac_prefix(rdp);
+
 	return TRUE;
 }
 
 BOOL security_key_update(BYTE* key, BYTE* update_key, int key_len)
 {
 	BYTE sha1h[CRYPTO_SHA1_DIGEST_LENGTH];
-	CryptoMd5 md5;
-	CryptoSha1 sha1;
-	CryptoRc4 rc4;
+	struct crypto_md5_struct md5;
+	struct crypto_sha1_struct sha1;
+	struct crypto_rc4_struct rc4;
 	BYTE salt40[] = { 0xD1, 0x26, 0x9E };
 
-	sha1 = crypto_sha1_init();
-	crypto_sha1_update(sha1, update_key, key_len);
-	crypto_sha1_update(sha1, pad1, sizeof(pad1));
-	crypto_sha1_update(sha1, key, key_len);
-	crypto_sha1_final(sha1, sha1h);
+	crypto_sha1_reset(&sha1);
+	crypto_sha1_update(&sha1, update_key, key_len);
+	crypto_sha1_update(&sha1, pad1, sizeof(pad1));
+	crypto_sha1_update(&sha1, key, key_len);
+	crypto_sha1_digest(&sha1, sha1h);
 
-	md5 = crypto_md5_init();
-	crypto_md5_update(md5, update_key, key_len);
-	crypto_md5_update(md5, pad2, sizeof(pad2));
-	crypto_md5_update(md5, sha1h, sizeof(sha1h));
-	crypto_md5_final(md5, key);
+	crypto_md5_reset(&md5);
+	crypto_md5_update(&md5, update_key, key_len);
+	crypto_md5_update(&md5, pad2, sizeof(pad2));
+	crypto_md5_update(&md5, sha1h, sizeof(sha1h));
+	crypto_md5_digest(&md5, key);
 
-	rc4 = crypto_rc4_init(key, key_len);
-	crypto_rc4(rc4, key_len, key, key);
-	crypto_rc4_free(rc4);
+	crypto_rc4_set_key(&rc4, key, key_len);
+	crypto_rc4(&rc4, key_len, key, key);
 
 	if (key_len == 8)
 		memcpy(key, salt40, 3); /* TODO 56 bit */
@@ -465,36 +498,109 @@ BOOL security_key_update(BYTE* key, BYTE* update_key, int key_len)
 	return TRUE;
 }
 
-BOOL security_encrypt(BYTE* data, int length, rdpRdp* rdp)
+static void security_encrypt_key_update(rdpRdp* rdp)
 {
 	if (rdp->encrypt_use_count >= 4096)
 	{
 		security_key_update(rdp->encrypt_key, rdp->encrypt_update_key, rdp->rc4_key_len);
-		crypto_rc4_free(rdp->rc4_encrypt_key);
-		rdp->rc4_encrypt_key = crypto_rc4_init(rdp->encrypt_key, rdp->rc4_key_len);
+		crypto_rc4_set_key(&rdp->rc4_encrypt_key, rdp->encrypt_key, rdp->rc4_key_len);
 		rdp->encrypt_use_count = 0;
 	}
-	crypto_rc4(rdp->rc4_encrypt_key, length, data, data);
-	rdp->encrypt_use_count++;
-	rdp->encrypt_checksum_use_count++;
-	return TRUE;
 }
 
-BOOL security_decrypt(BYTE* data, int length, rdpRdp* rdp)
+static void security_decrypt_key_update(rdpRdp* rdp)
 {
 	if (rdp->decrypt_use_count >= 4096)
 	{
 		security_key_update(rdp->decrypt_key, rdp->decrypt_update_key, rdp->rc4_key_len);
-		crypto_rc4_free(rdp->rc4_decrypt_key);
-		rdp->rc4_decrypt_key = crypto_rc4_init(rdp->decrypt_key, rdp->rc4_key_len);
+		crypto_rc4_set_key(&rdp->rc4_decrypt_key, rdp->decrypt_key, rdp->rc4_key_len);
 		rdp->decrypt_use_count = 0;
 	}
-	crypto_rc4(rdp->rc4_decrypt_key, length, data, data);
+}
+
+BOOL security_encrypt(BYTE* data, int length, rdpRdp* rdp)
+{
+	security_encrypt_key_update(rdp);
+	crypto_rc4(&rdp->rc4_encrypt_key, length, data, data);
+	rdp->encrypt_use_count++;
+	rdp->encrypt_checksum_use_count++;
+	return TRUE;
+}
+
+BOOL security_decrypt(BYTE* data, int length, rdpRdp* rdp)
+{
+	security_decrypt_key_update(rdp);
+	crypto_rc4(&rdp->rc4_decrypt_key, length, data, data);
 	rdp->decrypt_use_count += 1;
 	rdp->decrypt_checksum_use_count++;
 	return TRUE;
 }
 
+/**
+ * Signs and encrypts in a single pass: each block of the payload is hashed
+ * and encrypted in turn, while it is still in cache. The signature is the
+ * one of security_mac_signature() or security_salted_mac_signature().
+ */
+
+void security_sign_and_encrypt(rdpRdp* rdp, BYTE* data, UINT32 length, BOOL salted, BYTE* output)
+{
+	UINT32 count;
+	BYTE use_count_le[4];
+	struct crypto_sha1_struct sha1;
+
+	security_UINT32_le(use_count_le, rdp->encrypt_checksum_use_count);
+	security_encrypt_key_update(rdp);
+	security_mac_begin(rdp, &sha1, length);
+
+	while (length > 0)
+	{
+		count = (length < SECURITY_BLOCK_LENGTH) ? length : SECURITY_BLOCK_LENGTH;
+
+		crypto_sha1_update(&sha1, data, count);
+		crypto_rc4(&rdp->rc4_encrypt_key, count, data, data);
+
+		data += count;
+		length -= count;
+	}
+
+	security_mac_end(rdp, &sha1, salted ? use_count_le : NULL, output);
+
+	rdp->encrypt_use_count++;
+	rdp->encrypt_checksum_use_count++;
+}
+
+/**
+ * The reverse of security_sign_and_encrypt(): output receives the signature
+ * of the decrypted payload, to be compared with the one that came with it.
+ */
+
+void security_decrypt_and_sign(rdpRdp* rdp, BYTE* data, UINT32 length, BOOL salted, BYTE* output)
+{
+	UINT32 count;
+	BYTE use_count_le[4];
+	struct crypto_sha1_struct sha1;
+
+	security_UINT32_le(use_count_le, rdp->decrypt_checksum_use_count);
+	security_decrypt_key_update(rdp);
+	security_mac_begin(rdp, &sha1, length);
+
+	while (length > 0)
+	{
+		count = (length < SECURITY_BLOCK_LENGTH) ? length : SECURITY_BLOCK_LENGTH;
+
+		crypto_rc4(&rdp->rc4_decrypt_key, count, data, data);
+		crypto_sha1_update(&sha1, data, count);
+
+		data += count;
+		length -= count;
+	}
+
+	security_mac_end(rdp, &sha1, salted ? use_count_le : NULL, output);
+
+	rdp->decrypt_use_count++;
+	rdp->decrypt_checksum_use_count++;
+}
+
 void security_hmac_signature(BYTE* data, int length, BYTE* output, rdpRdp* rdp)
 {
 	BYTE buf[20];
@@ -502,7 +608,7 @@ void security_hmac_signature(BYTE* data, int length, BYTE* output, rdpRdp* rdp)
 
 	security_UINT32_le(use_count_le, rdp->encrypt_use_count);
 
-	crypto_hmac_sha1_init(rdp->fips_hmac, rdp->fips_sign_key, 20);
+	crypto_hmac_reset(rdp->fips_hmac);
 	crypto_hmac_update(rdp->fips_hmac, data, length);
 	crypto_hmac_update(rdp->fips_hmac, use_count_le, 4);
 	crypto_hmac_final(rdp->fips_hmac, buf, 20);
@@ -530,7 +636,7 @@ BOOL security_fips_check_signature(BYTE* data, int length, BYTE* sig, rdpRdp* rd
 
 	security_UINT32_le(use_count_le, rdp->decrypt_use_count);
 
-	crypto_hmac_sha1_init(rdp->fips_hmac, rdp->fips_sign_key, 20);
+	crypto_hmac_reset(rdp->fips_hmac);
 	crypto_hmac_update(rdp->fips_hmac, data, length);
 	crypto_hmac_update(rdp->fips_hmac, use_count_le, 4);
 	crypto_hmac_final(rdp->fips_hmac, buf, 20);
@@ -542,3 +648,74 @@ BOOL security_fips_check_signature(BYTE* data, int length, BYTE* sig, rdpRdp* rd
 
 	return TRUE;
 }
+
+/**
+ * FIPS counterpart of security_sign_and_encrypt(): the HMAC covers the
+ * length bytes of data, the encryption the pad bytes that follow as well.
+ */
+
+void security_fips_sign_and_encrypt(rdpRdp* rdp, BYTE* data, UINT32 length, UINT32 pad, BYTE* output)
+{
+	UINT32 count;
+	UINT32 signed_count;
+	BYTE buf[20];
+	BYTE use_count_le[4];
+
+	security_UINT32_le(use_count_le, rdp->encrypt_use_count);
+	crypto_hmac_reset(rdp->fips_hmac);
+
+	for (signed_count = length, length += pad; length > 0; )
+	{
+		count = (length < SECURITY_BLOCK_LENGTH) ? length : SECURITY_BLOCK_LENGTH;
+
+		crypto_hmac_update(rdp->fips_hmac, data, (count < signed_count) ? count : signed_count);
+		crypto_des3_encrypt(rdp->fips_encrypt, count, data, data);
+
+		signed_count = (count < signed_count) ? signed_count - count : 0;
+		data += count;
+		length -= count;
+	}
+
+	crypto_hmac_update(rdp->fips_hmac, use_count_le, 4);
+	crypto_hmac_final(rdp->fips_hmac, buf, 20);
+
+	memcpy(output, buf, 8);
+
+	rdp->encrypt_use_count++;
+}
+
+BOOL security_fips_decrypt_and_check(rdpRdp* rdp, BYTE* data, UINT32 length, UINT32 pad, BYTE* sig)
+{
+	UINT32 count;
+	UINT32 signed_count;
+	BYTE buf[20];
+	BYTE use_count_le[4];
+
+	if ((length % 8) || (pad > length))
+		return FALSE;
+
+	security_UINT32_le(use_count_le, rdp->decrypt_use_count);
+	crypto_hmac_reset(rdp->fips_hmac);
+
+	for (signed_count = length - pad; length > 0; )
+	{
+		count = (length < SECURITY_BLOCK_LENGTH) ? length : SECURITY_BLOCK_LENGTH;
+
+		crypto_des3_decrypt(rdp->fips_decrypt, count, data, data);
+		crypto_hmac_update(rdp->fips_hmac, data, (count < signed_count) ? count : signed_count);
+
+		signed_count = (count < signed_count) ? signed_count - count : 0;
+		data += count;
+		length -= count;
+	}
+
+	crypto_hmac_update(rdp->fips_hmac, use_count_le, 4);
+	crypto_hmac_final(rdp->fips_hmac, buf, 20);
+
+	rdp->decrypt_use_count++;
+
+	if (memcmp(sig, buf, 8))
+		return FALSE;
+
+	return TRUE;
+}
@@ -30,18 +30,22 @@ void security_master_secret(BYTE* premaster_secret, BYTE* client_random, BYTE* s
 void security_session_key_blob(BYTE* master_secret, BYTE* client_random, BYTE* server_random, BYTE* output);
 void security_mac_salt_key(BYTE* session_key_blob, BYTE* client_random, BYTE* server_random, BYTE* output);
 void security_licensing_encryption_key(BYTE* session_key_blob, BYTE* client_random, BYTE* server_random, BYTE* output);
-void security_mac_data(BYTE* mac_salt_key, BYTE* data, UINT32 length, BYTE* output);
+FREERDP_TEST_API void security_mac_data(BYTE* mac_salt_key, BYTE* data, UINT32 length, BYTE* output);
 
 void security_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BYTE* output);
 void security_salted_mac_signature(rdpRdp *rdp, BYTE* data, UINT32 length, BOOL encryption, BYTE* output);
-BOOL security_establish_keys(BYTE* client_random, rdpRdp* rdp);
+FREERDP_TEST_API BOOL security_establish_keys(BYTE* client_random, rdpRdp* rdp);
 
-BOOL security_encrypt(BYTE* data, int length, rdpRdp* rdp);
+FREERDP_TEST_API BOOL security_encrypt(BYTE* data, int length, rdpRdp* rdp);
 BOOL security_decrypt(BYTE* data, int length, rdpRdp* rdp);
+FREERDP_TEST_API void security_sign_and_encrypt(rdpRdp* rdp, BYTE* data, UINT32 length, BOOL salted, BYTE* output);
+FREERDP_TEST_API void security_decrypt_and_sign(rdpRdp* rdp, BYTE* data, UINT32 length, BOOL salted, BYTE* output);
 
 void security_hmac_signature(BYTE* data, int length, BYTE* output, rdpRdp* rdp);
-BOOL security_fips_encrypt(BYTE* data, int length, rdpRdp* rdp);
+FREERDP_TEST_API BOOL security_fips_encrypt(BYTE* data, int length, rdpRdp* rdp);
 BOOL security_fips_decrypt(BYTE* data, int length, rdpRdp* rdp);
 BOOL security_fips_check_signature(BYTE* data, int length, BYTE* sig, rdpRdp* rdp);
+FREERDP_TEST_API void security_fips_sign_and_encrypt(rdpRdp* rdp, BYTE* data, UINT32 length, UINT32 pad, BYTE* output);
+FREERDP_TEST_API BOOL security_fips_decrypt_and_check(rdpRdp* rdp, BYTE* data, UINT32 length, UINT32 pad, BYTE* sig);
 
 #endif /* __SECURITY_H */
@@ -40,6 +40,10 @@
 #include <netinet/tcp.h>
 #include <net/if.h>
 
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
 #ifdef __APPLE__
 #ifndef TCP_KEEPIDLE
 #define TCP_KEEPIDLE TCP_KEEPALIVE
@@ -169,6 +173,112 @@ int tcp_write(rdpTcp* tcp, BYTE* data, int length)
 	return freerdp_tcp_write(tcp->sockfd, data, length);
 }
 
+/**
+ * Waits up to timeout milliseconds for the socket to take more data, or
+ * for data to arrive as well when read is set.
+ */
+
+int tcp_wait_write(rdpTcp* tcp, BOOL read, int timeout)
+{
+	fd_set rfds;
+	fd_set wfds;
+	struct timeval tv;
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(tcp->sockfd, &wfds);
+
+	if (read)
+		FD_SET(tcp->sockfd, &rfds);
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	return select(tcp->sockfd + 1, &rfds, &wfds, NULL, &tv);
+}
+
+/**
+ * Sizes the send side from TCP_INFO. The congestion window is the sender's
+ * own estimate of the bandwidth-delay product: the send buffer holds twice
+ * that, leaving room for the window to grow, plus the unsent queue. The
+ * unsent queue is held to half a window, enough to keep the pipe full while
+ * the application wakes up but too short for queued frames to go stale.
+ */
+
+BOOL tcp_update_send_window(rdpTcp* tcp)
+{
+#if defined(TCP_INFO) && !defined(_WIN32)
+	UINT32 limit;
+	UINT32 size;
+	UINT32 window;
+	int option_value;
+	struct tcp_info info;
+	socklen_t length = sizeof(info);
+
+	if (getsockopt(tcp->sockfd, IPPROTO_TCP, TCP_INFO, (void*) &info, &length) != 0)
+		return FALSE;
+
+	window = info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+
+	limit = MIN(MAX(window / 2, TCP_MIN_SEND_QUEUE), TCP_MAX_SEND_QUEUE);
+
+	if (limit != tcp->send_queue_limit)
+	{
+		tcp->send_queue_limit = limit;
+
+#ifdef TCP_NOTSENT_LOWAT
+		/* writes are taken up to the limit, POLLOUT is reported below half of it */
+		option_value = limit;
+		setsockopt(tcp->sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (void*) &option_value, sizeof(option_value));
+#endif
+	}
+
+	size = MIN(MAX((2 * window) + limit, TCP_MIN_SEND_BUFFER), TCP_MAX_SEND_BUFFER);
+
+	if ((size > tcp->send_buffer_size + (tcp->send_buffer_size / 4)) ||
+			(size < tcp->send_buffer_size - (tcp->send_buffer_size / 4)))
+	{
+		tcp->send_buffer_size = size;
+		option_value = size;
+		setsockopt(tcp->sockfd, SOL_SOCKET, SO_SNDBUF, (void*) &option_value, sizeof(option_value));
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Bytes written to the socket and not sent yet, or -1 when unknown.
+ * Without SIOCOUTQNSD, SIOCOUTQ and FIONWRITE also count the bytes sent
+ * but not acknowledged yet, which only makes the estimate conservative.
+ */
+
+int tcp_get_send_queue(rdpTcp* tcp)
+{
+#if defined(SIOCOUTQNSD) || defined(SIOCOUTQ) || defined(FIONWRITE)
+	int queued;
+#endif
+
+#ifdef SIOCOUTQNSD
+	if (ioctl(tcp->sockfd, SIOCOUTQNSD, &queued) == 0)
+		return queued;
+#endif
+
+#ifdef SIOCOUTQ
+	if (ioctl(tcp->sockfd, SIOCOUTQ, &queued) == 0)
+		return queued;
+#endif
+
+#ifdef FIONWRITE
+	if (ioctl(tcp->sockfd, FIONWRITE, &queued) == 0)
+		return queued;
+#endif
+
+	return -1;
+}
+
 BOOL tcp_disconnect(rdpTcp* tcp)
 {
 	freerdp_tcp_disconnect(tcp->sockfd);
@@ -31,6 +31,11 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#define TCP_MIN_SEND_QUEUE	0x8000
+#define TCP_MAX_SEND_QUEUE	0x100000
+#define TCP_MIN_SEND_BUFFER	0x10000
+#define TCP_MAX_SEND_BUFFER	0x800000
+
 typedef struct rdp_tcp rdpTcp;
 
 struct rdp_tcp
@@ -39,6 +44,8 @@ struct rdp_tcp
 	char ip_address[32];
 	BYTE mac_address[6];
 	struct rdp_settings* settings;
+	UINT32 send_queue_limit;
+	UINT32 send_buffer_size;
 #ifdef _WIN32
 	WSAEVENT wsa_event;
 #endif
@@ -48,6 +55,9 @@ BOOL tcp_connect(rdpTcp* tcp, const char* hostname, UINT16 port);
 BOOL tcp_disconnect(rdpTcp* tcp);
 int tcp_read(rdpTcp* tcp, BYTE* data, int length);
 int tcp_write(rdpTcp* tcp, BYTE* data, int length);
+int tcp_wait_write(rdpTcp* tcp, BOOL read, int timeout);
+BOOL tcp_update_send_window(rdpTcp* tcp);
+int tcp_get_send_queue(rdpTcp* tcp);
 BOOL tcp_set_blocking_mode(rdpTcp* tcp, BOOL blocking);
 BOOL tcp_set_keep_alive_mode(rdpTcp* tcp);
 
@@ -0,0 +1,231 @@
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include "test_core.h"
+
+/**
+ * Many TLS handshakes are left half-finished while a single thread keeps
+ * calling CheckFileDescriptor on every peer: none of the calls may block,
+ * and every handshake must complete once its client carries on.
+ */
+
+#define TEST_ACCEPT_PEERS		200
+
+#define TEST_ACCEPT_CERT_FILE		"TestCoreAccept.crt"
+#define TEST_ACCEPT_KEY_FILE		"TestCoreAccept.key"
+
+/* TPKT, X.224 Connection Request, RDP Negotiation Request for TLS */
+
+static BYTE test_connection_request[19] =
+	"\x03\x00\x00\x13\x0E\xE0\x00\x00\x00\x00\x00\x01\x00\x08\x00\x01\x00\x00\x00";
+
+static int test_logons = 0;
+
+static BOOL test_peer_logon(freerdp_peer* client, SEC_WINNT_AUTH_IDENTITY* identity, BOOL automatic)
+{
+	test_logons++;
+	return TRUE;
+}
+
+static BOOL test_check_peers(freerdp_peer** peers, long* usec)
+{
+	int index;
+	long start;
+
+	start = test_now();
+
+	for (index = 0; index < TEST_ACCEPT_PEERS; index++)
+	{
+		if (peers[index]->CheckFileDescriptor(peers[index]) != TRUE)
+		{
+			printf("CheckFileDescriptor failed for peer %d\n", index);
+			return FALSE;
+		}
+	}
+
+	*usec = test_now() - start;
+
+	return TRUE;
+}
+
+int TestCoreAccept(int argc, char* argv[])
+{
+	int index;
+	int pass;
+	int status;
+	int listener;
+	int connected;
+	long usec;
+	long total;
+	socklen_t length;
+	SSL_CTX* ctx;
+	BYTE response[19];
+	struct sockaddr_in addr;
+	int clients[TEST_ACCEPT_PEERS];
+	SSL* ssl[TEST_ACCEPT_PEERS];
+	BOOL done[TEST_ACCEPT_PEERS];
+	freerdp_peer* peers[TEST_ACCEPT_PEERS];
+
+	SSL_load_error_strings();
+	SSL_library_init();
+
+	if (!test_write_certificate(TEST_ACCEPT_CERT_FILE, TEST_ACCEPT_KEY_FILE, "TestCoreAccept"))
+	{
+		printf("failed to generate a test certificate\n");
+		return -1;
+	}
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	length = sizeof(addr);
+
+	if ((bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(listener, TEST_ACCEPT_PEERS) != 0) ||
+			(getsockname(listener, (struct sockaddr*) &addr, &length) != 0))
+	{
+		printf("failed to listen on the loopback interface\n");
+		return -1;
+	}
+
+	/* connection requests: the security layer handshakes start here */
+
+	for (index = 0; index < TEST_ACCEPT_PEERS; index++)
+	{
+		clients[index] = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (connect(clients[index], (struct sockaddr*) &addr, sizeof(addr)) != 0)
+		{
+			printf("connect failed for client %d\n", index);
+			return -1;
+		}
+
+		peers[index] = freerdp_peer_new(accept(listener, NULL, NULL));
+		peers[index]->Logon = test_peer_logon;
+		freerdp_peer_context_new(peers[index]);
+
+		peers[index]->settings->CertificateFile = _strdup(TEST_ACCEPT_CERT_FILE);
+		peers[index]->settings->PrivateKeyFile = _strdup(TEST_ACCEPT_KEY_FILE);
+		peers[index]->settings->NlaSecurity = FALSE;
+		peers[index]->settings->TlsSecurity = TRUE;
+		peers[index]->settings->RdpSecurity = FALSE;
+		peers[index]->Initialize(peers[index]);
+
+		send(clients[index], test_connection_request, sizeof(test_connection_request), 0);
+	}
+
+	if (!test_check_peers(peers, &usec))
+		return -1;
+
+	ctx = SSL_CTX_new(SSLv23_client_method());
+
+	for (index = 0; index < TEST_ACCEPT_PEERS; index++)
+	{
+		if (recv(clients[index], response, sizeof(response), MSG_WAITALL) != sizeof(response))
+		{
+			printf("no negotiation response for client %d\n", index);
+			return -1;
+		}
+
+		fcntl(clients[index], F_SETFL, fcntl(clients[index], F_GETFL) | O_NONBLOCK);
+
+		ssl[index] = SSL_new(ctx);
+		SSL_set_fd(ssl[index], clients[index]);
+		SSL_connect(ssl[index]); /* ClientHello */
+		done[index] = FALSE;
+	}
+
+	/* the server answers every ClientHello, then the clients stall */
+
+	if (!test_check_peers(peers, &usec))
+		return -1;
+
+	for (pass = 0, total = 0; pass < 10; pass++)
+	{
+		if (!test_check_peers(peers, &usec))
+			return -1;
+
+		total += usec;
+	}
+
+	printf("%d half-finished handshakes: %ld us per pass over all peers\n", TEST_ACCEPT_PEERS, total / 10);
+
+	if (test_logons != 0)
+	{
+		printf("Logon called before the end of the handshake\n");
+		return -1;
+	}
+
+	/* the clients carry on, all handshakes progress on this thread */
+
+	total = 0;
+	connected = 0;
+
+	for (pass = 0; (pass < 1000) && ((connected < TEST_ACCEPT_PEERS) || (test_logons < TEST_ACCEPT_PEERS)); pass++)
+	{
+		for (index = 0; index < TEST_ACCEPT_PEERS; index++)
+		{
+			if (done[index])
+				continue;
+
+			status = SSL_connect(ssl[index]);
+
+			if (status == 1)
+			{
+				done[index] = TRUE;
+				connected++;
+			}
+			else if ((SSL_get_error(ssl[index], status) != SSL_ERROR_WANT_READ) &&
+					(SSL_get_error(ssl[index], status) != SSL_ERROR_WANT_WRITE))
+			{
+				printf("SSL_connect failed for client %d\n", index);
+				return -1;
+			}
+		}
+
+		if (!test_check_peers(peers, &usec))
+			return -1;
+
+		total += usec;
+	}
+
+	if ((connected != TEST_ACCEPT_PEERS) || (test_logons != TEST_ACCEPT_PEERS))
+	{
+		printf("handshakes completed: %d clients, %d peers, expected %d\n",
+				connected, test_logons, TEST_ACCEPT_PEERS);
+		return -1;
+	}
+
+	printf("%d handshakes completed on one thread in %d passes: %ld us\n", TEST_ACCEPT_PEERS, pass, total);
+
+	for (index = 0; index < TEST_ACCEPT_PEERS; index++)
+	{
+		SSL_free(ssl[index]);
+		close(clients[index]);
+
+		peers[index]->Disconnect(peers[index]);
+		freerdp_peer_context_free(peers[index]);
+		freerdp_peer_free(peers[index]);
+	}
+
+	SSL_CTX_free(ctx);
+	close(listener);
+
+	unlink(TEST_ACCEPT_CERT_FILE);
+	unlink(TEST_ACCEPT_KEY_FILE);
+
+	return 0;
+}
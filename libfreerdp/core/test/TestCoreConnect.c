@@ -0,0 +1,229 @@
+
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include "test_core.h"
+
+/**
+ * A client with static channels connects to a peer through a proxy that
+ * delays every chunk by a fixed one-way latency. The channel joins are
+ * pipelined, so they cost a single round trip however many channels
+ * there are, and the whole connection stays within a fixed number of
+ * round trips.
+ */
+
+#define TEST_CONNECT_CHANNELS		8
+#define TEST_CONNECT_DELAY		25000 /* one-way, in microseconds */
+#define TEST_CONNECT_MAX_ROUND_TRIPS	12
+
+#define TEST_CONNECT_CERT_FILE		"TestCoreConnect.crt"
+#define TEST_CONNECT_KEY_FILE		"TestCoreConnect.key"
+
+static int test_server_listener;
+static volatile BOOL test_done = FALSE;
+static BOOL test_connected = FALSE;
+
+static BOOL test_peer_activate(freerdp_peer* client)
+{
+	return TRUE;
+}
+
+static BOOL test_peer_logon(freerdp_peer* client, SEC_WINNT_AUTH_IDENTITY* identity, BOOL automatic)
+{
+	return TRUE;
+}
+
+static void* test_server_thread(void* arg)
+{
+	struct pollfd pfd;
+	freerdp_peer* client;
+
+	client = freerdp_peer_new(accept(test_server_listener, NULL, NULL));
+	client->PostConnect = test_peer_activate;
+	client->Activate = test_peer_activate;
+	client->Logon = test_peer_logon;
+	freerdp_peer_context_new(client);
+
+	client->settings->CertificateFile = _strdup(TEST_CONNECT_CERT_FILE);
+	client->settings->PrivateKeyFile = _strdup(TEST_CONNECT_KEY_FILE);
+	client->settings->NlaSecurity = FALSE;
+	client->settings->TlsSecurity = TRUE;
+	client->settings->RdpSecurity = FALSE;
+	client->Initialize(client);
+
+	while (!test_done)
+	{
+		pfd.fd = client->sockfd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, 10) <= 0)
+			continue;
+
+		if (client->CheckFileDescriptor(client) != TRUE)
+			break;
+	}
+
+	client->Disconnect(client);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+
+	return NULL;
+}
+
+static BOOL test_client_pre_connect(freerdp* instance)
+{
+	return TRUE;
+}
+
+static BOOL test_client_post_connect(freerdp* instance)
+{
+	return TRUE;
+}
+
+static void* test_client_thread(void* arg)
+{
+	test_connected = freerdp_connect((freerdp*) arg);
+
+	return NULL;
+}
+
+int TestCoreConnect(int argc, char* argv[])
+{
+	int index;
+	int proxy_listener;
+	int proxy_client;
+	int proxy_server;
+	long usec;
+	long round_trips;
+	freerdp* instance;
+	rdpSettings* settings;
+	struct sockaddr_in server_addr;
+	struct sockaddr_in proxy_addr;
+	struct test_proxy_link upstream;
+	struct test_proxy_link downstream;
+	HANDLE server_thread;
+	HANDLE client_thread;
+	HANDLE upstream_thread;
+	HANDLE downstream_thread;
+
+	if (!test_write_certificate(TEST_CONNECT_CERT_FILE, TEST_CONNECT_KEY_FILE, "TestCoreConnect"))
+	{
+		printf("failed to generate a test certificate\n");
+		return -1;
+	}
+
+	test_server_listener = test_listen(&server_addr);
+	proxy_listener = test_listen(&proxy_addr);
+
+	if ((test_server_listener < 0) || (proxy_listener < 0))
+	{
+		printf("failed to listen on the loopback interface\n");
+		return -1;
+	}
+
+	server_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_server_thread, NULL, 0, NULL);
+
+	instance = freerdp_new();
+	instance->PreConnect = test_client_pre_connect;
+	instance->PostConnect = test_client_post_connect;
+	freerdp_context_new(instance);
+
+	settings = instance->settings;
+	settings->ServerHostname = _strdup("127.0.0.1");
+	settings->ServerPort = ntohs(proxy_addr.sin_port);
+	settings->Username = _strdup("TestCoreConnect");
+	settings->Password = _strdup("TestCoreConnect");
+	settings->Domain = _strdup("");
+	settings->IgnoreCertificate = TRUE;
+	settings->NlaSecurity = FALSE;
+	settings->TlsSecurity = TRUE;
+	settings->RdpSecurity = FALSE;
+
+	for (index = 0; index < TEST_CONNECT_CHANNELS; index++)
+	{
+		sprintf_s(settings->ChannelDefArray[index].Name, 8, "test%d", index);
+		settings->ChannelDefArray[index].options = CHANNEL_OPTION_INITIALIZED;
+	}
+
+	settings->ChannelCount = TEST_CONNECT_CHANNELS;
+
+	/* the proxy connects to the peer as soon as the client connects to it */
+
+	usec = test_now();
+
+	client_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_client_thread, instance, 0, NULL);
+
+	proxy_client = accept(proxy_listener, NULL, NULL);
+	proxy_server = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (connect(proxy_server, (struct sockaddr*) &server_addr, sizeof(server_addr)) != 0)
+	{
+		printf("the proxy failed to connect to the peer\n");
+		return -1;
+	}
+
+	upstream.src = proxy_client;
+	upstream.dst = proxy_server;
+	upstream.delay = TEST_CONNECT_DELAY;
+	downstream.src = proxy_server;
+	downstream.dst = proxy_client;
+	downstream.delay = TEST_CONNECT_DELAY;
+
+	upstream_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_proxy_thread, &upstream, 0, NULL);
+	downstream_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_proxy_thread, &downstream, 0, NULL);
+
+	WaitForSingleObject(client_thread, INFINITE);
+	CloseHandle(client_thread);
+
+	usec = test_now() - usec;
+	round_trips = usec / (2 * TEST_CONNECT_DELAY);
+
+	printf("%d static channels, %d ms one-way delay: connected in %ld ms, %ld round trips\n",
+			TEST_CONNECT_CHANNELS, TEST_CONNECT_DELAY / 1000, usec / 1000, round_trips);
+
+	if (!test_connected || !settings->ChannelDefArray[TEST_CONNECT_CHANNELS - 1].joined)
+	{
+		printf("freerdp_connect failed\n");
+		return -1;
+	}
+
+	if (round_trips > TEST_CONNECT_MAX_ROUND_TRIPS)
+	{
+		printf("connection took more than %d round trips\n", TEST_CONNECT_MAX_ROUND_TRIPS);
+		return -1;
+	}
+
+	test_done = TRUE;
+
+	freerdp_disconnect(instance);
+	WaitForSingleObject(upstream_thread, INFINITE);
+	WaitForSingleObject(downstream_thread, INFINITE);
+	WaitForSingleObject(server_thread, INFINITE);
+	CloseHandle(upstream_thread);
+	CloseHandle(downstream_thread);
+	CloseHandle(server_thread);
+
+	close(proxy_client);
+	close(proxy_server);
+	close(proxy_listener);
+	close(test_server_listener);
+
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+
+	unlink(TEST_CONNECT_CERT_FILE);
+	unlink(TEST_CONNECT_KEY_FILE);
+
+	return 0;
+}
@@ -0,0 +1,475 @@
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/crypto/tls.h>
+
+#include "tsg.h"
+
+#include "test_core.h"
+
+/**
+ * A stand-in gateway streams pipe data to the client over an OUT channel
+ * delayed by a fixed one-way latency, only sending as much as the flow
+ * control acks received on the IN channel allow. The client reads it with
+ * tsg_read() while writing requests of its own. With a 64 KB window the
+ * transfer is bound by one window per round trip; the default window must
+ * do a lot better.
+ */
+
+#define TEST_GATEWAY_DELAY		25000 /* one-way, in microseconds */
+#define TEST_GATEWAY_STUB_LENGTH	4040
+#define TEST_GATEWAY_PDUS		512
+#define TEST_GATEWAY_WRITES		64
+#define TEST_GATEWAY_WRITE_LENGTH	1000
+
+#define TEST_GATEWAY_CERT_FILE		"TestCoreGateway.crt"
+#define TEST_GATEWAY_KEY_FILE		"TestCoreGateway.key"
+
+struct test_gateway
+{
+	rdpTls* in;
+	rdpTls* out;
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cond;
+	UINT32 bytes_sent;
+	UINT32 credit;
+	int requests;
+	BOOL failed;
+};
+
+static BYTE test_pattern(UINT32 index)
+{
+	return (BYTE) ((index * 7) + (index >> 11));
+}
+
+static BOOL test_read_all(rdpTls* tls, BYTE* data, int length)
+{
+	int status;
+	int offset = 0;
+
+	while (offset < length)
+	{
+		status = tls_read_all(tls, &data[offset], length - offset);
+
+		if (status < 0)
+			return FALSE;
+
+		offset += status;
+	}
+
+	return TRUE;
+}
+
+/* IN channel: flow control acks hand out credit, requests are checked */
+
+static void* test_gateway_in_thread(void* arg)
+{
+	UINT32 index;
+	UINT32 offset;
+	UINT32 frag_length;
+	UINT32 BytesReceived;
+	UINT32 AvailableWindow;
+	BYTE pdu[8192];
+	struct test_gateway* gateway = (struct test_gateway*) arg;
+
+	while (test_read_all(gateway->in, pdu, 16))
+	{
+		frag_length = *((UINT16*) &pdu[8]);
+
+		if ((frag_length > sizeof(pdu)) || !test_read_all(gateway->in, &pdu[16], frag_length - 16))
+			break;
+
+		if (pdu[2] == PTYPE_RTS)
+		{
+			/* RTS header (20 bytes), Destination (8 bytes), FlowControlAck */
+
+			BytesReceived = *((UINT32*) &pdu[32]);
+			AvailableWindow = *((UINT32*) &pdu[36]);
+
+			EnterCriticalSection(&gateway->lock);
+			gateway->credit = AvailableWindow - (gateway->bytes_sent - BytesReceived);
+			WakeConditionVariable(&gateway->cond);
+			LeaveCriticalSection(&gateway->lock);
+		}
+		else if (pdu[2] == PTYPE_REQUEST)
+		{
+			/* TsProxySendToServer: channel context, sizes, then the data, signature last */
+
+			offset = 24 + 32;
+
+			for (index = 0; index < TEST_GATEWAY_WRITE_LENGTH; index++)
+			{
+				if (pdu[offset + index] != test_pattern(gateway->requests + index))
+					gateway->failed = TRUE;
+			}
+
+			if ((*((UINT16*) &pdu[22]) != TsProxySendToServerOpnum) ||
+					(*((UINT32*) &pdu[frag_length - 16]) != 1) ||
+					(*((UINT32*) &pdu[frag_length - 4]) != (UINT32) gateway->requests))
+				gateway->failed = TRUE;
+
+			gateway->requests++;
+		}
+	}
+
+	return NULL;
+}
+
+static void test_gateway_write_response(struct test_gateway* gateway, BYTE* pdu, UINT32 stub_length, UINT32 alloc_hint)
+{
+	UINT32 frag_length = 24 + stub_length + 8 + 16;
+
+	EnterCriticalSection(&gateway->lock);
+
+	while (gateway->credit < frag_length)
+		SleepConditionVariableCS(&gateway->cond, &gateway->lock, INFINITE);
+
+	gateway->credit -= frag_length;
+	gateway->bytes_sent += frag_length;
+
+	LeaveCriticalSection(&gateway->lock);
+
+	pdu[0] = 5;
+	pdu[1] = 0;
+	pdu[2] = PTYPE_RESPONSE;
+	pdu[3] = PFC_FIRST_FRAG | PFC_LAST_FRAG;
+	*((UINT32*) &pdu[4]) = 0x00000010;
+	*((UINT16*) &pdu[8]) = frag_length;
+	*((UINT16*) &pdu[10]) = 16;
+	*((UINT32*) &pdu[12]) = 2;
+	*((UINT32*) &pdu[16]) = alloc_hint;
+	*((UINT32*) &pdu[20]) = 0;
+
+	ZeroMemory(&pdu[24 + stub_length], 8 + 16);
+	pdu[24 + stub_length] = RPC_C_AUTHN_WINNT;
+	pdu[24 + stub_length + 1] = RPC_C_AUTHN_LEVEL_PKT_INTEGRITY;
+
+	tls_write_all(gateway->out, pdu, frag_length);
+}
+
+/* OUT channel: the receive pipe response, then the pipe data */
+
+static void* test_gateway_out_thread(void* arg)
+{
+	UINT32 index;
+	UINT32 position = 0;
+	BYTE pdu[4096];
+	struct test_gateway* gateway = (struct test_gateway*) arg;
+
+	test_gateway_write_response(gateway, pdu, 4, 4);
+
+	for (index = 0; index < TEST_GATEWAY_PDUS; index++)
+	{
+		UINT32 offset;
+
+		for (offset = 0; offset < TEST_GATEWAY_STUB_LENGTH; offset++)
+			pdu[24 + offset] = test_pattern(position++);
+
+		test_gateway_write_response(gateway, pdu, TEST_GATEWAY_STUB_LENGTH, TEST_GATEWAY_STUB_LENGTH);
+	}
+
+	return NULL;
+}
+
+static void* test_gateway_accept_thread(void* arg)
+{
+	struct test_gateway* gateway = (struct test_gateway*) arg;
+
+	if (!tls_accept(gateway->in, TEST_GATEWAY_CERT_FILE, TEST_GATEWAY_KEY_FILE) ||
+			!tls_accept(gateway->out, TEST_GATEWAY_CERT_FILE, TEST_GATEWAY_KEY_FILE))
+		gateway->failed = TRUE;
+
+	return NULL;
+}
+
+/* a client socket reaching the gateway through a pair of delaying proxy threads */
+
+static int test_connect_channel(int gateway_listener, struct sockaddr_in* gateway_addr, int* gateway_socket,
+		struct test_proxy_link* links, HANDLE* threads)
+{
+	int client;
+	int proxy_listener;
+	struct sockaddr_in proxy_addr;
+
+	proxy_listener = test_listen(&proxy_addr);
+	client = socket(AF_INET, SOCK_STREAM, 0);
+
+	if ((proxy_listener < 0) || (connect(client, (struct sockaddr*) &proxy_addr, sizeof(proxy_addr)) != 0))
+		return -1;
+
+	links[0].src = accept(proxy_listener, NULL, NULL);
+	links[0].dst = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (connect(links[0].dst, (struct sockaddr*) gateway_addr, sizeof(struct sockaddr_in)) != 0)
+		return -1;
+
+	*gateway_socket = accept(gateway_listener, NULL, NULL);
+
+	links[1].src = links[0].dst;
+	links[1].dst = links[0].src;
+	links[0].delay = links[1].delay = TEST_GATEWAY_DELAY;
+
+	threads[0] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_proxy_thread, &links[0], 0, NULL);
+	threads[1] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_proxy_thread, &links[1], 0, NULL);
+
+	close(proxy_listener);
+
+	return client;
+}
+
+static long test_transfer(int gateway_listener, struct sockaddr_in* gateway_addr, UINT32 window, UINT32* receive_window)
+{
+	int index;
+	int status;
+	long usec;
+	UINT32 total;
+	UINT32 position;
+	UINT32 written;
+	BYTE* data;
+	BYTE* request;
+	rdpTsg* tsg;
+	rdpRpc* rpc;
+	rdpSettings* settings;
+	rdpTransport* transport;
+	struct test_gateway gateway;
+	struct test_proxy_link links[4];
+	HANDLE proxy_threads[4];
+	HANDLE accept_thread;
+	HANDLE in_thread;
+	HANDLE out_thread;
+	int client_in, client_out;
+	int gateway_in, gateway_out;
+
+	settings = freerdp_settings_new(NULL);
+	settings->IgnoreCertificate = TRUE;
+	settings->ServerHostname = _strdup("127.0.0.1");
+	settings->GatewayReceiveWindow = window;
+
+	transport = (rdpTransport*) calloc(1, sizeof(rdpTransport));
+	transport->settings = settings;
+	transport->recv_event = wait_obj_new();
+	transport->blocking = TRUE;
+
+	tsg = tsg_new(transport);
+	rpc = tsg->rpc;
+
+	/* the IN and OUT channels, as left by the RTS connection sequence */
+
+	client_in = test_connect_channel(gateway_listener, gateway_addr, &gateway_in, &links[0], &proxy_threads[0]);
+	client_out = test_connect_channel(gateway_listener, gateway_addr, &gateway_out, &links[2], &proxy_threads[2]);
+
+	if ((client_in < 0) || (client_out < 0))
+		return -1;
+
+	ZeroMemory(&gateway, sizeof(gateway));
+	InitializeCriticalSection(&gateway.lock);
+	InitializeConditionVariable(&gateway.cond);
+	gateway.credit = rpc->ReceiveWindow;
+	gateway.in = tls_new(settings);
+	gateway.in->sockfd = gateway_in;
+	gateway.out = tls_new(settings);
+	gateway.out->sockfd = gateway_out;
+
+	accept_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_gateway_accept_thread, &gateway, 0, NULL);
+
+	transport->TlsIn = tls_new(settings);
+	transport->TlsIn->sockfd = client_in;
+	transport->TlsOut = tls_new(settings);
+	transport->TlsOut->sockfd = client_out;
+
+	if (!tls_connect(transport->TlsIn) || !tls_connect(transport->TlsOut))
+		return -1;
+
+	WaitForSingleObject(accept_thread, INFINITE);
+	CloseHandle(accept_thread);
+
+	if (gateway.failed)
+		return -1;
+
+	rpc->TlsIn = transport->TlsIn;
+	rpc->TlsOut = transport->TlsOut;
+	rpc->VirtualConnection->State = VIRTUAL_CONNECTION_STATE_OPENED;
+
+	ntlm_client_init(rpc->ntlm, FALSE, "TestCoreGateway", "", "TestCoreGateway");
+	ntlm_authenticate(rpc->ntlm);
+
+	in_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_gateway_in_thread, &gateway, 0, NULL);
+	out_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_gateway_out_thread, &gateway, 0, NULL);
+
+	tsg->state = TSG_STATE_PIPE_CREATED;
+
+	if (!rpc_out_reader_start(rpc))
+		return -1;
+
+	/* read the pipe data, writing requests along the way */
+
+	data = (BYTE*) malloc(65536);
+	request = (BYTE*) malloc(TEST_GATEWAY_WRITE_LENGTH);
+	total = TEST_GATEWAY_PDUS * TEST_GATEWAY_STUB_LENGTH;
+	position = 0;
+	written = 0;
+
+	usec = test_now();
+
+	while (position < total)
+	{
+		status = tsg_read(tsg, data, 65536);
+
+		if (status <= 0)
+		{
+			printf("tsg_read failed after %d bytes\n", position);
+			return -1;
+		}
+
+		for (index = 0; index < status; index++)
+		{
+			if (data[index] != test_pattern(position + index))
+			{
+				printf("unexpected data at offset %d\n", position + index);
+				return -1;
+			}
+		}
+
+		position += status;
+
+		if ((written < TEST_GATEWAY_WRITES) && (position >= written * (total / TEST_GATEWAY_WRITES)))
+		{
+			for (index = 0; index < TEST_GATEWAY_WRITE_LENGTH; index++)
+				request[index] = test_pattern(written + index);
+
+			if (tsg_write(tsg, request, TEST_GATEWAY_WRITE_LENGTH) < 0)
+			{
+				printf("tsg_write failed\n");
+				return -1;
+			}
+
+			written++;
+		}
+	}
+
+	usec = test_now() - usec;
+
+	*receive_window = rpc->ReceiveWindow;
+
+	/* closing the client channels ends the proxies, then the gateway */
+
+	WaitForSingleObject(out_thread, INFINITE);
+	CloseHandle(out_thread);
+
+	tsg_free(tsg);
+	shutdown(gateway_out, SHUT_RDWR);
+	shutdown(client_in, SHUT_RDWR);
+
+	WaitForSingleObject(in_thread, INFINITE);
+	CloseHandle(in_thread);
+	shutdown(gateway_in, SHUT_RDWR);
+
+	for (index = 0; index < 4; index++)
+	{
+		WaitForSingleObject(proxy_threads[index], INFINITE);
+		CloseHandle(proxy_threads[index]);
+	}
+
+	if (gateway.failed || (gateway.requests != (int) written))
+	{
+		printf("the gateway received %d requests out of %d, failed: %d\n",
+				gateway.requests, written, gateway.failed);
+		return -1;
+	}
+
+	for (index = 0; index < 4; index++)
+		close(links[index].src);
+
+	close(client_in);
+	close(client_out);
+	close(gateway_in);
+	close(gateway_out);
+
+	tls_free(transport->TlsIn);
+	tls_free(transport->TlsOut);
+	tls_free(gateway.in);
+	tls_free(gateway.out);
+	DeleteCriticalSection(&gateway.lock);
+	wait_obj_free(transport->recv_event);
+	free(transport);
+	freerdp_settings_free(settings);
+	free(data);
+	free(request);
+
+	return usec;
+}
+
+int TestCoreGateway(int argc, char* argv[])
+{
+	long usec;
+	long bound;
+	long usec_default;
+	UINT32 window;
+	UINT32 bytes;
+	int gateway_listener;
+	struct sockaddr_in gateway_addr;
+
+	if (!test_write_certificate(TEST_GATEWAY_CERT_FILE, TEST_GATEWAY_KEY_FILE, "TestCoreGateway"))
+	{
+		printf("failed to generate a test certificate\n");
+		return -1;
+	}
+
+	gateway_listener = test_listen(&gateway_addr);
+
+	if (gateway_listener < 0)
+	{
+		printf("failed to listen on the loopback interface\n");
+		return -1;
+	}
+
+	bytes = TEST_GATEWAY_PDUS * TEST_GATEWAY_STUB_LENGTH;
+
+	usec = test_transfer(gateway_listener, &gateway_addr, 0x00010000, &window);
+
+	if (usec < 0)
+		return -1;
+
+	printf("%d KB window, %d ms one-way delay: %d KB in %ld ms\n",
+			window / 1024, TEST_GATEWAY_DELAY / 1000, bytes / 1024, usec / 1000);
+
+	/* a window's worth of PDUs per round trip at most */
+
+	bound = (long) ((double) bytes / window * (2 * TEST_GATEWAY_DELAY));
+
+	if (usec < bound / 2)
+	{
+		printf("the configured receive window was not honored\n");
+		return -1;
+	}
+
+	usec_default = test_transfer(gateway_listener, &gateway_addr, 0, &window);
+
+	if (usec_default < 0)
+		return -1;
+
+	printf("%d KB window, %d ms one-way delay: %d KB in %ld ms\n",
+			window / 1024, TEST_GATEWAY_DELAY / 1000, bytes / 1024, usec_default / 1000);
+
+	if (usec_default * 2 > usec)
+	{
+		printf("the default receive window is not faster than a 64 KB window\n");
+		return -1;
+	}
+
+	close(gateway_listener);
+
+	unlink(TEST_GATEWAY_CERT_FILE);
+	unlink(TEST_GATEWAY_KEY_FILE);
+
+	return 0;
+}
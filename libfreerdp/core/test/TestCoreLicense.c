@@ -0,0 +1,201 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/file.h>
+#include <freerdp/crypto/crypto.h>
+
+#include "license.h"
+#include "security.h"
+
+/**
+ * A license issued in a NEW_LICENSE packet is stored for its scope only
+ * when its MAC verifies, and is found again by license_read_stored_license
+ * once the server lists that scope in a later license request.
+ */
+
+#define TEST_LICENSE_CONFIG_PATH	"TestCoreLicense.d"
+#define TEST_LICENSE_HOSTNAME		"TestCoreLicense"
+#define TEST_LICENSE_LENGTH		2048
+
+static char test_scope[] = "../Microsoft Corp";
+static char test_tampered_scope[] = "tampered";
+
+static BYTE test_license_info[TEST_LICENSE_LENGTH];
+
+static void test_write_blob(STREAM* s, char* data, UINT32 length)
+{
+	stream_write_UINT32(s, length);
+	stream_write(s, data, length);
+}
+
+/* an encrypted NEW_LICENSE_INFO and its MAC, as the server sends them */
+
+static STREAM* test_new_license_packet(rdpLicense* license, char* scope, BOOL tamper)
+{
+	STREAM* s;
+	STREAM* info;
+	CryptoRc4 rc4;
+	UINT32 length;
+	BYTE mac_data[16];
+
+	info = stream_new(TEST_LICENSE_LENGTH + 256);
+	stream_write_UINT32(info, 0x00010002); /* dwVersion */
+	test_write_blob(info, scope, strlen(scope) + 1);
+	test_write_blob(info, "TestCore", 9);
+	test_write_blob(info, "A02", 4);
+	test_write_blob(info, (char*) test_license_info, TEST_LICENSE_LENGTH);
+
+	length = stream_get_length(info);
+
+	s = stream_new(length + 20);
+	stream_write_UINT16(s, BB_ENCRYPTED_DATA_BLOB); /* wBlobType */
+	stream_write_UINT16(s, length); /* wBlobLen */
+
+	rc4 = crypto_rc4_init(license->licensing_encryption_key, LICENSING_ENCRYPTION_KEY_LENGTH);
+	crypto_rc4(rc4, length, stream_get_head(info), stream_get_tail(s));
+	crypto_rc4_free(rc4);
+	stream_seek(s, length);
+
+	security_mac_data(license->mac_salt_key, stream_get_head(info), length, mac_data);
+
+	if (tamper)
+		mac_data[7] ^= 0x01;
+
+	stream_write(s, mac_data, 16);
+	stream_seal(s);
+	stream_set_pos(s, 0);
+
+	stream_free(info);
+
+	return s;
+}
+
+/* the scope list of a license request naming a single scope */
+
+static void test_set_scope(rdpLicense* license, char* scope)
+{
+	SCOPE_LIST* scopeList = license->scope_list;
+
+	if (scopeList->count > 0)
+		free(scopeList->array[0].data);
+
+	free(scopeList->array);
+
+	scopeList->count = 1;
+	scopeList->array = (LICENSE_BLOB*) calloc(1, sizeof(LICENSE_BLOB));
+	scopeList->array[0].type = BB_SCOPE_BLOB;
+	scopeList->array[0].length = strlen(scope) + 1;
+	scopeList->array[0].data = (BYTE*) _strdup(scope);
+}
+
+int TestCoreLicense(int argc, char* argv[])
+{
+	int i;
+	STREAM* s;
+	rdpRdp* rdp;
+	char* path;
+	char* store_path;
+	rdpLicense* license;
+	int status = -1;
+
+	for (i = 0; i < TEST_LICENSE_LENGTH; i++)
+		test_license_info[i] = (BYTE) (i * 7);
+
+	freerdp_mkdir(TEST_LICENSE_CONFIG_PATH);
+	store_path = freerdp_construct_path(TEST_LICENSE_CONFIG_PATH, "licenses");
+	path = freerdp_construct_path(store_path, TEST_LICENSE_HOSTNAME "_.._Microsoft_Corp.lic");
+
+	rdp = (rdpRdp*) calloc(1, sizeof(rdpRdp));
+	rdp->settings = freerdp_settings_new(NULL);
+	free(rdp->settings->ConfigPath);
+	rdp->settings->ConfigPath = _strdup(TEST_LICENSE_CONFIG_PATH);
+	rdp->settings->ServerHostname = _strdup(TEST_LICENSE_HOSTNAME);
+
+	license = license_new(rdp);
+
+	for (i = 0; i < MAC_SALT_KEY_LENGTH; i++)
+		license->mac_salt_key[i] = (BYTE) (0x40 + i);
+
+	for (i = 0; i < LICENSING_ENCRYPTION_KEY_LENGTH; i++)
+		license->licensing_encryption_key[i] = (BYTE) (0x80 + i);
+
+	/* a license with a valid MAC is stored and found again for its scope */
+
+	s = test_new_license_packet(license, test_scope, FALSE);
+	license_read_new_license_packet(license, s);
+	stream_free(s);
+
+	test_set_scope(license, test_scope);
+
+	if (!license_read_stored_license(license))
+	{
+		printf("license_read_stored_license: issued license not found\n");
+		goto out;
+	}
+
+	if ((license->license_info->length != TEST_LICENSE_LENGTH) ||
+			(memcmp(license->license_info->data, test_license_info, TEST_LICENSE_LENGTH) != 0))
+	{
+		printf("license_read_stored_license: stored license differs from the issued one\n");
+		goto out;
+	}
+
+	if (strcmp(license->license_scope, test_scope) != 0)
+	{
+		printf("license_read_stored_license: Actual scope: %s, Expected: %s\n", license->license_scope, test_scope);
+		goto out;
+	}
+
+	/* the server supplied scope does not leave the license store */
+
+	if (!freerdp_check_file_exists(path))
+	{
+		printf("license not stored under its sanitized name\n");
+		goto out;
+	}
+
+	/* a license whose MAC does not verify is not stored */
+
+	s = test_new_license_packet(license, test_tampered_scope, TRUE);
+	license_read_new_license_packet(license, s);
+	stream_free(s);
+
+	test_set_scope(license, test_tampered_scope);
+
+	if (license_read_stored_license(license))
+	{
+		printf("license_read_new_license_packet: license with an invalid MAC stored\n");
+		goto out;
+	}
+
+	/* a deleted license is not found again */
+
+	license_delete_stored_license(license, test_scope);
+	test_set_scope(license, test_scope);
+
+	if (license_read_stored_license(license))
+	{
+		printf("license_delete_stored_license: license still stored\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	license_delete_stored_license(license, test_scope);
+	license_delete_stored_license(license, test_tampered_scope);
+	license_free(license);
+
+	freerdp_settings_free(rdp->settings);
+	free(rdp);
+
+	remove(store_path);
+	remove(TEST_LICENSE_CONFIG_PATH);
+
+	free(store_path);
+	free(path);
+
+	return status;
+}
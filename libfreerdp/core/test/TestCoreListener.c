@@ -0,0 +1,345 @@
+
+#include <stdio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+#include <freerdp/listener.h>
+
+#include "test_core.h"
+
+/**
+ * A burst of queued connections is accepted in a single call, with the
+ * listening socket options carried over to every peer socket. Local
+ * clients then open connections as fast as the server closes them, once
+ * against a single listening socket and once against SO_REUSEPORT shards
+ * each polled by its own thread.
+ */
+
+#define TEST_LISTENER_BURST		64
+#define TEST_LISTENER_SHARDS		4
+#define TEST_LISTENER_CLIENTS		8
+#define TEST_LISTENER_CONNECTIONS	4000
+#define TEST_LISTENER_BUFFER_SIZE	0x20000
+
+struct test_listener_shard
+{
+	int index;
+	freerdp_listener* instance;
+};
+
+static UINT16 test_port;
+static volatile BOOL test_done;
+static volatile LONG test_accepted;
+static volatile LONG test_bad_options;
+static LONG test_shard_accepted[TEST_LISTENER_SHARDS];
+static DWORD test_shard_index; /* thread local: the shard polled by the thread */
+
+static BOOL test_check_options(int sockfd)
+{
+	int value = 0;
+	socklen_t length = sizeof(value);
+
+	if (!(fcntl(sockfd, F_GETFL) & O_NONBLOCK) || !(fcntl(sockfd, F_GETFD) & FD_CLOEXEC))
+		return FALSE;
+
+	if ((getsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &value, &length) != 0) || !value)
+		return FALSE;
+
+	length = sizeof(value);
+
+	if ((getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &value, &length) != 0) || (value < TEST_LISTENER_BUFFER_SIZE))
+		return FALSE;
+
+	length = sizeof(value);
+
+	if ((getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &value, &length) != 0) || (value < TEST_LISTENER_BUFFER_SIZE))
+		return FALSE;
+
+	return TRUE;
+}
+
+/* the peer is closed right away: only the accept path is measured */
+
+static void test_peer_accepted(freerdp_listener* instance, freerdp_peer* client)
+{
+	if (!test_check_options(client->sockfd))
+		InterlockedIncrement(&test_bad_options);
+
+	close(client->sockfd);
+	free(client);
+
+	test_shard_accepted[(int) (size_t) TlsGetValue(test_shard_index)]++;
+	InterlockedIncrement(&test_accepted);
+}
+
+static int test_connect(void)
+{
+	int sockfd;
+	struct sockaddr_in addr;
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(test_port);
+
+	if (connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+	{
+		close(sockfd);
+		return -1;
+	}
+
+	return sockfd;
+}
+
+/* the server closes first, so client ports are not left in TIME_WAIT */
+
+static void* test_client_thread(void* arg)
+{
+	int index;
+	int sockfd;
+	BYTE buffer[16];
+
+	for (index = 0; index < TEST_LISTENER_CONNECTIONS / TEST_LISTENER_CLIENTS; index++)
+	{
+		sockfd = test_connect();
+
+		if (sockfd < 0)
+		{
+			printf("connect failed\n");
+			break;
+		}
+
+		while (recv(sockfd, buffer, sizeof(buffer), 0) > 0);
+
+		close(sockfd);
+	}
+
+	return NULL;
+}
+
+static void* test_shard_thread(void* arg)
+{
+	int index;
+	int rcount;
+	void* rfds[8];
+	struct pollfd pfds[8];
+	struct test_listener_shard* shard = (struct test_listener_shard*) arg;
+
+	TlsSetValue(test_shard_index, (LPVOID) (size_t) shard->index);
+
+	rcount = 0;
+
+	if (!shard->instance->GetShardFileDescriptor(shard->instance, shard->index, rfds, &rcount))
+		return NULL;
+
+	for (index = 0; index < rcount; index++)
+	{
+		pfds[index].fd = (int)(long) rfds[index];
+		pfds[index].events = POLLIN;
+	}
+
+	while (!test_done)
+	{
+		if (poll(pfds, rcount, 10) <= 0)
+			continue;
+
+		if (!shard->instance->CheckShardFileDescriptor(shard->instance, shard->index))
+			break;
+	}
+
+	return NULL;
+}
+
+static freerdp_listener* test_listener_new(int shards)
+{
+	freerdp_listener* instance;
+
+	instance = freerdp_listener_new();
+	instance->PeerAccepted = test_peer_accepted;
+	instance->Shards = shards;
+	instance->SendBufferSize = TEST_LISTENER_BUFFER_SIZE;
+	instance->ReceiveBufferSize = TEST_LISTENER_BUFFER_SIZE;
+
+	return instance;
+}
+
+static long test_rate(int shards)
+{
+	int index;
+	long usec;
+	freerdp_listener* instance;
+	HANDLE clients[TEST_LISTENER_CLIENTS];
+	HANDLE threads[TEST_LISTENER_SHARDS];
+	struct test_listener_shard shard[TEST_LISTENER_SHARDS];
+
+	instance = test_listener_new(shards);
+
+	if (!instance->Open(instance, "127.0.0.1", test_port))
+		return -1;
+
+	test_done = FALSE;
+	test_accepted = 0;
+	ZeroMemory(test_shard_accepted, sizeof(test_shard_accepted));
+
+	for (index = 0; index < shards; index++)
+	{
+		shard[index].index = index;
+		shard[index].instance = instance;
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_shard_thread, &shard[index], 0, NULL);
+	}
+
+	usec = test_now();
+
+	for (index = 0; index < TEST_LISTENER_CLIENTS; index++)
+		clients[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_client_thread, NULL, 0, NULL);
+
+	for (index = 0; index < TEST_LISTENER_CLIENTS; index++)
+	{
+		WaitForSingleObject(clients[index], INFINITE);
+		CloseHandle(clients[index]);
+	}
+
+	usec = test_now() - usec;
+
+	test_done = TRUE;
+
+	for (index = 0; index < shards; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		CloseHandle(threads[index]);
+	}
+
+	instance->Close(instance);
+	freerdp_listener_free(instance);
+
+	if (test_accepted != TEST_LISTENER_CONNECTIONS)
+	{
+		printf("%d shards: accepted %d connections, expected %d\n", shards, (int) test_accepted, TEST_LISTENER_CONNECTIONS);
+		return -1;
+	}
+
+	for (index = 0; index < shards; index++)
+	{
+		if (test_shard_accepted[index] == 0)
+		{
+			printf("%d shards: shard %d accepted no connection\n", shards, index);
+			return -1;
+		}
+	}
+
+	printf("%d shards: %d connections in %ld ms, %ld connections/s\n", shards, TEST_LISTENER_CONNECTIONS,
+			usec / 1000, (long) ((double) TEST_LISTENER_CONNECTIONS * 1000000 / (usec ? usec : 1)));
+
+	return usec;
+}
+
+int TestCoreListener(int argc, char* argv[])
+{
+	int index;
+	int sockfd;
+	int clients[TEST_LISTENER_BURST];
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	freerdp_listener* instance;
+
+	/* the burst is accepted on this thread, which counts as shard 0 */
+	test_shard_index = TlsAlloc();
+	TlsSetValue(test_shard_index, (LPVOID) 0);
+
+	/* pick a free port */
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(sockfd, (struct sockaddr*) &addr, sizeof(addr)) != 0) ||
+			(getsockname(sockfd, (struct sockaddr*) &addr, &length) != 0))
+	{
+		printf("failed to bind on the loopback interface\n");
+		return -1;
+	}
+
+	test_port = ntohs(addr.sin_port);
+	close(sockfd);
+
+	/* a burst of queued connections is drained by a single call */
+
+	instance = test_listener_new(1);
+
+	if (!instance->Open(instance, "127.0.0.1", test_port))
+	{
+		printf("failed to open the listener\n");
+		return -1;
+	}
+
+	for (index = 0; index < TEST_LISTENER_BURST; index++)
+	{
+		clients[index] = test_connect();
+
+		if (clients[index] < 0)
+		{
+			printf("connect failed for client %d\n", index);
+			return -1;
+		}
+	}
+
+	test_accepted = 0;
+
+	if (!instance->CheckFileDescriptor(instance))
+	{
+		printf("CheckFileDescriptor failed\n");
+		return -1;
+	}
+
+	if (test_accepted != TEST_LISTENER_BURST)
+	{
+		printf("accepted %d of %d queued connections in one call\n", (int) test_accepted, TEST_LISTENER_BURST);
+		return -1;
+	}
+
+	if (test_bad_options != 0)
+	{
+		printf("%d peer sockets are missing options\n", (int) test_bad_options);
+		return -1;
+	}
+
+	for (index = 0; index < TEST_LISTENER_BURST; index++)
+		close(clients[index]);
+
+	instance->Close(instance);
+	freerdp_listener_free(instance);
+
+	/* connection rate */
+
+	if (test_rate(1) < 0)
+		return -1;
+
+	if (test_rate(TEST_LISTENER_SHARDS) < 0)
+		return -1;
+
+	if (test_bad_options != 0)
+	{
+		printf("%d peer sockets are missing options\n", (int) test_bad_options);
+		return -1;
+	}
+
+	TlsFree(test_shard_index);
+
+	return 0;
+}
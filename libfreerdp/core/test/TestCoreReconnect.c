@@ -0,0 +1,204 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/wait_obj.h>
+
+#include "info.h"
+#include "reconnect.h"
+
+#include "test_core.h"
+
+/**
+ * Reconnection attempts are driven from the event loop: each one becomes
+ * due once its backoff expired, the delay doubles up to its cap, and the
+ * attempts stop after the configured count. The cookie presented on
+ * reconnection carries HMAC_MD5(arcRandomBits, ClientRandom).
+ */
+
+#define TEST_RECONNECT_RETRIES		8
+
+static int test_auto_reconnect_cookie(void)
+{
+	int i;
+	unsigned int length;
+	BYTE expected[16];
+	BYTE client_random[32];
+	rdpSettings* settings;
+	ARC_SC_PRIVATE_PACKET* serverCookie;
+	ARC_CS_PRIVATE_PACKET* clientCookie;
+
+	settings = freerdp_settings_new(NULL);
+	serverCookie = settings->ServerAutoReconnectCookie;
+	clientCookie = settings->ClientAutoReconnectCookie;
+
+	for (i = 0; i < 16; i++)
+		serverCookie->arcRandomBits[i] = (BYTE) (0xA0 + i);
+
+	/* without Standard RDP Security the client random is all zeros */
+
+	ZeroMemory(client_random, sizeof(client_random));
+	HMAC(EVP_md5(), serverCookie->arcRandomBits, 16, client_random, 32, expected, &length);
+
+	rdp_compute_client_auto_reconnect_cookie(settings);
+
+	if (memcmp(clientCookie->securityVerifier, expected, 16) != 0)
+	{
+		printf("auto-reconnect verifier differs without a client random\n");
+		freerdp_settings_free(settings);
+		return -1;
+	}
+
+	for (i = 0; i < 32; i++)
+		client_random[i] = (BYTE) (i * 3);
+
+	settings->ClientRandomLength = 32;
+	settings->ClientRandom = (BYTE*) malloc(32);
+	CopyMemory(settings->ClientRandom, client_random, 32);
+
+	HMAC(EVP_md5(), serverCookie->arcRandomBits, 16, client_random, 32, expected, &length);
+
+	rdp_compute_client_auto_reconnect_cookie(settings);
+
+	if (memcmp(clientCookie->securityVerifier, expected, 16) != 0)
+	{
+		printf("auto-reconnect verifier differs with a client random\n");
+		freerdp_settings_free(settings);
+		return -1;
+	}
+
+	freerdp_settings_free(settings);
+
+	return 0;
+}
+
+static int test_reconnect_backoff(void)
+{
+	long start;
+	long elapsed;
+	UINT32 retry;
+	DWORD delay;
+	rdpReconnect* reconnect;
+
+	reconnect = reconnect_new();
+
+	if (reconnect_is_due(reconnect))
+	{
+		printf("reconnect_is_due: attempt due before reconnection started\n");
+		return -1;
+	}
+
+	reconnect_start(reconnect, 0);
+
+	if (reconnect->maxRetries != RECONNECT_MAX_RETRIES)
+	{
+		printf("reconnect_start: Actual retries: %d, Expected: %d\n", reconnect->maxRetries, RECONNECT_MAX_RETRIES);
+		return -1;
+	}
+
+	reconnect_start(reconnect, TEST_RECONNECT_RETRIES);
+
+	/* the first attempt is due right away, and only once */
+
+	if (!reconnect_is_due(reconnect) || reconnect_is_due(reconnect))
+	{
+		printf("reconnect_is_due: first attempt not due exactly once\n");
+		return -1;
+	}
+
+	/* the next one wakes the event loop once its backoff expired */
+
+	start = test_now();
+
+	if (!reconnect_schedule(reconnect) || reconnect_is_due(reconnect))
+	{
+		printf("reconnect_schedule: second attempt due before its backoff\n");
+		return -1;
+	}
+
+	if (wait_obj_select(&reconnect->event, 1, 5000) != 1)
+	{
+		printf("reconnect_schedule: second attempt never became due\n");
+		return -1;
+	}
+
+	elapsed = (test_now() - start) / 1000;
+
+	if ((elapsed < RECONNECT_MIN_DELAY - 50) || !reconnect_is_due(reconnect))
+	{
+		printf("reconnect_schedule: second attempt due after %ld ms, expected %d ms\n", elapsed, RECONNECT_MIN_DELAY);
+		return -1;
+	}
+
+	/* the delay doubles up to its cap; the later waits are skipped */
+
+	delay = RECONNECT_MIN_DELAY * 2;
+
+	for (retry = 2; retry < TEST_RECONNECT_RETRIES; retry++)
+	{
+		if (reconnect->delay != delay)
+		{
+			printf("reconnect_schedule: Actual delay: %d, Expected: %d\n", (int) reconnect->delay, (int) delay);
+			return -1;
+		}
+
+		if (!reconnect_schedule(reconnect))
+		{
+			printf("reconnect_schedule: gave up after %d attempts\n", retry);
+			return -1;
+		}
+
+		delay = MIN(delay * 2, RECONNECT_MAX_DELAY);
+
+		wait_obj_set(reconnect->event);
+
+		if (!reconnect_is_due(reconnect))
+			return -1;
+	}
+
+	if ((reconnect->retry != TEST_RECONNECT_RETRIES) || (reconnect->delay != RECONNECT_MAX_DELAY))
+	{
+		printf("reconnect: %d attempts with a %d ms delay\n", reconnect->retry, (int) reconnect->delay);
+		return -1;
+	}
+
+	/* the attempts stop after the configured count */
+
+	if (reconnect_schedule(reconnect) || reconnect->pending)
+	{
+		printf("reconnect_schedule: attempt scheduled past the maximum\n");
+		return -1;
+	}
+
+	/* stopping disarms a pending backoff */
+
+	reconnect_start(reconnect, TEST_RECONNECT_RETRIES);
+	reconnect_is_due(reconnect);
+	reconnect_schedule(reconnect);
+	reconnect_stop(reconnect);
+
+	if (wait_obj_select(&reconnect->event, 1, RECONNECT_MIN_DELAY + 200) != 0)
+	{
+		printf("reconnect_stop: attempt became due after stopping\n");
+		return -1;
+	}
+
+	reconnect_free(reconnect);
+
+	return 0;
+}
+
+int TestCoreReconnect(int argc, char* argv[])
+{
+	if (test_auto_reconnect_cookie() < 0)
+		return -1;
+
+	if (test_reconnect_backoff() < 0)
+		return -1;
+
+	return 0;
+}
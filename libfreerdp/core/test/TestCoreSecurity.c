@@ -0,0 +1,291 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/crypto/crypto.h>
+
+#include "security.h"
+
+#include "test_core.h"
+
+/**
+ * The single-pass functions must produce the same bytes as signing and
+ * then encrypting in two passes, across key updates, and the peer must
+ * decrypt and verify them. Both paths are timed over the same payloads.
+ */
+
+#define TEST_SECURITY_LENGTH		16000
+#define TEST_SECURITY_PACKETS		4096
+#define TEST_SECURITY_FIPS_PACKETS	256
+
+static BYTE test_pad1[40];
+static BYTE test_pad2[48];
+
+static BYTE test_client_random[32];
+static BYTE test_server_random[32];
+
+static rdpRdp* test_rdp_new(UINT32 encryptionMethods, BOOL serverMode)
+{
+	rdpRdp* rdp;
+
+	rdp = (rdpRdp*) calloc(1, sizeof(rdpRdp));
+	rdp->settings = freerdp_settings_new(NULL);
+	rdp->settings->ServerMode = serverMode;
+	rdp->settings->EncryptionMethods = encryptionMethods;
+	rdp->settings->ServerRandom = test_server_random;
+
+	security_establish_keys(test_client_random, rdp);
+
+	return rdp;
+}
+
+static void test_rdp_free(rdpRdp* rdp)
+{
+	rdp->settings->ServerRandom = NULL;
+	freerdp_settings_free(rdp->settings);
+	crypto_des3_free(rdp->fips_encrypt);
+	crypto_des3_free(rdp->fips_decrypt);
+	crypto_hmac_free(rdp->fips_hmac);
+	free(rdp);
+}
+
+static void test_UINT32_le(BYTE* output, UINT32 value)
+{
+	output[0] = (value) & 0xFF;
+	output[1] = (value >> 8) & 0xFF;
+	output[2] = (value >> 16) & 0xFF;
+	output[3] = (value >> 24) & 0xFF;
+}
+
+/* the signature as computed before the hash states were embedded */
+
+static void test_mac_signature(rdpRdp* rdp, BYTE* data, UINT32 length, BOOL salted, BYTE* output)
+{
+	CryptoMd5 md5;
+	CryptoSha1 sha1;
+	BYTE length_le[4];
+	BYTE use_count_le[4];
+	BYTE md5_digest[CRYPTO_MD5_DIGEST_LENGTH];
+	BYTE sha1_digest[CRYPTO_SHA1_DIGEST_LENGTH];
+
+	test_UINT32_le(length_le, length);
+	test_UINT32_le(use_count_le, rdp->encrypt_checksum_use_count);
+
+	sha1 = crypto_sha1_init();
+	crypto_sha1_update(sha1, rdp->sign_key, rdp->rc4_key_len);
+	crypto_sha1_update(sha1, test_pad1, sizeof(test_pad1));
+	crypto_sha1_update(sha1, length_le, sizeof(length_le));
+	crypto_sha1_update(sha1, data, length);
+
+	if (salted)
+		crypto_sha1_update(sha1, use_count_le, sizeof(use_count_le));
+
+	crypto_sha1_final(sha1, sha1_digest);
+
+	md5 = crypto_md5_init();
+	crypto_md5_update(md5, rdp->sign_key, rdp->rc4_key_len);
+	crypto_md5_update(md5, test_pad2, sizeof(test_pad2));
+	crypto_md5_update(md5, sha1_digest, sizeof(sha1_digest));
+	crypto_md5_final(md5, md5_digest);
+
+	memcpy(output, md5_digest, 8);
+}
+
+static void test_hmac_signature(rdpRdp* rdp, BYTE* data, UINT32 length, BYTE* output)
+{
+	CryptoHmac hmac;
+	BYTE buf[20];
+	BYTE use_count_le[4];
+
+	test_UINT32_le(use_count_le, rdp->encrypt_use_count);
+
+	hmac = crypto_hmac_new();
+	crypto_hmac_sha1_init(hmac, rdp->fips_sign_key, 20);
+	crypto_hmac_update(hmac, data, length);
+	crypto_hmac_update(hmac, use_count_le, 4);
+	crypto_hmac_final(hmac, buf, 20);
+	crypto_hmac_free(hmac);
+
+	memcpy(output, buf, 8);
+}
+
+static int test_rc4(BYTE* payload, BYTE* reference, BYTE* fused)
+{
+	int index;
+	long usec;
+	BOOL salted;
+	BYTE ref_sig[8];
+	BYTE fused_sig[8];
+	BYTE check_sig[8];
+	rdpRdp* client_ref;
+	rdpRdp* client_fused;
+	rdpRdp* server;
+	long start;
+
+	client_ref = test_rdp_new(ENCRYPTION_METHOD_128BIT, FALSE);
+	client_fused = test_rdp_new(ENCRYPTION_METHOD_128BIT, FALSE);
+	server = test_rdp_new(ENCRYPTION_METHOD_128BIT, TRUE);
+
+	for (index = 0; index < TEST_SECURITY_PACKETS; index++)
+	{
+		salted = (index % 2) ? TRUE : FALSE;
+		payload[0] = (BYTE) index;
+
+		CopyMemory(reference, payload, TEST_SECURITY_LENGTH);
+		test_mac_signature(client_ref, reference, TEST_SECURITY_LENGTH, salted, ref_sig);
+		security_encrypt(reference, TEST_SECURITY_LENGTH, client_ref);
+
+		CopyMemory(fused, payload, TEST_SECURITY_LENGTH);
+		security_sign_and_encrypt(client_fused, fused, TEST_SECURITY_LENGTH, salted, fused_sig);
+
+		if ((memcmp(ref_sig, fused_sig, 8) != 0) || (memcmp(reference, fused, TEST_SECURITY_LENGTH) != 0))
+		{
+			printf("RC4: single pass differs from two passes at packet %d\n", index);
+			return -1;
+		}
+
+		security_decrypt_and_sign(server, fused, TEST_SECURITY_LENGTH, salted, check_sig);
+
+		if ((memcmp(fused_sig, check_sig, 8) != 0) || (memcmp(payload, fused, TEST_SECURITY_LENGTH) != 0))
+		{
+			printf("RC4: packet %d does not decrypt or verify\n", index);
+			return -1;
+		}
+	}
+
+	/* throughput, salted checksums */
+
+	start = test_now();
+
+	for (index = 0; index < TEST_SECURITY_PACKETS; index++)
+	{
+		test_mac_signature(client_ref, reference, TEST_SECURITY_LENGTH, TRUE, ref_sig);
+		security_encrypt(reference, TEST_SECURITY_LENGTH, client_ref);
+	}
+
+	usec = test_now() - start;
+	printf("RC4 two passes: %ld MB/s\n", (long) ((double) TEST_SECURITY_PACKETS * TEST_SECURITY_LENGTH / (usec ? usec : 1)));
+
+	start = test_now();
+
+	for (index = 0; index < TEST_SECURITY_PACKETS; index++)
+		security_sign_and_encrypt(client_fused, fused, TEST_SECURITY_LENGTH, TRUE, fused_sig);
+
+	usec = test_now() - start;
+	printf("RC4 single pass: %ld MB/s\n", (long) ((double) TEST_SECURITY_PACKETS * TEST_SECURITY_LENGTH / (usec ? usec : 1)));
+
+	test_rdp_free(client_ref);
+	test_rdp_free(client_fused);
+	test_rdp_free(server);
+
+	return 0;
+}
+
+static int test_fips(BYTE* payload, BYTE* reference, BYTE* fused)
+{
+	int index;
+	long usec;
+	UINT32 pad;
+	UINT32 length;
+	BYTE ref_sig[8];
+	BYTE fused_sig[8];
+	rdpRdp* client_ref;
+	rdpRdp* client_fused;
+	rdpRdp* server;
+	long start;
+
+	client_ref = test_rdp_new(ENCRYPTION_METHOD_FIPS, FALSE);
+	client_fused = test_rdp_new(ENCRYPTION_METHOD_FIPS, FALSE);
+	server = test_rdp_new(ENCRYPTION_METHOD_FIPS, TRUE);
+
+	for (index = 0; index < TEST_SECURITY_FIPS_PACKETS; index++)
+	{
+		length = TEST_SECURITY_LENGTH - (index % 8);
+		pad = (8 - (length % 8)) % 8;
+		payload[0] = (BYTE) index;
+		ZeroMemory(&payload[length], pad);
+
+		CopyMemory(reference, payload, length + pad);
+		test_hmac_signature(client_ref, reference, length, ref_sig);
+		security_fips_encrypt(reference, length + pad, client_ref);
+
+		CopyMemory(fused, payload, length + pad);
+		security_fips_sign_and_encrypt(client_fused, fused, length, pad, fused_sig);
+
+		if ((memcmp(ref_sig, fused_sig, 8) != 0) || (memcmp(reference, fused, length + pad) != 0))
+		{
+			printf("FIPS: single pass differs from two passes at packet %d\n", index);
+			return -1;
+		}
+
+		if (!security_fips_decrypt_and_check(server, fused, length + pad, pad, fused_sig) ||
+				(memcmp(payload, fused, length) != 0))
+		{
+			printf("FIPS: packet %d does not decrypt or verify\n", index);
+			return -1;
+		}
+	}
+
+	start = test_now();
+
+	for (index = 0; index < TEST_SECURITY_FIPS_PACKETS; index++)
+	{
+		test_hmac_signature(client_ref, reference, TEST_SECURITY_LENGTH, ref_sig);
+		security_fips_encrypt(reference, TEST_SECURITY_LENGTH, client_ref);
+	}
+
+	usec = test_now() - start;
+	printf("FIPS two passes: %ld MB/s\n", (long) ((double) TEST_SECURITY_FIPS_PACKETS * TEST_SECURITY_LENGTH / (usec ? usec : 1)));
+
+	start = test_now();
+
+	for (index = 0; index < TEST_SECURITY_FIPS_PACKETS; index++)
+		security_fips_sign_and_encrypt(client_fused, fused, TEST_SECURITY_LENGTH, 0, fused_sig);
+
+	usec = test_now() - start;
+	printf("FIPS single pass: %ld MB/s\n", (long) ((double) TEST_SECURITY_FIPS_PACKETS * TEST_SECURITY_LENGTH / (usec ? usec : 1)));
+
+	test_rdp_free(client_ref);
+	test_rdp_free(client_fused);
+	test_rdp_free(server);
+
+	return 0;
+}
+
+int TestCoreSecurity(int argc, char* argv[])
+{
+	int index;
+	int status;
+	BYTE* payload;
+	BYTE* reference;
+	BYTE* fused;
+
+	FillMemory(test_pad1, sizeof(test_pad1), 0x36);
+	FillMemory(test_pad2, sizeof(test_pad2), 0x5C);
+
+	for (index = 0; index < 32; index++)
+	{
+		test_client_random[index] = (BYTE) (index * 7);
+		test_server_random[index] = (BYTE) (index * 13 + 1);
+	}
+
+	payload = (BYTE*) malloc(TEST_SECURITY_LENGTH);
+	reference = (BYTE*) malloc(TEST_SECURITY_LENGTH);
+	fused = (BYTE*) malloc(TEST_SECURITY_LENGTH);
+
+	for (index = 0; index < TEST_SECURITY_LENGTH; index++)
+		payload[index] = (BYTE) (index * 31);
+
+	status = test_rc4(payload, reference, fused);
+
+	if (status == 0)
+		status = test_fips(payload, reference, fused);
+
+	free(payload);
+	free(reference);
+	free(fused);
+
+	return status;
+}
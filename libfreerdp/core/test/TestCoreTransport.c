@@ -0,0 +1,286 @@
+
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include "rdp.h"
+#include "transport.h"
+
+#include "test_core.h"
+
+/**
+ * A peer sends frames at a fixed rate to a client that reads slower than
+ * that. Encoding every frame and writing it anyway lets the frames grow
+ * stale behind the socket, while holding off whenever CanSend says no and
+ * resuming from the Writable callback keeps the delay of the frames that
+ * are sent bounded by the send window.
+ */
+
+#define TEST_TRANSPORT_FRAME_SIZE	0x10000
+#define TEST_TRANSPORT_FRAME_INTERVAL	10000 /* microseconds: 6.4 MB/s */
+#define TEST_TRANSPORT_FRAMES		200
+#define TEST_TRANSPORT_READ_SIZE	0x4000
+#define TEST_TRANSPORT_READ_INTERVAL	4000 /* microseconds: 4 MB/s */
+#define TEST_TRANSPORT_MSS		1448
+#define TEST_TRANSPORT_RCVBUF		0x10000
+
+struct test_transport_result
+{
+	int sockfd;
+	int frames;
+	long max_delay;
+};
+
+static int test_writable_calls;
+static BOOL test_writable;
+
+static BOOL test_peer_writable(freerdp_peer* client)
+{
+	test_writable_calls++;
+	test_writable = TRUE;
+
+	return TRUE;
+}
+
+/* reads at a fixed rate, the first bytes of every frame hold its timestamp */
+
+static void* test_reader_thread(void* arg)
+{
+	int status;
+	int offset = 0;
+	long stamp;
+	long delay;
+	BYTE* frame = (BYTE*) malloc(TEST_TRANSPORT_FRAME_SIZE);
+	struct test_transport_result* result = (struct test_transport_result*) arg;
+
+	result->frames = 0;
+	result->max_delay = 0;
+
+	while (1)
+	{
+		usleep(TEST_TRANSPORT_READ_INTERVAL);
+
+		status = recv(result->sockfd, &frame[offset], MIN(TEST_TRANSPORT_READ_SIZE, TEST_TRANSPORT_FRAME_SIZE - offset), 0);
+
+		if (status <= 0)
+			break;
+
+		offset += status;
+
+		if (offset < TEST_TRANSPORT_FRAME_SIZE)
+			continue;
+
+		CopyMemory(&stamp, frame, sizeof(stamp));
+		delay = test_now() - stamp;
+
+		if (delay > result->max_delay)
+			result->max_delay = delay;
+
+		result->frames++;
+		offset = 0;
+	}
+
+	free(frame);
+
+	return NULL;
+}
+
+static BOOL test_send_frame(rdpTransport* transport, long stamp)
+{
+	STREAM* s;
+
+	s = transport_send_stream_init(transport, TEST_TRANSPORT_FRAME_SIZE);
+	FillMemory(s->data, TEST_TRANSPORT_FRAME_SIZE, 0xAB);
+	CopyMemory(s->data, &stamp, sizeof(stamp));
+	stream_set_pos(s, TEST_TRANSPORT_FRAME_SIZE);
+
+	return (transport_write(transport, s) >= 0) ? TRUE : FALSE;
+}
+
+static int test_connect(int* server, int* client)
+{
+	int option_value;
+	int listener;
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+
+	/* Ethernet sized segments, and a small receive buffer for the slow reader */
+
+	option_value = TEST_TRANSPORT_MSS;
+	setsockopt(listener, IPPROTO_TCP, TCP_MAXSEG, &option_value, sizeof(option_value));
+	setsockopt(*client, IPPROTO_TCP, TCP_MAXSEG, &option_value, sizeof(option_value));
+
+	option_value = TEST_TRANSPORT_RCVBUF;
+	setsockopt(*client, SOL_SOCKET, SO_RCVBUF, &option_value, sizeof(option_value));
+
+	ZeroMemory(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(listener, 1) != 0) ||
+			(getsockname(listener, (struct sockaddr*) &addr, &length) != 0))
+		return -1;
+
+	if (connect(*client, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+		return -1;
+
+	*server = accept(listener, NULL, NULL);
+	close(listener);
+
+	return (*server < 0) ? -1 : 0;
+}
+
+/**
+ * Frames are due every interval. With backpressure, a frame that does not
+ * fit is dropped and the next one is encoded as soon as Writable is called.
+ */
+
+static int test_run(BOOL backpressure, struct test_transport_result* result, int* dropped)
+{
+	int index;
+	int count;
+	int client_sockfd;
+	int server_sockfd;
+	long due;
+	long now;
+	long start;
+	int rcount;
+	int wcount;
+	void* rfds[8];
+	struct pollfd pfds[8];
+	rdpTransport* transport;
+	freerdp_peer* client;
+	HANDLE reader;
+
+	if (test_connect(&server_sockfd, &client_sockfd) != 0)
+		return -1;
+
+	client = freerdp_peer_new(server_sockfd);
+	client->Writable = test_peer_writable;
+	freerdp_peer_context_new(client);
+	transport = client->context->rdp->transport;
+
+	result->sockfd = client_sockfd;
+	reader = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_reader_thread, result, 0, NULL);
+
+	*dropped = 0;
+	test_writable = FALSE;
+	test_writable_calls = 0;
+	start = test_now();
+
+	for (index = 0; index < TEST_TRANSPORT_FRAMES; index++)
+	{
+		due = start + (index * TEST_TRANSPORT_FRAME_INTERVAL);
+
+		while ((now = test_now()) < due)
+		{
+			if (!backpressure)
+			{
+				usleep(due - now);
+				continue;
+			}
+
+			rcount = 0;
+			client->GetFileDescriptor(client, rfds, &rcount);
+			wcount = rcount;
+			client->GetWriteFileDescriptor(client, rfds, &wcount);
+
+			for (count = 0; count < wcount; count++)
+			{
+				pfds[count].fd = (int)(long) rfds[count];
+				pfds[count].events = (count < rcount) ? POLLIN : POLLOUT;
+			}
+
+			poll(pfds, wcount, (int) ((due - now + 999) / 1000));
+
+			if (!client->CheckFileDescriptor(client))
+				return -1;
+
+			if (test_writable)
+			{
+				/* catch up with a fresh frame rather than waiting for the next one */
+				test_writable = FALSE;
+
+				if (!test_send_frame(transport, test_now()))
+					return -1;
+			}
+		}
+
+		if (backpressure && !client->CanSend(client, TEST_TRANSPORT_FRAME_SIZE))
+		{
+			(*dropped)++;
+			continue;
+		}
+
+		if (!test_send_frame(transport, due))
+			return -1;
+	}
+
+	shutdown(server_sockfd, SHUT_WR);
+	WaitForSingleObject(reader, INFINITE);
+	CloseHandle(reader);
+
+	close(client_sockfd);
+
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+
+	printf("%s: %d frames received, %d dropped, %d writable events, %ld ms max delay, %ld ms\n",
+			backpressure ? "backpressure" : "no backpressure", result->frames, *dropped, test_writable_calls,
+			result->max_delay / 1000, (test_now() - start) / 1000);
+
+	return 0;
+}
+
+int TestCoreTransport(int argc, char* argv[])
+{
+	int dropped;
+	struct test_transport_result blocking;
+	struct test_transport_result throttled;
+
+	if (test_run(FALSE, &blocking, &dropped) != 0)
+	{
+		printf("the run without backpressure failed\n");
+		return -1;
+	}
+
+	if (blocking.frames != TEST_TRANSPORT_FRAMES)
+	{
+		printf("%d frames received, expected %d\n", blocking.frames, TEST_TRANSPORT_FRAMES);
+		return -1;
+	}
+
+	if (test_run(TRUE, &throttled, &dropped) != 0)
+	{
+		printf("the run with backpressure failed\n");
+		return -1;
+	}
+
+	if ((dropped == 0) || (test_writable_calls == 0))
+	{
+		printf("the sender was never held off\n");
+		return -1;
+	}
+
+	if (throttled.max_delay * 4 > blocking.max_delay)
+	{
+		printf("backpressure did not keep the frame delay down\n");
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#endif
+
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include "test_core.h"
+
+/* microseconds, only meaningful as a difference */
+
+long test_now(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER base;
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	if (!base.QuadPart)
+		base = counter;
+
+	return (long) (((counter.QuadPart - base.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (tv.tv_sec * 1000000) + tv.tv_usec;
+#endif
+}
+
+/* a self-signed certificate and its private key, valid for an hour */
+
+BOOL test_write_certificate(const char* cert_file, const char* key_file, const char* name)
+{
+	FILE* fp;
+	RSA* rsa;
+	BIGNUM* e;
+	X509* x509;
+	EVP_PKEY* pkey;
+
+	e = BN_new();
+	rsa = RSA_new();
+	BN_set_word(e, RSA_F4);
+
+	if (RSA_generate_key_ex(rsa, 2048, e, NULL) != 1)
+	{
+		BN_free(e);
+		RSA_free(rsa);
+		return FALSE;
+	}
+
+	BN_free(e);
+
+	pkey = EVP_PKEY_new();
+	EVP_PKEY_assign_RSA(pkey, rsa);
+
+	x509 = X509_new();
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_get_notBefore(x509), 0);
+	X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+	X509_set_pubkey(x509, pkey);
+	X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN", MBSTRING_ASC, (BYTE*) name, -1, -1, 0);
+	X509_set_issuer_name(x509, X509_get_subject_name(x509));
+	X509_sign(x509, pkey, EVP_sha256());
+
+	fp = fopen(key_file, "w");
+
+	if (fp)
+	{
+		PEM_write_RSAPrivateKey(fp, rsa, NULL, NULL, 0, NULL, NULL);
+		fclose(fp);
+	}
+
+	if (fp)
+		fp = fopen(cert_file, "w");
+
+	if (fp)
+	{
+		PEM_write_X509(fp, x509);
+		fclose(fp);
+	}
+
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+
+	return fp ? TRUE : FALSE;
+}
+
+#ifndef _WIN32
+
+#define TEST_PROXY_CHUNKS		1024
+#define TEST_PROXY_CHUNK_SIZE		16384
+
+/* a listening socket on an ephemeral loopback port, returned in addr */
+
+int test_listen(struct sockaddr_in* addr)
+{
+	int listener;
+	socklen_t length = sizeof(struct sockaddr_in);
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (listener < 0)
+		return -1;
+
+	ZeroMemory(addr, sizeof(struct sockaddr_in));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(listener, (struct sockaddr*) addr, sizeof(struct sockaddr_in)) != 0) || (listen(listener, 4) != 0) ||
+			(getsockname(listener, (struct sockaddr*) addr, &length) != 0))
+	{
+		close(listener);
+		return -1;
+	}
+
+	return listener;
+}
+
+void* test_proxy_thread(void* arg)
+{
+	int head = 0;
+	int tail = 0;
+	int timeout;
+	int status;
+	long now;
+	BOOL open = TRUE;
+	struct pollfd pfd;
+	struct test_proxy_link* link = (struct test_proxy_link*) arg;
+	long* due = (long*) malloc(sizeof(long) * TEST_PROXY_CHUNKS);
+	int* length = (int*) malloc(sizeof(int) * TEST_PROXY_CHUNKS);
+	BYTE* chunks = (BYTE*) malloc(TEST_PROXY_CHUNKS * TEST_PROXY_CHUNK_SIZE);
+
+	if (!due || !length || !chunks)
+		open = FALSE;
+
+	while (open || (head != tail))
+	{
+		now = test_now();
+
+		while ((head != tail) && (due[head] <= now))
+		{
+			send(link->dst, &chunks[head * TEST_PROXY_CHUNK_SIZE], length[head], MSG_NOSIGNAL);
+			head = (head + 1) % TEST_PROXY_CHUNKS;
+		}
+
+		timeout = (head != tail) ? (int) ((due[head] - now + 999) / 1000) : -1;
+
+		if (!open)
+		{
+			if (head != tail)
+				usleep(timeout * 1000);
+			continue;
+		}
+
+		pfd.fd = link->src;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, timeout) <= 0)
+			continue;
+
+		status = recv(link->src, &chunks[tail * TEST_PROXY_CHUNK_SIZE], TEST_PROXY_CHUNK_SIZE, 0);
+
+		if (status <= 0)
+		{
+			open = FALSE;
+			continue;
+		}
+
+		length[tail] = status;
+		due[tail] = test_now() + link->delay;
+		tail = (tail + 1) % TEST_PROXY_CHUNKS;
+	}
+
+	shutdown(link->dst, SHUT_WR);
+
+	free(due);
+	free(length);
+	free(chunks);
+
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef FREERDP_CORE_TEST_H
+#define FREERDP_CORE_TEST_H
+
+#include <winpr/crt.h>
+
+/* helpers shared by the TestCore tests */
+
+long test_now(void);
+
+BOOL test_write_certificate(const char* cert_file, const char* key_file, const char* name);
+
+#ifndef _WIN32
+
+struct sockaddr_in;
+
+/* a proxy thread forwards every chunk read on src to dst once delay (in microseconds) has elapsed */
+
+struct test_proxy_link
+{
+	int src;
+	int dst;
+	long delay;
+};
+
+int test_listen(struct sockaddr_in* addr);
+void* test_proxy_thread(void* arg);
+
+#endif
+
+#endif /* FREERDP_CORE_TEST_H */
@@ -40,6 +40,7 @@
 #ifndef _WIN32
 #include <netdb.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
 #endif
 
 #include "tpkt.h"
@@ -48,6 +49,8 @@
 
 #define BUFFER_SIZE 16384
 
+static int transport_read_nonblocking(rdpTransport* transport);
+
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size)
 {
 	STREAM* s = transport->recv_stream;
@@ -67,6 +70,9 @@ STREAM* transport_send_stream_init(rdpTransport* transport, int size)
 void transport_attach(rdpTransport* transport, int sockfd)
 {
 	transport->TcpIn->sockfd = sockfd;
+
+	transport->SplitInputOutput = FALSE;
+	transport->TcpOut = transport->TcpIn;
 }
 
 BOOL transport_disconnect(rdpTransport* transport)
@@ -143,10 +149,12 @@ BOOL transport_connect_nla(rdpTransport* transport)
 			"If credentials are valid, the NTLMSSP implementation may be to blame.\n");
 
 		credssp_free(transport->credssp);
+		transport->credssp = NULL;
 		return FALSE;
 	}
 
 	credssp_free(transport->credssp);
+	transport->credssp = NULL;
 
 	return TRUE;
 }
@@ -222,6 +230,9 @@ BOOL transport_accept_tls(rdpTransport* transport)
 	if (transport->TlsIn == NULL)
 		transport->TlsIn = tls_new(transport->settings);
 
+	if (transport->TlsOut == NULL)
+		transport->TlsOut = transport->TlsIn;
+
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->TlsIn->sockfd = transport->TcpIn->sockfd;
 
@@ -239,6 +250,9 @@ BOOL transport_accept_nla(rdpTransport* transport)
 	if (transport->TlsIn == NULL)
 		transport->TlsIn = tls_new(transport->settings);
 
+	if (transport->TlsOut == NULL)
+		transport->TlsOut = transport->TlsIn;
+
 	transport->layer = TRANSPORT_LAYER_TLS;
 	transport->TlsIn->sockfd = transport->TcpIn->sockfd;
 
@@ -260,6 +274,7 @@ BOOL transport_accept_nla(rdpTransport* transport)
 	{
 		printf("client authentication failure\n");
 		credssp_free(transport->credssp);
+		transport->credssp = NULL;
 		return FALSE;
 	}
 
@@ -268,6 +283,195 @@ BOOL transport_accept_nla(rdpTransport* transport)
 	return TRUE;
 }
 
+/**
+ * Non-blocking counterpart of transport_accept_tls() and transport_accept_nla():
+ * the TLS handshake and the CredSSP exchange are then advanced by
+ * transport_accept_continue() each time the socket becomes readable.
+ */
+
+BOOL transport_accept_start(rdpTransport* transport, BOOL nla)
+{
+	if (transport->TlsIn == NULL)
+		transport->TlsIn = tls_new(transport->settings);
+
+	if (transport->TlsOut == NULL)
+		transport->TlsOut = transport->TlsIn;
+
+	transport->layer = TRANSPORT_LAYER_TLS;
+	transport->TlsIn->sockfd = transport->TcpIn->sockfd;
+
+	if (tls_accept_start(transport->TlsIn, transport->settings->CertificateFile, transport->settings->PrivateKeyFile) != TRUE)
+		return FALSE;
+
+	transport->AcceptNla = nla;
+	transport->AcceptState = TRANSPORT_ACCEPT_TLS;
+
+	return TRUE;
+}
+
+/**
+ * TSRequests use a DER definite length of up to 4 bytes, and are
+ * rejected beyond TS_REQUEST_MAX_LENGTH.
+ */
+
+#define TS_REQUEST_MAX_LENGTH	0x100000
+
+/**
+ * Returns the length of the TSRequest at the head of the receive buffer,
+ * 0 if its header is not complete yet, or -1 if it is not a TSRequest.
+ */
+
+static int transport_ts_request_length(STREAM* s, int pos)
+{
+	int index;
+	int count;
+	UINT32 length;
+	BYTE* header = stream_get_head(s);
+
+	if (pos < 2)
+		return 0;
+
+	if (header[0] != 0x30) /* DER SEQUENCE */
+		return -1;
+
+	if (!(header[1] & 0x80))
+		return header[1] + 2;
+
+	count = header[1] & 0x7F;
+
+	if ((count < 1) || (count > 4))
+		return -1;
+
+	if (pos < count + 2)
+		return 0;
+
+	length = 0;
+
+	for (index = 0; index < count; index++)
+		length = (length << 8) | header[2 + index];
+
+	if (length > TS_REQUEST_MAX_LENGTH - (count + 2))
+	{
+		printf("transport_ts_request_length: TSRequest of %u bytes is too large\n", length);
+		return -1;
+	}
+
+	return length + count + 2;
+}
+
+static int transport_accept_check_nla(rdpTransport* transport)
+{
+	int pos;
+	int length;
+	int status;
+	STREAM* received;
+
+	do
+	{
+		status = transport_read_nonblocking(transport);
+
+		if (status < 0)
+			return -1;
+	}
+	while (status > 0);
+
+	while ((pos = stream_get_pos(transport->recv_buffer)) > 0)
+	{
+		length = transport_ts_request_length(transport->recv_buffer, pos);
+
+		if (length < 0)
+		{
+			printf("transport_accept_continue: protocol error, not a TSRequest.\n");
+			return -1;
+		}
+
+		if ((length == 0) || (pos < length))
+			return 0;
+
+		received = transport->recv_buffer;
+		transport->recv_buffer = stream_new(BUFFER_SIZE);
+
+		if (pos > length)
+		{
+			stream_set_pos(received, length);
+			stream_check_size(transport->recv_buffer, pos - length);
+			stream_copy(transport->recv_buffer, received, pos - length);
+		}
+
+		stream_set_pos(received, length);
+		stream_seal(received);
+		stream_set_pos(received, 0);
+
+		status = credssp_server_recv(transport->credssp, received);
+
+		stream_free(received);
+
+		if (status != 0)
+			return status;
+	}
+
+	return 0;
+}
+
+/**
+ * Advance the handshake begun with transport_accept_start() without blocking.
+ * @return 1 when the security layer is established, 0 if it waits for the
+ * client, -1 on failure
+ */
+
+int transport_accept_continue(rdpTransport* transport)
+{
+	int status;
+	freerdp* instance;
+	rdpSettings* settings = transport->settings;
+
+	if (transport->AcceptState == TRANSPORT_ACCEPT_TLS)
+	{
+		status = tls_accept_continue(transport->TlsIn);
+
+		if (status <= 0)
+			return status;
+
+		if (!transport->AcceptNla || (settings->Authentication != TRUE))
+		{
+			transport->AcceptState = TRANSPORT_ACCEPT_NONE;
+			return 1;
+		}
+
+		/* Network Level Authentication */
+
+		instance = (freerdp*) settings->instance;
+
+		if (transport->credssp == NULL)
+			transport->credssp = credssp_new(instance, transport, settings);
+
+		if (credssp_server_begin(transport->credssp) < 0)
+			return -1;
+
+		transport->AcceptState = TRANSPORT_ACCEPT_NLA;
+	}
+
+	if (transport->AcceptState == TRANSPORT_ACCEPT_NLA)
+	{
+		status = transport_accept_check_nla(transport);
+
+		if (status < 0)
+		{
+			printf("client authentication failure\n");
+			return -1;
+		}
+
+		if (status == 0)
+			return 0;
+
+		/* don't free credssp module yet, we need to copy the credentials from it first */
+
+		transport->AcceptState = TRANSPORT_ACCEPT_NONE;
+	}
+
+	return 1;
+}
+
 int transport_read(rdpTransport* transport, STREAM* s)
 {
 	int status = -1;
@@ -346,8 +550,11 @@ int transport_write(rdpTransport* transport, STREAM* s)
 
 		if (status == 0)
 		{
-			/* blocking while sending */
-			freerdp_usleep(transport->usleep_interval);
+			/* blocking while sending: wait for the socket to drain, or for data to read */
+			if (transport->layer == TRANSPORT_LAYER_TSG)
+				freerdp_usleep(transport->usleep_interval);
+			else
+				tcp_wait_write(transport->TcpOut, !transport->blocking, 100);
 
 			/* when sending is blocked in nonblocking mode, the receiving buffer should be checked */
 			if (!transport->blocking)
@@ -371,13 +578,82 @@ int transport_write(rdpTransport* transport, STREAM* s)
 	return status;
 }
 
+/**
+ * Bytes that can be written without queueing more than the send window
+ * allows. Gateway connections are not tracked and report no limit.
+ */
+
+UINT32 transport_get_send_capacity(rdpTransport* transport)
+{
+	int queued;
+	rdpTcp* tcp = transport->TcpOut;
+
+	if ((transport->layer == TRANSPORT_LAYER_TSG) || !tcp_update_send_window(tcp))
+		return 0xFFFFFFFF;
+
+	queued = tcp_get_send_queue(tcp);
+
+	if (queued < 0)
+		return tcp->send_queue_limit;
+
+	return ((UINT32) queued < tcp->send_queue_limit) ? tcp->send_queue_limit - queued : 0;
+}
+
+/**
+ * An empty queue always takes a write. When a write would not fit, the
+ * caller is told to hold off and is signaled through transport_check_writable
+ * once half of the queue has drained.
+ */
+
+BOOL transport_can_send(rdpTransport* transport, UINT32 length)
+{
+	UINT32 capacity;
+
+	capacity = transport_get_send_capacity(transport);
+
+	if ((length <= capacity) || (capacity == transport->TcpOut->send_queue_limit))
+		return TRUE;
+
+	transport->WaitingWritable = TRUE;
+
+	return FALSE;
+}
+
+BOOL transport_check_writable(rdpTransport* transport)
+{
+	if (!transport->WaitingWritable)
+		return FALSE;
+
+	if (transport_get_send_capacity(transport) < transport->TcpOut->send_queue_limit / 2)
+		return FALSE;
+
+	transport->WaitingWritable = FALSE;
+
+	return TRUE;
+}
+
+/* the socket reports writable only below the low watermark set from the send window */
+
+void transport_get_write_fds(rdpTransport* transport, void** wfds, int* wcount)
+{
+#if defined(TCP_NOTSENT_LOWAT) && !defined(_WIN32)
+	if (!transport->WaitingWritable)
+		return;
+
+	wfds[*wcount] = (void*)(long)(transport->TcpOut->sockfd);
+	(*wcount)++;
+#endif
+}
+
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount)
 {
+	/* the gateway OUT channel has its own reader, which signals recv_event */
+
 #ifdef _WIN32
 	rfds[*rcount] = transport->TcpIn->wsa_event;
 	(*rcount)++;
 
-	if (transport->SplitInputOutput)
+	if (transport->SplitInputOutput && (transport->layer != TRANSPORT_LAYER_TSG))
 	{
 		rfds[*rcount] = transport->TcpOut->wsa_event;
 		(*rcount)++;
@@ -386,7 +662,7 @@ void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount)
 	rfds[*rcount] = (void*)(long)(transport->TcpIn->sockfd);
 	(*rcount)++;
 
-	if (transport->SplitInputOutput)
+	if (transport->SplitInputOutput && (transport->layer != TRANSPORT_LAYER_TSG))
 	{
 		rfds[*rcount] = (void*)(long)(transport->TcpOut->sockfd);
 		(*rcount)++;
@@ -555,6 +831,8 @@ void transport_free(rdpTransport* transport)
 		if (transport->TlsIn)
 			tls_free(transport->TlsIn);
 
+		credssp_free(transport->credssp);
+
 		tcp_free(transport->TcpIn);
 		tsg_free(transport->tsg);
 
@@ -28,6 +28,13 @@ typedef enum
 	TRANSPORT_LAYER_CLOSED
 } TRANSPORT_LAYER;
 
+typedef enum
+{
+	TRANSPORT_ACCEPT_NONE,
+	TRANSPORT_ACCEPT_TLS,
+	TRANSPORT_ACCEPT_NLA
+} TRANSPORT_ACCEPT_STATE;
+
 typedef struct rdp_transport rdpTransport;
 
 #include "tcp.h"
@@ -65,10 +72,13 @@ struct rdp_transport
 	BOOL blocking;
 	BOOL ProcessSinglePdu;
 	BOOL SplitInputOutput;
+	BOOL AcceptNla;
+	BOOL WaitingWritable;
+	TRANSPORT_ACCEPT_STATE AcceptState;
 };
 
 STREAM* transport_recv_stream_init(rdpTransport* transport, int size);
-STREAM* transport_send_stream_init(rdpTransport* transport, int size);
+FREERDP_TEST_API STREAM* transport_send_stream_init(rdpTransport* transport, int size);
 BOOL transport_connect(rdpTransport* transport, const char* hostname, UINT16 port);
 void transport_attach(rdpTransport* transport, int sockfd);
 BOOL transport_disconnect(rdpTransport* transport);
@@ -79,8 +89,14 @@ BOOL transport_connect_tsg(rdpTransport* transport);
 BOOL transport_accept_rdp(rdpTransport* transport);
 BOOL transport_accept_tls(rdpTransport* transport);
 BOOL transport_accept_nla(rdpTransport* transport);
+BOOL transport_accept_start(rdpTransport* transport, BOOL nla);
+int transport_accept_continue(rdpTransport* transport);
 int transport_read(rdpTransport* transport, STREAM* s);
-int transport_write(rdpTransport* transport, STREAM* s);
+FREERDP_TEST_API int transport_write(rdpTransport* transport, STREAM* s);
+UINT32 transport_get_send_capacity(rdpTransport* transport);
+BOOL transport_can_send(rdpTransport* transport, UINT32 length);
+BOOL transport_check_writable(rdpTransport* transport);
+void transport_get_write_fds(rdpTransport* transport, void** wfds, int* wcount);
 void transport_get_fds(rdpTransport* transport, void** rfds, int* rcount);
 int transport_check_fds(rdpTransport** ptransport);
 BOOL transport_set_blocking_mode(rdpTransport* transport, BOOL blocking);
@@ -130,7 +130,9 @@ DWORD TsProxySendToServer(handle_t IDL_handle, byte pRpcMessage[], UINT32 count,
 		totalDataBytes += lengths[2] + 4;
 	}
 
-	s = stream_new(28 + totalDataBytes);
+	s = tsg->SendStream;
+	stream_set_pos(s, 0);
+	stream_check_size(s, 28 + totalDataBytes);
 
 	/* PCHANNEL_CONTEXT_HANDLE_NOSERIALIZE_NR (20 bytes) */
 	stream_write(s, &tsg->ChannelContext.ContextType, 4); /* ContextType (4 bytes) */
@@ -153,12 +155,8 @@ DWORD TsProxySendToServer(handle_t IDL_handle, byte pRpcMessage[], UINT32 count,
 	if (buffer3Length > 0)
 		stream_write(s, buffer3, buffer3Length); /* buffer3 (variable) */
 
-	stream_seal(s);
-
-	length = s->size;
-	status = rpc_tsg_write(tsg->rpc, s->data, s->size, TsProxySendToServerOpnum);
-
-	stream_free(s);
+	length = stream_get_length(s);
+	status = rpc_tsg_write(tsg->rpc, s->data, length, TsProxySendToServerOpnum);
 
 	if (status <= 0)
 	{
@@ -1107,69 +1105,82 @@ BOOL tsg_connect(rdpTsg* tsg, const char* hostname, UINT16 port)
 
 	tsg->state = TSG_STATE_PIPE_CREATED;
 
+	/* from now on, PDUs are prefetched from the OUT channel and read from a queue */
+
+	if (!rpc_out_reader_start(rpc))
+		return FALSE;
+
 	return TRUE;
 }
 
 int tsg_read(rdpTsg* tsg, BYTE* data, UINT32 length)
 {
 	int status;
-	int CopyLength;
+	UINT32 CopyLength;
+	UINT32 BytesCopied = 0;
 	rdpRpc* rpc = tsg->rpc;
+	rpcconn_response_hdr_t* header;
 
 	DEBUG_TSG("tsg_read: %d, pending: %d", length, tsg->PendingPdu);
 
-	if (tsg->PendingPdu)
-	{
-		rpcconn_common_hdr_t* header;
-
-		header = (rpcconn_common_hdr_t*) rpc->buffer;
-
-		CopyLength = (tsg->BytesAvailable > length) ? length : tsg->BytesAvailable;
+	/* copy stub data from as many queued PDUs as fit, waiting for the first one only */
 
-		CopyMemory(data, &rpc->buffer[tsg->StubOffset + tsg->BytesRead], CopyLength);
-		tsg->BytesAvailable -= CopyLength;
-		tsg->BytesRead += CopyLength;
-
-		if (tsg->BytesAvailable < 1)
-			tsg->PendingPdu = FALSE;
-
-		return CopyLength;
-	}
-	else
+	while (BytesCopied < length)
 	{
-		rpcconn_response_hdr_t* header;
-
-		status = rpc_recv_pdu(rpc);
-		
-		header = (rpcconn_response_hdr_t*) rpc->buffer;
-
-		if (!rpc_get_stub_data_info(rpc, rpc->buffer, &tsg->StubOffset, &tsg->StubLength))
+		if (!tsg->PendingPdu)
 		{
-			printf("tsg_read error: expected stub\n");
-			return -1;
+			status = rpc_recv_dequeue_pdu(rpc, &tsg->Pdu, tsg->transport->blocking && (BytesCopied == 0));
+
+			if (status < 0)
+				return (BytesCopied > 0) ? BytesCopied : -1;
+
+			if (status == 0)
+				break;
+
+			header = (rpcconn_response_hdr_t*) tsg->Pdu;
+
+			if (!rpc_get_stub_data_info(rpc, tsg->Pdu, &tsg->StubOffset, &tsg->StubLength))
+			{
+				printf("tsg_read error: expected stub\n");
+				rpc_recv_release_pdu(rpc, tsg->Pdu);
+				tsg->Pdu = NULL;
+				return -1;
+			}
+
+			if (header->alloc_hint == 4)
+			{
+				DEBUG_TSG("Ignoring TsProxySetupReceivePipe Response");
+				rpc_recv_release_pdu(rpc, tsg->Pdu);
+				tsg->Pdu = NULL;
+				continue;
+			}
+
+			tsg->PendingPdu = TRUE;
+			tsg->BytesAvailable = tsg->StubLength;
+			tsg->BytesRead = 0;
 		}
 
-		if (header->alloc_hint == 4)
-		{
-			DEBUG_TSG("Ignoring TsProxySetupReceivePipe Response");
-			return tsg_read(tsg, data, length);
-		}
-
-		tsg->PendingPdu = TRUE;
-		tsg->BytesAvailable = tsg->StubLength;
-		tsg->BytesRead = 0;
-
-		CopyLength = (tsg->BytesAvailable > length) ? length : tsg->BytesAvailable;
+		CopyLength = MIN(tsg->BytesAvailable, length - BytesCopied);
 
-		CopyMemory(data, &rpc->buffer[tsg->StubOffset + tsg->BytesRead], CopyLength);
+		CopyMemory(&data[BytesCopied], &tsg->Pdu[tsg->StubOffset + tsg->BytesRead], CopyLength);
 		tsg->BytesAvailable -= CopyLength;
 		tsg->BytesRead += CopyLength;
+		BytesCopied += CopyLength;
 
 		if (tsg->BytesAvailable < 1)
+		{
 			tsg->PendingPdu = FALSE;
-
-		return CopyLength;
+			rpc_recv_release_pdu(rpc, tsg->Pdu);
+			tsg->Pdu = NULL;
+		}
 	}
+
+	/* data left behind must wake up the transport again */
+
+	if (tsg->PendingPdu || (Queue_Count(rpc->ReceiveQueue) > 0))
+		wait_obj_set(tsg->transport->recv_event);
+
+	return BytesCopied;
 }
 
 int tsg_write(rdpTsg* tsg, BYTE* data, UINT32 length)
@@ -1190,6 +1201,7 @@ rdpTsg* tsg_new(rdpTransport* transport)
 		tsg->settings = transport->settings;
 		tsg->rpc = rpc_new(tsg->transport);
 		tsg->PendingPdu = FALSE;
+		tsg->SendStream = stream_new(4096);
 	}
 
 	return tsg;
@@ -1199,6 +1211,10 @@ void tsg_free(rdpTsg* tsg)
 {
 	if (tsg != NULL)
 	{
+		if (tsg->Pdu)
+			BufferPool_Return(tsg->rpc->ReceivePool, tsg->Pdu);
+
+		stream_free(tsg->SendStream);
 		rpc_free(tsg->rpc);
 		free(tsg);
 	}
@@ -59,11 +59,13 @@ struct rdp_tsg
 	LPWSTR Hostname;
 	LPWSTR MachineName;
 	TSG_STATE state;
+	BYTE* Pdu;
 	BOOL PendingPdu;
-	BOOL BytesRead;
-	BOOL BytesAvailable;
+	UINT32 BytesRead;
+	UINT32 BytesAvailable;
 	UINT32 StubOffset;
 	UINT32 StubLength;
+	STREAM* SendStream;
 	rdpSettings* settings;
 	rdpTransport* transport;
 	CONTEXT_HANDLE TunnelContext;
@@ -304,11 +306,11 @@ DWORD TsProxySendToServer(handle_t IDL_handle, BYTE pRpcMessage[], UINT32 count,
 
 BOOL tsg_connect(rdpTsg* tsg, const char* hostname, UINT16 port);
 
-int tsg_write(rdpTsg* tsg, BYTE* data, UINT32 length);
-int tsg_read(rdpTsg* tsg, BYTE* data, UINT32 length);
+FREERDP_TEST_API int tsg_write(rdpTsg* tsg, BYTE* data, UINT32 length);
+FREERDP_TEST_API int tsg_read(rdpTsg* tsg, BYTE* data, UINT32 length);
 
-rdpTsg* tsg_new(rdpTransport* transport);
-void tsg_free(rdpTsg* tsg);
+FREERDP_TEST_API rdpTsg* tsg_new(rdpTransport* transport);
+FREERDP_TEST_API void tsg_free(rdpTsg* tsg);
 
 #ifdef WITH_DEBUG_TSG
 #define DEBUG_TSG(fmt, ...) DEBUG_CLASS(TSG, fmt, ## __VA_ARGS__)
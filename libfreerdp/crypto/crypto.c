@@ -32,6 +32,16 @@ CryptoSha1 crypto_sha1_init(void)
 	return sha1;
 }
 
+/**
+ * crypto_sha1_reset() and crypto_sha1_digest() work on a context embedded
+ * in another structure or on the stack: nothing is allocated or freed.
+ */
+
+void crypto_sha1_reset(CryptoSha1 sha1)
+{
+	SHA1_Init(&sha1->sha_ctx);
+}
+
 void crypto_sha1_update(CryptoSha1 sha1, const BYTE* data, UINT32 length)
 {
 	SHA1_Update(&sha1->sha_ctx, data, length);
@@ -43,6 +53,11 @@ void crypto_sha1_final(CryptoSha1 sha1, BYTE* out_data)
 	free(sha1);
 }
 
+void crypto_sha1_digest(CryptoSha1 sha1, BYTE* out_data)
+{
+	SHA1_Final(out_data, &sha1->sha_ctx);
+}
+
 CryptoMd5 crypto_md5_init(void)
 {
 	CryptoMd5 md5 = malloc(sizeof(*md5));
@@ -50,6 +65,11 @@ CryptoMd5 crypto_md5_init(void)
 	return md5;
 }
 
+void crypto_md5_reset(CryptoMd5 md5)
+{
+	MD5_Init(&md5->md5_ctx);
+}
+
 void crypto_md5_update(CryptoMd5 md5, const BYTE* data, UINT32 length)
 {
 	MD5_Update(&md5->md5_ctx, data, length);
@@ -61,6 +81,11 @@ void crypto_md5_final(CryptoMd5 md5, BYTE* out_data)
 	free(md5);
 }
 
+void crypto_md5_digest(CryptoMd5 md5, BYTE* out_data)
+{
+	MD5_Final(out_data, &md5->md5_ctx);
+}
+
 CryptoRc4 crypto_rc4_init(const BYTE* key, UINT32 length)
 {
 	CryptoRc4 rc4 = malloc(sizeof(*rc4));
@@ -79,6 +104,11 @@ void crypto_rc4_free(CryptoRc4 rc4)
 		free(rc4);
 }
 
+void crypto_rc4_set_key(CryptoRc4 rc4, const BYTE* key, UINT32 length)
+{
+	RC4_set_key(&rc4->rc4_key, length, key);
+}
+
 CryptoDes3 crypto_des3_encrypt_init(const BYTE* key, const BYTE* ivec)
 {
 	CryptoDes3 des3 = malloc(sizeof(*des3));
@@ -132,6 +162,11 @@ void crypto_hmac_sha1_init(CryptoHmac hmac, const BYTE* data, UINT32 length)
 	HMAC_Init_ex(&hmac->hmac_ctx, data, length, EVP_sha1(), NULL);
 }
 
+void crypto_hmac_md5_init(CryptoHmac hmac, const BYTE* data, UINT32 length)
+{
+	HMAC_Init_ex(&hmac->hmac_ctx, data, length, EVP_md5(), NULL);
+}
+
 void crypto_hmac_update(CryptoHmac hmac, const BYTE* data, UINT32 length)
 {
 	HMAC_Update(&hmac->hmac_ctx, data, length);
@@ -142,6 +177,15 @@ void crypto_hmac_final(CryptoHmac hmac, BYTE* out_data, UINT32 length)
 	HMAC_Final(&hmac->hmac_ctx, out_data, &length);
 }
 
+/**
+ * Starts a new MAC with the key and digest of the last crypto_hmac_*_init().
+ */
+
+void crypto_hmac_reset(CryptoHmac hmac)
+{
+	HMAC_Init_ex(&hmac->hmac_ctx, NULL, 0, NULL, NULL);
+}
+
 void crypto_hmac_free(CryptoHmac hmac)
 {
 	if (hmac == NULL)
@@ -21,12 +21,127 @@
 #include "config.h"
 #endif
 
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
 #include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#ifndef _WIN32
+#include <sys/select.h>
+#else
+#include <winsock2.h>
+#endif
 
 #include <freerdp/utils/stream.h>
 
 #include <freerdp/crypto/tls.h>
 
+/**
+ * Before 1.1.0, OpenSSL is only thread safe once given locks. Server
+ * contexts and the client session cache are shared by connections running
+ * on different threads, and the TS Gateway OUT channel is read by a thread
+ * of its own, so the locks are set up once unless the application already
+ * did.
+ */
+
+static INIT_ONCE tls_init_once = INIT_ONCE_STATIC_INIT;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
+static CRITICAL_SECTION* tls_locks = NULL;
+
+static void tls_locking_callback(int mode, int type, const char* file, int line)
+{
+	if (mode & CRYPTO_LOCK)
+		EnterCriticalSection(&tls_locks[type]);
+	else
+		LeaveCriticalSection(&tls_locks[type]);
+}
+
+#endif
+
+static BOOL CALLBACK tls_init_library(PINIT_ONCE InitOnce, PVOID Parameter, PVOID* Context)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	int index;
+#endif
+
+	SSL_load_error_strings();
+	SSL_library_init();
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	if (CRYPTO_get_locking_callback())
+		return TRUE;
+
+	tls_locks = (CRITICAL_SECTION*) malloc(CRYPTO_num_locks() * sizeof(CRITICAL_SECTION));
+
+	if (!tls_locks)
+		return FALSE;
+
+	for (index = 0; index < CRYPTO_num_locks(); index++)
+		InitializeCriticalSection(&tls_locks[index]);
+
+	CRYPTO_set_locking_callback(tls_locking_callback);
+#endif
+
+	return TRUE;
+}
+
+static void tls_init(void)
+{
+	InitOnceExecuteOnce(&tls_init_once, tls_init_library, NULL, NULL);
+}
+
+/**
+ * Server contexts are shared by all peers accepted with the same certificate
+ * and private key files: the files are read once, and the SSL_CTX holds the
+ * server session cache and the session ticket keys, so that a client coming
+ * back can resume its session with an abbreviated handshake. A context is
+ * rebuilt when either file changes; peers still using the previous one keep
+ * it alive through the reference held by their SSL object.
+ */
+
+typedef struct rdp_tls_server_context rdpTlsServerContext;
+
+struct rdp_tls_server_context
+{
+	rdpTlsServerContext* next;
+	char* cert_file;
+	char* privatekey_file;
+	time_t cert_mtime;
+	off_t cert_size;
+	time_t privatekey_mtime;
+	off_t privatekey_size;
+
+	SSL_CTX* ctx;
+	BYTE* PublicKey;
+	DWORD PublicKeyLength;
+};
+
+static SRWLOCK tls_server_lock = SRWLOCK_INIT;
+static rdpTlsServerContext* tls_server_contexts = NULL;
+
+/**
+ * Client sessions are cached per server name and port, most recently used
+ * first, and offered again on the next connection to the same server.
+ */
+
+#define TLS_CLIENT_SESSION_CACHE_SIZE	32
+
+typedef struct rdp_tls_client_session rdpTlsClientSession;
+
+struct rdp_tls_client_session
+{
+	rdpTlsClientSession* next;
+	char* name;
+	SSL_SESSION* session;
+};
+
+static SRWLOCK tls_client_lock = SRWLOCK_INIT;
+static rdpTlsClientSession* tls_client_sessions = NULL;
+
 static CryptoCert tls_get_certificate(rdpTls* tls, BOOL peer)
 {
 	CryptoCert cert;
@@ -57,11 +172,121 @@ static void tls_free_certificate(CryptoCert cert)
 	free(cert);
 }
 
+/**
+ * Client sessions are keyed by the name and port the connection was made to,
+ * the gateway for connections going through a TS Gateway.
+ */
+
+static BOOL tls_get_server_name(rdpTls* tls, char* name, int length)
+{
+	rdpSettings* settings = tls->settings;
+
+	if (settings->GatewayUsageMethod)
+	{
+		if (!settings->GatewayHostname)
+			return FALSE;
+
+		sprintf_s(name, length, "%s:%d", settings->GatewayHostname, 443);
+	}
+	else
+	{
+		if (!settings->ServerHostname)
+			return FALSE;
+
+		sprintf_s(name, length, "%s:%d", settings->ServerHostname, settings->ServerPort);
+	}
+
+	return TRUE;
+}
+
+static void tls_client_session_free(rdpTlsClientSession* entry)
+{
+	SSL_SESSION_free(entry->session);
+	free(entry->name);
+	free(entry);
+}
+
+/**
+ * Offers the session cached for the server, if any.
+ */
+
+static void tls_client_session_offer(rdpTls* tls, const char* name)
+{
+	rdpTlsClientSession* entry;
+
+	AcquireSRWLockShared(&tls_client_lock);
+
+	for (entry = tls_client_sessions; entry; entry = entry->next)
+	{
+		if (strcmp(entry->name, name) == 0)
+		{
+			SSL_set_session(tls->ssl, entry->session);
+			break;
+		}
+	}
+
+	ReleaseSRWLockShared(&tls_client_lock);
+}
+
+/**
+ * Stores the session of an established connection for the server,
+ * or drops the cached one if session is NULL.
+ */
+
+static void tls_client_session_store(const char* name, SSL_SESSION* session)
+{
+	int count;
+	rdpTlsClientSession* entry;
+	rdpTlsClientSession** link;
+	rdpTlsClientSession* added = NULL;
+
+	if (session)
+	{
+		added = (rdpTlsClientSession*) malloc(sizeof(rdpTlsClientSession));
+
+		if (!added)
+		{
+			SSL_SESSION_free(session);
+			return;
+		}
+
+		added->name = _strdup(name);
+		added->session = session;
+	}
+
+	AcquireSRWLockExclusive(&tls_client_lock);
+
+	link = &tls_client_sessions;
+	count = 0;
+
+	while ((entry = *link) != NULL)
+	{
+		if ((strcmp(entry->name, name) == 0) || (count >= TLS_CLIENT_SESSION_CACHE_SIZE - 1))
+		{
+			*link = entry->next;
+			tls_client_session_free(entry);
+			continue;
+		}
+
+		link = &entry->next;
+		count++;
+	}
+
+	if (added)
+	{
+		added->next = tls_client_sessions;
+		tls_client_sessions = added;
+	}
+
+	ReleaseSRWLockExclusive(&tls_client_lock);
+}
+
 BOOL tls_connect(rdpTls* tls)
 {
 	CryptoCert cert;
 	long options = 0;
 	int connection_status;
+	char name[512];
 
 	tls->ctx = SSL_CTX_new(TLSv1_client_method());
 
@@ -116,6 +341,12 @@ BOOL tls_connect(rdpTls* tls)
 		return FALSE;
 	}
 
+	if (!tls_get_server_name(tls, name, sizeof(name)))
+		name[0] = '\0';
+
+	if (name[0])
+		tls_client_session_offer(tls, name);
+
 	connection_status = SSL_connect(tls->ssl);
 
 	if (connection_status <= 0)
@@ -144,6 +375,10 @@ BOOL tls_connect(rdpTls* tls)
 	if (!tls_verify_certificate(tls, cert, tls->settings->ServerHostname))
 	{
 		printf("tls_connect: certificate not trusted, aborting.\n");
+
+		if (name[0])
+			tls_client_session_store(name, NULL);
+
 		tls_disconnect(tls);
 		tls_free_certificate(cert);
 		return FALSE;
@@ -151,21 +386,52 @@ BOOL tls_connect(rdpTls* tls)
 
 	tls_free_certificate(cert);
 
+	if (name[0])
+		tls_client_session_store(name, SSL_get1_session(tls->ssl));
+
 	return TRUE;
 }
 
-BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+static void tls_server_context_free(rdpTlsServerContext* context)
 {
-	CryptoCert cert;
+	if (context->ctx)
+		SSL_CTX_free(context->ctx);
+
+	free(context->PublicKey);
+	free(context->cert_file);
+	free(context->privatekey_file);
+	free(context);
+}
+
+static rdpTlsServerContext* tls_server_context_new(const char* cert_file, const char* privatekey_file,
+		struct stat* cert_stat, struct stat* privatekey_stat)
+{
+	BIO* bio;
 	long options = 0;
-	int connection_status;
+	struct crypto_cert_struct cert;
+	rdpTlsServerContext* context;
 
-	tls->ctx = SSL_CTX_new(SSLv23_server_method());
+	context = (rdpTlsServerContext*) malloc(sizeof(rdpTlsServerContext));
 
-	if (tls->ctx == NULL)
+	if (!context)
+		return NULL;
+
+	ZeroMemory(context, sizeof(rdpTlsServerContext));
+
+	context->cert_file = _strdup(cert_file);
+	context->privatekey_file = _strdup(privatekey_file);
+	context->cert_mtime = cert_stat->st_mtime;
+	context->cert_size = cert_stat->st_size;
+	context->privatekey_mtime = privatekey_stat->st_mtime;
+	context->privatekey_size = privatekey_stat->st_size;
+
+	context->ctx = SSL_CTX_new(SSLv23_server_method());
+
+	if (context->ctx == NULL)
 	{
 		printf("SSL_CTX_new failed\n");
-		return FALSE;
+		tls_server_context_free(context);
+		return NULL;
 	}
 
 	/*
@@ -205,44 +471,133 @@ BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
 	 */
 	options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
 
-	SSL_CTX_set_options(tls->ctx, options);
+	SSL_CTX_set_options(context->ctx, options);
 
-	if (SSL_CTX_use_RSAPrivateKey_file(tls->ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
+	/**
+	 * Session resumption: session IDs are kept in the context's cache,
+	 * and session tickets (enabled by default) are encrypted with keys
+	 * generated for the context, so both work across all its peers.
+	 */
+	SSL_CTX_set_session_cache_mode(context->ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(context->ctx, (BYTE*) "FreeRDP", 7);
+
+	if (SSL_CTX_use_RSAPrivateKey_file(context->ctx, privatekey_file, SSL_FILETYPE_PEM) <= 0)
 	{
 		printf("SSL_CTX_use_RSAPrivateKey_file failed\n");
-		return FALSE;
+		tls_server_context_free(context);
+		return NULL;
 	}
 
-	tls->ssl = SSL_new(tls->ctx);
+	bio = BIO_new_file(cert_file, "r");
+	cert.px509 = bio ? PEM_read_bio_X509(bio, NULL, NULL, NULL) : NULL;
 
-	if (tls->ssl == NULL)
+	if (bio)
+		BIO_free(bio);
+
+	if (!cert.px509 || (SSL_CTX_use_certificate(context->ctx, cert.px509) <= 0))
 	{
-		printf("SSL_new failed\n");
-		return FALSE;
+		printf("SSL_CTX_use_certificate failed\n");
+
+		if (cert.px509)
+			X509_free(cert.px509);
+
+		tls_server_context_free(context);
+		return NULL;
 	}
 
-	if (SSL_use_certificate_file(tls->ssl, cert_file, SSL_FILETYPE_PEM) <= 0)
+	if (!crypto_cert_get_public_key(&cert, &context->PublicKey, &context->PublicKeyLength))
 	{
-		printf("SSL_use_certificate_file failed\n");
-		return FALSE;
+		printf("tls_accept: crypto_cert_get_public_key failed to return the server public key.\n");
+		X509_free(cert.px509);
+		tls_server_context_free(context);
+		return NULL;
 	}
 
-	cert = tls_get_certificate(tls, FALSE);
+	X509_free(cert.px509);
 
-	if (cert == NULL)
+	return context;
+}
+
+/**
+ * Returns a new SSL object for the context of the given files, creating or
+ * reloading the context as needed, and copies out the server public key.
+ */
+
+static SSL* tls_server_context_ssl_new(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+{
+	SSL* ssl = NULL;
+	struct stat cert_stat;
+	struct stat privatekey_stat;
+	rdpTlsServerContext* context;
+	rdpTlsServerContext** link;
+
+	/* the shared contexts are used from every peer thread */
+	tls_init();
+
+	if ((stat(cert_file, &cert_stat) != 0) || (stat(privatekey_file, &privatekey_stat) != 0))
 	{
-		printf("tls_connect: tls_get_certificate failed to return the server certificate.\n");
-		return FALSE;
+		printf("tls_accept: cannot access %s or %s\n", cert_file, privatekey_file);
+		return NULL;
 	}
 
-	if (!crypto_cert_get_public_key(cert, &tls->PublicKey, &tls->PublicKeyLength))
+	AcquireSRWLockExclusive(&tls_server_lock);
+
+	for (link = &tls_server_contexts; (context = *link) != NULL; link = &context->next)
 	{
-		printf("tls_connect: crypto_cert_get_public_key failed to return the server public key.\n");
-		tls_free_certificate(cert);
-		return FALSE;
+		if ((strcmp(context->cert_file, cert_file) == 0) && (strcmp(context->privatekey_file, privatekey_file) == 0))
+			break;
 	}
 
-	free(cert);
+	if (context && ((context->cert_mtime != cert_stat.st_mtime) || (context->cert_size != cert_stat.st_size) ||
+			(context->privatekey_mtime != privatekey_stat.st_mtime) || (context->privatekey_size != privatekey_stat.st_size)))
+	{
+		*link = context->next;
+		tls_server_context_free(context);
+		context = NULL;
+	}
+
+	if (!context)
+	{
+		context = tls_server_context_new(cert_file, privatekey_file, &cert_stat, &privatekey_stat);
+
+		if (context)
+		{
+			context->next = tls_server_contexts;
+			tls_server_contexts = context;
+		}
+	}
+
+	if (context)
+	{
+		tls->PublicKey = (BYTE*) malloc(context->PublicKeyLength);
+
+		if (tls->PublicKey)
+		{
+			CopyMemory(tls->PublicKey, context->PublicKey, context->PublicKeyLength);
+			tls->PublicKeyLength = context->PublicKeyLength;
+			ssl = SSL_new(context->ctx);
+		}
+	}
+
+	ReleaseSRWLockExclusive(&tls_server_lock);
+
+	return ssl;
+}
+
+/**
+ * Prepares a server connection: the handshake itself is then driven by
+ * tls_accept_continue(), which never blocks on a non-blocking socket.
+ */
+
+BOOL tls_accept_start(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+{
+	tls->ssl = tls_server_context_ssl_new(tls, cert_file, privatekey_file);
+
+	if (tls->ssl == NULL)
+	{
+		printf("SSL_new failed\n");
+		return FALSE;
+	}
 
 	if (SSL_set_fd(tls->ssl, tls->sockfd) < 1)
 	{
@@ -250,34 +605,106 @@ BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
 		return FALSE;
 	}
 
-	while (1)
-	{
-		connection_status = SSL_accept(tls->ssl);
+	return TRUE;
+}
 
-		if (connection_status <= 0)
-		{
-			switch (SSL_get_error(tls->ssl, connection_status))
-			{
-				case SSL_ERROR_WANT_READ:
-				case SSL_ERROR_WANT_WRITE:
-					break;
+/**
+ * Advances the server handshake with whatever the socket has to offer.
+ * @return 1 when the handshake is complete, 0 if it is waiting for the
+ * socket (see tls_want_write()), -1 on failure
+ */
 
-				default:
-					if (tls_print_error("SSL_accept", tls->ssl, connection_status))
-						return FALSE;
-					break;
+int tls_accept_continue(rdpTls* tls)
+{
+	int connection_status;
 
-			}
-		}
-		else
+	connection_status = SSL_accept(tls->ssl);
+
+	if (connection_status <= 0)
+	{
+		switch (SSL_get_error(tls->ssl, connection_status))
 		{
-			break;
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE:
+				return 0;
+
+			default:
+				tls_print_error("SSL_accept", tls->ssl, connection_status);
+				return -1;
 		}
 	}
 
 	printf("TLS connection accepted\n");
 
-	return TRUE;
+	return 1;
+}
+
+/**
+ * Tells whether a pending handshake waits for the socket to become
+ * writable rather than readable.
+ */
+
+BOOL tls_want_write(rdpTls* tls)
+{
+	return SSL_want_write(tls->ssl) ? TRUE : FALSE;
+}
+
+/**
+ * A blocking accept gives up on a peer that has not completed
+ * the handshake within TLS_ACCEPT_TIMEOUT seconds.
+ */
+
+#define TLS_ACCEPT_TIMEOUT	30
+
+static BOOL tls_wait(rdpTls* tls, time_t deadline)
+{
+	int status;
+	fd_set fds;
+	time_t now;
+	struct timeval timeout;
+
+	now = time(NULL);
+
+	if (now >= deadline)
+		return FALSE;
+
+	FD_ZERO(&fds);
+	FD_SET(tls->sockfd, &fds);
+
+	timeout.tv_sec = (long) (deadline - now);
+	timeout.tv_usec = 0;
+
+	if (tls_want_write(tls))
+		status = select(tls->sockfd + 1, NULL, &fds, NULL, &timeout);
+	else
+		status = select(tls->sockfd + 1, &fds, NULL, NULL, &timeout);
+
+	if ((status < 0) && (errno == EINTR))
+		return TRUE;
+
+	return (status > 0) ? TRUE : FALSE;
+}
+
+BOOL tls_accept(rdpTls* tls, const char* cert_file, const char* privatekey_file)
+{
+	int status;
+	time_t deadline;
+
+	if (!tls_accept_start(tls, cert_file, privatekey_file))
+		return FALSE;
+
+	deadline = time(NULL) + TLS_ACCEPT_TIMEOUT;
+
+	while ((status = tls_accept_continue(tls)) == 0)
+	{
+		if (!tls_wait(tls, deadline))
+		{
+			printf("tls_accept: handshake timed out\n");
+			return FALSE;
+		}
+	}
+
+	return (status > 0) ? TRUE : FALSE;
 }
 
 BOOL tls_disconnect(rdpTls* tls)
@@ -625,8 +1052,7 @@ rdpTls* tls_new(rdpSettings* settings)
 	{
 		ZeroMemory(tls, sizeof(rdpTls));
 
-		SSL_load_error_strings();
-		SSL_library_init();
+		tls_init();
 
 		tls->settings = settings;
 		tls->certificate_store = certificate_store_new(settings);
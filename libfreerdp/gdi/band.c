@@ -0,0 +1,418 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Band-Parallel Rendering
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/brush.h>
+#include <freerdp/gdi/shape.h>
+#include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/clipping.h>
+
+#include <freerdp/gdi/band.h>
+
+/**
+ * Large orders are split into horizontal bands which are drawn concurrently
+ * by a small pool of worker threads, the calling thread taking bands as well.
+ *
+ * Dispatching is fork-join: a band call only returns once every band has
+ * been drawn, so later orders touching the same pixels are always applied
+ * on top of earlier ones, exactly as with serial rendering.
+ *
+ * Workers draw through a private copy of the destination DC without a
+ * window, so that only the calling thread ever touches the invalid region.
+ * Coordinates are clipped before splitting, which makes the clipping done
+ * again by the kernels a no-op and keeps brush patterns in phase, since
+ * bands start at multiples of GDI_BAND_MIN_HEIGHT from the clipped origin.
+ */
+
+#define GDI_BAND_FILL		1
+#define GDI_BAND_PATBLT		2
+#define GDI_BAND_BITBLT		3
+
+struct _GDI_BAND_JOB
+{
+	int type;
+	GDI_DC dc;
+	int x;
+	int y;
+	int width;
+	int height;
+	int bandHeight;
+	int bandCount;
+	HGDI_DC hdcSrc;
+	int xSrc;
+	int ySrc;
+	int rop;
+	HGDI_BRUSH brush;
+	GDI_RECT* rects;
+	int count;
+};
+typedef struct _GDI_BAND_JOB GDI_BAND_JOB;
+
+struct _GDI_BANDS
+{
+	int count;
+	HANDLE* threads;
+	HANDLE start;
+	HANDLE done;
+	BOOL exit;
+	LONG volatile next;
+
+	GDI_BAND_JOB job;
+	GDI_RECT* rects;
+	int maxRects;
+};
+
+static void gdi_band_draw(GDI_BAND_JOB* job, int index)
+{
+	int i;
+	int top;
+	int bottom;
+	GDI_RECT rect;
+	GDI_RECT* clip;
+
+	top = job->y + (index * job->bandHeight);
+	bottom = MIN(top + job->bandHeight, job->y + job->height);
+
+	switch (job->type)
+	{
+		case GDI_BAND_FILL:
+			for (i = 0; i < job->count; i++)
+			{
+				clip = &job->rects[i];
+
+				rect.left = clip->left;
+				rect.right = clip->right;
+				rect.top = MAX(clip->top, top);
+				rect.bottom = MIN(clip->bottom, bottom - 1);
+
+				if (rect.top <= rect.bottom)
+					gdi_FillRect(&job->dc, &rect, job->brush);
+			}
+			break;
+
+		case GDI_BAND_PATBLT:
+			gdi_PatBlt(&job->dc, job->x, top, job->width, bottom - top, job->rop);
+			break;
+
+		case GDI_BAND_BITBLT:
+			gdi_BitBlt(&job->dc, job->x, top, job->width, bottom - top,
+					job->hdcSrc, job->xSrc, job->ySrc + (top - job->y), job->rop);
+			break;
+	}
+}
+
+static void gdi_band_work(HGDI_BANDS hBands)
+{
+	LONG index;
+
+	while ((index = InterlockedIncrement(&hBands->next) - 1) < hBands->job.bandCount)
+		gdi_band_draw(&hBands->job, (int) index);
+}
+
+static void* gdi_band_thread(void* arg)
+{
+	HGDI_BANDS hBands = (HGDI_BANDS) arg;
+
+	while (1)
+	{
+		WaitForSingleObject(hBands->start, INFINITE);
+
+		if (hBands->exit)
+		{
+			ReleaseSemaphore(hBands->done, 1, NULL);
+			break;
+		}
+
+		gdi_band_work(hBands);
+
+		ReleaseSemaphore(hBands->done, 1, NULL);
+	}
+
+	return NULL;
+}
+
+/**
+ * Split the current job into bands and draw them, returning once all are done.
+ * @param hBands band pool
+ * @param hdc destination device context
+ * @param y top of the area to split
+ * @param height height of the area to split
+ */
+
+static void gdi_band_dispatch(HGDI_BANDS hBands, HGDI_DC hdc, int y, int height)
+{
+	int i;
+	int bandCount;
+	int bandHeight;
+	GDI_BAND_JOB* job = &hBands->job;
+
+	bandCount = MIN(hBands->count + 1, height / GDI_BAND_MIN_HEIGHT);
+	bandHeight = (height + bandCount - 1) / bandCount;
+	bandHeight = (bandHeight + GDI_BAND_MIN_HEIGHT - 1) & ~(GDI_BAND_MIN_HEIGHT - 1);
+
+	CopyMemory(&job->dc, hdc, sizeof(GDI_DC));
+	job->dc.hwnd = NULL;
+
+	job->y = y;
+	job->height = height;
+	job->bandHeight = bandHeight;
+	job->bandCount = (height + bandHeight - 1) / bandHeight;
+
+	hBands->next = 0;
+	ReleaseSemaphore(hBands->start, hBands->count, NULL);
+
+	gdi_band_work(hBands);
+
+	for (i = 0; i < hBands->count; i++)
+		WaitForSingleObject(hBands->done, INFINITE);
+}
+
+static BOOL gdi_band_worthwhile(HGDI_BANDS hBands, int width, int height)
+{
+	if ((hBands == NULL) || (hBands->count < 1))
+		return FALSE;
+
+	if (height < (GDI_BAND_MIN_HEIGHT * 2))
+		return FALSE;
+
+	return ((width * height) >= GDI_BAND_MIN_PIXELS) ? TRUE : FALSE;
+}
+
+/**
+ * Create a band rendering pool.
+ * @param nThreads number of worker threads, or 0 for one per additional processor
+ * @return new band pool, or NULL if there is nothing to run in parallel
+ */
+
+HGDI_BANDS gdi_CreateBands(int nThreads)
+{
+	int i;
+	HGDI_BANDS hBands;
+
+	if (nThreads < 1)
+	{
+		SYSTEM_INFO sysinfo;
+
+		GetSystemInfo(&sysinfo);
+		nThreads = (int) sysinfo.dwNumberOfProcessors - 1;
+	}
+
+	if (nThreads < 1)
+		return NULL;
+
+	hBands = (HGDI_BANDS) malloc(sizeof(GDI_BANDS));
+	ZeroMemory(hBands, sizeof(GDI_BANDS));
+
+	hBands->count = nThreads;
+	hBands->start = CreateSemaphore(NULL, 0, nThreads, NULL);
+	hBands->done = CreateSemaphore(NULL, 0, nThreads, NULL);
+	hBands->threads = (HANDLE*) malloc(sizeof(HANDLE) * nThreads);
+
+	for (i = 0; i < nThreads; i++)
+	{
+		hBands->threads[i] = CreateThread(NULL, 0,
+				(LPTHREAD_START_ROUTINE) gdi_band_thread, (void*) hBands, 0, NULL);
+	}
+
+	return hBands;
+}
+
+void gdi_DeleteBands(HGDI_BANDS hBands)
+{
+	int i;
+
+	if (hBands == NULL)
+		return;
+
+	hBands->exit = TRUE;
+	ReleaseSemaphore(hBands->start, hBands->count, NULL);
+
+	for (i = 0; i < hBands->count; i++)
+		WaitForSingleObject(hBands->done, INFINITE);
+
+	for (i = 0; i < hBands->count; i++)
+		CloseHandle(hBands->threads[i]);
+
+	CloseHandle(hBands->start);
+	CloseHandle(hBands->done);
+
+	free(hBands->threads);
+	free(hBands->rects);
+	free(hBands);
+}
+
+/**
+ * Fill a set of rectangles with the same brush, split into bands.
+ * @param hBands band pool
+ * @param hdc device context
+ * @param rects rectangles to fill
+ * @param count number of rectangles
+ * @param hbr brush
+ * @return 0 if the rectangles were filled, -1 if the caller should fill them itself
+ */
+
+int gdi_BandFillRects(HGDI_BANDS hBands, HGDI_DC hdc, GDI_RECT* rects, int count, HGDI_BRUSH hbr)
+{
+	int i;
+	int x, y;
+	int w, h;
+	int area;
+	int top, bottom;
+	GDI_BAND_JOB* job;
+
+	if ((hBands == NULL) || (count < 1))
+		return -1;
+
+	if (count > hBands->maxRects)
+	{
+		hBands->maxRects = count;
+		hBands->rects = (GDI_RECT*) realloc(hBands->rects, sizeof(GDI_RECT) * count);
+	}
+
+	job = &hBands->job;
+	job->count = 0;
+	area = 0;
+	top = bottom = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		gdi_RectToCRgn(&rects[i], &x, &y, &w, &h);
+
+		if (gdi_ClipCoords(hdc, &x, &y, &w, &h, NULL, NULL) == 0)
+			continue;
+
+		gdi_CRgnToRect(x, y, w, h, &hBands->rects[job->count]);
+
+		if (job->count == 0)
+		{
+			top = y;
+			bottom = y + h;
+		}
+		else
+		{
+			top = MIN(top, y);
+			bottom = MAX(bottom, y + h);
+		}
+
+		area += w * h;
+		job->count++;
+	}
+
+	if (job->count < 1)
+		return 0;
+
+	if (!gdi_band_worthwhile(hBands, area / (bottom - top), bottom - top))
+		return -1;
+
+	job->type = GDI_BAND_FILL;
+	job->rects = hBands->rects;
+	job->brush = hbr;
+
+	gdi_band_dispatch(hBands, hdc, top, bottom - top);
+
+	for (i = 0; i < job->count; i++)
+	{
+		gdi_RectToCRgn(&job->rects[i], &x, &y, &w, &h);
+		gdi_InvalidateRegion(hdc, x, y, w, h);
+	}
+
+	return 0;
+}
+
+/**
+ * Perform a pattern blit operation split into bands, using the DC brush.
+ * @return 0 if the blit was done, -1 if the caller should do it itself
+ */
+
+int gdi_BandPatBlt(HGDI_BANDS hBands, HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop)
+{
+	GDI_BAND_JOB* job;
+
+	if (!gdi_band_worthwhile(hBands, nWidth, nHeight))
+		return -1;
+
+	if (gdi_ClipCoords(hdc, &nXLeft, &nYLeft, &nWidth, &nHeight, NULL, NULL) == 0)
+		return 0;
+
+	if (!gdi_band_worthwhile(hBands, nWidth, nHeight))
+		return -1;
+
+	job = &hBands->job;
+	job->type = GDI_BAND_PATBLT;
+	job->x = nXLeft;
+	job->width = nWidth;
+	job->rop = rop;
+
+	gdi_band_dispatch(hBands, hdc, nYLeft, nHeight);
+	gdi_InvalidateRegion(hdc, nXLeft, nYLeft, nWidth, nHeight);
+
+	return 0;
+}
+
+/**
+ * Perform a bit blit operation split into bands.
+ * The source must not be the destination, since bands would then race each other.
+ * @return 0 if the blit was done, -1 if the caller should do it itself
+ */
+
+int gdi_BandBitBlt(HGDI_BANDS hBands, HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
+{
+	GDI_BAND_JOB* job;
+
+	if (!gdi_band_worthwhile(hBands, nWidth, nHeight))
+		return -1;
+
+	if ((hdcSrc == NULL) || (hdcSrc->selectedObject == hdcDest->selectedObject))
+		return -1;
+
+	if (gdi_ClipCoords(hdcDest, &nXDest, &nYDest, &nWidth, &nHeight, &nXSrc, &nYSrc) == 0)
+		return 0;
+
+	if (!gdi_band_worthwhile(hBands, nWidth, nHeight))
+		return -1;
+
+	job = &hBands->job;
+	job->type = GDI_BAND_BITBLT;
+	job->x = nXDest;
+	job->width = nWidth;
+	job->hdcSrc = hdcSrc;
+	job->xSrc = nXSrc;
+	job->ySrc = nYSrc;
+	job->rop = rop;
+
+	gdi_band_dispatch(hBands, hdcDest, nYDest, nHeight);
+	gdi_InvalidateRegion(hdcDest, nXDest, nYDest, nWidth, nHeight);
+
+	return 0;
+}
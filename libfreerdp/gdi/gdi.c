@@ -46,6 +46,10 @@
 #include <freerdp/gdi/palette.h>
 #include <freerdp/gdi/drawing.h>
 #include <freerdp/gdi/clipping.h>
+#include <freerdp/gdi/tiled.h>
+#include <freerdp/gdi/band.h>
+#include <freerdp/gdi/16bpp.h>
+#include <freerdp/gdi/32bpp.h>
 
 #include <freerdp/gdi/gdi.h>
 
@@ -436,6 +440,52 @@ void gdi_bitmap_free_ex(gdiBitmap* bitmap)
 	}
 }
 
+/**
+ * With a tiled primary surface, orders without a tile-aware kernel draw
+ * through the linear buffer. The affected area must be linearized first.
+ */
+
+void gdi_tiled_lock(rdpGdi* gdi, HGDI_DC hdc, int x, int y, int width, int height)
+{
+	if ((gdi->tiled != NULL) && (hdc == gdi->primary->hdc))
+		gdi_TiledLockLinear(gdi->tiled, x, y, width, height);
+}
+
+static BOOL gdi_tiled_target(rdpGdi* gdi)
+{
+	return ((gdi->tiled != NULL) && (gdi->drawing == gdi->primary)) ? TRUE : FALSE;
+}
+
+static UINT32 gdi_tiled_pixel(rdpGdi* gdi, GDI_COLOR color)
+{
+	if (gdi->bytesPerPixel == 2)
+		return gdi_get_color_16bpp(gdi->drawing->hdc, color);
+
+	return gdi_get_color_32bpp(gdi->drawing->hdc, color);
+}
+
+static void gdi_tiled_fill_rect(rdpGdi* gdi, int x, int y, int width, int height, GDI_COLOR color)
+{
+	HGDI_DC hdc = gdi->drawing->hdc;
+
+	if (gdi_ClipCoords(hdc, &x, &y, &width, &height, NULL, NULL) == 0)
+		return;
+
+	gdi_TiledFillRect(gdi->tiled, x, y, width, height, gdi_tiled_pixel(gdi, color));
+	gdi_InvalidateRegion(hdc, x, y, width, height);
+}
+
+/**
+ * Update the linear primary buffer from the tiled surface before presenting it.
+ * This is a no-op unless the GDI was initialized with CLRBUF_TILED.
+ */
+
+void gdi_linearize(rdpGdi* gdi, int x, int y, int width, int height)
+{
+	if (gdi->tiled != NULL)
+		gdi_TiledLinearize(gdi->tiled, x, y, width, height);
+}
+
 void gdi_palette_update(rdpContext* context, PALETTE_UPDATE* palette)
 {
 	rdpGdi* gdi = context->gdi;
@@ -462,6 +512,9 @@ void gdi_dstblt(rdpContext* context, DSTBLT_ORDER* dstblt)
 {
 	rdpGdi* gdi = context->gdi;
 
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, dstblt->nLeftRect, dstblt->nTopRect,
+			dstblt->nWidth, dstblt->nHeight);
+
 	gdi_BitBlt(gdi->drawing->hdc, dstblt->nLeftRect, dstblt->nTopRect,
 			dstblt->nWidth, dstblt->nHeight, NULL, 0, 0, gdi_rop3_code(dstblt->bRop));
 }
@@ -475,6 +528,9 @@ void gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 
 	brush = &patblt->brush;
 
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
+			patblt->nWidth, patblt->nHeight);
+
 	if (brush->style == GDI_BS_SOLID)
 	{
 		UINT32 color;
@@ -483,8 +539,12 @@ void gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 		color = freerdp_color_convert_rgb(patblt->foreColor, gdi->srcBpp, 32, gdi->clrconv);
 		gdi->drawing->hdc->brush = gdi_CreateSolidBrush(color);
 
-		gdi_PatBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
-				patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop));
+		if (gdi_BandPatBlt(gdi->bands, gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
+				patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop)) != 0)
+		{
+			gdi_PatBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
+					patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop));
+		}
 
 		gdi_DeleteObject((HGDIOBJECT) gdi->drawing->hdc->brush);
 		gdi->drawing->hdc->brush = originalBrush;
@@ -508,8 +568,12 @@ void gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 		originalBrush = gdi->drawing->hdc->brush;
 		gdi->drawing->hdc->brush = gdi_CreatePatternBrush(hBmp);
 
-		gdi_PatBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
-				patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop));
+		if (gdi_BandPatBlt(gdi->bands, gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
+				patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop)) != 0)
+		{
+			gdi_PatBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect,
+					patblt->nWidth, patblt->nHeight, gdi_rop3_code(patblt->bRop));
+		}
 
 		gdi_DeleteObject((HGDIOBJECT) gdi->drawing->hdc->brush);
 		gdi->drawing->hdc->brush = originalBrush;
@@ -524,6 +588,30 @@ void gdi_scrblt(rdpContext* context, SCRBLT_ORDER* scrblt)
 {
 	rdpGdi* gdi = context->gdi;
 
+	if (gdi_tiled_target(gdi) && (gdi_rop3_code(scrblt->bRop) == GDI_SRCCOPY))
+	{
+		int x = scrblt->nLeftRect;
+		int y = scrblt->nTopRect;
+		int width = scrblt->nWidth;
+		int height = scrblt->nHeight;
+		int srcx = scrblt->nXSrc;
+		int srcy = scrblt->nYSrc;
+
+		if (gdi_ClipCoords(gdi->drawing->hdc, &x, &y, &width, &height, &srcx, &srcy) == 0)
+			return;
+
+		gdi_TiledBitBlt(gdi->tiled, x, y, width, height, srcx, srcy);
+		gdi_InvalidateRegion(gdi->drawing->hdc, x, y, width, height);
+		return;
+	}
+
+	if (gdi->tiled != NULL)
+	{
+		gdi_TiledLinearize(gdi->tiled, scrblt->nXSrc, scrblt->nYSrc, scrblt->nWidth, scrblt->nHeight);
+		gdi_tiled_lock(gdi, gdi->drawing->hdc, scrblt->nLeftRect, scrblt->nTopRect,
+				scrblt->nWidth, scrblt->nHeight);
+	}
+
 	gdi_BitBlt(gdi->drawing->hdc, scrblt->nLeftRect, scrblt->nTopRect,
 			scrblt->nWidth, scrblt->nHeight, gdi->primary->hdc,
 			scrblt->nXSrc, scrblt->nYSrc, gdi_rop3_code(scrblt->bRop));
@@ -541,8 +629,17 @@ void gdi_opaque_rect(rdpContext* context, OPAQUE_RECT_ORDER* opaque_rect)
 
 	brush_color = freerdp_color_convert_var_bgr(opaque_rect->color, gdi->srcBpp, 32, gdi->clrconv);
 
+	if (gdi_tiled_target(gdi))
+	{
+		gdi_tiled_fill_rect(gdi, opaque_rect->nLeftRect, opaque_rect->nTopRect,
+				opaque_rect->nWidth, opaque_rect->nHeight, brush_color);
+		return;
+	}
+
 	hBrush = gdi_CreateSolidBrush(brush_color);
-	gdi_FillRect(gdi->drawing->hdc, &rect, hBrush);
+
+	if (gdi_BandFillRects(gdi->bands, gdi->drawing->hdc, &rect, 1, hBrush) != 0)
+		gdi_FillRect(gdi->drawing->hdc, &rect, hBrush);
 
 	gdi_DeleteObject((HGDIOBJECT) hBrush);
 }
@@ -554,8 +651,32 @@ void gdi_multi_opaque_rect(rdpContext* context, MULTI_OPAQUE_RECT_ORDER* multi_o
 	HGDI_BRUSH hBrush;
 	UINT32 brush_color;
 	DELTA_RECT* rectangle;
+	GDI_RECT rects[45];
 	rdpGdi *gdi = context->gdi;
 
+	if (!gdi_tiled_target(gdi) && (gdi->bands != NULL))
+	{
+		/* fill all rectangles in a single pass over each band, the order rectangles are 1-based */
+		for (i = 0; (i < (int) multi_opaque_rect->numRectangles) && (i < 45); i++)
+		{
+			rectangle = &multi_opaque_rect->rectangles[i + 1];
+
+			gdi_CRgnToRect(rectangle->left, rectangle->top,
+					rectangle->width, rectangle->height, &rects[i]);
+		}
+
+		brush_color = freerdp_color_convert_var_bgr(multi_opaque_rect->color, gdi->srcBpp, 32, gdi->clrconv);
+		hBrush = gdi_CreateSolidBrush(brush_color);
+
+		if (gdi_BandFillRects(gdi->bands, gdi->drawing->hdc, rects, i, hBrush) == 0)
+		{
+			gdi_DeleteObject((HGDIOBJECT) hBrush);
+			return;
+		}
+
+		gdi_DeleteObject((HGDIOBJECT) hBrush);
+	}
+
 	for (i = 1; i < (int) multi_opaque_rect->numRectangles + 1; i++)
 	{
 		rectangle = &multi_opaque_rect->rectangles[i];
@@ -565,6 +686,13 @@ void gdi_multi_opaque_rect(rdpContext* context, MULTI_OPAQUE_RECT_ORDER* multi_o
 
 		brush_color = freerdp_color_convert_var_bgr(multi_opaque_rect->color, gdi->srcBpp, 32, gdi->clrconv);
 
+		if (gdi_tiled_target(gdi))
+		{
+			gdi_tiled_fill_rect(gdi, rectangle->left, rectangle->top,
+					rectangle->width, rectangle->height, brush_color);
+			continue;
+		}
+
 		hBrush = gdi_CreateSolidBrush(brush_color);
 		gdi_FillRect(gdi->drawing->hdc, &rect, hBrush);
 
@@ -578,6 +706,13 @@ void gdi_line_to(rdpContext* context, LINE_TO_ORDER* line_to)
 	HGDI_PEN hPen;
 	rdpGdi *gdi = context->gdi;
 
+	if (gdi->tiled != NULL)
+	{
+		gdi_tiled_lock(gdi, gdi->drawing->hdc,
+				MIN(line_to->nXStart, line_to->nXEnd), MIN(line_to->nYStart, line_to->nYEnd),
+				abs(line_to->nXEnd - line_to->nXStart) + 1, abs(line_to->nYEnd - line_to->nYStart) + 1);
+	}
+
 	color = freerdp_color_convert_rgb(line_to->penColor, gdi->srcBpp, 32, gdi->clrconv);
 	hPen = gdi_CreatePen(line_to->penStyle, line_to->penWidth, (GDI_COLOR) color);
 	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) hPen);
@@ -599,6 +734,27 @@ void gdi_polyline(rdpContext* context, POLYLINE_ORDER* polyline)
 	INT32 x;
 	INT32 y;
 
+	if (gdi->tiled != NULL)
+	{
+		INT32 left, top;
+		INT32 right, bottom;
+
+		left = right = x = polyline->xStart;
+		top = bottom = y = polyline->yStart;
+
+		for (i = 0; i < (int) polyline->numPoints; i++)
+		{
+			x += polyline->points[i].x;
+			y += polyline->points[i].y;
+			left = MIN(left, x);
+			top = MIN(top, y);
+			right = MAX(right, x);
+			bottom = MAX(bottom, y);
+		}
+
+		gdi_tiled_lock(gdi, gdi->drawing->hdc, left, top, right - left + 1, bottom - top + 1);
+	}
+
 	color = freerdp_color_convert_rgb(polyline->penColor, gdi->srcBpp, 32, gdi->clrconv);
 	hPen = gdi_CreatePen(GDI_PS_SOLID, 1, (GDI_COLOR) color);
 	gdi_SelectObject(gdi->drawing->hdc, (HGDIOBJECT) hPen);
@@ -627,6 +783,34 @@ void gdi_memblt(rdpContext* context, MEMBLT_ORDER* memblt)
 
 	bitmap = (gdiBitmap*) memblt->bitmap;
 
+	if (gdi_tiled_target(gdi) && (gdi_rop3_code(memblt->bRop) == GDI_SRCCOPY))
+	{
+		int x = memblt->nLeftRect;
+		int y = memblt->nTopRect;
+		int width = memblt->nWidth;
+		int height = memblt->nHeight;
+		int srcx = memblt->nXSrc;
+		int srcy = memblt->nYSrc;
+
+		if (gdi_ClipCoords(gdi->drawing->hdc, &x, &y, &width, &height, &srcx, &srcy) == 0)
+			return;
+
+		if (gdi_TiledPutImage(gdi->tiled, x, y, width, height,
+				(HGDI_BITMAP) bitmap->hdc->selectedObject, srcx, srcy) == 0)
+		{
+			gdi_InvalidateRegion(gdi->drawing->hdc, x, y, width, height);
+			return;
+		}
+	}
+
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, memblt->nLeftRect, memblt->nTopRect,
+			memblt->nWidth, memblt->nHeight);
+
+	if (gdi_BandBitBlt(gdi->bands, gdi->drawing->hdc, memblt->nLeftRect, memblt->nTopRect,
+			memblt->nWidth, memblt->nHeight, bitmap->hdc,
+			memblt->nXSrc, memblt->nYSrc, gdi_rop3_code(memblt->bRop)) == 0)
+		return;
+
 	gdi_BitBlt(gdi->drawing->hdc, memblt->nLeftRect, memblt->nTopRect,
 			memblt->nWidth, memblt->nHeight, bitmap->hdc,
 			memblt->nXSrc, memblt->nYSrc, gdi_rop3_code(memblt->bRop));
@@ -644,6 +828,9 @@ void gdi_mem3blt(rdpContext* context, MEM3BLT_ORDER* mem3blt)
 	brush = &mem3blt->brush;
 	bitmap = (gdiBitmap*) mem3blt->bitmap;
 
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, mem3blt->nLeftRect, mem3blt->nTopRect,
+			mem3blt->nWidth, mem3blt->nHeight);
+
 	foreColor = freerdp_color_convert_rgb(mem3blt->foreColor, gdi->srcBpp, 32, gdi->clrconv);
 	backColor = freerdp_color_convert_rgb(mem3blt->backColor, gdi->srcBpp, 32, gdi->clrconv);
 
@@ -708,6 +895,10 @@ void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surface_bits_co
 	tile_bitmap = (char*) malloc(32);
 	ZeroMemory(tile_bitmap, 32);
 
+	gdi_tiled_lock(gdi, gdi->primary->hdc, surface_bits_command->destLeft, surface_bits_command->destTop,
+			surface_bits_command->destRight - surface_bits_command->destLeft + 1,
+			surface_bits_command->destBottom - surface_bits_command->destTop + 1);
+
 	if (surface_bits_command->codecID == CODEC_ID_REMOTEFX)
 	{
 		message = rfx_process_message(rfx_context,
@@ -852,6 +1043,9 @@ void gdi_init_primary(rdpGdi* gdi)
 	gdi->primary->hdc->hwnd->count = 32;
 	gdi->primary->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * gdi->primary->hdc->hwnd->count);
 	gdi->primary->hdc->hwnd->ninvalid = 0;
+
+	if (gdi->tiling)
+		gdi->tiled = gdi_CreateTiledSurface(gdi->width, gdi->height, gdi->bytesPerPixel, gdi->primary_buffer);
 }
 
 void gdi_resize(rdpGdi* gdi, int width, int height)
@@ -865,6 +1059,8 @@ void gdi_resize(rdpGdi* gdi, int width, int height)
 
 			gdi->width = width;
 			gdi->height = height;
+			gdi_DeleteTiledSurface(gdi->tiled);
+			gdi->tiled = NULL;
 			gdi_bitmap_free_ex(gdi->primary);
 			gdi_init_primary(gdi);
 		}
@@ -929,6 +1125,13 @@ int gdi_init(freerdp* instance, UINT32 flags, BYTE* buffer)
 		}
 	}
 	
+	/* tile-aware kernels exist for 16bpp and 32bpp buffers */
+	if ((flags & CLRBUF_TILED) && ((gdi->bytesPerPixel == 2) || (gdi->bytesPerPixel == 4)))
+		gdi->tiling = TRUE;
+
+	if (flags & CLRBUF_PARALLEL)
+		gdi->bands = gdi_CreateBands(0);
+
 	gdi->hdc = gdi_GetDC();
 	gdi->hdc->bitsPerPixel = gdi->dstBpp;
 	gdi->hdc->bytesPerPixel = gdi->bytesPerPixel;
@@ -976,6 +1179,8 @@ void gdi_free(freerdp* instance)
 
 	if (gdi)
 	{
+		gdi_DeleteBands(gdi->bands);
+		gdi_DeleteTiledSurface(gdi->tiled);
 		gdi_bitmap_free_ex(gdi->primary);
 		gdi_bitmap_free_ex(gdi->tile);
 		gdi_bitmap_free_ex(gdi->image);
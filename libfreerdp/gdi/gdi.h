@@ -25,4 +25,6 @@
 gdiBitmap* gdi_bitmap_new_ex(rdpGdi* gdi, int width, int height, int bpp, BYTE* data);
 void gdi_bitmap_free_ex(gdiBitmap* gdi_bmp);
 
+void gdi_tiled_lock(rdpGdi* gdi, HGDI_DC hdc, int x, int y, int width, int height);
+
 #endif /* __GDI_CORE_H */
@@ -37,6 +37,7 @@
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/cache/glyph.h>
 
+#include "gdi.h"
 #include "graphics.h"
 
 /* Bitmap Class */
@@ -89,6 +90,8 @@ void gdi_Bitmap_Paint(rdpContext* context, rdpBitmap* bitmap)
 	width = bitmap->right - bitmap->left + 1;
 	height = bitmap->bottom - bitmap->top + 1;
 
+	gdi_tiled_lock(context->gdi, context->gdi->primary->hdc, bitmap->left, bitmap->top, width, height);
+
 	gdi_BitBlt(context->gdi->primary->hdc, bitmap->left, bitmap->top,
 			width, height, gdi_bitmap->hdc, 0, 0, GDI_SRCCOPY);
 }
@@ -228,6 +231,8 @@ void gdi_Glyph_Draw(rdpContext* context, rdpGlyph* glyph, int x, int y)
 
 	gdi_glyph = (gdiGlyph*) glyph;
 
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width, gdi_glyph->bitmap->height);
+
 	gdi_BitBlt(gdi->drawing->hdc, x, y, gdi_glyph->bitmap->width,
 			gdi_glyph->bitmap->height, gdi_glyph->hdc, 0, 0, GDI_DSPDxax);
 }
@@ -245,6 +250,8 @@ void gdi_Glyph_BeginDraw(rdpContext* context, int x, int y, int width, int heigh
 
 	brush = gdi_CreateSolidBrush(fgcolor);
 
+	gdi_tiled_lock(gdi, gdi->drawing->hdc, x, y, width, height);
+
 	gdi_FillRect(gdi->drawing->hdc, &rect, brush);
 
 	gdi->textColor = gdi_SetTextColor(gdi->drawing->hdc, bgcolor);
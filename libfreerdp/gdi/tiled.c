@@ -0,0 +1,593 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Tiled Surfaces
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/tiled.h>
+
+/**
+ * A tiled surface stores pixels in GDI_TILE_SIZE x GDI_TILE_SIZE tiles, each
+ * tile being contiguous in memory. Vertical operations on very wide surfaces
+ * then stay within a few pages instead of striding over whole scanlines.
+ *
+ * The surface can mirror a linear (row-major) buffer, which is kept in sync
+ * lazily: each tile records which of the two copies is authoritative, and
+ * tiles are only copied when the other representation is about to be used.
+ */
+
+#define TILE_INDEX(_t, _tx, _ty)	((_ty) * (_t)->tilesX + (_tx))
+
+static BOOL gdi_tiled_clip(HGDI_TILED hTiled, int* x, int* y, int* w, int* h)
+{
+	if (*x < 0)
+	{
+		*w += *x;
+		*x = 0;
+	}
+
+	if (*y < 0)
+	{
+		*h += *y;
+		*y = 0;
+	}
+
+	if (*x + *w > hTiled->width)
+		*w = hTiled->width - *x;
+
+	if (*y + *h > hTiled->height)
+		*h = hTiled->height - *y;
+
+	return ((*w > 0) && (*h > 0)) ? TRUE : FALSE;
+}
+
+static void gdi_tiled_copy_tile(HGDI_TILED hTiled, int tx, int ty, BOOL toLinear)
+{
+	int y;
+	int width;
+	int height;
+	BYTE* tile;
+	BYTE* linear;
+
+	width = hTiled->width - (tx * GDI_TILE_SIZE);
+	height = hTiled->height - (ty * GDI_TILE_SIZE);
+
+	if (width > GDI_TILE_SIZE)
+		width = GDI_TILE_SIZE;
+
+	if (height > GDI_TILE_SIZE)
+		height = GDI_TILE_SIZE;
+
+	width *= hTiled->bytesPerPixel;
+
+	tile = &hTiled->data[TILE_INDEX(hTiled, tx, ty) * hTiled->tileLength];
+	linear = &hTiled->linear[(ty * GDI_TILE_SIZE * hTiled->scanline) + (tx * hTiled->tileScanline)];
+
+	for (y = 0; y < height; y++)
+	{
+		if (toLinear)
+			CopyMemory(linear, tile, width);
+		else
+			CopyMemory(tile, linear, width);
+
+		tile += hTiled->tileScanline;
+		linear += hTiled->scanline;
+	}
+}
+
+/**
+ * Prepare tiles for writing the given rectangle. Tiles which are only
+ * partially overwritten are first brought up to date from the linear buffer.
+ */
+
+static void gdi_tiled_begin_write(HGDI_TILED hTiled, int x, int y, int w, int h)
+{
+	int tx, ty;
+	int tx1, ty1;
+	int tx2, ty2;
+	int left, top;
+	int right, bottom;
+	BYTE* state;
+
+	if (hTiled->linear == NULL)
+		return;
+
+	tx1 = x / GDI_TILE_SIZE;
+	ty1 = y / GDI_TILE_SIZE;
+	tx2 = (x + w - 1) / GDI_TILE_SIZE;
+	ty2 = (y + h - 1) / GDI_TILE_SIZE;
+
+	for (ty = ty1; ty <= ty2; ty++)
+	{
+		top = ty * GDI_TILE_SIZE;
+		bottom = top + GDI_TILE_SIZE;
+
+		if (bottom > hTiled->height)
+			bottom = hTiled->height;
+
+		for (tx = tx1; tx <= tx2; tx++)
+		{
+			state = &hTiled->state[TILE_INDEX(hTiled, tx, ty)];
+
+			if (*state == GDI_TILE_TILED_STALE)
+			{
+				left = tx * GDI_TILE_SIZE;
+				right = left + GDI_TILE_SIZE;
+
+				if (right > hTiled->width)
+					right = hTiled->width;
+
+				if ((left < x) || (top < y) || (right > x + w) || (bottom > y + h))
+					gdi_tiled_copy_tile(hTiled, tx, ty, FALSE);
+			}
+
+			*state = GDI_TILE_LINEAR_STALE;
+		}
+	}
+}
+
+/**
+ * Copy a span of pixels within a row, splitting it so that each piece
+ * lies within a single source tile and a single destination tile.
+ */
+
+static void gdi_tiled_copy_span(HGDI_TILED hTiled, int nXDest, int nYDest, int nXSrc, int nYSrc, int n, BOOL backward)
+{
+	int count;
+	int srcEnd;
+	int dstEnd;
+	int bpp = hTiled->bytesPerPixel;
+
+	if (!backward)
+	{
+		while (n > 0)
+		{
+			count = GDI_TILE_SIZE - (nXSrc % GDI_TILE_SIZE);
+
+			if (GDI_TILE_SIZE - (nXDest % GDI_TILE_SIZE) < count)
+				count = GDI_TILE_SIZE - (nXDest % GDI_TILE_SIZE);
+
+			if (n < count)
+				count = n;
+
+			MoveMemory(gdi_get_tile_pointer(hTiled, nXDest, nYDest),
+					gdi_get_tile_pointer(hTiled, nXSrc, nYSrc), count * bpp);
+
+			nXSrc += count;
+			nXDest += count;
+			n -= count;
+		}
+	}
+	else
+	{
+		srcEnd = nXSrc + n;
+		dstEnd = nXDest + n;
+
+		while (n > 0)
+		{
+			count = ((srcEnd - 1) % GDI_TILE_SIZE) + 1;
+
+			if (((dstEnd - 1) % GDI_TILE_SIZE) + 1 < count)
+				count = ((dstEnd - 1) % GDI_TILE_SIZE) + 1;
+
+			if (n < count)
+				count = n;
+
+			srcEnd -= count;
+			dstEnd -= count;
+			n -= count;
+
+			MoveMemory(gdi_get_tile_pointer(hTiled, dstEnd, nYDest),
+					gdi_get_tile_pointer(hTiled, srcEnd, nYSrc), count * bpp);
+		}
+	}
+}
+
+/**
+ * Create a new tiled surface.
+ * @param nWidth width
+ * @param nHeight height
+ * @param bytesPerPixel bytes per pixel
+ * @param linear linear buffer mirrored by this surface, or NULL
+ * @return new tiled surface
+ */
+
+HGDI_TILED gdi_CreateTiledSurface(int nWidth, int nHeight, int bytesPerPixel, BYTE* linear)
+{
+	int count;
+	HGDI_TILED hTiled;
+
+	hTiled = (HGDI_TILED) malloc(sizeof(GDI_TILED));
+	ZeroMemory(hTiled, sizeof(GDI_TILED));
+
+	hTiled->width = nWidth;
+	hTiled->height = nHeight;
+	hTiled->bytesPerPixel = bytesPerPixel;
+	hTiled->tilesX = (nWidth + GDI_TILE_SIZE - 1) / GDI_TILE_SIZE;
+	hTiled->tilesY = (nHeight + GDI_TILE_SIZE - 1) / GDI_TILE_SIZE;
+	hTiled->tileScanline = GDI_TILE_SIZE * bytesPerPixel;
+	hTiled->tileLength = GDI_TILE_SIZE * hTiled->tileScanline;
+	hTiled->linear = linear;
+	hTiled->scanline = nWidth * bytesPerPixel;
+
+	count = hTiled->tilesX * hTiled->tilesY;
+
+	hTiled->data = (BYTE*) malloc(count * hTiled->tileLength);
+	ZeroMemory(hTiled->data, count * hTiled->tileLength);
+
+	/* the linear buffer holds the initial surface contents */
+	hTiled->state = (BYTE*) malloc(count);
+	memset(hTiled->state, (linear != NULL) ? GDI_TILE_TILED_STALE : GDI_TILE_SYNCED, count);
+
+	return hTiled;
+}
+
+void gdi_DeleteTiledSurface(HGDI_TILED hTiled)
+{
+	if (hTiled != NULL)
+	{
+		free(hTiled->data);
+		free(hTiled->state);
+		free(hTiled);
+	}
+}
+
+INLINE BYTE* gdi_get_tile_pointer(HGDI_TILED hTiled, int x, int y)
+{
+	BYTE* tile;
+
+	tile = &hTiled->data[TILE_INDEX(hTiled, x / GDI_TILE_SIZE, y / GDI_TILE_SIZE) * hTiled->tileLength];
+
+	return tile + ((y % GDI_TILE_SIZE) * hTiled->tileScanline) + ((x % GDI_TILE_SIZE) * hTiled->bytesPerPixel);
+}
+
+/**
+ * Bring tiles covering the given rectangle up to date with the linear buffer.
+ */
+
+void gdi_TiledAcquire(HGDI_TILED hTiled, int x, int y, int w, int h)
+{
+	int tx, ty;
+	BYTE* state;
+
+	if (hTiled->linear == NULL)
+		return;
+
+	if (!gdi_tiled_clip(hTiled, &x, &y, &w, &h))
+		return;
+
+	for (ty = y / GDI_TILE_SIZE; ty <= (y + h - 1) / GDI_TILE_SIZE; ty++)
+	{
+		for (tx = x / GDI_TILE_SIZE; tx <= (x + w - 1) / GDI_TILE_SIZE; tx++)
+		{
+			state = &hTiled->state[TILE_INDEX(hTiled, tx, ty)];
+
+			if (*state == GDI_TILE_TILED_STALE)
+			{
+				gdi_tiled_copy_tile(hTiled, tx, ty, FALSE);
+				*state = GDI_TILE_SYNCED;
+			}
+		}
+	}
+}
+
+/**
+ * Bring the linear buffer up to date with the tiles covering the given rectangle.
+ * Only tiles modified since the last linearization are copied.
+ */
+
+void gdi_TiledLinearize(HGDI_TILED hTiled, int x, int y, int w, int h)
+{
+	int tx, ty;
+	BYTE* state;
+
+	if (hTiled->linear == NULL)
+		return;
+
+	if (!gdi_tiled_clip(hTiled, &x, &y, &w, &h))
+		return;
+
+	for (ty = y / GDI_TILE_SIZE; ty <= (y + h - 1) / GDI_TILE_SIZE; ty++)
+	{
+		for (tx = x / GDI_TILE_SIZE; tx <= (x + w - 1) / GDI_TILE_SIZE; tx++)
+		{
+			state = &hTiled->state[TILE_INDEX(hTiled, tx, ty)];
+
+			if (*state == GDI_TILE_LINEAR_STALE)
+			{
+				gdi_tiled_copy_tile(hTiled, tx, ty, TRUE);
+				*state = GDI_TILE_SYNCED;
+			}
+		}
+	}
+}
+
+/**
+ * Linearize the given rectangle before it is modified through the linear
+ * buffer, and mark the tiles covering it as outdated.
+ */
+
+void gdi_TiledLockLinear(HGDI_TILED hTiled, int x, int y, int w, int h)
+{
+	int tx, ty;
+	BYTE* state;
+
+	if (hTiled->linear == NULL)
+		return;
+
+	if (!gdi_tiled_clip(hTiled, &x, &y, &w, &h))
+		return;
+
+	for (ty = y / GDI_TILE_SIZE; ty <= (y + h - 1) / GDI_TILE_SIZE; ty++)
+	{
+		for (tx = x / GDI_TILE_SIZE; tx <= (x + w - 1) / GDI_TILE_SIZE; tx++)
+		{
+			state = &hTiled->state[TILE_INDEX(hTiled, tx, ty)];
+
+			if (*state == GDI_TILE_LINEAR_STALE)
+				gdi_tiled_copy_tile(hTiled, tx, ty, TRUE);
+
+			*state = GDI_TILE_TILED_STALE;
+		}
+	}
+}
+
+/**
+ * Fill a rectangle with a solid pixel value, one tile at a time.
+ * @return 0 on success
+ */
+
+int gdi_TiledFillRect(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight, UINT32 pixel)
+{
+	int x, y;
+	int tx, ty;
+	int left, top;
+	int right, bottom;
+	int width;
+	BYTE* row;
+	BYTE* dstp;
+	int bpp = hTiled->bytesPerPixel;
+
+	if (!gdi_tiled_clip(hTiled, &nXDest, &nYDest, &nWidth, &nHeight))
+		return 0;
+
+	gdi_tiled_begin_write(hTiled, nXDest, nYDest, nWidth, nHeight);
+
+	for (ty = nYDest / GDI_TILE_SIZE; ty <= (nYDest + nHeight - 1) / GDI_TILE_SIZE; ty++)
+	{
+		top = (ty * GDI_TILE_SIZE > nYDest) ? ty * GDI_TILE_SIZE : nYDest;
+		bottom = ((ty + 1) * GDI_TILE_SIZE < nYDest + nHeight) ? (ty + 1) * GDI_TILE_SIZE : nYDest + nHeight;
+
+		for (tx = nXDest / GDI_TILE_SIZE; tx <= (nXDest + nWidth - 1) / GDI_TILE_SIZE; tx++)
+		{
+			left = (tx * GDI_TILE_SIZE > nXDest) ? tx * GDI_TILE_SIZE : nXDest;
+			right = ((tx + 1) * GDI_TILE_SIZE < nXDest + nWidth) ? (tx + 1) * GDI_TILE_SIZE : nXDest + nWidth;
+			width = right - left;
+
+			/* fill the first row, then replicate it */
+			row = gdi_get_tile_pointer(hTiled, left, top);
+
+			if (bpp == 4)
+			{
+				for (x = 0; x < width; x++)
+					((UINT32*) row)[x] = pixel;
+			}
+			else if (bpp == 2)
+			{
+				for (x = 0; x < width; x++)
+					((UINT16*) row)[x] = (UINT16) pixel;
+			}
+			else
+			{
+				for (x = 0; x < width; x++)
+					CopyMemory(&row[x * bpp], &pixel, bpp);
+			}
+
+			dstp = row + hTiled->tileScanline;
+
+			for (y = top + 1; y < bottom; y++)
+			{
+				CopyMemory(dstp, row, width * bpp);
+				dstp += hTiled->tileScanline;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Copy a rectangle within the surface. Source and destination may overlap,
+ * as they do when scrolling.
+ * @return 0 on success
+ */
+
+int gdi_TiledBitBlt(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight, int nXSrc, int nYSrc)
+{
+	int y;
+	int tx, ty;
+	int ty1, ty2;
+	int left, top;
+	int right, bottom;
+	int dx, dy;
+	BOOL overlap;
+	BOOL upward;
+	BOOL backward;
+
+	/* clip against the destination, then against the source */
+
+	dx = nXSrc - nXDest;
+	dy = nYSrc - nYDest;
+
+	if (!gdi_tiled_clip(hTiled, &nXDest, &nYDest, &nWidth, &nHeight))
+		return 0;
+
+	nXSrc = nXDest + dx;
+	nYSrc = nYDest + dy;
+
+	if (!gdi_tiled_clip(hTiled, &nXSrc, &nYSrc, &nWidth, &nHeight))
+		return 0;
+
+	nXDest = nXSrc - dx;
+	nYDest = nYSrc - dy;
+
+	if ((dx == 0) && (dy == 0))
+		return 0;
+
+	gdi_TiledAcquire(hTiled, nXSrc, nYSrc, nWidth, nHeight);
+	gdi_tiled_begin_write(hTiled, nXDest, nYDest, nWidth, nHeight);
+
+	overlap = ((nXDest < nXSrc + nWidth) && (nXSrc < nXDest + nWidth) &&
+			(nYDest < nYSrc + nHeight) && (nYSrc < nYDest + nHeight)) ? TRUE : FALSE;
+
+	upward = (nYDest > nYSrc) ? TRUE : FALSE;
+	backward = ((nYDest == nYSrc) && (nXDest > nXSrc)) ? TRUE : FALSE;
+
+	if (overlap && (dx != 0))
+	{
+		/* rows depend on each other horizontally, walk whole rows */
+
+		for (y = 0; y < nHeight; y++)
+		{
+			int row = upward ? (nHeight - 1 - y) : y;
+
+			gdi_tiled_copy_span(hTiled, nXDest, nYDest + row,
+					nXSrc, nYSrc + row, nWidth, backward);
+		}
+
+		return 0;
+	}
+
+	/**
+	 * Vertical scrolls and disjoint copies are processed one destination
+	 * tile at a time, going through tile rows in the direction of the copy.
+	 */
+
+	ty1 = nYDest / GDI_TILE_SIZE;
+	ty2 = (nYDest + nHeight - 1) / GDI_TILE_SIZE;
+
+	for (ty = upward ? ty2 : ty1; upward ? (ty >= ty1) : (ty <= ty2); upward ? ty-- : ty++)
+	{
+		top = (ty * GDI_TILE_SIZE > nYDest) ? ty * GDI_TILE_SIZE : nYDest;
+		bottom = ((ty + 1) * GDI_TILE_SIZE < nYDest + nHeight) ? (ty + 1) * GDI_TILE_SIZE : nYDest + nHeight;
+
+		for (tx = nXDest / GDI_TILE_SIZE; tx <= (nXDest + nWidth - 1) / GDI_TILE_SIZE; tx++)
+		{
+			left = (tx * GDI_TILE_SIZE > nXDest) ? tx * GDI_TILE_SIZE : nXDest;
+			right = ((tx + 1) * GDI_TILE_SIZE < nXDest + nWidth) ? (tx + 1) * GDI_TILE_SIZE : nXDest + nWidth;
+
+			for (y = 0; y < bottom - top; y++)
+			{
+				int row = upward ? (bottom - 1 - y) : (top + y);
+
+				gdi_tiled_copy_span(hTiled, left, row, left + dx, row + dy, right - left, FALSE);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Copy a rectangle from a linear bitmap into the surface.
+ * @return 0 on success, -1 if the bitmap format does not match
+ */
+
+int gdi_TiledPutImage(HGDI_TILED hTiled, int nXDest, int nYDest, int nWidth, int nHeight,
+		HGDI_BITMAP hSrc, int nXSrc, int nYSrc)
+{
+	int y;
+	int tx, ty;
+	int left, top;
+	int right, bottom;
+	int dx, dy;
+	BYTE* srcp;
+	BYTE* dstp;
+	int bpp = hTiled->bytesPerPixel;
+
+	if (hSrc->bytesPerPixel != bpp)
+		return -1;
+
+	dx = nXSrc - nXDest;
+	dy = nYSrc - nYDest;
+
+	if (!gdi_tiled_clip(hTiled, &nXDest, &nYDest, &nWidth, &nHeight))
+		return 0;
+
+	nXSrc = nXDest + dx;
+	nYSrc = nYDest + dy;
+
+	if (nXSrc < 0)
+	{
+		nWidth += nXSrc;
+		nXSrc = 0;
+	}
+
+	if (nYSrc < 0)
+	{
+		nHeight += nYSrc;
+		nYSrc = 0;
+	}
+
+	if (nXSrc + nWidth > hSrc->width)
+		nWidth = hSrc->width - nXSrc;
+
+	if (nYSrc + nHeight > hSrc->height)
+		nHeight = hSrc->height - nYSrc;
+
+	if ((nWidth <= 0) || (nHeight <= 0))
+		return 0;
+
+	nXDest = nXSrc - dx;
+	nYDest = nYSrc - dy;
+
+	gdi_tiled_begin_write(hTiled, nXDest, nYDest, nWidth, nHeight);
+
+	for (ty = nYDest / GDI_TILE_SIZE; ty <= (nYDest + nHeight - 1) / GDI_TILE_SIZE; ty++)
+	{
+		top = (ty * GDI_TILE_SIZE > nYDest) ? ty * GDI_TILE_SIZE : nYDest;
+		bottom = ((ty + 1) * GDI_TILE_SIZE < nYDest + nHeight) ? (ty + 1) * GDI_TILE_SIZE : nYDest + nHeight;
+
+		for (tx = nXDest / GDI_TILE_SIZE; tx <= (nXDest + nWidth - 1) / GDI_TILE_SIZE; tx++)
+		{
+			left = (tx * GDI_TILE_SIZE > nXDest) ? tx * GDI_TILE_SIZE : nXDest;
+			right = ((tx + 1) * GDI_TILE_SIZE < nXDest + nWidth) ? (tx + 1) * GDI_TILE_SIZE : nXDest + nWidth;
+
+			dstp = gdi_get_tile_pointer(hTiled, left, top);
+			srcp = &hSrc->data[((top + dy) * hSrc->scanline) + ((left + dx) * bpp)];
+
+			for (y = top; y < bottom; y++)
+			{
+				CopyMemory(dstp, srcp, (right - left) * bpp);
+				dstp += hTiled->tileScanline;
+				srcp += hSrc->scanline;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -32,6 +32,8 @@
 
 int freerdp_AsciiToUnicodeAlloc(const CHAR* str, WCHAR** wstr, int length)
 {
+	int cchWideChar;
+
 	if (!str)
 	{
 		*wstr = NULL;
@@ -41,22 +43,29 @@ int freerdp_AsciiToUnicodeAlloc(const CHAR* str, WCHAR** wstr, int length)
 	if (length < 1)
 		length = strlen(str);
 
-	length = MultiByteToWideChar(CP_UTF8, 0, str, length, NULL, 0);
-	*wstr = (WCHAR*) malloc((length + 1) * sizeof(WCHAR));
+	cchWideChar = MultiByteToWideChar(CP_UTF8, 0, str, length, NULL, 0);
+	*wstr = (WCHAR*) malloc((cchWideChar + 1) * sizeof(WCHAR));
 
-	MultiByteToWideChar(CP_UTF8, 0, str, length, (LPWSTR) (*wstr), length * sizeof(WCHAR));
-	(*wstr)[length] = 0;
+	MultiByteToWideChar(CP_UTF8, 0, str, length, (LPWSTR) (*wstr), cchWideChar);
+	(*wstr)[cchWideChar] = 0;
 
-	return length;
+	return cchWideChar;
 }
 
+/**
+ * Returns the length of the UTF-8 string in bytes, which is larger than the
+ * number of WCHARs converted as soon as the string is not pure ASCII.
+ */
+
 int freerdp_UnicodeToAsciiAlloc(const WCHAR* wstr, CHAR** str, int length)
 {
-	*str = malloc((length * 2) + 1);
-	memset(*str, 0, (length * 2) + 1);
+	int cbMultiByte;
+
+	cbMultiByte = WideCharToMultiByte(CP_UTF8, 0, wstr, length, NULL, 0, NULL, NULL);
+	*str = (CHAR*) malloc(cbMultiByte + 1);
 
-	WideCharToMultiByte(CP_UTF8, 0, wstr, length, *str, length, NULL, NULL);
-	(*str)[length] = 0;
+	WideCharToMultiByte(CP_UTF8, 0, wstr, length, *str, cbMultiByte, NULL, NULL);
+	(*str)[cbMultiByte] = 0;
 
-	return length;
+	return cbMultiByte;
 }
@@ -26,25 +26,14 @@
 #include <string.h>
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 #include <winpr/windows.h>
 
 #include <freerdp/utils/wait_obj.h>
 
-#ifndef _WIN32
-#include <sys/time.h>
-#endif
-
-#ifdef HAVE_UNISTD_H
-#include <unistd.h>
-#endif
-
 struct wait_obj
 {
-#ifdef _WIN32
 	HANDLE event;
-#else
-	int pipe_fd[2];
-#endif
 	int attached;
 };
 
@@ -56,19 +45,14 @@ struct wait_obj* wait_obj_new(void)
 	ZeroMemory(obj, sizeof(struct wait_obj));
 
 	obj->attached = 0;
-#ifdef _WIN32
 	obj->event = CreateEvent(NULL, TRUE, FALSE, NULL);
-#else
-	obj->pipe_fd[0] = -1;
-	obj->pipe_fd[1] = -1;
 
-	if (pipe(obj->pipe_fd) < 0)
+	if (!obj->event)
 	{
-		printf("wait_obj_new: pipe failed\n");
+		printf("wait_obj_new: CreateEvent failed\n");
 		free(obj);
 		return NULL;
 	}
-#endif
 
 	return obj;
 }
@@ -84,8 +68,7 @@ struct wait_obj* wait_obj_new_with_fd(void* fd)
 #ifdef _WIN32
 	obj->event = fd;
 #else
-	obj->pipe_fd[0] = (int)(long)fd;
-	obj->pipe_fd[1] = -1;
+	obj->event = CreateFileDescriptorEvent(NULL, TRUE, FALSE, (int) (long) fd);
 #endif
 
 	return obj;
@@ -95,26 +78,15 @@ void wait_obj_free(struct wait_obj* obj)
 {
 	if (obj)
 	{
+#ifdef _WIN32
 		if (obj->attached == 0)
+#endif
 		{
-#ifdef _WIN32
 			if (obj->event)
 			{
 				CloseHandle(obj->event);
 				obj->event = NULL;
 			}
-#else
-			if (obj->pipe_fd[0] != -1)
-			{
-				close(obj->pipe_fd[0]);
-				obj->pipe_fd[0] = -1;
-			}
-			if (obj->pipe_fd[1] != -1)
-			{
-				close(obj->pipe_fd[1]);
-				obj->pipe_fd[1] = -1;
-			}
-#endif
 		}
 
 		free(obj);
@@ -123,106 +95,50 @@ void wait_obj_free(struct wait_obj* obj)
 
 int wait_obj_is_set(struct wait_obj* obj)
 {
-#ifdef _WIN32
 	return (WaitForSingleObject(obj->event, 0) == WAIT_OBJECT_0);
-#else
-	fd_set rfds;
-	int num_set;
-	struct timeval time;
-
-	FD_ZERO(&rfds);
-	FD_SET(obj->pipe_fd[0], &rfds);
-	memset(&time, 0, sizeof(time));
-	num_set = select(obj->pipe_fd[0] + 1, &rfds, 0, 0, &time);
-	return (num_set == 1);
-#endif
 }
 
 void wait_obj_set(struct wait_obj* obj)
 {
-#ifdef _WIN32
-	SetEvent(obj->event);
-#else
-	int len;
-
-	if (wait_obj_is_set(obj))
-		return;
-
-	len = write(obj->pipe_fd[1], "sig", 4);
-
-	if (len != 4)
+	if (!SetEvent(obj->event))
 		printf("wait_obj_set: error\n");
-#endif
 }
 
 void wait_obj_clear(struct wait_obj* obj)
 {
-#ifdef _WIN32
-	ResetEvent(obj->event);
-#else
-	int len;
-
-	while (wait_obj_is_set(obj))
-	{
-		len = read(obj->pipe_fd[0], &len, 4);
-		if (len != 4)
-			printf("wait_obj_clear: error\n");
-	}
-#endif
+	if (!ResetEvent(obj->event))
+		printf("wait_obj_clear: error\n");
 }
 
 int wait_obj_select(struct wait_obj** listobj, int numobj, int timeout)
 {
 	int index;
-	int status;
-#ifndef _WIN32
-	int max;
-	int sock;
-	fd_set fds;
-	struct timeval time;
-	struct timeval* ptime;
-
-	ptime = 0;
-	if (timeout >= 0)
-	{
-		time.tv_sec = timeout / 1000;
-		time.tv_usec = (timeout * 1000) % 1000000;
-		ptime = &time;
-	}
+	DWORD status;
+	HANDLE hnds[MAXIMUM_WAIT_OBJECTS];
 
-	max = 0;
-	FD_ZERO(&fds);
-	if (listobj)
+	if (!listobj || (numobj < 1))
 	{
-		for (index = 0; index < numobj; index++)
-		{
-			sock = listobj[index]->pipe_fd[0];
-			FD_SET(sock, &fds);
+		if (timeout > 0)
+			Sleep(timeout);
 
-			if (sock > max)
-				max = sock;
-		}
+		return 0;
 	}
-	status = select(max + 1, &fds, 0, 0, ptime);
-#else
-	HANDLE* hnds;
 
-	hnds = (HANDLE*) malloc(sizeof(HANDLE) * (numobj + 1));
-	ZeroMemory(hnds, sizeof(HANDLE) * (numobj + 1));
+	if (numobj > MAXIMUM_WAIT_OBJECTS)
+	{
+		printf("wait_obj_select: %d objects, at most %d can be waited on\n", numobj, MAXIMUM_WAIT_OBJECTS);
+		return -1;
+	}
 
 	for (index = 0; index < numobj; index++)
-	{
 		hnds[index] = listobj[index]->event;
-	}
 
-	if (WaitForMultipleObjects(numobj, hnds, FALSE, timeout) == WAIT_FAILED)
-		status = -1;
-	else
-		status = 0;
-	free(hnds);
-#endif
+	status = WaitForMultipleObjects(numobj, hnds, FALSE, (timeout < 0) ? INFINITE : timeout);
 
-	return status;
+	if (status == WAIT_FAILED)
+		return -1;
+
+	return (status == WAIT_TIMEOUT) ? 0 : 1;
 }
 
 void wait_obj_get_fds(struct wait_obj* obj, void** fds, int* count)
@@ -230,10 +146,12 @@ void wait_obj_get_fds(struct wait_obj* obj, void** fds, int* count)
 #ifdef _WIN32
 	fds[*count] = (void*) obj->event;
 #else
-	if (obj->pipe_fd[0] == -1)
+	int fd = GetEventFileDescriptor(obj->event);
+
+	if (fd == -1)
 		return;
 
-	fds[*count] = (void*)(long) obj->pipe_fd[0];
+	fds[*count] = (void*)(long) fd;
 #endif
 	(*count)++;
 }
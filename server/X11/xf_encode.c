@@ -26,8 +26,6 @@
 #include <sys/select.h>
 #include <sys/signal.h>
 
-#include <freerdp/utils/sleep.h>
-
 #include "xf_encode.h"
 
 XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height)
@@ -79,29 +77,17 @@ void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int
 #endif
 }
 
-void* xf_frame_rate_thread(void* param)
+void xf_frame_rate_timer(PVOID param, BOOLEAN fired)
 {
-	xfInfo* xfi;
 	xfEvent* event;
 	xfPeerContext* xfp;
 	freerdp_peer* client;
-	UINT32 wait_interval;
 
 	client = (freerdp_peer*) param;
 	xfp = (xfPeerContext*) client->context;
-	xfi = xfp->info;
-
-	wait_interval = 1000000 / xfp->fps;
 
-	while (1)
-	{
-		// check if we should terminate
-		pthread_testcancel();
-		
-		event = xf_event_new(XF_EVENT_TYPE_FRAME_TICK);
-		xf_event_push(xfp->event_queue, (xfEvent*) event);
-		freerdp_usleep(wait_interval);
-	}
+	event = xf_event_new(XF_EVENT_TYPE_FRAME_TICK);
+	xf_event_push(xfp->event_queue, (xfEvent*) event);
 }
 
 void* xf_monitor_updates(void* param)
@@ -128,8 +114,6 @@ void* xf_monitor_updates(void* param)
 	wait_interval = (1000000 / 2500);
 	memset(&timeout, 0, sizeof(struct timeval));
 
-	pthread_create(&(xfp->frame_rate_thread), 0, xf_frame_rate_thread, (void*) client);
-
 	while (1)
 	{
 		// check if we should terminate
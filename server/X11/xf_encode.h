@@ -27,6 +27,7 @@
 
 XImage* xf_snapshot(xfPeerContext* xfp, int x, int y, int width, int height);
 void xf_xdamage_subtract_region(xfPeerContext* xfp, int x, int y, int width, int height);
+void xf_frame_rate_timer(PVOID param, BOOLEAN fired);
 void* xf_monitor_updates(void* param);
 
 #endif /* __XF_ENCODE_H */
@@ -33,6 +33,7 @@
 #include <sys/select.h>
 
 #include <winpr/crt.h>
+#include <winpr/file.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/locale/keyboard.h>
@@ -298,6 +299,7 @@ void xf_peer_init(freerdp_peer* client)
 
 	xfp->fps = 24;
 	xfp->thread = 0;
+	xfp->frame_rate_timer = NULL;
 	xfp->activations = 0;
 	xfp->event_queue = xf_event_queue_new();
 
@@ -319,7 +321,14 @@ void xf_peer_live_rfx(freerdp_peer* client)
 	xfPeerContext* xfp = (xfPeerContext*) client->context;
 
 	if (xfp->activations == 1)
+	{
 		pthread_create(&(xfp->thread), 0, xf_monitor_updates, (void*) client);
+
+		/* frame ticks of all sessions are driven by the shared default timer queue */
+
+		CreateTimerQueueTimer(&(xfp->frame_rate_timer), NULL, xf_frame_rate_timer,
+				(PVOID) client, 0, 1000 / xfp->fps, WT_EXECUTEINTIMERTHREAD);
+	}
 }
 
 static BOOL xf_peer_sleep_tsdiff(UINT32 *old_sec, UINT32 *old_usec, UINT32 new_sec, UINT32 new_usec)
@@ -708,10 +717,11 @@ void* xf_peer_main_loop(void* arg)
 	client->Disconnect(client);
 	
 	pthread_cancel(xfp->thread);
-	pthread_cancel(xfp->frame_rate_thread);
+
+	if (xfp->frame_rate_timer)
+		DeleteTimerQueueTimer(NULL, xfp->frame_rate_timer, INVALID_HANDLE_VALUE);
 	
 	pthread_join(xfp->thread, NULL);
-	pthread_join(xfp->frame_rate_thread, NULL);
 	
 	freerdp_peer_context_free(client);
 	freerdp_peer_free(client);
@@ -20,6 +20,8 @@
 #ifndef __XF_PEER_H
 #define __XF_PEER_H
 
+#include <winpr/synch.h>
+
 #include <freerdp/gdi/gdi.h>
 #include <freerdp/gdi/dc.h>
 #include <freerdp/gdi/region.h>
@@ -46,7 +48,7 @@ struct xf_peer_context
 	pthread_mutex_t mutex;
 	RFX_CONTEXT* rfx_context;
 	xfEventQueue* event_queue;
-	pthread_t frame_rate_thread;
+	HANDLE frame_rate_timer;
 };
 
 void xf_peer_accepted(freerdp_listener* instance, freerdp_peer* client);
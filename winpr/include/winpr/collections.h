@@ -0,0 +1,79 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_COLLECTIONS_H
+#define WINPR_COLLECTIONS_H
+
+#include <winpr/winpr.h>
+#include <winpr/wtypes.h>
+
+/**
+ * Queue
+ *
+ * Multiple producer, multiple consumer FIFO of pointers. Items go into a
+ * lock-free ring of the given capacity; when the ring is full they spill
+ * into a locked overflow list, so Queue_Enqueue() only fails on allocation
+ * failure. Items from a single producer are dequeued in order.
+ *
+ * The queue owns a manual-reset event that is signaled while the queue may
+ * hold items, and is reset by a Queue_Dequeue() call that finds it empty.
+ */
+
+typedef struct _wQueue wQueue;
+
+WINPR_API wQueue* Queue_New(int capacity);
+WINPR_API void Queue_Free(wQueue* queue);
+
+WINPR_API HANDLE Queue_Event(wQueue* queue);
+WINPR_API int Queue_Count(wQueue* queue);
+
+WINPR_API BOOL Queue_Enqueue(wQueue* queue, void* item);
+WINPR_API void* Queue_Dequeue(wQueue* queue);
+
+/**
+ * ObjectPool
+ *
+ * Cache of fixed-size objects. Up to capacity returned objects are kept
+ * for reuse, any more are freed. Objects are not cleared on reuse.
+ */
+
+typedef struct _wObjectPool wObjectPool;
+
+WINPR_API wObjectPool* ObjectPool_New(size_t size, int capacity);
+WINPR_API void ObjectPool_Free(wObjectPool* pool);
+
+WINPR_API void* ObjectPool_Take(wObjectPool* pool);
+WINPR_API void ObjectPool_Return(wObjectPool* pool, void* obj);
+
+/**
+ * BufferPool
+ *
+ * Cache of buffers in power-of-two size classes from 64 bytes to 64 KiB,
+ * each class keeping up to capacity buffers for reuse. Larger buffers are
+ * allocated and freed directly. Buffers taken from a pool must be given
+ * back to the same pool.
+ */
+
+typedef struct _wBufferPool wBufferPool;
+
+WINPR_API wBufferPool* BufferPool_New(int capacity);
+WINPR_API void BufferPool_Free(wBufferPool* pool);
+
+WINPR_API BYTE* BufferPool_Take(wBufferPool* pool, size_t size);
+WINPR_API void BufferPool_Return(wBufferPool* pool, BYTE* buffer);
+
+#endif /* WINPR_COLLECTIONS_H */
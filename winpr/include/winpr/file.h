@@ -52,6 +52,11 @@
 #define FILE_READ_ATTRIBUTES			0x0080
 #define FILE_WRITE_ATTRIBUTES			0x0100
 
+#define GENERIC_READ				0x80000000
+#define GENERIC_WRITE				0x40000000
+#define GENERIC_EXECUTE				0x20000000
+#define GENERIC_ALL				0x10000000
+
 #define FILE_ALL_ACCESS		(STANDARD_RIGHTS_REQUIRED | SYNCHRONIZE | 0x1FF)
 #define FILE_GENERIC_READ	(STANDARD_RIGHTS_READ | FILE_READ_DATA | FILE_READ_ATTRIBUTES | FILE_READ_EA | SYNCHRONIZE)
 #define FILE_GENERIC_WRITE	(STANDARD_RIGHTS_WRITE | FILE_WRITE_DATA | FILE_WRITE_ATTRIBUTES | FILE_WRITE_EA | FILE_APPEND_DATA | SYNCHRONIZE)
@@ -271,6 +276,14 @@ WINPR_API BOOL FindClose(HANDLE hFindFile);
 #define FindNextFile		FindNextFileA
 #endif
 
+/**
+ * Wraps an existing file descriptor (such as a socket) into a file handle
+ * that can be associated with an I/O completion port. The handle owns the
+ * descriptor: CloseHandle() closes it.
+ */
+
+WINPR_API HANDLE GetFileHandleForFileDescriptor(int fd);
+
 #endif
 
 /* Extra Functions */
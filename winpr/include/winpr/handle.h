@@ -35,6 +35,8 @@
 #define HANDLE_TYPE_TIMER			5
 #define HANDLE_TYPE_NAMED_PIPE			6
 #define HANDLE_TYPE_ANONYMOUS_PIPE		7
+#define HANDLE_TYPE_FILE			8
+#define HANDLE_TYPE_COMPLETION_PORT		9
 
 WINPR_API HANDLE winpr_Handle_Insert(ULONG Type, PVOID Object);
 WINPR_API BOOL winpr_Handle_Remove(HANDLE handle);
@@ -43,6 +45,17 @@ WINPR_API ULONG winpr_Handle_GetType(HANDLE handle);
 WINPR_API PVOID winpr_Handle_GetObject(HANDLE handle);
 WINPR_API BOOL winpr_Handle_GetInfo(HANDLE handle, ULONG* pType, PVOID* pObject);
 
+/**
+ * Modules layered above the handle module (such as the I/O completion ports)
+ * register a close hook to be told about a handle being closed. The hook runs
+ * after the handle has been removed from the table; returning TRUE means it
+ * has released the object itself.
+ */
+
+typedef BOOL (*pfnHandleCloseHook)(HANDLE handle, ULONG Type, PVOID Object);
+
+WINPR_API void winpr_Handle_SetCloseHook(pfnHandleCloseHook fnCloseHook);
+
 #ifndef _WIN32
 
 #define HANDLE_FLAG_INHERIT			0x00000001
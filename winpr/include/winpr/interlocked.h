@@ -144,8 +144,16 @@ WINPR_API LONG InterlockedExchangeAdd(LONG volatile *Addend, LONG Value);
 
 WINPR_API LONG InterlockedCompareExchange(LONG volatile *Destination, LONG Exchange, LONG Comperand);
 
+#ifdef _WIN64
+WINPR_API BOOL InterlockedCompareExchange128(LONGLONG volatile *Destination, LONGLONG ExchangeHigh, LONGLONG ExchangeLow, LONGLONG* ComparandResult);
+#endif
+
 #endif /* _WIN32 */
 
+/* WinPR extension: flushes a singly-linked list, returning entries in push order */
+
+WINPR_API PSLIST_ENTRY InterlockedFlushSListFifo(PSLIST_HEADER ListHead);
+
 WINPR_API LONGLONG InterlockedCompareExchange64(LONGLONG volatile *Destination, LONGLONG Exchange, LONGLONG Comperand);
 
 /* Doubly-Linked List */
@@ -23,11 +23,11 @@
 #include <winpr/winpr.h>
 #include <winpr/wtypes.h>
 
+typedef struct winpr_sam_database WINPR_SAM_DATABASE;
+
 struct winpr_sam
 {
-	FILE* fp;
-	char* line;
-	char* buffer;
+	WINPR_SAM_DATABASE* db;
 	BOOL read_only;
 };
 typedef struct winpr_sam WINPR_SAM;
@@ -49,6 +49,7 @@ WINPR_API WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPWSTR User, UINT32 Us
 WINPR_API void SamFreeEntry(WINPR_SAM* sam, WINPR_SAM_ENTRY* entry);
 
 WINPR_API WINPR_SAM* SamOpen(BOOL read_only);
+WINPR_API WINPR_SAM* SamOpenFile(LPCSTR filename, BOOL read_only);
 WINPR_API void SamClose(WINPR_SAM* sam);
 
 #endif /* WINPR_UTILS_SAM_H */
@@ -44,6 +44,13 @@
 #define MB_USEGLYPHCHARS		0x00000004
 #define MB_ERR_INVALID_CHARS		0x00000008
 
+#define WC_COMPOSITECHECK		0x00000200
+#define WC_DISCARDNS			0x00000010
+#define WC_SEPCHARS			0x00000020
+#define WC_DEFAULTCHAR			0x00000040
+#define WC_ERR_INVALID_CHARS		0x00000080
+#define WC_NO_BEST_FIT_CHARS		0x00000400
+
 WINPR_API char* _strdup(const char* strSource);
 WINPR_API WCHAR* _wcsdup(const WCHAR* strSource);
 
@@ -74,6 +74,9 @@ WINPR_API BOOL ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG lp
 
 /* Event */
 
+#define CREATE_EVENT_MANUAL_RESET	0x00000001
+#define CREATE_EVENT_INITIAL_SET	0x00000002
+
 WINPR_API HANDLE CreateEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName);
 WINPR_API HANDLE CreateEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpName);
 
@@ -96,6 +99,19 @@ WINPR_API BOOL ResetEvent(HANDLE hEvent);
 #define OpenEvent		OpenEventA
 #endif
 
+/* Event (WinPR extension) */
+
+WINPR_API HANDLE CreateFileDescriptorEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, int FileDescriptor);
+WINPR_API HANDLE CreateFileDescriptorEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, int FileDescriptor);
+
+WINPR_API int GetEventFileDescriptor(HANDLE hEvent);
+
+#ifdef UNICODE
+#define CreateFileDescriptorEvent	CreateFileDescriptorEventW
+#else
+#define CreateFileDescriptorEvent	CreateFileDescriptorEventA
+#endif
+
 /* One-Time Initialization */
 
 typedef union _RTL_RUN_ONCE
@@ -103,10 +119,15 @@ typedef union _RTL_RUN_ONCE
 	PVOID Ptr;
 } RTL_RUN_ONCE, *PRTL_RUN_ONCE;
 
+#define RTL_RUN_ONCE_INIT		{ 0 }
+
+typedef RTL_RUN_ONCE INIT_ONCE;
 typedef PRTL_RUN_ONCE PINIT_ONCE;
 typedef PRTL_RUN_ONCE LPINIT_ONCE;
 typedef BOOL CALLBACK (*PINIT_ONCE_FN) (PINIT_ONCE InitOnce, PVOID Parameter, PVOID* Context);
 
+#define INIT_ONCE_STATIC_INIT		RTL_RUN_ONCE_INIT
+
 WINPR_API BOOL InitOnceBeginInitialize(LPINIT_ONCE lpInitOnce, DWORD dwFlags, PBOOL fPending, LPVOID* lpContext);
 WINPR_API BOOL InitOnceComplete(LPINIT_ONCE lpInitOnce, DWORD dwFlags, LPVOID lpContext);
 WINPR_API BOOL InitOnceExecuteOnce(PINIT_ONCE InitOnce, PINIT_ONCE_FN InitFn, PVOID Parameter, LPVOID* Context);
@@ -114,9 +135,17 @@ WINPR_API VOID InitOnceInitialize(PINIT_ONCE InitOnce);
 
 /* Slim Reader/Writer (SRW) Lock */
 
-typedef PVOID RTL_SRWLOCK;
+/* pointer sized as on Windows, the lock state is a 32-bit futex word in it, see srw.c */
+
+typedef union _RTL_SRWLOCK
+{
+	PVOID Ptr;
+	INT32 State;
+} RTL_SRWLOCK;
 typedef RTL_SRWLOCK SRWLOCK, *PSRWLOCK;
 
+#define SRWLOCK_INIT		{ 0 }
+
 WINPR_API VOID InitializeSRWLock(PSRWLOCK SRWLock);
 
 WINPR_API VOID AcquireSRWLockExclusive(PSRWLOCK SRWLock);
@@ -130,21 +159,31 @@ WINPR_API VOID ReleaseSRWLockShared(PSRWLOCK SRWLock);
 
 /* Condition Variable */
 
-typedef PVOID RTL_CONDITION_VARIABLE;
+/* pointer sized as on Windows, the wakeup sequence is a 32-bit futex word in it, see condition.c */
+
+typedef union _RTL_CONDITION_VARIABLE
+{
+	PVOID Ptr;
+	INT32 Sequence;
+} RTL_CONDITION_VARIABLE;
 typedef RTL_CONDITION_VARIABLE CONDITION_VARIABLE, *PCONDITION_VARIABLE;
 
+#define CONDITION_VARIABLE_INIT			{ 0 }
+#define CONDITION_VARIABLE_LOCKMODE_SHARED	0x1
+
 /* Critical Section */
 
 typedef struct _RTL_CRITICAL_SECTION
 {
 	void* DebugInfo;
-	LONG LockCount;
+	INT32 LockCount;
 	LONG RecursionCount;
 	PVOID OwningThread;
 	PVOID LockSemaphore;
 	ULONG SpinCount;
 } RTL_CRITICAL_SECTION, *PRTL_CRITICAL_SECTION;
 
+typedef RTL_CRITICAL_SECTION CRITICAL_SECTION;
 typedef PRTL_CRITICAL_SECTION PCRITICAL_SECTION;
 typedef PRTL_CRITICAL_SECTION LPCRITICAL_SECTION;
 
@@ -161,6 +200,16 @@ WINPR_API VOID LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
 
 WINPR_API VOID DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
 
+/* Condition Variable */
+
+WINPR_API VOID InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+
+WINPR_API BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable, PCRITICAL_SECTION CriticalSection, DWORD dwMilliseconds);
+WINPR_API BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE ConditionVariable, PSRWLOCK SRWLock, DWORD dwMilliseconds, ULONG Flags);
+
+WINPR_API VOID WakeAllConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+WINPR_API VOID WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable);
+
 /* Synchronization Barrier */
 
 typedef PVOID RTL_SYNCHRONIZATION_BARRIER;
@@ -186,6 +235,8 @@ WINPR_API BOOL WaitOnAddress(VOID volatile *Address, PVOID CompareAddress, SIZE_
 
 #define INFINITE		0xFFFFFFFF
 
+#define MAXIMUM_WAIT_OBJECTS	64
+
 #define WAIT_OBJECT_0		0x00000000L
 #define WAIT_ABANDONED		0x00000080L
 
@@ -225,6 +276,11 @@ typedef struct _REASON_CONTEXT
 
 typedef VOID (*PTIMERAPCROUTINE)(LPVOID lpArgToCompletionRoutine, DWORD dwTimerLowValue, DWORD dwTimerHighValue);
 
+#define CREATE_WAITABLE_TIMER_MANUAL_RESET	0x00000001
+
+WINPR_API HANDLE CreateWaitableTimerA(LPSECURITY_ATTRIBUTES lpTimerAttributes, BOOL bManualReset, LPCSTR lpTimerName);
+WINPR_API HANDLE CreateWaitableTimerW(LPSECURITY_ATTRIBUTES lpTimerAttributes, BOOL bManualReset, LPCWSTR lpTimerName);
+
 WINPR_API HANDLE CreateWaitableTimerExA(LPSECURITY_ATTRIBUTES lpTimerAttributes, LPCSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess);
 WINPR_API HANDLE CreateWaitableTimerExW(LPSECURITY_ATTRIBUTES lpTimerAttributes, LPCWSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess);
 
@@ -240,13 +296,36 @@ WINPR_API HANDLE OpenWaitableTimerW(DWORD dwDesiredAccess, BOOL bInheritHandle,
 WINPR_API BOOL CancelWaitableTimer(HANDLE hTimer);
 
 #ifdef UNICODE
+#define CreateWaitableTimer		CreateWaitableTimerW
 #define CreateWaitableTimerEx		CreateWaitableTimerExW
 #define OpenWaitableTimer		OpenWaitableTimerW
 #else
+#define CreateWaitableTimer		CreateWaitableTimerA
 #define CreateWaitableTimerEx		CreateWaitableTimerExA
 #define OpenWaitableTimer		OpenWaitableTimerA
 #endif
 
+/* Timer Queue */
+
+#define WT_EXECUTEDEFAULT		0x00000000
+#define WT_EXECUTEINIOTHREAD		0x00000001
+#define WT_EXECUTEINWAITTHREAD		0x00000004
+#define WT_EXECUTEONLYONCE		0x00000008
+#define WT_EXECUTELONGFUNCTION		0x00000010
+#define WT_EXECUTEINTIMERTHREAD		0x00000020
+#define WT_EXECUTEINPERSISTENTTHREAD	0x00000080
+
+typedef VOID (*WAITORTIMERCALLBACK)(PVOID lpParameter, BOOLEAN TimerOrWaitFired);
+
+WINPR_API HANDLE CreateTimerQueue(void);
+WINPR_API BOOL DeleteTimerQueue(HANDLE TimerQueue);
+WINPR_API BOOL DeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent);
+
+WINPR_API BOOL CreateTimerQueueTimer(PHANDLE phNewTimer, HANDLE TimerQueue,
+		WAITORTIMERCALLBACK Callback, PVOID Parameter, DWORD DueTime, DWORD Period, ULONG Flags);
+WINPR_API BOOL ChangeTimerQueueTimer(HANDLE TimerQueue, HANDLE Timer, ULONG DueTime, ULONG Period);
+WINPR_API BOOL DeleteTimerQueueTimer(HANDLE TimerQueue, HANDLE Timer, HANDLE CompletionEvent);
+
 #endif
 
 #endif /* WINPR_SYNCH_H */
@@ -147,6 +147,39 @@ WINPR_API BOOL GetVersionExW(LPOSVERSIONINFOW lpVersionInformation);
 
 WINPR_API VOID GetSystemTimeAsFileTime(LPFILETIME lpSystemTimeAsFileTime);
 
+typedef struct _SYSTEM_INFO
+{
+	union
+	{
+		DWORD dwOemId;
+
+		struct
+		{
+			WORD wProcessorArchitecture;
+			WORD wReserved;
+		};
+	};
+
+	DWORD dwPageSize;
+	LPVOID lpMinimumApplicationAddress;
+	LPVOID lpMaximumApplicationAddress;
+	DWORD_PTR dwActiveProcessorMask;
+	DWORD dwNumberOfProcessors;
+	DWORD dwProcessorType;
+	DWORD dwAllocationGranularity;
+	WORD wProcessorLevel;
+	WORD wProcessorRevision;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+#define PROCESSOR_ARCHITECTURE_INTEL		0
+#define PROCESSOR_ARCHITECTURE_ARM		5
+#define PROCESSOR_ARCHITECTURE_IA64		6
+#define PROCESSOR_ARCHITECTURE_AMD64		9
+#define PROCESSOR_ARCHITECTURE_UNKNOWN		0xFFFF
+
+WINPR_API void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo);
+WINPR_API void GetNativeSystemInfo(LPSYSTEM_INFO lpSystemInfo);
+
 #endif
 
 #endif /* WINPR_SYSINFO_H */
@@ -70,7 +70,8 @@ typedef short SHORT;
 #define CONST const
 #define CALLBACK
 
-typedef void* HANDLE, *PHANDLE, *LPHANDLE;
+typedef void* HANDLE;
+typedef HANDLE *PHANDLE, *LPHANDLE;
 typedef HANDLE HINSTANCE;
 typedef HANDLE HMODULE;
 
@@ -0,0 +1,147 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections (BufferPool)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "collections.h"
+
+/**
+ * Every buffer is preceded by a header holding its size class, so that
+ * BufferPool_Return() needs no size. Buffers above the largest class are
+ * marked as such and go straight back to free().
+ */
+
+#define BUFFER_POOL_MIN_SHIFT		6
+#define BUFFER_POOL_MAX_SHIFT		16
+#define BUFFER_POOL_CLASS_COUNT		(BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+#define BUFFER_POOL_UNPOOLED		0xFFFFFFFF
+
+typedef union _wBufferHeader
+{
+	UINT32 SizeClass;
+	BYTE Alignment[16];
+} wBufferHeader;
+
+struct _wBufferPool
+{
+	wRing Classes[BUFFER_POOL_CLASS_COUNT];
+};
+
+wBufferPool* BufferPool_New(int capacity)
+{
+	int index;
+	wBufferPool* pool;
+
+	pool = (wBufferPool*) calloc(1, sizeof(wBufferPool));
+
+	if (!pool)
+		return NULL;
+
+	for (index = 0; index < BUFFER_POOL_CLASS_COUNT; index++)
+	{
+		if (!Ring_Init(&pool->Classes[index], (capacity > 0) ? capacity : 32))
+		{
+			while (index-- > 0)
+				Ring_Uninit(&pool->Classes[index]);
+
+			free(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * Buffers still taken from the pool are not freed.
+ */
+
+void BufferPool_Free(wBufferPool* pool)
+{
+	int index;
+	void* header;
+
+	if (!pool)
+		return;
+
+	for (index = 0; index < BUFFER_POOL_CLASS_COUNT; index++)
+	{
+		while ((header = Ring_Pop(&pool->Classes[index])) != NULL)
+			free(header);
+
+		Ring_Uninit(&pool->Classes[index]);
+	}
+
+	free(pool);
+}
+
+static UINT32 BufferPool_SizeClass(size_t size)
+{
+	UINT32 shift = BUFFER_POOL_MIN_SHIFT;
+
+	if (size > ((size_t) 1 << BUFFER_POOL_MAX_SHIFT))
+		return BUFFER_POOL_UNPOOLED;
+
+	while (((size_t) 1 << shift) < size)
+		shift++;
+
+	return shift - BUFFER_POOL_MIN_SHIFT;
+}
+
+BYTE* BufferPool_Take(wBufferPool* pool, size_t size)
+{
+	UINT32 sizeClass;
+	wBufferHeader* header;
+
+	sizeClass = BufferPool_SizeClass(size);
+
+	if (sizeClass == BUFFER_POOL_UNPOOLED)
+	{
+		header = (wBufferHeader*) malloc(sizeof(wBufferHeader) + size);
+	}
+	else
+	{
+		header = (wBufferHeader*) Ring_Pop(&pool->Classes[sizeClass]);
+
+		if (!header)
+			header = (wBufferHeader*) malloc(sizeof(wBufferHeader) + ((size_t) 1 << (sizeClass + BUFFER_POOL_MIN_SHIFT)));
+	}
+
+	if (!header)
+		return NULL;
+
+	header->SizeClass = sizeClass;
+
+	return (BYTE*) &header[1];
+}
+
+void BufferPool_Return(wBufferPool* pool, BYTE* buffer)
+{
+	wBufferHeader* header;
+
+	if (!buffer)
+		return;
+
+	header = &((wBufferHeader*) buffer)[-1];
+
+	if ((header->SizeClass == BUFFER_POOL_UNPOOLED) || !Ring_Push(&pool->Classes[header->SizeClass], header))
+		free(header);
+}
@@ -0,0 +1,62 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_COLLECTIONS_PRIVATE_H
+#define WINPR_COLLECTIONS_PRIVATE_H
+
+#include <winpr/collections.h>
+
+#include <pthread.h>
+
+#define winpr_Collections_Barrier()			__sync_synchronize()
+#define winpr_Collections_CompareExchange(_p, _old, _new)	__sync_bool_compare_and_swap(_p, _old, _new)
+
+#define WINPR_CACHE_LINE_SIZE		64
+
+/**
+ * Bounded lock-free ring of pointers (Dmitry Vyukov's MPMC queue).
+ *
+ * Every cell carries a sequence number telling whether it is free for the
+ * producer at a given position or filled for the consumer at that position,
+ * so producers and consumers only contend on their own position counter.
+ */
+
+typedef struct _wRingCell
+{
+	ULONG_PTR volatile Sequence;
+	void* Data;
+} wRingCell;
+
+typedef struct _wRing
+{
+	wRingCell* Cells;
+	ULONG_PTR Mask;
+	BYTE Pad0[WINPR_CACHE_LINE_SIZE];
+	ULONG_PTR volatile EnqueuePos;
+	BYTE Pad1[WINPR_CACHE_LINE_SIZE];
+	ULONG_PTR volatile DequeuePos;
+	BYTE Pad2[WINPR_CACHE_LINE_SIZE];
+} wRing;
+
+BOOL Ring_Init(wRing* ring, int capacity);
+void Ring_Uninit(wRing* ring);
+
+BOOL Ring_Push(wRing* ring, void* data);
+void* Ring_Pop(wRing* ring);
+int Ring_Count(wRing* ring);
+
+#endif /* WINPR_COLLECTIONS_PRIVATE_H */
@@ -0,0 +1,89 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections (ObjectPool)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "collections.h"
+
+struct _wObjectPool
+{
+	wRing Ring;
+	size_t Size;
+};
+
+wObjectPool* ObjectPool_New(size_t size, int capacity)
+{
+	wObjectPool* pool;
+
+	pool = (wObjectPool*) calloc(1, sizeof(wObjectPool));
+
+	if (!pool)
+		return NULL;
+
+	if (!Ring_Init(&pool->Ring, (capacity > 0) ? capacity : 64))
+	{
+		free(pool);
+		return NULL;
+	}
+
+	pool->Size = size;
+
+	return pool;
+}
+
+/**
+ * Objects still taken from the pool are not freed.
+ */
+
+void ObjectPool_Free(wObjectPool* pool)
+{
+	void* obj;
+
+	if (!pool)
+		return;
+
+	while ((obj = Ring_Pop(&pool->Ring)) != NULL)
+		free(obj);
+
+	Ring_Uninit(&pool->Ring);
+	free(pool);
+}
+
+void* ObjectPool_Take(wObjectPool* pool)
+{
+	void* obj;
+
+	obj = Ring_Pop(&pool->Ring);
+
+	if (!obj)
+		obj = malloc(pool->Size);
+
+	return obj;
+}
+
+void ObjectPool_Return(wObjectPool* pool, void* obj)
+{
+	if (!obj)
+		return;
+
+	if (!Ring_Push(&pool->Ring, obj))
+		free(obj);
+}
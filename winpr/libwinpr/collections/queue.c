@@ -0,0 +1,236 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections (Queue)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include <winpr/synch.h>
+
+#include "collections.h"
+
+/**
+ * Once an item has gone to the overflow list, producers keep appending
+ * there until the consumers have drained it, otherwise a later item from
+ * the same producer could overtake it through the ring.
+ *
+ * The event is set by whoever moves Signaled from 0 to 1 after pushing,
+ * and reset by a consumer that finds the queue empty. The consumer resets
+ * the event before clearing Signaled and looks at the queue again after,
+ * so a push racing with it is either seen or signals the event anew.
+ */
+
+typedef struct _wQueueNode wQueueNode;
+
+struct _wQueueNode
+{
+	wQueueNode* Next;
+	void* Data;
+};
+
+struct _wQueue
+{
+	wRing Ring;
+
+	HANDLE Event;
+	LONG volatile Signaled;
+
+	pthread_mutex_t Lock;
+	LONG volatile OverflowCount;
+	wQueueNode* OverflowHead;
+	wQueueNode* OverflowTail;
+};
+
+wQueue* Queue_New(int capacity)
+{
+	wQueue* queue;
+
+	queue = (wQueue*) calloc(1, sizeof(wQueue));
+
+	if (!queue)
+		return NULL;
+
+	if (!Ring_Init(&queue->Ring, (capacity > 0) ? capacity : 64))
+	{
+		free(queue);
+		return NULL;
+	}
+
+	queue->Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!queue->Event)
+	{
+		Ring_Uninit(&queue->Ring);
+		free(queue);
+		return NULL;
+	}
+
+	pthread_mutex_init(&queue->Lock, NULL);
+
+	return queue;
+}
+
+/**
+ * The queue must be empty: items still in it are not freed.
+ */
+
+void Queue_Free(wQueue* queue)
+{
+	wQueueNode* node;
+
+	if (!queue)
+		return;
+
+	while (queue->OverflowHead)
+	{
+		node = queue->OverflowHead;
+		queue->OverflowHead = node->Next;
+		free(node);
+	}
+
+	pthread_mutex_destroy(&queue->Lock);
+	CloseHandle(queue->Event);
+	Ring_Uninit(&queue->Ring);
+	free(queue);
+}
+
+HANDLE Queue_Event(wQueue* queue)
+{
+	return queue->Event;
+}
+
+int Queue_Count(wQueue* queue)
+{
+	return Ring_Count(&queue->Ring) + queue->OverflowCount;
+}
+
+static void Queue_Signal(wQueue* queue)
+{
+	winpr_Collections_Barrier();
+
+	if (queue->Signaled)
+		return;
+
+	if (winpr_Collections_CompareExchange(&queue->Signaled, 0, 1))
+		SetEvent(queue->Event);
+}
+
+static BOOL Queue_Overflow(wQueue* queue, void* item)
+{
+	wQueueNode* node;
+
+	pthread_mutex_lock(&queue->Lock);
+
+	if ((queue->OverflowCount == 0) && Ring_Push(&queue->Ring, item))
+	{
+		pthread_mutex_unlock(&queue->Lock);
+		return TRUE;
+	}
+
+	node = (wQueueNode*) malloc(sizeof(wQueueNode));
+
+	if (!node)
+	{
+		pthread_mutex_unlock(&queue->Lock);
+		return FALSE;
+	}
+
+	node->Next = NULL;
+	node->Data = item;
+
+	if (queue->OverflowTail)
+		queue->OverflowTail->Next = node;
+	else
+		queue->OverflowHead = node;
+
+	queue->OverflowTail = node;
+	queue->OverflowCount++;
+
+	pthread_mutex_unlock(&queue->Lock);
+
+	return TRUE;
+}
+
+BOOL Queue_Enqueue(wQueue* queue, void* item)
+{
+	if ((queue->OverflowCount != 0) || !Ring_Push(&queue->Ring, item))
+	{
+		if (!Queue_Overflow(queue, item))
+			return FALSE;
+	}
+
+	Queue_Signal(queue);
+
+	return TRUE;
+}
+
+static void* Queue_Take(wQueue* queue)
+{
+	void* item;
+	wQueueNode* node;
+
+	item = Ring_Pop(&queue->Ring);
+
+	if (item || (queue->OverflowCount == 0))
+		return item;
+
+	pthread_mutex_lock(&queue->Lock);
+
+	/* the ring may have been refilled before the overflow was noticed */
+
+	item = Ring_Pop(&queue->Ring);
+
+	if (!item && queue->OverflowHead)
+	{
+		node = queue->OverflowHead;
+		queue->OverflowHead = node->Next;
+
+		if (!queue->OverflowHead)
+			queue->OverflowTail = NULL;
+
+		queue->OverflowCount--;
+
+		item = node->Data;
+		free(node);
+	}
+
+	pthread_mutex_unlock(&queue->Lock);
+
+	return item;
+}
+
+void* Queue_Dequeue(wQueue* queue)
+{
+	void* item;
+
+	item = Queue_Take(queue);
+
+	if (item)
+		return item;
+
+	ResetEvent(queue->Event);
+	__sync_fetch_and_and(&queue->Signaled, 0);
+
+	item = Queue_Take(queue);
+
+	if (item)
+		Queue_Signal(queue);
+
+	return item;
+}
@@ -0,0 +1,144 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Collections (Ring)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "collections.h"
+
+BOOL Ring_Init(wRing* ring, int capacity)
+{
+	ULONG_PTR index;
+	ULONG_PTR size = 2;
+
+	while ((int) size < capacity)
+		size <<= 1;
+
+	ring->Cells = (wRingCell*) malloc(sizeof(wRingCell) * size);
+
+	if (!ring->Cells)
+		return FALSE;
+
+	for (index = 0; index < size; index++)
+	{
+		ring->Cells[index].Sequence = index;
+		ring->Cells[index].Data = NULL;
+	}
+
+	ring->Mask = size - 1;
+	ring->EnqueuePos = 0;
+	ring->DequeuePos = 0;
+
+	return TRUE;
+}
+
+void Ring_Uninit(wRing* ring)
+{
+	free(ring->Cells);
+	ring->Cells = NULL;
+}
+
+/**
+ * Returns FALSE if the ring is full.
+ */
+
+BOOL Ring_Push(wRing* ring, void* data)
+{
+	LONG_PTR diff;
+	ULONG_PTR pos;
+	wRingCell* cell;
+
+	pos = ring->EnqueuePos;
+
+	for (;;)
+	{
+		cell = &ring->Cells[pos & ring->Mask];
+		diff = (LONG_PTR) (cell->Sequence - pos);
+
+		if (diff == 0)
+		{
+			if (winpr_Collections_CompareExchange(&ring->EnqueuePos, pos, pos + 1))
+				break;
+		}
+		else if (diff < 0)
+		{
+			return FALSE;
+		}
+
+		pos = ring->EnqueuePos;
+	}
+
+	cell->Data = data;
+	winpr_Collections_Barrier();
+	cell->Sequence = pos + 1;
+
+	return TRUE;
+}
+
+/**
+ * Returns NULL if the ring is empty.
+ */
+
+void* Ring_Pop(wRing* ring)
+{
+	void* data;
+	LONG_PTR diff;
+	ULONG_PTR pos;
+	wRingCell* cell;
+
+	pos = ring->DequeuePos;
+
+	for (;;)
+	{
+		cell = &ring->Cells[pos & ring->Mask];
+		diff = (LONG_PTR) (cell->Sequence - (pos + 1));
+
+		if (diff == 0)
+		{
+			if (winpr_Collections_CompareExchange(&ring->DequeuePos, pos, pos + 1))
+				break;
+		}
+		else if (diff < 0)
+		{
+			return NULL;
+		}
+
+		pos = ring->DequeuePos;
+	}
+
+	data = cell->Data;
+	winpr_Collections_Barrier();
+	cell->Sequence = pos + ring->Mask + 1;
+
+	return data;
+}
+
+/**
+ * Approximate while other threads are pushing or popping.
+ */
+
+int Ring_Count(wRing* ring)
+{
+	LONG_PTR count;
+
+	count = (LONG_PTR) (ring->EnqueuePos - ring->DequeuePos);
+
+	return (count < 0) ? 0 : (int) count;
+}
@@ -0,0 +1,106 @@
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+
+#define TEST_POOL_THREADS		4
+#define TEST_POOL_ITERATIONS		50000
+
+static wBufferPool* bufferPool;
+
+static void* test_buffer_pool_thread(void* arg)
+{
+	int index;
+	size_t size;
+	BYTE* buffer;
+	BYTE value = (BYTE) (ULONG_PTR) arg;
+
+	for (index = 0; index < TEST_POOL_ITERATIONS; index++)
+	{
+		size = 1 + ((index * 397) % 20000);
+		buffer = BufferPool_Take(bufferPool, size);
+
+		if (!buffer)
+			return (void*) 1;
+
+		memset(buffer, value, size);
+
+		if ((buffer[0] != value) || (buffer[size - 1] != value))
+			return (void*) 1;
+
+		BufferPool_Return(bufferPool, buffer);
+	}
+
+	return NULL;
+}
+
+int TestPools(int argc, char* argv[])
+{
+	int index;
+	void* obj;
+	void* other;
+	BYTE* buffer;
+	BYTE* large;
+	pthread_t threads[TEST_POOL_THREADS];
+	wObjectPool* objectPool;
+
+	/* ObjectPool hands returned objects out again */
+
+	objectPool = ObjectPool_New(48, 4);
+
+	obj = ObjectPool_Take(objectPool);
+	ObjectPool_Return(objectPool, obj);
+	other = ObjectPool_Take(objectPool);
+
+	if (other != obj)
+	{
+		printf("ObjectPool_Take did not reuse a returned object\n");
+		return -1;
+	}
+
+	ObjectPool_Return(objectPool, other);
+
+	ObjectPool_Free(objectPool);
+
+	/* BufferPool reuses buffers within a size class */
+
+	bufferPool = BufferPool_New(8);
+
+	buffer = BufferPool_Take(bufferPool, 100);
+	memset(buffer, 0xAA, 128);
+	BufferPool_Return(bufferPool, buffer);
+
+	if (BufferPool_Take(bufferPool, 128) != buffer)
+	{
+		printf("BufferPool_Take did not reuse a buffer of the same size class\n");
+		return -1;
+	}
+
+	BufferPool_Return(bufferPool, buffer);
+
+	large = BufferPool_Take(bufferPool, 1024 * 1024);
+	memset(large, 0x55, 1024 * 1024);
+	BufferPool_Return(bufferPool, large);
+
+	for (index = 0; index < TEST_POOL_THREADS; index++)
+		pthread_create(&threads[index], NULL, test_buffer_pool_thread, (void*) (ULONG_PTR) (index + 1));
+
+	for (index = 0; index < TEST_POOL_THREADS; index++)
+	{
+		void* status;
+
+		pthread_join(threads[index], &status);
+
+		if (status)
+		{
+			printf("concurrent BufferPool_Take failed\n");
+			return -1;
+		}
+	}
+
+	BufferPool_Free(bufferPool);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/collections.h>
+
+#define TEST_QUEUE_PRODUCERS		4
+#define TEST_QUEUE_ITEMS		100000
+
+static wQueue* queue;
+
+static void* test_queue_producer(void* arg)
+{
+	ULONG_PTR index;
+	ULONG_PTR producer = (ULONG_PTR) arg;
+
+	for (index = 1; index <= TEST_QUEUE_ITEMS; index++)
+	{
+		if (!Queue_Enqueue(queue, (void*) ((producer << 24) | index)))
+			return (void*) 1;
+	}
+
+	return NULL;
+}
+
+int TestQueue(int argc, char* argv[])
+{
+	int count;
+	ULONG_PTR item;
+	ULONG_PTR index;
+	ULONG_PTR producer;
+	long usec;
+	struct timeval start;
+	struct timeval end;
+	ULONG_PTR expected[TEST_QUEUE_PRODUCERS];
+	pthread_t threads[TEST_QUEUE_PRODUCERS];
+
+	/* FIFO order across the ring and the overflow list */
+
+	queue = Queue_New(4);
+
+	if (WaitForSingleObject(Queue_Event(queue), 0) != WAIT_TIMEOUT)
+	{
+		printf("event of an empty queue is signaled\n");
+		return -1;
+	}
+
+	for (index = 1; index <= 100; index++)
+		Queue_Enqueue(queue, (void*) index);
+
+	if (Queue_Count(queue) != 100)
+	{
+		printf("Queue_Count: Actual: %d, Expected: %d\n", Queue_Count(queue), 100);
+		return -1;
+	}
+
+	if (WaitForSingleObject(Queue_Event(queue), 0) != WAIT_OBJECT_0)
+	{
+		printf("event of a non-empty queue is not signaled\n");
+		return -1;
+	}
+
+	for (index = 1; index <= 100; index++)
+	{
+		item = (ULONG_PTR) Queue_Dequeue(queue);
+
+		if (item != index)
+		{
+			printf("Queue_Dequeue: Actual: %d, Expected: %d\n", (int) item, (int) index);
+			return -1;
+		}
+	}
+
+	if (Queue_Dequeue(queue) != NULL)
+	{
+		printf("Queue_Dequeue returned an item from an empty queue\n");
+		return -1;
+	}
+
+	if (WaitForSingleObject(Queue_Event(queue), 0) != WAIT_TIMEOUT)
+	{
+		printf("event of a drained queue is still signaled\n");
+		return -1;
+	}
+
+	Queue_Free(queue);
+
+	/* concurrent producers, single consumer woken by the event */
+
+	queue = Queue_New(1024);
+
+	for (producer = 0; producer < TEST_QUEUE_PRODUCERS; producer++)
+		expected[producer] = 1;
+
+	gettimeofday(&start, NULL);
+
+	for (producer = 0; producer < TEST_QUEUE_PRODUCERS; producer++)
+		pthread_create(&threads[producer], NULL, test_queue_producer, (void*) producer);
+
+	for (count = 0; count < TEST_QUEUE_PRODUCERS * TEST_QUEUE_ITEMS; )
+	{
+		item = (ULONG_PTR) Queue_Dequeue(queue);
+
+		if (!item)
+		{
+			WaitForSingleObject(Queue_Event(queue), INFINITE);
+			continue;
+		}
+
+		producer = item >> 24;
+		index = item & 0xFFFFFF;
+
+		if ((producer >= TEST_QUEUE_PRODUCERS) || (index != expected[producer]))
+		{
+			printf("item %d of producer %d out of order\n", (int) index, (int) producer);
+			return -1;
+		}
+
+		expected[producer]++;
+		count++;
+	}
+
+	gettimeofday(&end, NULL);
+
+	for (producer = 0; producer < TEST_QUEUE_PRODUCERS; producer++)
+	{
+		void* status;
+
+		pthread_join(threads[producer], &status);
+
+		if (status)
+		{
+			printf("Queue_Enqueue failed\n");
+			return -1;
+		}
+	}
+
+	if (Queue_Dequeue(queue) != NULL)
+	{
+		printf("Queue_Dequeue returned more items than were enqueued\n");
+		return -1;
+	}
+
+	usec = ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+
+	printf("%d producers, %d items: %ld us\n", TEST_QUEUE_PRODUCERS,
+			TEST_QUEUE_PRODUCERS * TEST_QUEUE_ITEMS, usec);
+
+	Queue_Free(queue);
+
+	return 0;
+}
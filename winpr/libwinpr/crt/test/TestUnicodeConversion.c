@@ -0,0 +1,200 @@
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/windows.h>
+
+#define TEST_UNICODE_ITERATIONS		20000
+
+/* file names, window titles and format names as seen on a real session */
+
+static const char* testStrings[] =
+{
+	"Documents",
+	"desktop.ini",
+	"Quarterly Report - Final (2).xlsx",
+	"FileGroupDescriptorW",
+	"Pr\xC3\xA9sentation g\xC3\xA9n\xC3\xA9rale.pptx",
+	"\xE6\x96\xB0\xE5\xBB\xBA\xE6\x96\x87\xE4\xBB\xB6\xE5\xA4\xB9",
+	"Inbox - Outlook \xE2\x80\x94 \xF0\x9F\x93\xA7 3 unread",
+	"C:\\Users\\Administrator\\AppData\\Local\\Temp\\~DF3A2B.tmp"
+};
+
+#define TEST_UNICODE_STRINGS		(sizeof(testStrings) / sizeof(testStrings[0]))
+
+/* "\xF0\x9F\x93\xA7" is U+1F4E7, encoded as a surrogate pair */
+static const WCHAR testSurrogateW[] = { 'a', 0xD83D, 0xDCE7, 'b' };
+
+static long test_elapsed(struct timeval* start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+
+	return ((end.tv_sec - start->tv_sec) * 1000000) + (end.tv_usec - start->tv_usec);
+}
+
+static long test_round_trips(UINT CodePage, const char** strings, int count)
+{
+	int index;
+	int iteration;
+	int length;
+	int cchWideChar;
+	WCHAR bufferW[256];
+	char buffer[256];
+	struct timeval start;
+
+	gettimeofday(&start, NULL);
+
+	for (iteration = 0; iteration < TEST_UNICODE_ITERATIONS; iteration++)
+	{
+		for (index = 0; index < count; index++)
+		{
+			length = strlen(strings[index]);
+			cchWideChar = MultiByteToWideChar(CodePage, 0, strings[index], length, bufferW, 256);
+
+			if (WideCharToMultiByte(CodePage, 0, bufferW, cchWideChar, buffer, 256, NULL, NULL) != length)
+				return -1;
+		}
+	}
+
+	return test_elapsed(&start);
+}
+
+int TestUnicodeConversion(int argc, char* argv[])
+{
+	int index;
+	int length;
+	int cchWideChar;
+	long usec;
+	WCHAR bufferW[256];
+	char buffer[256];
+	const char* latin1[] = { "Caf\xE9", "na\xEFve r\xE9sum\xE9.doc", "Documents" };
+
+	/* round trips, with the size queries matching the conversions */
+
+	for (index = 0; index < TEST_UNICODE_STRINGS; index++)
+	{
+		length = strlen(testStrings[index]);
+
+		cchWideChar = MultiByteToWideChar(CP_UTF8, 0, testStrings[index], length, NULL, 0);
+
+		if (MultiByteToWideChar(CP_UTF8, 0, testStrings[index], length, bufferW, 256) != cchWideChar)
+		{
+			printf("MultiByteToWideChar: size query mismatch for \"%s\"\n", testStrings[index]);
+			return -1;
+		}
+
+		if (WideCharToMultiByte(CP_UTF8, 0, bufferW, cchWideChar, NULL, 0, NULL, NULL) != length)
+		{
+			printf("WideCharToMultiByte: size query mismatch for \"%s\"\n", testStrings[index]);
+			return -1;
+		}
+
+		ZeroMemory(buffer, sizeof(buffer));
+
+		if ((WideCharToMultiByte(CP_UTF8, 0, bufferW, cchWideChar, buffer, 256, NULL, NULL) != length) ||
+				(strcmp(buffer, testStrings[index]) != 0))
+		{
+			printf("round trip mismatch: \"%s\" became \"%s\"\n", testStrings[index], buffer);
+			return -1;
+		}
+	}
+
+	/* surrogate pairs */
+
+	if ((MultiByteToWideChar(CP_UTF8, 0, "a\xF0\x9F\x93\xA7" "b", 6, bufferW, 256) != 4) ||
+			(memcmp(bufferW, testSurrogateW, sizeof(testSurrogateW)) != 0))
+	{
+		printf("MultiByteToWideChar: supplementary character not converted to a surrogate pair\n");
+		return -1;
+	}
+
+	if ((WideCharToMultiByte(CP_UTF8, 0, testSurrogateW, 4, buffer, 256, NULL, NULL) != 6) ||
+			(memcmp(buffer, "a\xF0\x9F\x93\xA7" "b", 6) != 0))
+	{
+		printf("WideCharToMultiByte: surrogate pair not converted to a supplementary character\n");
+		return -1;
+	}
+
+	/* ill-formed input is replaced, or rejected on request */
+
+	if ((MultiByteToWideChar(CP_UTF8, 0, "a\xC0\xAF" "b", 4, bufferW, 256) < 3) || (bufferW[1] != 0xFFFD))
+	{
+		printf("MultiByteToWideChar: overlong sequence not replaced\n");
+		return -1;
+	}
+
+	if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, "a\xED\xA0\x80" "b", 5, bufferW, 256) != 0)
+	{
+		printf("MultiByteToWideChar: encoded surrogate not rejected\n");
+		return -1;
+	}
+
+	if ((WideCharToMultiByte(CP_UTF8, 0, &testSurrogateW[2], 2, buffer, 256, NULL, NULL) != 4) ||
+			(memcmp(buffer, "\xEF\xBF\xBD" "b", 4) != 0))
+	{
+		printf("WideCharToMultiByte: unpaired surrogate not replaced\n");
+		return -1;
+	}
+
+	if (WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, &testSurrogateW[2], 2, buffer, 256, NULL, NULL) != 0)
+	{
+		printf("WideCharToMultiByte: unpaired surrogate not rejected\n");
+		return -1;
+	}
+
+	/* too small buffers fail */
+
+	if (MultiByteToWideChar(CP_UTF8, 0, testStrings[2], -1, bufferW, 4) != 0)
+	{
+		printf("MultiByteToWideChar: overflowed a short buffer\n");
+		return -1;
+	}
+
+	/* other code pages, which need iconv */
+
+	cchWideChar = MultiByteToWideChar(1252, 0, latin1[0], 4, bufferW, 256);
+
+	if (cchWideChar && ((cchWideChar != 4) || (bufferW[3] != 0xE9)))
+	{
+		printf("MultiByteToWideChar: code page 1252 conversion failed\n");
+		return -1;
+	}
+
+	if (cchWideChar && ((WideCharToMultiByte(1252, 0, bufferW, 4, buffer, 256, NULL, NULL) != 4) ||
+			(memcmp(buffer, latin1[0], 4) != 0)))
+	{
+		printf("WideCharToMultiByte: code page 1252 conversion failed\n");
+		return -1;
+	}
+
+	usec = test_round_trips(CP_UTF8, testStrings, TEST_UNICODE_STRINGS);
+
+	if (usec < 0)
+	{
+		printf("UTF-8 round trip failed\n");
+		return -1;
+	}
+
+	printf("UTF-8: %d round trips in %ld us\n", (int) (TEST_UNICODE_ITERATIONS * TEST_UNICODE_STRINGS), usec);
+
+	if (!cchWideChar)
+	{
+		printf("code page 1252 not supported\n");
+		return 0;
+	}
+
+	usec = test_round_trips(1252, latin1, 3);
+
+	if (usec < 0)
+	{
+		printf("code page 1252 round trip failed\n");
+		return -1;
+	}
+
+	printf("code page 1252: %d round trips in %ld us\n", TEST_UNICODE_ITERATIONS * 3, usec);
+
+	return 0;
+}
@@ -0,0 +1,486 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Unicode Conversion (CRT)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <winpr/crt.h>
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+#ifdef HAVE_ICONV_H
+#include <iconv.h>
+#endif
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * UTF-8, which is also what CP_ACP stands for, is converted by the built-in
+ * transcoder below, which copies runs of ASCII 16 characters at a time with
+ * SSE2. Other code pages go through iconv, with descriptors opened once per
+ * thread and code page instead of once per call, and fail without iconv.
+ *
+ * As on Windows, ill-formed input is replaced with U+FFFD unless
+ * MB_ERR_INVALID_CHARS or WC_ERR_INVALID_CHARS is given, in which case the
+ * conversion fails, and so does a conversion into a buffer that is too small.
+ */
+
+#define UNICODE_REPLACEMENT_CHARACTER		0xFFFD
+
+#define UNICODE_IS_HIGH_SURROGATE(_c)		(((_c) >= 0xD800) && ((_c) <= 0xDBFF))
+#define UNICODE_IS_LOW_SURROGATE(_c)		(((_c) >= 0xDC00) && ((_c) <= 0xDFFF))
+
+/* returns the number of WCHARs, or -1 on ill-formed input or a short buffer */
+
+static int winpr_utf8_to_utf16(const BYTE* src, int srcLength, WCHAR* dst, int dstLength, BOOL strict)
+{
+	int n;
+	int index;
+	int in = 0;
+	int out = 0;
+	UINT32 cp;
+	UINT32 min;
+	BYTE c;
+
+	while (in < srcLength)
+	{
+#ifdef WITH_SSE2
+		while ((in + 16 <= srcLength) && (!dst || (out + 16 <= dstLength)))
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i*) &src[in]);
+
+			if (_mm_movemask_epi8(bytes))
+				break;
+
+			if (dst)
+			{
+				_mm_storeu_si128((__m128i*) &dst[out], _mm_unpacklo_epi8(bytes, _mm_setzero_si128()));
+				_mm_storeu_si128((__m128i*) &dst[out + 8], _mm_unpackhi_epi8(bytes, _mm_setzero_si128()));
+			}
+
+			in += 16;
+			out += 16;
+		}
+
+		if (in >= srcLength)
+			break;
+#endif
+		c = src[in];
+
+		if (c < 0x80)
+		{
+			cp = c;
+			n = 0;
+			min = 0;
+		}
+		else if ((c >= 0xC2) && (c <= 0xDF))
+		{
+			cp = c & 0x1F;
+			n = 1;
+			min = 0x80;
+		}
+		else if ((c >= 0xE0) && (c <= 0xEF))
+		{
+			cp = c & 0x0F;
+			n = 2;
+			min = 0x800;
+		}
+		else if ((c >= 0xF0) && (c <= 0xF4))
+		{
+			cp = c & 0x07;
+			n = 3;
+			min = 0x10000;
+		}
+		else
+		{
+			cp = UNICODE_REPLACEMENT_CHARACTER;
+			n = -1;
+			min = 0;
+		}
+
+		in++;
+
+		for (index = 0; index < n; index++)
+		{
+			if ((in >= srcLength) || ((src[in] & 0xC0) != 0x80))
+				break;
+
+			cp = (cp << 6) | (src[in++] & 0x3F);
+		}
+
+		/* truncated, overlong, surrogate or out of range sequences */
+
+		if ((n < 0) || (index < n) || (cp < min) || (cp > 0x10FFFF) ||
+				((cp >= 0xD800) && (cp <= 0xDFFF)))
+		{
+			if (strict)
+				return -1;
+
+			cp = UNICODE_REPLACEMENT_CHARACTER;
+		}
+
+		if (cp < 0x10000)
+		{
+			if (dst)
+			{
+				if (out + 1 > dstLength)
+					return -1;
+
+				dst[out] = (WCHAR) cp;
+			}
+
+			out++;
+		}
+		else
+		{
+			if (dst)
+			{
+				if (out + 2 > dstLength)
+					return -1;
+
+				cp -= 0x10000;
+				dst[out] = (WCHAR) (0xD800 + (cp >> 10));
+				dst[out + 1] = (WCHAR) (0xDC00 + (cp & 0x3FF));
+			}
+
+			out += 2;
+		}
+	}
+
+	return out;
+}
+
+/* returns the number of bytes, or -1 on ill-formed input or a short buffer */
+
+static int winpr_utf16_to_utf8(const WCHAR* src, int srcLength, BYTE* dst, int dstLength, BOOL strict)
+{
+	int n;
+	int in = 0;
+	int out = 0;
+	UINT32 cp;
+
+	while (in < srcLength)
+	{
+#ifdef WITH_SSE2
+		while ((in + 16 <= srcLength) && (!dst || (out + 16 <= dstLength)))
+		{
+			__m128i lo = _mm_loadu_si128((const __m128i*) &src[in]);
+			__m128i hi = _mm_loadu_si128((const __m128i*) &src[in + 8]);
+			__m128i mask = _mm_and_si128(_mm_or_si128(lo, hi), _mm_set1_epi16((short) 0xFF80));
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(mask, _mm_setzero_si128())) != 0xFFFF)
+				break;
+
+			if (dst)
+				_mm_storeu_si128((__m128i*) &dst[out], _mm_packus_epi16(lo, hi));
+
+			in += 16;
+			out += 16;
+		}
+
+		if (in >= srcLength)
+			break;
+#endif
+		cp = src[in++];
+
+		if (UNICODE_IS_HIGH_SURROGATE(cp) && (in < srcLength) && UNICODE_IS_LOW_SURROGATE(src[in]))
+		{
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (src[in++] - 0xDC00);
+		}
+		else if (UNICODE_IS_HIGH_SURROGATE(cp) || UNICODE_IS_LOW_SURROGATE(cp))
+		{
+			if (strict)
+				return -1;
+
+			cp = UNICODE_REPLACEMENT_CHARACTER;
+		}
+
+		n = (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+
+		if (dst)
+		{
+			if (out + n > dstLength)
+				return -1;
+
+			switch (n)
+			{
+				case 1:
+					dst[out] = (BYTE) cp;
+					break;
+
+				case 2:
+					dst[out] = (BYTE) (0xC0 | (cp >> 6));
+					dst[out + 1] = (BYTE) (0x80 | (cp & 0x3F));
+					break;
+
+				case 3:
+					dst[out] = (BYTE) (0xE0 | (cp >> 12));
+					dst[out + 1] = (BYTE) (0x80 | ((cp >> 6) & 0x3F));
+					dst[out + 2] = (BYTE) (0x80 | (cp & 0x3F));
+					break;
+
+				default:
+					dst[out] = (BYTE) (0xF0 | (cp >> 18));
+					dst[out + 1] = (BYTE) (0x80 | ((cp >> 12) & 0x3F));
+					dst[out + 2] = (BYTE) (0x80 | ((cp >> 6) & 0x3F));
+					dst[out + 3] = (BYTE) (0x80 | (cp & 0x3F));
+					break;
+			}
+		}
+
+		out += n;
+	}
+
+	return out;
+}
+
+static BOOL winpr_codepage_is_utf8(UINT CodePage)
+{
+	return ((CodePage == CP_UTF8) || (CodePage == CP_ACP) || (CodePage == CP_THREAD_ACP)) ? TRUE : FALSE;
+}
+
+#ifdef HAVE_ICONV_H
+
+typedef struct _WINPR_ICONV_CACHE
+{
+	UINT CodePage;
+	iconv_t ToUnicode;
+	iconv_t FromUnicode;
+} WINPR_ICONV_CACHE;
+
+static pthread_key_t iconv_cache_key;
+static pthread_once_t iconv_cache_once = PTHREAD_ONCE_INIT;
+
+static void winpr_iconv_cache_free(void* arg)
+{
+	WINPR_ICONV_CACHE* cache = (WINPR_ICONV_CACHE*) arg;
+
+	if (cache->ToUnicode != (iconv_t) -1)
+		iconv_close(cache->ToUnicode);
+
+	if (cache->FromUnicode != (iconv_t) -1)
+		iconv_close(cache->FromUnicode);
+
+	free(cache);
+}
+
+static void winpr_iconv_cache_init(void)
+{
+	pthread_key_create(&iconv_cache_key, winpr_iconv_cache_free);
+}
+
+static iconv_t winpr_iconv_get(UINT CodePage, BOOL bToUnicode)
+{
+	iconv_t* handle;
+	char name[16];
+	WINPR_ICONV_CACHE* cache;
+
+	pthread_once(&iconv_cache_once, winpr_iconv_cache_init);
+
+	cache = (WINPR_ICONV_CACHE*) pthread_getspecific(iconv_cache_key);
+
+	if (!cache)
+	{
+		cache = (WINPR_ICONV_CACHE*) malloc(sizeof(WINPR_ICONV_CACHE));
+
+		if (!cache)
+			return (iconv_t) -1;
+
+		cache->CodePage = CodePage;
+		cache->ToUnicode = (iconv_t) -1;
+		cache->FromUnicode = (iconv_t) -1;
+
+		pthread_setspecific(iconv_cache_key, cache);
+	}
+
+	if (cache->CodePage != CodePage)
+	{
+		if (cache->ToUnicode != (iconv_t) -1)
+			iconv_close(cache->ToUnicode);
+
+		if (cache->FromUnicode != (iconv_t) -1)
+			iconv_close(cache->FromUnicode);
+
+		cache->CodePage = CodePage;
+		cache->ToUnicode = (iconv_t) -1;
+		cache->FromUnicode = (iconv_t) -1;
+	}
+
+	handle = bToUnicode ? &cache->ToUnicode : &cache->FromUnicode;
+
+	if (*handle == (iconv_t) -1)
+	{
+		if (CodePage == CP_UTF7)
+			strcpy(name, "UTF-7");
+		else if (CodePage == CP_OEMCP)
+			strcpy(name, "CP437");
+		else if (CodePage == CP_MACCP)
+			strcpy(name, "MACINTOSH");
+		else
+			sprintf(name, "CP%u", CodePage);
+
+		*handle = bToUnicode ? iconv_open("UTF-16LE", name) : iconv_open(name, "UTF-16LE");
+
+		if (*handle == (iconv_t) -1)
+		{
+			printf("Error opening iconv converter for %s\n", name);
+			return (iconv_t) -1;
+		}
+	}
+	else
+	{
+		/* reset the shift state left by the previous conversion */
+		iconv(*handle, NULL, NULL, NULL, NULL);
+	}
+
+	return *handle;
+}
+
+/* returns the number of bytes produced, counting them if out is NULL */
+
+static int winpr_iconv_convert(iconv_t handle, const char* in, size_t inLength, char* out, size_t outLength)
+{
+	char* pin;
+	char* pout;
+	size_t obl;
+	size_t avail;
+	size_t count = 0;
+	char buffer[256];
+
+	pin = (char*) in;
+
+	do
+	{
+		avail = out ? (outLength - count) : sizeof(buffer);
+		pout = out ? (out + count) : buffer;
+		obl = avail;
+
+		if (iconv(handle, &pin, &inLength, &pout, &obl) == (size_t) -1)
+		{
+			if ((errno != E2BIG) || out)
+				return -1;
+		}
+
+		count += avail - obl;
+	}
+	while (inLength > 0);
+
+	/* stateful encodings may end with a closing shift sequence */
+
+	avail = out ? (outLength - count) : sizeof(buffer);
+	pout = out ? (out + count) : buffer;
+	obl = avail;
+
+	if (iconv(handle, NULL, NULL, &pout, &obl) == (size_t) -1)
+		return -1;
+
+	count += avail - obl;
+
+	return (int) count;
+}
+
+#endif
+
+int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, LPCSTR lpMultiByteStr,
+		int cbMultiByte, LPWSTR lpWideCharStr, int cchWideChar)
+{
+	int status;
+
+	if (!lpMultiByteStr || (cbMultiByte == 0) || (cchWideChar < 0))
+		return 0;
+
+	if (cbMultiByte < 0)
+		cbMultiByte = strlen(lpMultiByteStr) + 1;
+
+	/* a zero-sized output buffer queries the required size */
+
+	if (cchWideChar == 0)
+		lpWideCharStr = NULL;
+
+#ifdef HAVE_ICONV_H
+	if (!winpr_codepage_is_utf8(CodePage))
+	{
+		iconv_t handle = winpr_iconv_get(CodePage, TRUE);
+
+		if (handle == (iconv_t) -1)
+			return 0;
+
+		status = winpr_iconv_convert(handle, lpMultiByteStr, cbMultiByte,
+				(char*) lpWideCharStr, cchWideChar * sizeof(WCHAR));
+
+		return (status < 0) ? 0 : (status / sizeof(WCHAR));
+	}
+#else
+	if (!winpr_codepage_is_utf8(CodePage))
+		return 0;
+#endif
+
+	status = winpr_utf8_to_utf16((const BYTE*) lpMultiByteStr, cbMultiByte,
+			lpWideCharStr, cchWideChar, (dwFlags & MB_ERR_INVALID_CHARS) ? TRUE : FALSE);
+
+	return (status < 0) ? 0 : status;
+}
+
+int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, LPCWSTR lpWideCharStr, int cchWideChar,
+		LPSTR lpMultiByteStr, int cbMultiByte, LPCSTR lpDefaultChar, LPBOOL lpUsedDefaultChar)
+{
+	int status;
+
+	if (!lpWideCharStr || (cchWideChar == 0) || (cbMultiByte < 0))
+		return 0;
+
+	if (cchWideChar < 0)
+		cchWideChar = lstrlenW(lpWideCharStr) + 1;
+
+	if (cbMultiByte == 0)
+		lpMultiByteStr = NULL;
+
+	if (lpUsedDefaultChar)
+		*lpUsedDefaultChar = FALSE;
+
+#ifdef HAVE_ICONV_H
+	if (!winpr_codepage_is_utf8(CodePage))
+	{
+		iconv_t handle = winpr_iconv_get(CodePage, FALSE);
+
+		if (handle == (iconv_t) -1)
+			return 0;
+
+		status = winpr_iconv_convert(handle, (const char*) lpWideCharStr, cchWideChar * sizeof(WCHAR),
+				lpMultiByteStr, cbMultiByte);
+
+		return (status < 0) ? 0 : status;
+	}
+#else
+	if (!winpr_codepage_is_utf8(CodePage))
+		return 0;
+#endif
+
+	status = winpr_utf16_to_utf8(lpWideCharStr, cchWideChar, (BYTE*) lpMultiByteStr, cbMultiByte,
+			(dwFlags & WC_ERR_INVALID_CHARS) ? TRUE : FALSE);
+
+	return (status < 0) ? 0 : status;
+}
+
+#endif
@@ -42,6 +42,21 @@
 
 #ifndef _WIN32
 
+#include <pthread.h>
+
+/**
+ * The last error code is stored directly in a thread-specific value,
+ * so SetLastError() never allocates.
+ */
+
+static pthread_key_t winpr_last_error_key;
+static pthread_once_t winpr_last_error_once = PTHREAD_ONCE_INIT;
+
+static void winpr_last_error_init(void)
+{
+	pthread_key_create(&winpr_last_error_key, NULL);
+}
+
 UINT GetErrorMode(void)
 {
 	return 0;
@@ -54,17 +69,21 @@ UINT SetErrorMode(UINT uMode)
 
 DWORD GetLastError(VOID)
 {
-	return 0;
+	pthread_once(&winpr_last_error_once, winpr_last_error_init);
+
+	return (DWORD) (ULONG_PTR) pthread_getspecific(winpr_last_error_key);
 }
 
 VOID SetLastError(DWORD dwErrCode)
 {
+	pthread_once(&winpr_last_error_once, winpr_last_error_init);
 
+	pthread_setspecific(winpr_last_error_key, (void*) (ULONG_PTR) dwErrCode);
 }
 
 VOID RestoreLastError(DWORD dwErrCode)
 {
-
+	SetLastError(dwErrCode);
 }
 
 VOID RaiseException(DWORD dwExceptionCode, DWORD dwExceptionFlags, DWORD nNumberOfArguments, CONST ULONG_PTR* lpArguments)
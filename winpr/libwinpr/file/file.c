@@ -139,16 +139,114 @@
 #include <sys/statvfs.h>
 #endif
 
+#include "../io/io.h"
+
 HANDLE CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
 		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
 {
-	return NULL;
+	int fd;
+	int flags;
+	BOOL bRead;
+	BOOL bWrite;
+
+	bRead = (dwDesiredAccess & (GENERIC_READ | GENERIC_ALL | FILE_READ_DATA)) ? TRUE : FALSE;
+	bWrite = (dwDesiredAccess & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA)) ? TRUE : FALSE;
+
+	if (bRead && bWrite)
+		flags = O_RDWR;
+	else if (bWrite)
+		flags = O_WRONLY;
+	else
+		flags = O_RDONLY;
+
+	switch (dwCreationDisposition)
+	{
+		case CREATE_NEW:
+			flags |= O_CREAT | O_EXCL;
+			break;
+
+		case CREATE_ALWAYS:
+			flags |= O_CREAT | O_TRUNC;
+			break;
+
+		case OPEN_EXISTING:
+			break;
+
+		case OPEN_ALWAYS:
+			flags |= O_CREAT;
+			break;
+
+		case TRUNCATE_EXISTING:
+			flags |= O_TRUNC;
+			break;
+
+		default:
+			SetLastError(ERROR_INVALID_PARAMETER);
+			return INVALID_HANDLE_VALUE;
+	}
+
+	fd = open(lpFileName, flags | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+	{
+		switch (errno)
+		{
+			case ENOENT:
+				SetLastError(ERROR_FILE_NOT_FOUND);
+				break;
+
+			case EEXIST:
+				SetLastError(ERROR_FILE_EXISTS);
+				break;
+
+			case EACCES:
+			case EPERM:
+				SetLastError(ERROR_ACCESS_DENIED);
+				break;
+
+			default:
+				SetLastError(ERROR_GEN_FAILURE);
+				break;
+		}
+
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return winpr_Handle_Insert(HANDLE_TYPE_FILE, (PVOID) (ULONG_PTR) fd);
 }
 
 HANDLE CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
 		DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
 {
-	return NULL;
+	int length;
+	HANDLE handle;
+	LPSTR lpFileNameA;
+
+	length = WideCharToMultiByte(CP_UTF8, 0, lpFileName, -1, NULL, 0, NULL, NULL);
+
+	if (length < 1)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	lpFileNameA = (LPSTR) malloc(length);
+	WideCharToMultiByte(CP_UTF8, 0, lpFileName, -1, lpFileNameA, length, NULL, NULL);
+
+	handle = CreateFileA(lpFileNameA, dwDesiredAccess, dwShareMode, lpSecurityAttributes,
+			dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+
+	free(lpFileNameA);
+
+	return handle;
+}
+
+HANDLE GetFileHandleForFileDescriptor(int fd)
+{
+	if (fd < 0)
+		return INVALID_HANDLE_VALUE;
+
+	return winpr_Handle_Insert(HANDLE_TYPE_FILE, (PVOID) (ULONG_PTR) fd);
 }
 
 BOOL DeleteFileA(LPCSTR lpFileName)
@@ -170,15 +268,24 @@ BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead,
 	if (!winpr_Handle_GetInfo(hFile, &Type, &Object))
 		return FALSE;
 
-	if (Type == HANDLE_TYPE_ANONYMOUS_PIPE)
+	if ((Type == HANDLE_TYPE_ANONYMOUS_PIPE) || (Type == HANDLE_TYPE_FILE))
 	{
 		int status;
 		int read_fd;
 
 		read_fd = (int) ((ULONG_PTR) Object);
 
+		if (lpOverlapped)
+		{
+			return winpr_io_submit(hFile, read_fd, FALSE, (LPVOID) lpBuffer, nNumberOfBytesToRead,
+					lpNumberOfBytesRead, lpOverlapped);
+		}
+
 		status = read(read_fd, lpBuffer, nNumberOfBytesToRead);
 
+		if (status < 0)
+			return FALSE;
+
 		*lpNumberOfBytesRead = status;
 
 		return TRUE;
@@ -208,15 +315,24 @@ BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
 	if (!winpr_Handle_GetInfo(hFile, &Type, &Object))
 		return FALSE;
 
-	if (Type == HANDLE_TYPE_ANONYMOUS_PIPE)
+	if ((Type == HANDLE_TYPE_ANONYMOUS_PIPE) || (Type == HANDLE_TYPE_FILE))
 	{
 		int status;
 		int write_fd;
 
 		write_fd = (int) ((ULONG_PTR) Object);
 
+		if (lpOverlapped)
+		{
+			return winpr_io_submit(hFile, write_fd, TRUE, (LPVOID) lpBuffer, nNumberOfBytesToWrite,
+					lpNumberOfBytesWritten, lpOverlapped);
+		}
+
 		status = write(write_fd, lpBuffer, nNumberOfBytesToWrite);
 
+		if (status < 0)
+			return FALSE;
+
 		*lpNumberOfBytesWritten = status;
 
 		return TRUE;
@@ -26,11 +26,19 @@
 #ifndef _WIN32
 
 #include "../synch/synch.h"
+#include "../thread/thread.h"
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 
+static pfnHandleCloseHook winpr_close_hook = NULL;
+
+void winpr_Handle_SetCloseHook(pfnHandleCloseHook fnCloseHook)
+{
+	winpr_close_hook = fnCloseHook;
+}
+
 BOOL CloseHandle(HANDLE hObject)
 {
 	ULONG Type;
@@ -39,14 +47,38 @@ BOOL CloseHandle(HANDLE hObject)
 	if (!winpr_Handle_GetInfo(hObject, &Type, &Object))
 		return FALSE;
 
+	/* only one of concurrent closes of the same handle gets past this */
+
+	if (!winpr_Handle_Remove(hObject))
+		return FALSE;
+
+	if (winpr_close_hook && winpr_close_hook(hObject, Type, Object))
+		return TRUE;
+
 	if (Type == HANDLE_TYPE_THREAD)
 	{
+		BOOL exited;
+		WINPR_THREAD* thread;
+
+		thread = (WINPR_THREAD*) Object;
+
+		pthread_mutex_lock(&thread->mutex);
+		exited = thread->exited || !thread->started;
+		thread->closed = TRUE;
+		pthread_mutex_unlock(&thread->mutex);
+
+		if (exited)
+		{
+			CloseHandle(thread->hExitEvent);
+			pthread_mutex_destroy(&thread->mutex);
+			free(thread);
+		}
+
 		return TRUE;
 	}
 	else if (Type == HANDLE_TYPE_MUTEX)
 	{
 		pthread_mutex_destroy((pthread_mutex_t*) Object);
-		winpr_Handle_Remove(Object);
 		free(Object);
 
 		return TRUE;
@@ -57,7 +89,7 @@ BOOL CloseHandle(HANDLE hObject)
 
 		event = (WINPR_EVENT*) Object;
 
-		if (event->pipe_fd[0] != -1)
+		if ((event->pipe_fd[0] != -1) && !event->bAttached)
 		{
 			close(event->pipe_fd[0]);
 			event->pipe_fd[0] = -1;
@@ -68,24 +100,40 @@ BOOL CloseHandle(HANDLE hObject)
 			event->pipe_fd[1] = -1;
 		}
 
-		winpr_Handle_Remove(Object);
 		free(event);
 
 		return TRUE;
 	}
 	else if (Type == HANDLE_TYPE_SEMAPHORE)
 	{
-#if defined __APPLE__
-		semaphore_destroy(mach_task_self(), *((winpr_sem_t*) Object));
-#else
-		sem_destroy((winpr_sem_t*) Object);
-#endif
-		winpr_Handle_Remove(Object);
-		free(Object);
+		WINPR_SEMAPHORE* semaphore;
+
+		semaphore = (WINPR_SEMAPHORE*) Object;
+
+		if (semaphore->pipe_fd[0] != -1)
+			close(semaphore->pipe_fd[0]);
+
+		if (semaphore->pipe_fd[1] != -1)
+			close(semaphore->pipe_fd[1]);
+
+		free(semaphore);
+
+		return TRUE;
+	}
+	else if (Type == HANDLE_TYPE_TIMER)
+	{
+		WINPR_TIMER* timer;
+
+		timer = (WINPR_TIMER*) Object;
+
+		if (timer->fd != -1)
+			close(timer->fd);
+
+		free(timer);
 
 		return TRUE;
 	}
-	else if (Type == HANDLE_TYPE_ANONYMOUS_PIPE)
+	else if ((Type == HANDLE_TYPE_ANONYMOUS_PIPE) || (Type == HANDLE_TYPE_FILE))
 	{
 		int pipe_fd;
 
@@ -96,8 +144,6 @@ BOOL CloseHandle(HANDLE hObject)
 			close(pipe_fd);
 		}
 
-		winpr_Handle_Remove(Object);
-
 		return TRUE;
 	}
 
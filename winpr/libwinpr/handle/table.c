@@ -28,190 +28,221 @@
 
 #include <pthread.h>
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Handle values encode the index of their entry in the low
+ * HANDLE_TABLE_INDEX_BITS bits, plus one so that no handle is NULL, and the
+ * generation of the entry in the remaining bits. The generation is bumped
+ * each time an entry is freed, so that a closed handle is not mistaken for
+ * the handle later reusing its entry.
+ *
+ * Entries live in fixed-size segments which never move once allocated, so
+ * that lookups can index the table without taking the lock: an entry is
+ * valid for a handle while its Value matches the handle, which is checked
+ * before and after reading the entry. Insertions and removals are serialized
+ * by the lock and pop or push entries on a free list.
+ */
+
+#define HANDLE_TABLE_INDEX_BITS		22
+#define HANDLE_TABLE_INDEX_MASK		((1 << HANDLE_TABLE_INDEX_BITS) - 1)
+#define HANDLE_TABLE_SEGMENT_BITS	10
+#define HANDLE_TABLE_SEGMENT_SIZE	(1 << HANDLE_TABLE_SEGMENT_BITS)
+#define HANDLE_TABLE_MAX_SEGMENTS	(1 << (HANDLE_TABLE_INDEX_BITS - HANDLE_TABLE_SEGMENT_BITS))
+
+/* the last index would make the all-ones INVALID_HANDLE_VALUE */
+#define HANDLE_TABLE_MAX_COUNT		(HANDLE_TABLE_INDEX_MASK - 1)
+
+#define HANDLE_TABLE_NO_ENTRY		-1
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct _HANDLE_TABLE_ENTRY
 {
+	ULONG_PTR volatile Value;
+	ULONG_PTR Generation;
 	ULONG Type;
 	PVOID Object;
+	LONG NextFree;
 } HANDLE_TABLE_ENTRY, *PHANDLE_TABLE_ENTRY;
 
 typedef struct _HANDLE_TABLE
 {
 	LONG Count;
 	LONG MaxCount;
-	PHANDLE_TABLE_ENTRY Entries;
+	LONG FreeList;
+	PHANDLE_TABLE_ENTRY volatile Segments[HANDLE_TABLE_MAX_SEGMENTS];
 } HANDLE_TABLE, *PHANDLE_TABLE;
 
-static HANDLE_TABLE HandleTable = { 0, 0, NULL };
+static HANDLE_TABLE HandleTable = { 0, 0, HANDLE_TABLE_NO_ENTRY };
 
-#define HandleTable_GetInstance() \
-	if (HandleTable.MaxCount < 1) \
-		winpr_HandleTable_New()
+#define winpr_HandleTable_Barrier()		__sync_synchronize()
 
-void winpr_HandleTable_New()
+static PHANDLE_TABLE_ENTRY winpr_HandleTable_GetEntry(HANDLE handle)
 {
-	size_t size;
+	ULONG_PTR index;
+	PHANDLE_TABLE_ENTRY segment;
 
-	pthread_mutex_lock(&mutex);
+	index = (((ULONG_PTR) handle) & HANDLE_TABLE_INDEX_MASK) - 1;
 
-	if (HandleTable.MaxCount < 1)
-	{
-		HandleTable.Count = 0;
-		HandleTable.MaxCount = 64;
+	if (index >= (ULONG_PTR) HANDLE_TABLE_MAX_COUNT)
+		return NULL;
 
-		size = sizeof(HANDLE_TABLE_ENTRY) * HandleTable.MaxCount;
+	segment = HandleTable.Segments[index >> HANDLE_TABLE_SEGMENT_BITS];
 
-		HandleTable.Entries = (PHANDLE_TABLE_ENTRY) malloc(size);
-		ZeroMemory(HandleTable.Entries, size);
-	}
+	if (!segment)
+		return NULL;
 
-	pthread_mutex_unlock(&mutex);
+	return &segment[index & (HANDLE_TABLE_SEGMENT_SIZE - 1)];
 }
 
-void winpr_HandleTable_Grow()
+/* called with the lock held */
+
+static BOOL winpr_HandleTable_Grow()
 {
-	size_t size;
+	LONG index;
+	PHANDLE_TABLE_ENTRY segment;
 
-	pthread_mutex_lock(&mutex);
+	if (HandleTable.MaxCount + HANDLE_TABLE_SEGMENT_SIZE > HANDLE_TABLE_MAX_COUNT)
+		return FALSE;
 
-	HandleTable.MaxCount *= 2;
+	segment = (PHANDLE_TABLE_ENTRY) calloc(HANDLE_TABLE_SEGMENT_SIZE, sizeof(HANDLE_TABLE_ENTRY));
 
-	size = sizeof(HANDLE_TABLE_ENTRY) * HandleTable.MaxCount;
+	if (!segment)
+		return FALSE;
 
-	HandleTable.Entries = (PHANDLE_TABLE_ENTRY) realloc(HandleTable.Entries, size);
-	ZeroMemory((void*) &HandleTable.Entries[HandleTable.MaxCount / 2], size / 2);
+	/* chain the new entries in index order in front of the free list */
 
-	pthread_mutex_unlock(&mutex);
-}
+	for (index = 0; index < HANDLE_TABLE_SEGMENT_SIZE - 1; index++)
+		segment[index].NextFree = HandleTable.MaxCount + index + 1;
 
-void winpr_HandleTable_Free()
-{
-	pthread_mutex_lock(&mutex);
+	segment[HANDLE_TABLE_SEGMENT_SIZE - 1].NextFree = HandleTable.FreeList;
+	HandleTable.FreeList = HandleTable.MaxCount;
 
-	HandleTable.Count = 0;
-	HandleTable.MaxCount = 0;
+	/* publish the zeroed segment before lookups can index it */
+	winpr_HandleTable_Barrier();
 
-	free(HandleTable.Entries);
-	HandleTable.Entries = NULL;
+	HandleTable.Segments[HandleTable.MaxCount >> HANDLE_TABLE_SEGMENT_BITS] = segment;
+	HandleTable.MaxCount += HANDLE_TABLE_SEGMENT_SIZE;
 
-	pthread_mutex_unlock(&mutex);
+	return TRUE;
 }
 
 HANDLE winpr_Handle_Insert(ULONG Type, PVOID Object)
 {
-	int index;
-
-	HandleTable_GetInstance();
+	LONG index;
+	ULONG_PTR value;
+	PHANDLE_TABLE_ENTRY entry;
 
 	pthread_mutex_lock(&mutex);
 
-	for (index = 0; index < (int) HandleTable.MaxCount; index++)
+	if ((HandleTable.FreeList == HANDLE_TABLE_NO_ENTRY) && !winpr_HandleTable_Grow())
 	{
-		if (HandleTable.Entries[index].Object == NULL)
-		{
-			HandleTable.Count++;
+		pthread_mutex_unlock(&mutex);
+		return NULL;
+	}
 
-			HandleTable.Entries[index].Type = Type;
-			HandleTable.Entries[index].Object = Object;
+	index = HandleTable.FreeList;
+	entry = &HandleTable.Segments[index >> HANDLE_TABLE_SEGMENT_BITS][index & (HANDLE_TABLE_SEGMENT_SIZE - 1)];
 
-			pthread_mutex_unlock(&mutex);
+	HandleTable.FreeList = entry->NextFree;
+	HandleTable.Count++;
 
-			return Object;
-		}
-	}
+	entry->Type = Type;
+	entry->Object = Object;
 
-	pthread_mutex_unlock(&mutex);
+	value = (entry->Generation << HANDLE_TABLE_INDEX_BITS) | (ULONG_PTR) (index + 1);
 
-	/* no available entry was found, the table needs to be grown */
+	/* the entry must be complete before its handle matches */
+	winpr_HandleTable_Barrier();
 
-	winpr_HandleTable_Grow();
+	entry->Value = value;
 
-	/* the next call should now succeed */
+	pthread_mutex_unlock(&mutex);
 
-	return winpr_Handle_Insert(Type, Object);
+	return (HANDLE) value;
 }
 
 BOOL winpr_Handle_Remove(HANDLE handle)
 {
-	int index;
-
-	HandleTable_GetInstance();
+	LONG index;
+	PHANDLE_TABLE_ENTRY entry;
 
 	pthread_mutex_lock(&mutex);
 
-	for (index = 0; index < (int) HandleTable.MaxCount; index++)
+	entry = winpr_HandleTable_GetEntry(handle);
+
+	if (!entry || (entry->Value != (ULONG_PTR) handle))
 	{
-		if (HandleTable.Entries[index].Object == handle)
-		{
-			HandleTable.Entries[index].Type = HANDLE_TYPE_NONE;
-			HandleTable.Entries[index].Object = NULL;
-			HandleTable.Count--;
+		pthread_mutex_unlock(&mutex);
+		return FALSE;
+	}
 
-			pthread_mutex_unlock(&mutex);
+	index = (LONG) ((((ULONG_PTR) handle) & HANDLE_TABLE_INDEX_MASK) - 1);
 
-			return TRUE;
-		}
-	}
+	entry->Value = 0;
+
+	/* lookups still reading the entry see it changed under them */
+	winpr_HandleTable_Barrier();
+
+	entry->Type = HANDLE_TYPE_NONE;
+	entry->Object = NULL;
+	entry->Generation = (entry->Generation + 1) & (((ULONG_PTR) -1) >> HANDLE_TABLE_INDEX_BITS);
+
+	entry->NextFree = HandleTable.FreeList;
+	HandleTable.FreeList = index;
+	HandleTable.Count--;
 
 	pthread_mutex_unlock(&mutex);
 
-	return FALSE;
+	return TRUE;
 }
 
-ULONG winpr_Handle_GetType(HANDLE handle)
+BOOL winpr_Handle_GetInfo(HANDLE handle, ULONG* pType, PVOID* pObject)
 {
-	int index;
+	ULONG Type;
+	PVOID Object;
+	PHANDLE_TABLE_ENTRY entry;
 
-	HandleTable_GetInstance();
+	entry = winpr_HandleTable_GetEntry(handle);
 
-	pthread_mutex_lock(&mutex);
+	if (!entry || (entry->Value != (ULONG_PTR) handle))
+		return FALSE;
 
-	for (index = 0; index < (int) HandleTable.MaxCount; index++)
-	{
-		if (HandleTable.Entries[index].Object == handle)
-		{
-			pthread_mutex_unlock(&mutex);
-			return HandleTable.Entries[index].Type;
-		}
-	}
+	winpr_HandleTable_Barrier();
 
-	pthread_mutex_unlock(&mutex);
+	Type = entry->Type;
+	Object = entry->Object;
 
-	return HANDLE_TYPE_NONE;
-}
+	winpr_HandleTable_Barrier();
 
-PVOID winpr_Handle_GetObject(HANDLE handle)
-{
-	HandleTable_GetInstance();
+	if (entry->Value != (ULONG_PTR) handle)
+		return FALSE;
+
+	*pType = Type;
+	*pObject = Object;
 
-	return handle;
+	return TRUE;
 }
 
-BOOL winpr_Handle_GetInfo(HANDLE handle, ULONG* pType, PVOID* pObject)
+ULONG winpr_Handle_GetType(HANDLE handle)
 {
-	int index;
-
-	HandleTable_GetInstance();
-
-	pthread_mutex_lock(&mutex);
+	ULONG Type;
+	PVOID Object;
 
-	for (index = 0; index < (int) HandleTable.MaxCount; index++)
-	{
-		if (HandleTable.Entries[index].Object == handle)
-		{
-			*pType = HandleTable.Entries[index].Type;
-			*pObject = HandleTable.Entries[index].Object;
+	if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+		return HANDLE_TYPE_NONE;
 
-			pthread_mutex_unlock(&mutex);
+	return Type;
+}
 
-			return TRUE;
-		}
-	}
+PVOID winpr_Handle_GetObject(HANDLE handle)
+{
+	ULONG Type;
+	PVOID Object;
 
-	pthread_mutex_unlock(&mutex);
+	if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+		return NULL;
 
-	return FALSE;
+	return Object;
 }
 
 #endif
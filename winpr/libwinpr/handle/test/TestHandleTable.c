@@ -0,0 +1,121 @@
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/handle.h>
+
+#define TEST_HANDLE_COUNT		20000
+#define TEST_HANDLE_READERS		4
+#define TEST_HANDLE_LOOKUPS		1000000
+
+static HANDLE handles[TEST_HANDLE_COUNT];
+static int objects[TEST_HANDLE_COUNT];
+static BOOL mismatch = FALSE;
+
+static void* test_handle_reader(void* arg)
+{
+	int index;
+	ULONG Type;
+	PVOID Object;
+
+	for (index = 0; index < TEST_HANDLE_LOOKUPS; index++)
+	{
+		/* the first half of the handles is never removed */
+
+		if (!winpr_Handle_GetInfo(handles[index % (TEST_HANDLE_COUNT / 2)], &Type, &Object) ||
+				(Object != &objects[index % (TEST_HANDLE_COUNT / 2)]))
+		{
+			mismatch = TRUE;
+		}
+	}
+
+	return NULL;
+}
+
+int TestHandleTable(int argc, char* argv[])
+{
+	int index;
+	ULONG Type;
+	PVOID Object;
+	HANDLE stale;
+	long usec;
+	struct timeval start;
+	struct timeval end;
+	pthread_t threads[TEST_HANDLE_READERS];
+
+	for (index = 0; index < TEST_HANDLE_COUNT; index++)
+	{
+		handles[index] = winpr_Handle_Insert(HANDLE_TYPE_EVENT, &objects[index]);
+
+		if (!handles[index] || (handles[index] == INVALID_HANDLE_VALUE))
+		{
+			printf("winpr_Handle_Insert failed\n");
+			return -1;
+		}
+	}
+
+	for (index = 0; index < TEST_HANDLE_COUNT; index++)
+	{
+		if (!winpr_Handle_GetInfo(handles[index], &Type, &Object) ||
+				(Type != HANDLE_TYPE_EVENT) || (Object != &objects[index]))
+		{
+			printf("winpr_Handle_GetInfo failed for handle %d\n", index);
+			return -1;
+		}
+	}
+
+	/* a removed handle stays invalid after its entry is reused */
+
+	stale = handles[TEST_HANDLE_COUNT - 1];
+
+	if (!winpr_Handle_Remove(stale) || winpr_Handle_Remove(stale))
+	{
+		printf("winpr_Handle_Remove: handle removed twice\n");
+		return -1;
+	}
+
+	handles[TEST_HANDLE_COUNT - 1] = winpr_Handle_Insert(HANDLE_TYPE_MUTEX, &objects[TEST_HANDLE_COUNT - 1]);
+
+	if ((handles[TEST_HANDLE_COUNT - 1] == stale) || (winpr_Handle_GetType(stale) != HANDLE_TYPE_NONE) ||
+			(winpr_Handle_GetType(handles[TEST_HANDLE_COUNT - 1]) != HANDLE_TYPE_MUTEX))
+	{
+		printf("stale handle still valid after its entry was reused\n");
+		return -1;
+	}
+
+	/* lookups run concurrently with insertions and removals */
+
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < TEST_HANDLE_READERS; index++)
+		pthread_create(&threads[index], NULL, test_handle_reader, NULL);
+
+	for (index = TEST_HANDLE_COUNT / 2; index < TEST_HANDLE_COUNT; index++)
+	{
+		winpr_Handle_Remove(handles[index]);
+		handles[index] = winpr_Handle_Insert(HANDLE_TYPE_EVENT, &objects[index]);
+	}
+
+	for (index = 0; index < TEST_HANDLE_READERS; index++)
+		pthread_join(threads[index], NULL);
+
+	gettimeofday(&end, NULL);
+	usec = ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+
+	if (mismatch)
+	{
+		printf("concurrent lookup returned a wrong object\n");
+		return -1;
+	}
+
+	printf("%d lookups by %d threads among %d handles in %ld us\n",
+			TEST_HANDLE_LOOKUPS * TEST_HANDLE_READERS, TEST_HANDLE_READERS, TEST_HANDLE_COUNT, usec);
+
+	for (index = 0; index < TEST_HANDLE_COUNT; index++)
+		winpr_Handle_Remove(handles[index]);
+
+	return 0;
+}
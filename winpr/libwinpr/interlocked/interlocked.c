@@ -33,6 +33,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * The list head is swapped as a whole with a single compare-and-exchange:
+ * 64-bit on 32-bit systems, 128-bit (cmpxchg16b) on 64-bit systems, where
+ * the entry pointer, depth and sequence do not fit in 64 bits. The sequence
+ * is bumped on every change so that a head that was popped and pushed back
+ * in between is not mistaken for an unchanged one. A failed exchange leaves
+ * the current head in the comparand, so the loops below read it only once.
+ */
+
+#ifdef _WIN64
+
+#define SListFirstEntry(_header)		((PSLIST_ENTRY) (((ULONG_PTR) (_header).HeaderX64.NextEntry) << 4))
+#define SListSetFirstEntry(_header, _entry)	(_header).HeaderX64.NextEntry = (((ULONG_PTR) (_entry)) >> 4)
+#define SListDepth(_header)			(_header).HeaderX64.Depth
+#define SListSequence(_header)			(_header).HeaderX64.Sequence
+
+static BOOL SListExchange(PSLIST_HEADER ListHead, PSLIST_HEADER Old, PSLIST_HEADER New)
+{
+	return InterlockedCompareExchange128((LONGLONG*) ListHead,
+			New->s.Region, New->s.Alignment, (LONGLONG*) Old);
+}
+
+#else
+
+#define SListFirstEntry(_header)		((_header).s.Next.Next)
+#define SListSetFirstEntry(_header, _entry)	(_header).s.Next.Next = (_entry)
+#define SListDepth(_header)			(_header).s.Depth
+#define SListSequence(_header)			(_header).s.Sequence
+
+static BOOL SListExchange(PSLIST_HEADER ListHead, PSLIST_HEADER Old, PSLIST_HEADER New)
+{
+	LONGLONG previous;
+
+	previous = InterlockedCompareExchange64((LONGLONG*) &ListHead->Alignment, New->Alignment, Old->Alignment);
+
+	if (previous == (LONGLONG) Old->Alignment)
+		return TRUE;
+
+	Old->Alignment = previous;
+
+	return FALSE;
+}
+
+#endif
+
 VOID InitializeSListHead(PSLIST_HEADER ListHead)
 {
 #ifdef _WIN64
@@ -46,53 +91,32 @@ VOID InitializeSListHead(PSLIST_HEADER ListHead)
 
 PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER ListHead, PSLIST_ENTRY ListEntry)
 {
-	SLIST_HEADER old;
-	SLIST_HEADER new;
-
-#ifdef _WIN64
-	new.HeaderX64.NextEntry = (((ULONG_PTR) ListEntry) >> 4);
-
-	while (1)
-	{
-		old = *ListHead;
-
-		ListEntry->Next = (PSLIST_ENTRY) (((ULONG_PTR) old.HeaderX64.NextEntry) << 4);
+	return InterlockedPushListSListEx(ListHead, ListEntry, ListEntry, 1);
+}
 
-		new.HeaderX64.Depth = old.HeaderX64.Depth + 1;
-		new.HeaderX64.Sequence = old.HeaderX64.Sequence + 1;
+/**
+ * Pushes the chain of Count entries from List to ListEnd, already linked
+ * through their Next pointers, with a single exchange. List ends up first.
+ */
 
-		if (InterlockedCompareExchange64((LONGLONG*) ListHead, new.s.Alignment, old.s.Alignment))
-		{
-			InterlockedCompareExchange64(&((LONGLONG*) ListHead)[1], new.s.Region, old.s.Region);
-			break;
-		}
-	}
+PSLIST_ENTRY InterlockedPushListSListEx(PSLIST_HEADER ListHead, PSLIST_ENTRY List, PSLIST_ENTRY ListEnd, ULONG Count)
+{
+	SLIST_HEADER old;
+	SLIST_HEADER new;
 
-	return (PSLIST_ENTRY) ((ULONG_PTR) old.HeaderX64.NextEntry << 4);
-#else
-	new.s.Next.Next = ListEntry;
+	old = *ListHead;
 
 	do
 	{
-		old = *ListHead;
-		ListEntry->Next = old.s.Next.Next;
-		new.s.Depth = old.s.Depth + 1;
-		new.s.Sequence = old.s.Sequence + 1;
+		new = old;
+		ListEnd->Next = SListFirstEntry(old);
+		SListSetFirstEntry(new, List);
+		SListDepth(new) = SListDepth(old) + Count;
+		SListSequence(new) = SListSequence(old) + 1;
 	}
-	while(InterlockedCompareExchange64((LONGLONG*) &ListHead->Alignment, new.Alignment, old.Alignment) != old.Alignment);
+	while (!SListExchange(ListHead, &old, &new));
 
-	return old.s.Next.Next;
-#endif
-}
-
-PSLIST_ENTRY InterlockedPushListSListEx(PSLIST_HEADER ListHead, PSLIST_ENTRY List, PSLIST_ENTRY ListEnd, ULONG Count)
-{
-#ifdef _WIN64
-
-#else
-
-#endif
-	return NULL;
+	return SListFirstEntry(old);
 }
 
 PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER ListHead)
@@ -101,42 +125,22 @@ PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER ListHead)
 	SLIST_HEADER new;
 	PSLIST_ENTRY entry;
 
-#ifdef _WIN64
-	while (1)
-	{
-		old = *ListHead;
-
-		entry = (PSLIST_ENTRY) (((ULONG_PTR) old.HeaderX64.NextEntry) << 4);
+	old = *ListHead;
 
-		if (!entry)
-			return NULL;
-
-		new.HeaderX64.NextEntry = ((ULONG_PTR) entry->Next) >> 4;
-		new.HeaderX64.Depth = old.HeaderX64.Depth - 1;
-		new.HeaderX64.Sequence = old.HeaderX64.Sequence - 1;
-
-		if (InterlockedCompareExchange64((LONGLONG*) ListHead, new.s.Alignment, old.s.Alignment))
-		{
-			InterlockedCompareExchange64(&((LONGLONG*) ListHead)[1], new.s.Region, old.s.Region);
-			break;
-		}
-	}
-#else
 	do
 	{
-		old = *ListHead;
-
-		entry = old.s.Next.Next;
+		entry = SListFirstEntry(old);
 
 		if (!entry)
 			return NULL;
 
-		new.s.Next.Next = entry->Next;
-		new.s.Depth = old.s.Depth - 1;
-		new.s.Sequence = old.s.Sequence + 1;
+		new = old;
+		SListSetFirstEntry(new, entry->Next);
+		SListDepth(new) = SListDepth(old) - 1;
+		SListSequence(new) = SListSequence(old) + 1;
 	}
-	while(InterlockedCompareExchange64((LONGLONG*) &ListHead->Alignment, new.Alignment, old.Alignment) != old.Alignment);
-#endif
+	while (!SListExchange(ListHead, &old, &new));
+
 	return entry;
 }
 
@@ -145,39 +149,21 @@ PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER ListHead)
 	SLIST_HEADER old;
 	SLIST_HEADER new;
 
-	if (!QueryDepthSList(ListHead))
-		return NULL;
-
-#ifdef _WIN64
-	new.s.Alignment = 0;
-	new.s.Region = 0;
-	new.HeaderX64.HeaderType = 1;
-
-	while (1)
-	{
-		old = *ListHead;
-		new.HeaderX64.Sequence = old.HeaderX64.Sequence + 1;
-
-		if (InterlockedCompareExchange64((LONGLONG*) ListHead, new.s.Alignment, old.s.Alignment))
-		{
-			InterlockedCompareExchange64(&((LONGLONG*) ListHead)[1], new.s.Region, old.s.Region);
-			break;
-		}
-	}
-
-	return (PSLIST_ENTRY) (((ULONG_PTR) old.HeaderX64.NextEntry) << 4);
-#else
-	new.Alignment = 0;
+	old = *ListHead;
 
 	do
 	{
-		old = *ListHead;
-		new.s.Sequence = old.s.Sequence + 1;
+		if (!SListFirstEntry(old))
+			return NULL;
+
+		new = old;
+		SListSetFirstEntry(new, NULL);
+		SListDepth(new) = 0;
+		SListSequence(new) = SListSequence(old) + 1;
 	}
-	while(InterlockedCompareExchange64((LONGLONG*) &ListHead->Alignment, new.Alignment, old.Alignment) != old.Alignment);
+	while (!SListExchange(ListHead, &old, &new));
 
-	return old.s.Next.Next;
-#endif
+	return SListFirstEntry(old);
 }
 
 USHORT QueryDepthSList(PSLIST_HEADER ListHead)
@@ -234,6 +220,51 @@ LONG InterlockedCompareExchange(LONG volatile *Destination, LONG Exchange, LONG
 #endif
 }
 
+#ifdef _WIN64
+
+/**
+ * Destination must be 16-byte aligned. ComparandResult holds the low and
+ * high halves of the comparand, and receives the previous value on failure.
+ */
+
+BOOL InterlockedCompareExchange128(LONGLONG volatile *Destination, LONGLONG ExchangeHigh, LONGLONG ExchangeLow, LONGLONG* ComparandResult)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+	BYTE result;
+
+	__asm__ __volatile__ ("lock; cmpxchg16b %1\n\tsetz %0"
+			: "=q" (result), "+m" (*((volatile __int128*) Destination)),
+			  "+a" (ComparandResult[0]), "+d" (ComparandResult[1])
+			: "b" (ExchangeLow), "c" (ExchangeHigh)
+			: "memory", "cc");
+
+	return (BOOL) result;
+#elif defined(__GNUC__)
+	unsigned __int128 comparand;
+	unsigned __int128 exchange;
+	unsigned __int128 previous;
+
+	comparand = (((unsigned __int128) (ULONGLONG) ComparandResult[1]) << 64) | (ULONGLONG) ComparandResult[0];
+	exchange = (((unsigned __int128) (ULONGLONG) ExchangeHigh) << 64) | (ULONGLONG) ExchangeLow;
+
+	previous = __sync_val_compare_and_swap((volatile unsigned __int128*) Destination, comparand, exchange);
+
+	if (previous == comparand)
+		return TRUE;
+
+	ComparandResult[0] = (LONGLONG) previous;
+	ComparandResult[1] = (LONGLONG) (previous >> 64);
+
+	return FALSE;
+#elif defined(_MSC_VER)
+	return (BOOL) _InterlockedCompareExchange128(Destination, ExchangeHigh, ExchangeLow, ComparandResult);
+#else
+#error "InterlockedCompareExchange128 needs a 128-bit compare-and-exchange on this compiler"
+#endif
+}
+
+#endif
+
 #endif /* _WIN32 */
 
 #if (_WIN32 && (_WIN32_WINNT < 0x0502))
@@ -306,6 +337,31 @@ LONGLONG InterlockedCompareExchange64(LONGLONG volatile *Destination, LONGLONG E
 
 #endif
 
+/**
+ * WinPR extension: flushes the list like InterlockedFlushSList(), but
+ * returns the entries in the order they were pushed, so that a consumer
+ * can drain a list used as a queue in FIFO order with one exchange.
+ */
+
+PSLIST_ENTRY InterlockedFlushSListFifo(PSLIST_HEADER ListHead)
+{
+	PSLIST_ENTRY next;
+	PSLIST_ENTRY entry;
+	PSLIST_ENTRY first = NULL;
+
+	entry = InterlockedFlushSList(ListHead);
+
+	while (entry)
+	{
+		next = entry->Next;
+		entry->Next = first;
+		first = entry;
+		entry = next;
+	}
+
+	return first;
+}
+
 /* Doubly-Linked List */
 
 /**
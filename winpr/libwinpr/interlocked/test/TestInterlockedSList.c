@@ -1,5 +1,7 @@
 
 #include <stdio.h>
+#include <pthread.h>
+
 #include <winpr/crt.h>
 #include <winpr/windows.h>
 #include <winpr/interlocked.h>
@@ -10,6 +12,29 @@ typedef struct _PROGRAM_ITEM
 	ULONG Signature;
 } PROGRAM_ITEM, *PPROGRAM_ITEM;
 
+#define TEST_SLIST_THREADS		4
+#define TEST_SLIST_ITEMS		64
+#define TEST_SLIST_ITERATIONS		100000
+
+static PSLIST_HEADER pSharedHead;
+static PPROGRAM_ITEM pSharedItems[TEST_SLIST_ITEMS];
+
+static void* test_slist_thread(void* arg)
+{
+	int index;
+	PSLIST_ENTRY pEntry;
+
+	for (index = 0; index < TEST_SLIST_ITERATIONS; index++)
+	{
+		pEntry = InterlockedPopEntrySList(pSharedHead);
+
+		if (pEntry)
+			InterlockedPushEntrySList(pSharedHead, pEntry);
+	}
+
+	return NULL;
+}
+
 int TestInterlockedSList(int argc, char* argv[])
 {
 	ULONG Count;
@@ -78,7 +103,117 @@ int TestInterlockedSList(int argc, char* argv[])
 		return -1;
 	}
 
+	/* Batch insertion and flushing in push order. */
+	for (Count = 1; Count <= 10; Count += 1)
+	{
+		pProgramItem = (PPROGRAM_ITEM) _aligned_malloc(sizeof(PROGRAM_ITEM), MEMORY_ALLOCATION_ALIGNMENT);
+		pProgramItem->Signature = Count;
+
+		if (Count == 1)
+			pFirstEntry = &(pProgramItem->ItemEntry);
+		else
+			pListEntry->Next = &(pProgramItem->ItemEntry);
+
+		pListEntry = &(pProgramItem->ItemEntry);
+		pListEntry->Next = NULL;
+	}
+
+	InterlockedPushListSListEx(pListHead, pFirstEntry, pListEntry, 10);
+
+	if (QueryDepthSList(pListHead) != 10)
+	{
+		printf("QueryDepthSList: Actual: %d, Expected: %d\n", (int) QueryDepthSList(pListHead), 10);
+		return -1;
+	}
+
+	pProgramItem = (PPROGRAM_ITEM) InterlockedPopEntrySList(pListHead);
+
+	if (pProgramItem->Signature != 1)
+	{
+		printf("InterlockedPushListSListEx: first entry is %d\n", (int) pProgramItem->Signature);
+		return -1;
+	}
+
+	_aligned_free(pProgramItem);
+
+	pListEntry = InterlockedFlushSListFifo(pListHead);
+
+	for (Count = 10; Count >= 2; Count -= 1)
+	{
+		pProgramItem = (PPROGRAM_ITEM) pListEntry;
+
+		if (!pProgramItem || (pProgramItem->Signature != Count))
+		{
+			printf("InterlockedFlushSListFifo: entry out of order, expected %d\n", (int) Count);
+			return -1;
+		}
+
+		pListEntry = pListEntry->Next;
+		_aligned_free(pProgramItem);
+	}
+
+	if (pListEntry || QueryDepthSList(pListHead))
+	{
+		printf("InterlockedFlushSListFifo left entries behind\n");
+		return -1;
+	}
+
 	_aligned_free(pListHead);
 
+	/* Concurrent pops and pushes neither lose nor duplicate entries. */
+	pSharedHead = (PSLIST_HEADER) _aligned_malloc(sizeof(SLIST_HEADER), MEMORY_ALLOCATION_ALIGNMENT);
+	InitializeSListHead(pSharedHead);
+
+	for (Count = 0; Count < TEST_SLIST_ITEMS; Count += 1)
+	{
+		pProgramItem = (PPROGRAM_ITEM) _aligned_malloc(sizeof(PROGRAM_ITEM), MEMORY_ALLOCATION_ALIGNMENT);
+		pProgramItem->Signature = 0;
+		pSharedItems[Count] = pProgramItem;
+		InterlockedPushEntrySList(pSharedHead, &(pProgramItem->ItemEntry));
+	}
+
+	{
+		pthread_t threads[TEST_SLIST_THREADS];
+
+		for (Count = 0; Count < TEST_SLIST_THREADS; Count += 1)
+			pthread_create(&threads[Count], NULL, test_slist_thread, NULL);
+
+		for (Count = 0; Count < TEST_SLIST_THREADS; Count += 1)
+			pthread_join(threads[Count], NULL);
+	}
+
+	if (QueryDepthSList(pSharedHead) != TEST_SLIST_ITEMS)
+	{
+		printf("QueryDepthSList: Actual: %d, Expected: %d\n", (int) QueryDepthSList(pSharedHead), TEST_SLIST_ITEMS);
+		return -1;
+	}
+
+	pListEntry = InterlockedFlushSList(pSharedHead);
+
+	for (Count = 0; pListEntry; Count += 1)
+	{
+		pProgramItem = (PPROGRAM_ITEM) pListEntry;
+
+		if (pProgramItem->Signature != 0)
+		{
+			printf("entry found twice in the list\n");
+			return -1;
+		}
+
+		pProgramItem->Signature = 1;
+		pListEntry = pListEntry->Next;
+	}
+
+	if (Count != TEST_SLIST_ITEMS)
+	{
+		printf("list holds %d entries, expected %d\n", (int) Count, TEST_SLIST_ITEMS);
+		return -1;
+	}
+
+	for (Count = 0; Count < TEST_SLIST_ITEMS; Count += 1)
+		_aligned_free(pSharedItems[Count]);
+
+	_aligned_free(pSharedHead);
+
 	return 0;
 }
@@ -40,13 +40,926 @@
 
 #ifndef _WIN32
 
-BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED lpOverlapped, LPDWORD lpNumberOfBytesTransferred, BOOL bWait)
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_EPOLL_H) && defined(HAVE_EVENTFD_H)
+#define WINPR_IO_EPOLL	1
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/synch.h>
+#include <winpr/handle.h>
+
+#include "io.h"
+
+#define WINPR_IO_MAX_EVENTS	64
+
+/**
+ * Bindings are indexed by file descriptor. The table lock is only held
+ * long enough to find a binding and lock its port, so lookups on
+ * different ports do not contend on anything else.
+ */
+
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+static WINPR_IO_BINDING** io_bindings = NULL;
+static int io_bindings_size = 0;
+
+static BOOL winpr_io_close_hook(HANDLE handle, ULONG Type, PVOID Object);
+
+static void winpr_io_init(void)
 {
+	winpr_Handle_SetCloseHook(winpr_io_close_hook);
+}
+
+static int winpr_io_get_fd(HANDLE hFile)
+{
+	ULONG Type;
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(hFile, &Type, &Object))
+		return -1;
+
+	if ((Type != HANDLE_TYPE_ANONYMOUS_PIPE) && (Type != HANDLE_TYPE_FILE))
+		return -1;
+
+	return (int) ((ULONG_PTR) Object);
+}
+
+static DWORD winpr_io_error(int error)
+{
+	switch (error)
+	{
+		case EPIPE:
+			return ERROR_BROKEN_PIPE;
+
+		case ECONNRESET:
+		case ECONNABORTED:
+			return ERROR_NETNAME_DELETED;
+
+		case EBADF:
+			return ERROR_INVALID_HANDLE;
+
+		case ENOMEM:
+			return ERROR_NOT_ENOUGH_MEMORY;
+
+		case EINVAL:
+			return ERROR_INVALID_PARAMETER;
+
+		default:
+			return ERROR_GEN_FAILURE;
+	}
+}
+
+static void winpr_io_deadline(struct timespec* ts, DWORD dwMilliseconds)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+
+	ts->tv_sec += dwMilliseconds / 1000;
+	ts->tv_nsec += (dwMilliseconds % 1000) * 1000000;
+
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static DWORD winpr_io_remaining(struct timespec* deadline, DWORD dwMilliseconds)
+{
+	LONGLONG remaining;
+	struct timespec now;
+
+	if (dwMilliseconds == INFINITE)
+		return INFINITE;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	remaining = ((LONGLONG) (deadline->tv_sec - now.tv_sec)) * 1000;
+	remaining += (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+	return (remaining > 0) ? (DWORD) remaining : 0;
+}
+
+/* port, must be called with the port lock held unless noted */
+
+static WINPR_IO_PACKET* winpr_io_packet_new(WINPR_COMPLETION_PORT* port)
+{
+	WINPR_IO_PACKET* packet = port->FreeList;
+
+	if (packet)
+		port->FreeList = packet->Next;
+	else
+		packet = (WINPR_IO_PACKET*) malloc(sizeof(WINPR_IO_PACKET));
+
+	if (!packet)
+	{
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return NULL;
+	}
+
+	ZeroMemory(packet, sizeof(WINPR_IO_PACKET));
+
+	return packet;
+}
+
+static void winpr_io_packet_free(WINPR_COMPLETION_PORT* port, WINPR_IO_PACKET* packet)
+{
+	packet->Next = port->FreeList;
+	port->FreeList = packet;
+}
+
+static void winpr_io_port_wake(WINPR_COMPLETION_PORT* port)
+{
+	if (port->Waiting)
+	{
+		pthread_cond_signal(&port->Cond);
+		return;
+	}
+
+#ifdef WINPR_IO_EPOLL
+	if (port->Polling && !port->Signaled)
+	{
+		eventfd_write(port->event_fd, 1);
+		port->Signaled = TRUE;
+	}
+#endif
+}
+
+static void winpr_io_port_push(WINPR_COMPLETION_PORT* port, WINPR_IO_PACKET* packet)
+{
+	packet->Next = NULL;
+
+	if (port->Tail)
+		port->Tail->Next = packet;
+	else
+		port->Head = packet;
+
+	port->Tail = packet;
+
+	winpr_io_port_wake(port);
+}
+
+static void winpr_io_complete(WINPR_COMPLETION_PORT* port, WINPR_IO_PACKET* packet)
+{
+	LPOVERLAPPED lpOverlapped = packet->lpOverlapped;
+
+	lpOverlapped->InternalHigh = packet->NumberOfBytesTransferred;
+	lpOverlapped->Internal = packet->Error;
+
+	winpr_io_port_push(port, packet);
+
+	if (lpOverlapped->hEvent)
+		SetEvent(lpOverlapped->hEvent);
+
+	if (port->Observers)
+		pthread_cond_broadcast(&port->Done);
+}
+
+static void winpr_io_port_free(WINPR_COMPLETION_PORT* port)
+{
+	WINPR_IO_PACKET* packet;
+	WINPR_IO_BINDING* binding;
+
+	while ((packet = port->Head) != NULL)
+	{
+		port->Head = packet->Next;
+		free(packet);
+	}
+
+	while ((packet = port->FreeList) != NULL)
+	{
+		port->FreeList = packet->Next;
+		free(packet);
+	}
+
+	while ((binding = port->Dead) != NULL)
+	{
+		port->Dead = binding->NextDead;
+		free(binding);
+	}
+
+#ifdef WINPR_IO_EPOLL
+	close(port->epoll_fd);
+	close(port->event_fd);
+#endif
+
+	pthread_cond_destroy(&port->Done);
+	pthread_cond_destroy(&port->Cond);
+	pthread_mutex_destroy(&port->Mutex);
+	free(port);
+}
+
+/* called with the port lock held, unlocks it */
+
+static void winpr_io_port_release(WINPR_COMPLETION_PORT* port)
+{
+	BOOL last = (--port->RefCount == 0);
+
+	pthread_mutex_unlock(&port->Mutex);
+
+	if (last)
+		winpr_io_port_free(port);
+}
+
+/**
+ * Try to make progress on a request: returns FALSE if the descriptor
+ * would block, TRUE once the request is complete (successfully or not).
+ */
+
+static BOOL winpr_io_attempt(WINPR_IO_BINDING* binding, WINPR_IO_PACKET* packet, BOOL bWrite)
+{
+	ssize_t status;
+
+	for (;;)
+	{
+		if (bWrite)
+		{
+			status = write(binding->fd, &packet->Buffer[packet->NumberOfBytesTransferred],
+					packet->Length - packet->NumberOfBytesTransferred);
+		}
+		else if (packet->Length > 0)
+		{
+			status = read(binding->fd, packet->Buffer, packet->Length);
+		}
+		else
+		{
+			/* zero-byte reads complete once data is available */
+
+			struct pollfd pfd;
+
+			pfd.fd = binding->fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+
+			return (poll(&pfd, 1, 0) > 0);
+		}
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return FALSE;
+
+			packet->Error = winpr_io_error(errno);
+			return TRUE;
+		}
+
+		if (!bWrite)
+		{
+			if ((status == 0) && (binding->Type == HANDLE_TYPE_ANONYMOUS_PIPE))
+				packet->Error = ERROR_BROKEN_PIPE;
+
+			packet->NumberOfBytesTransferred = status;
+			return TRUE;
+		}
+
+		packet->NumberOfBytesTransferred += status;
+
+		if (packet->NumberOfBytesTransferred >= packet->Length)
+			return TRUE;
+	}
+}
+
+static void winpr_io_drive(WINPR_COMPLETION_PORT* port, WINPR_IO_BINDING* binding, BOOL bWrite)
+{
+	WINPR_IO_PACKET* packet;
+	WINPR_IO_PACKET** head = bWrite ? &binding->WriteHead : &binding->ReadHead;
+	WINPR_IO_PACKET** tail = bWrite ? &binding->WriteTail : &binding->ReadTail;
+
+	while ((packet = *head) != NULL)
+	{
+		if (!winpr_io_attempt(binding, packet, bWrite))
+			break;
+
+		*head = packet->Next;
+
+		if (!*head)
+			*tail = NULL;
+
+		winpr_io_complete(port, packet);
+	}
+}
+
+static int winpr_io_cancel(WINPR_COMPLETION_PORT* port, WINPR_IO_BINDING* binding, LPOVERLAPPED lpOverlapped)
+{
+	int index;
+	int count = 0;
+	WINPR_IO_PACKET* packet;
+	WINPR_IO_PACKET* previous;
+	WINPR_IO_PACKET* next;
+	WINPR_IO_PACKET** head;
+	WINPR_IO_PACKET** tail;
+
+	for (index = 0; index < 2; index++)
+	{
+		head = index ? &binding->WriteHead : &binding->ReadHead;
+		tail = index ? &binding->WriteTail : &binding->ReadTail;
+		previous = NULL;
+
+		for (packet = *head; packet; packet = next)
+		{
+			next = packet->Next;
+
+			if (lpOverlapped && (packet->lpOverlapped != lpOverlapped))
+			{
+				previous = packet;
+				continue;
+			}
+
+			if (previous)
+				previous->Next = next;
+			else
+				*head = next;
+
+			if (*tail == packet)
+				*tail = previous;
+
+			packet->Error = ERROR_OPERATION_ABORTED;
+			winpr_io_complete(port, packet);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+#ifdef WINPR_IO_EPOLL
+
+/* called with the port lock held, drops it while waiting for events */
+
+static void winpr_io_port_poll(WINPR_COMPLETION_PORT* port, DWORD dwMilliseconds)
+{
+	int index;
+	int count;
+	eventfd_t value;
+	WINPR_IO_BINDING* binding;
+	struct epoll_event events[WINPR_IO_MAX_EVENTS];
+
+	port->Polling = TRUE;
+	pthread_mutex_unlock(&port->Mutex);
+
+	count = epoll_wait(port->epoll_fd, events, WINPR_IO_MAX_EVENTS,
+			(dwMilliseconds == INFINITE) ? -1 : (int) dwMilliseconds);
+
+	pthread_mutex_lock(&port->Mutex);
+	port->Polling = FALSE;
+
+	for (index = 0; index < count; index++)
+	{
+		binding = (WINPR_IO_BINDING*) events[index].data.ptr;
+
+		if (!binding)
+		{
+			eventfd_read(port->event_fd, &value);
+			port->Signaled = FALSE;
+			continue;
+		}
+
+		/* bindings removed while we were polling are kept until now */
+
+		if (binding->Port != port)
+			continue;
+
+		if (events[index].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			winpr_io_drive(port, binding, FALSE);
+
+		if (events[index].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+			winpr_io_drive(port, binding, TRUE);
+	}
+
+	while ((binding = port->Dead) != NULL)
+	{
+		port->Dead = binding->NextDead;
+		free(binding);
+	}
+}
+
+#endif
+
+static WINPR_COMPLETION_PORT* winpr_io_port_new(void)
+{
+	WINPR_COMPLETION_PORT* port;
+
+	port = (WINPR_COMPLETION_PORT*) calloc(1, sizeof(WINPR_COMPLETION_PORT));
+
+	if (!port)
+		return NULL;
+
+#ifdef WINPR_IO_EPOLL
+	{
+		struct epoll_event event;
+
+		port->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		port->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+
+		if ((port->epoll_fd < 0) || (port->event_fd < 0) ||
+			(epoll_ctl(port->epoll_fd, EPOLL_CTL_ADD, port->event_fd, &event) < 0))
+		{
+			if (port->epoll_fd >= 0)
+				close(port->epoll_fd);
+
+			if (port->event_fd >= 0)
+				close(port->event_fd);
+
+			free(port);
+			return NULL;
+		}
+	}
+#endif
+
+	pthread_mutex_init(&port->Mutex, NULL);
+	pthread_cond_init(&port->Cond, NULL);
+	pthread_cond_init(&port->Done, NULL);
+
+	port->RefCount = 1;
+
+	return port;
+}
+
+/**
+ * Returns the port with a reference held, dropped with winpr_io_port_release().
+ * The close hook drops the handle reference under io_mutex, so a port found
+ * in the handle table here cannot be freed before the reference is taken.
+ */
+
+static WINPR_COMPLETION_PORT* winpr_io_acquire_port(HANDLE CompletionPort)
+{
+	ULONG Type;
+	PVOID Object;
+	WINPR_COMPLETION_PORT* port = NULL;
+
+	pthread_mutex_lock(&io_mutex);
+
+	if (winpr_Handle_GetInfo(CompletionPort, &Type, &Object) && (Type == HANDLE_TYPE_COMPLETION_PORT))
+	{
+		port = (WINPR_COMPLETION_PORT*) Object;
+
+		pthread_mutex_lock(&port->Mutex);
+		port->RefCount++;
+		pthread_mutex_unlock(&port->Mutex);
+	}
+
+	pthread_mutex_unlock(&io_mutex);
+
+	return port;
+}
+
+/* on success, returns with the port of the binding locked */
+
+static WINPR_IO_BINDING* winpr_io_lock_binding(int fd)
+{
+	WINPR_IO_BINDING* binding = NULL;
+
+	pthread_mutex_lock(&io_mutex);
+
+	if ((fd >= 0) && (fd < io_bindings_size))
+		binding = io_bindings[fd];
+
+	if (binding)
+		pthread_mutex_lock(&binding->Port->Mutex);
+
+	pthread_mutex_unlock(&io_mutex);
+
+	return binding;
+}
+
+static BOOL winpr_io_bind(WINPR_COMPLETION_PORT* port, int fd, ULONG Type, ULONG_PTR CompletionKey)
+{
+	int size;
+	struct stat st;
+	WINPR_IO_BINDING* binding;
+
+	if (fstat(fd, &st) < 0)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&io_mutex);
+
+	if (fd >= io_bindings_size)
+	{
+		size = (io_bindings_size > 0) ? io_bindings_size : 64;
+
+		while (size <= fd)
+			size *= 2;
+
+		io_bindings = (WINPR_IO_BINDING**) realloc(io_bindings, size * sizeof(WINPR_IO_BINDING*));
+		ZeroMemory(&io_bindings[io_bindings_size], (size - io_bindings_size) * sizeof(WINPR_IO_BINDING*));
+		io_bindings_size = size;
+	}
+
+	if (io_bindings[fd])
+	{
+		pthread_mutex_unlock(&io_mutex);
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	binding = (WINPR_IO_BINDING*) calloc(1, sizeof(WINPR_IO_BINDING));
+	binding->fd = fd;
+	binding->Type = Type;
+	binding->Port = port;
+	binding->CompletionKey = CompletionKey;
+	binding->Pollable = !S_ISREG(st.st_mode);
+
+	if (binding->Pollable)
+	{
+#ifdef WINPR_IO_EPOLL
+		struct epoll_event event;
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.ptr = binding;
+
+		if (epoll_ctl(port->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			pthread_mutex_unlock(&io_mutex);
+			free(binding);
+			SetLastError(winpr_io_error(errno));
+			return FALSE;
+		}
+#else
+		pthread_mutex_unlock(&io_mutex);
+		free(binding);
+		SetLastError(ERROR_NOT_SUPPORTED);
+		return FALSE;
+#endif
+	}
+
+	pthread_mutex_lock(&port->Mutex);
+	port->RefCount++;
+	pthread_mutex_unlock(&port->Mutex);
+
+	io_bindings[fd] = binding;
+
+	pthread_mutex_unlock(&io_mutex);
+
+	return TRUE;
+}
+
+static void winpr_io_unbind(int fd)
+{
+	WINPR_IO_BINDING* binding = NULL;
+	WINPR_COMPLETION_PORT* port;
+
+	pthread_mutex_lock(&io_mutex);
+
+	if ((fd >= 0) && (fd < io_bindings_size))
+	{
+		binding = io_bindings[fd];
+		io_bindings[fd] = NULL;
+	}
+
+	if (!binding)
+	{
+		pthread_mutex_unlock(&io_mutex);
+		return;
+	}
+
+	port = binding->Port;
+	pthread_mutex_lock(&port->Mutex);
+	pthread_mutex_unlock(&io_mutex);
+
+	winpr_io_cancel(port, binding, NULL);
+
+#ifdef WINPR_IO_EPOLL
+	if (binding->Pollable)
+		epoll_ctl(port->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+
+	binding->Port = NULL;
+
+	if (port->Polling)
+	{
+		binding->NextDead = port->Dead;
+		port->Dead = binding;
+	}
+	else
+	{
+		free(binding);
+	}
+
+	winpr_io_port_release(port);
+}
+
+static BOOL winpr_io_close_hook(HANDLE handle, ULONG Type, PVOID Object)
+{
+	if (Type == HANDLE_TYPE_COMPLETION_PORT)
+	{
+		WINPR_COMPLETION_PORT* port = (WINPR_COMPLETION_PORT*) Object;
+
+		pthread_mutex_lock(&io_mutex);
+		pthread_mutex_lock(&port->Mutex);
+
+		port->Closed = TRUE;
+		pthread_cond_broadcast(&port->Cond);
+		pthread_cond_broadcast(&port->Done);
+
+#ifdef WINPR_IO_EPOLL
+		if (port->Polling)
+			eventfd_write(port->event_fd, 1);
+#endif
+
+		winpr_io_port_release(port);
+		pthread_mutex_unlock(&io_mutex);
+
+		return TRUE;
+	}
+
+	if ((Type == HANDLE_TYPE_ANONYMOUS_PIPE) || (Type == HANDLE_TYPE_FILE))
+		winpr_io_unbind((int) ((ULONG_PTR) Object));
+
+	return FALSE;
+}
+
+static BOOL winpr_io_synchronous(int fd, BOOL bWrite, LPVOID lpBuffer, DWORD nNumberOfBytes,
+		LPDWORD lpNumberOfBytesTransferred, LPOVERLAPPED lpOverlapped)
+{
+	ssize_t status;
+	struct stat st;
+	off_t offset = -1;
+
+	if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode))
+		offset = (off_t) ((((ULONGLONG) lpOverlapped->OffsetHigh) << 32) | lpOverlapped->Offset);
+
+	do
+	{
+		if (offset >= 0)
+			status = bWrite ? pwrite(fd, lpBuffer, nNumberOfBytes, offset) : pread(fd, lpBuffer, nNumberOfBytes, offset);
+		else
+			status = bWrite ? write(fd, lpBuffer, nNumberOfBytes) : read(fd, lpBuffer, nNumberOfBytes);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		lpOverlapped->Internal = winpr_io_error(errno);
+		lpOverlapped->InternalHigh = 0;
+	}
+	else
+	{
+		lpOverlapped->Internal = ((status == 0) && !bWrite && (nNumberOfBytes > 0) && (offset >= 0)) ? ERROR_HANDLE_EOF : 0;
+		lpOverlapped->InternalHigh = status;
+	}
+
+	if (lpNumberOfBytesTransferred)
+		*lpNumberOfBytesTransferred = (DWORD) lpOverlapped->InternalHigh;
+
+	if (lpOverlapped->hEvent)
+		SetEvent(lpOverlapped->hEvent);
+
+	if (lpOverlapped->Internal)
+	{
+		SetLastError((DWORD) lpOverlapped->Internal);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Overlapped ReadFile() and WriteFile() on pipe and file handles end up here.
+ * A handle that was never associated with a completion port completes the
+ * request synchronously and only signals the OVERLAPPED event.
+ */
+
+BOOL winpr_io_submit(HANDLE hFile, int fd, BOOL bWrite, LPVOID lpBuffer, DWORD nNumberOfBytes,
+		LPDWORD lpNumberOfBytesTransferred, LPOVERLAPPED lpOverlapped)
+{
+	BOOL queued;
+	WINPR_IO_PACKET* packet;
+	WINPR_IO_BINDING* binding;
+	WINPR_COMPLETION_PORT* port;
+
+	if (lpNumberOfBytesTransferred)
+		*lpNumberOfBytesTransferred = 0;
+
+	binding = winpr_io_lock_binding(fd);
+
+	if (!binding)
+		return winpr_io_synchronous(fd, bWrite, lpBuffer, nNumberOfBytes, lpNumberOfBytesTransferred, lpOverlapped);
+
+	port = binding->Port;
+
+	if (lpOverlapped->hEvent)
+		ResetEvent(lpOverlapped->hEvent);
+
+	packet = winpr_io_packet_new(port);
+
+	if (!packet)
+	{
+		pthread_mutex_unlock(&port->Mutex);
+		return FALSE;
+	}
+
+	if (!binding->Pollable)
+	{
+		/* the binding may go away while the port is unlocked, the port may not */
+
+		packet->CompletionKey = binding->CompletionKey;
+		packet->lpOverlapped = lpOverlapped;
+		port->RefCount++;
+
+		pthread_mutex_unlock(&port->Mutex);
+
+		if (!winpr_io_synchronous(fd, bWrite, lpBuffer, nNumberOfBytes, lpNumberOfBytesTransferred, lpOverlapped))
+		{
+			pthread_mutex_lock(&port->Mutex);
+			winpr_io_packet_free(port, packet);
+			winpr_io_port_release(port);
+
+			return FALSE;
+		}
+
+		pthread_mutex_lock(&port->Mutex);
+
+		packet->NumberOfBytesTransferred = (DWORD) lpOverlapped->InternalHigh;
+		winpr_io_port_push(port, packet);
+
+		winpr_io_port_release(port);
+
+		return TRUE;
+	}
+
+	packet->CompletionKey = binding->CompletionKey;
+	packet->lpOverlapped = lpOverlapped;
+	packet->Buffer = (BYTE*) lpBuffer;
+	packet->Length = nNumberOfBytes;
+
+	lpOverlapped->Internal = WINPR_IO_STATUS_PENDING;
+	lpOverlapped->InternalHigh = 0;
+
+	/* requests already waiting on the descriptor go first */
+
+	queued = bWrite ? (binding->WriteHead != NULL) : (binding->ReadHead != NULL);
+
+	if (queued || !winpr_io_attempt(binding, packet, bWrite))
+	{
+		if (bWrite)
+		{
+			if (binding->WriteTail)
+				binding->WriteTail->Next = packet;
+			else
+				binding->WriteHead = packet;
+
+			binding->WriteTail = packet;
+		}
+		else
+		{
+			if (binding->ReadTail)
+				binding->ReadTail->Next = packet;
+			else
+				binding->ReadHead = packet;
+
+			binding->ReadTail = packet;
+		}
+
+		pthread_mutex_unlock(&port->Mutex);
+
+		SetLastError(ERROR_IO_PENDING);
+		return FALSE;
+	}
+
+	if (packet->Error)
+	{
+		/* requests failing right away do not queue a completion packet */
+
+		lpOverlapped->Internal = packet->Error;
+		SetLastError(packet->Error);
+		winpr_io_packet_free(port, packet);
+		pthread_mutex_unlock(&port->Mutex);
+
+		return FALSE;
+	}
+
+	if (lpNumberOfBytesTransferred)
+		*lpNumberOfBytesTransferred = packet->NumberOfBytesTransferred;
+
+	winpr_io_complete(port, packet);
+
+	pthread_mutex_unlock(&port->Mutex);
+
 	return TRUE;
 }
 
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED lpOverlapped, LPDWORD lpNumberOfBytesTransferred, BOOL bWait)
+{
+	return GetOverlappedResultEx(hFile, lpOverlapped, lpNumberOfBytesTransferred, bWait ? INFINITE : 0, FALSE);
+}
+
 BOOL GetOverlappedResultEx(HANDLE hFile, LPOVERLAPPED lpOverlapped, LPDWORD lpNumberOfBytesTransferred, DWORD dwMilliseconds, BOOL bAlertable)
 {
+	DWORD remaining;
+	struct timespec deadline;
+	WINPR_IO_BINDING* binding;
+	WINPR_COMPLETION_PORT* port;
+
+	if (lpOverlapped->Internal == WINPR_IO_STATUS_PENDING)
+	{
+		if (dwMilliseconds == 0)
+		{
+			SetLastError(ERROR_IO_INCOMPLETE);
+			return FALSE;
+		}
+
+		if (lpOverlapped->hEvent)
+		{
+			if (WaitForSingleObject(lpOverlapped->hEvent, dwMilliseconds) != WAIT_OBJECT_0)
+			{
+				SetLastError(WAIT_TIMEOUT);
+				return FALSE;
+			}
+		}
+		else
+		{
+			binding = winpr_io_lock_binding(winpr_io_get_fd(hFile));
+
+			if (!binding)
+			{
+				SetLastError(ERROR_INVALID_HANDLE);
+				return FALSE;
+			}
+
+			port = binding->Port;
+			port->RefCount++;
+			port->Observers++;
+
+			winpr_io_deadline(&deadline, dwMilliseconds);
+
+			/* nobody may be dequeuing the port: drive it ourselves if so */
+
+			while (lpOverlapped->Internal == WINPR_IO_STATUS_PENDING)
+			{
+				remaining = winpr_io_remaining(&deadline, dwMilliseconds);
+
+				if (remaining == 0)
+					break;
+#ifdef WINPR_IO_EPOLL
+				if (!port->Polling)
+				{
+					winpr_io_port_poll(port, remaining);
+					continue;
+				}
+#endif
+				if (dwMilliseconds == INFINITE)
+					pthread_cond_wait(&port->Done, &port->Mutex);
+				else
+					pthread_cond_timedwait(&port->Done, &port->Mutex, &deadline);
+			}
+
+			port->Observers--;
+
+			if (port->Waiting)
+				pthread_cond_signal(&port->Cond);
+
+			if (port->Observers)
+				pthread_cond_broadcast(&port->Done);
+
+			winpr_io_port_release(port);
+
+			if (lpOverlapped->Internal == WINPR_IO_STATUS_PENDING)
+			{
+				SetLastError(WAIT_TIMEOUT);
+				return FALSE;
+			}
+		}
+	}
+
+	if (lpNumberOfBytesTransferred)
+		*lpNumberOfBytesTransferred = (DWORD) lpOverlapped->InternalHigh;
+
+	if (lpOverlapped->Internal)
+	{
+		SetLastError((DWORD) lpOverlapped->Internal);
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -58,34 +971,285 @@ BOOL DeviceIoControl(HANDLE hDevice, DWORD dwIoControlCode, LPVOID lpInBuffer, D
 
 HANDLE CreateIoCompletionPort(HANDLE FileHandle, HANDLE ExistingCompletionPort, ULONG_PTR CompletionKey, DWORD NumberOfConcurrentThreads)
 {
-	return NULL;
+	ULONG Type;
+	BOOL bound;
+	PVOID Object;
+	HANDLE handle = NULL;
+	WINPR_COMPLETION_PORT* port;
+
+	pthread_once(&io_once, winpr_io_init);
+
+	if ((FileHandle == INVALID_HANDLE_VALUE) && ExistingCompletionPort)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		if (!winpr_Handle_GetInfo(FileHandle, &Type, &Object) ||
+			((Type != HANDLE_TYPE_ANONYMOUS_PIPE) && (Type != HANDLE_TYPE_FILE)))
+		{
+			SetLastError(ERROR_INVALID_HANDLE);
+			return NULL;
+		}
+	}
+
+	if (ExistingCompletionPort)
+	{
+		port = winpr_io_acquire_port(ExistingCompletionPort);
+
+		if (!port)
+		{
+			SetLastError(ERROR_INVALID_PARAMETER);
+			return NULL;
+		}
+
+		handle = ExistingCompletionPort;
+	}
+	else
+	{
+		port = winpr_io_port_new();
+
+		if (!port)
+		{
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return NULL;
+		}
+
+		handle = winpr_Handle_Insert(HANDLE_TYPE_COMPLETION_PORT, (PVOID) port);
+	}
+
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		bound = winpr_io_bind(port, (int) ((ULONG_PTR) Object), Type, CompletionKey);
+
+		if (ExistingCompletionPort)
+		{
+			/* the binding holds its own reference */
+			pthread_mutex_lock(&port->Mutex);
+			winpr_io_port_release(port);
+		}
+
+		if (!bound)
+		{
+			if (!ExistingCompletionPort)
+				CloseHandle(handle);
+
+			return NULL;
+		}
+	}
+
+	return handle;
+}
+
+static BOOL winpr_io_dequeue(HANDLE CompletionPort, LPOVERLAPPED_ENTRY lpEntries,
+		ULONG ulCount, PULONG ulNumEntriesRemoved, DWORD dwMilliseconds)
+{
+	BOOL polled = FALSE;
+	DWORD remaining;
+	ULONG count = 0;
+	DWORD error = 0;
+	struct timespec deadline = { 0, 0 };
+	WINPR_IO_PACKET* packet;
+	WINPR_COMPLETION_PORT* port;
+
+	port = winpr_io_acquire_port(CompletionPort);
+
+	if (!port)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	if (dwMilliseconds != INFINITE)
+		winpr_io_deadline(&deadline, dwMilliseconds);
+
+	pthread_mutex_lock(&port->Mutex);
+
+	for (;;)
+	{
+		if (port->Head)
+		{
+			while ((count < ulCount) && ((packet = port->Head) != NULL))
+			{
+				port->Head = packet->Next;
+
+				lpEntries[count].lpCompletionKey = packet->CompletionKey;
+				lpEntries[count].lpOverlapped = packet->lpOverlapped;
+				lpEntries[count].Internal = packet->Error;
+				lpEntries[count].dwNumberOfBytesTransferred = packet->NumberOfBytesTransferred;
+				count++;
+
+				winpr_io_packet_free(port, packet);
+			}
+
+			if (!port->Head)
+				port->Tail = NULL;
+
+			break;
+		}
+
+		if (port->Closed)
+		{
+			error = ERROR_ABANDONED_WAIT_0;
+			break;
+		}
+
+		remaining = winpr_io_remaining(&deadline, dwMilliseconds);
+
+#ifdef WINPR_IO_EPOLL
+		if (!port->Polling && !(polled && (remaining == 0)))
+		{
+			winpr_io_port_poll(port, remaining);
+			polled = TRUE;
+			continue;
+		}
+#endif
+
+		if (remaining == 0)
+		{
+			error = WAIT_TIMEOUT;
+			break;
+		}
+
+		port->Waiting++;
+
+		if (dwMilliseconds == INFINITE)
+			pthread_cond_wait(&port->Cond, &port->Mutex);
+		else
+			pthread_cond_timedwait(&port->Cond, &port->Mutex, &deadline);
+
+		port->Waiting--;
+	}
+
+	/* hand the remaining packets, or the poller role, to another waiter */
+
+	if (port->Waiting && (port->Head || !port->Polling))
+		pthread_cond_signal(&port->Cond);
+
+	if (port->Observers && !port->Polling)
+		pthread_cond_broadcast(&port->Done);
+
+	winpr_io_port_release(port);
+
+	*ulNumEntriesRemoved = count;
+
+	if (error)
+	{
+		SetLastError(error);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 BOOL GetQueuedCompletionStatus(HANDLE CompletionPort, LPDWORD lpNumberOfBytesTransferred,
 		PULONG_PTR lpCompletionKey, LPOVERLAPPED* lpOverlapped, DWORD dwMilliseconds)
 {
+	ULONG count;
+	OVERLAPPED_ENTRY entry;
+
+	*lpOverlapped = NULL;
+
+	if (!winpr_io_dequeue(CompletionPort, &entry, 1, &count, dwMilliseconds))
+		return FALSE;
+
+	*lpNumberOfBytesTransferred = entry.dwNumberOfBytesTransferred;
+	*lpCompletionKey = entry.lpCompletionKey;
+	*lpOverlapped = entry.lpOverlapped;
+
+	if (entry.Internal)
+	{
+		SetLastError((DWORD) entry.Internal);
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
 BOOL GetQueuedCompletionStatusEx(HANDLE CompletionPort, LPOVERLAPPED_ENTRY lpCompletionPortEntries,
 		ULONG ulCount, PULONG ulNumEntriesRemoved, DWORD dwMilliseconds, BOOL fAlertable)
 {
-	return TRUE;
+	if (!lpCompletionPortEntries || (ulCount < 1))
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	return winpr_io_dequeue(CompletionPort, lpCompletionPortEntries, ulCount, ulNumEntriesRemoved, dwMilliseconds);
 }
 
 BOOL PostQueuedCompletionStatus(HANDLE CompletionPort, DWORD dwNumberOfBytesTransferred, ULONG_PTR dwCompletionKey, LPOVERLAPPED lpOverlapped)
 {
+	WINPR_IO_PACKET* packet;
+	WINPR_COMPLETION_PORT* port;
+
+	port = winpr_io_acquire_port(CompletionPort);
+
+	if (!port)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&port->Mutex);
+
+	packet = winpr_io_packet_new(port);
+
+	if (!packet)
+	{
+		winpr_io_port_release(port);
+		return FALSE;
+	}
+
+	packet->CompletionKey = dwCompletionKey;
+	packet->lpOverlapped = lpOverlapped;
+	packet->NumberOfBytesTransferred = dwNumberOfBytesTransferred;
+	winpr_io_port_push(port, packet);
+
+	winpr_io_port_release(port);
+
+	return TRUE;
+}
+
+static BOOL winpr_io_cancel_file(HANDLE hFile, LPOVERLAPPED lpOverlapped)
+{
+	int count;
+	WINPR_IO_BINDING* binding;
+	WINPR_COMPLETION_PORT* port;
+
+	binding = winpr_io_lock_binding(winpr_io_get_fd(hFile));
+
+	if (!binding)
+	{
+		SetLastError(ERROR_NOT_FOUND);
+		return FALSE;
+	}
+
+	port = binding->Port;
+	count = winpr_io_cancel(port, binding, lpOverlapped);
+	pthread_mutex_unlock(&port->Mutex);
+
+	if (count < 1)
+	{
+		SetLastError(ERROR_NOT_FOUND);
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
 BOOL CancelIo(HANDLE hFile)
 {
+	winpr_io_cancel_file(hFile, NULL);
+
 	return TRUE;
 }
 
 BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED lpOverlapped)
 {
-	return TRUE;
+	return winpr_io_cancel_file(hFile, lpOverlapped);
 }
 
 BOOL CancelSynchronousIo(HANDLE hThread)
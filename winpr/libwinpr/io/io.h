@@ -0,0 +1,103 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Asynchronous I/O Functions
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_IO_PRIVATE_H
+#define WINPR_IO_PRIVATE_H
+
+#include <winpr/io.h>
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+/**
+ * I/O completion ports are built on epoll. A file descriptor associated
+ * with a port is switched to non-blocking mode and registered edge-triggered;
+ * overlapped reads and writes that cannot complete right away are queued on
+ * its binding and retried by whichever thread is currently polling the port.
+ *
+ * Only one thread waits in epoll_wait() at a time (the leader); the others
+ * sleep on a condition variable and are handed completion packets directly.
+ * Regular files cannot be polled and are read and written synchronously at
+ * the OVERLAPPED offset, with the completion still going through the port.
+ *
+ * OVERLAPPED.Internal holds WINPR_IO_STATUS_PENDING while a request is in
+ * flight and the Win32 error code of the request once it has completed.
+ */
+
+#define WINPR_IO_STATUS_PENDING		0x00000103
+
+typedef struct winpr_io_packet WINPR_IO_PACKET;
+typedef struct winpr_io_binding WINPR_IO_BINDING;
+typedef struct winpr_completion_port WINPR_COMPLETION_PORT;
+
+struct winpr_io_packet
+{
+	WINPR_IO_PACKET* Next;
+	ULONG_PTR CompletionKey;
+	LPOVERLAPPED lpOverlapped;
+	DWORD NumberOfBytesTransferred;
+	DWORD Error;
+
+	BYTE* Buffer;
+	DWORD Length;
+};
+
+struct winpr_io_binding
+{
+	int fd;
+	ULONG Type;
+	BOOL Pollable;
+	ULONG_PTR CompletionKey;
+	WINPR_COMPLETION_PORT* Port;
+
+	WINPR_IO_PACKET* ReadHead;
+	WINPR_IO_PACKET* ReadTail;
+	WINPR_IO_PACKET* WriteHead;
+	WINPR_IO_PACKET* WriteTail;
+
+	WINPR_IO_BINDING* NextDead;
+};
+
+struct winpr_completion_port
+{
+	pthread_mutex_t Mutex;
+	pthread_cond_t Cond;
+	pthread_cond_t Done;
+
+	int RefCount;
+	BOOL Closed;
+	BOOL Polling;
+	BOOL Signaled;
+	int Waiting;
+	int Observers;
+
+	int epoll_fd;
+	int event_fd;
+
+	WINPR_IO_PACKET* Head;
+	WINPR_IO_PACKET* Tail;
+	WINPR_IO_PACKET* FreeList;
+	WINPR_IO_BINDING* Dead;
+};
+
+WINPR_API BOOL winpr_io_submit(HANDLE hFile, int fd, BOOL bWrite, LPVOID lpBuffer, DWORD nNumberOfBytes,
+		LPDWORD lpNumberOfBytesTransferred, LPOVERLAPPED lpOverlapped);
+
+#endif
+
+#endif /* WINPR_IO_PRIVATE_H */
@@ -0,0 +1,372 @@
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include <winpr/io.h>
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/pipe.h>
+#include <winpr/synch.h>
+#include <winpr/handle.h>
+#include <winpr/interlocked.h>
+#include <winpr/windows.h>
+
+#define TEST_IOCP_WORKERS		4
+#define TEST_IOCP_CONNECTIONS		16
+#define TEST_IOCP_MESSAGES		4000
+
+struct test_connection
+{
+	HANDLE hSocket;
+	OVERLAPPED readOverlapped;
+	OVERLAPPED writeOverlapped;
+	BYTE readBuffer[64];
+	int peer;
+	int received;
+};
+typedef struct test_connection TEST_CONNECTION;
+
+static HANDLE hEchoPort;
+static LONG volatile messages;
+
+static int test_iocp_dequeue(HANDLE hPort, ULONG_PTR expectedKey, DWORD expectedBytes, DWORD expectedError)
+{
+	BOOL status;
+	DWORD dwBytes = 0;
+	ULONG_PTR key = 0;
+	LPOVERLAPPED lpOverlapped = NULL;
+
+	status = GetQueuedCompletionStatus(hPort, &dwBytes, &key, &lpOverlapped, 1000);
+
+	if (!lpOverlapped)
+	{
+		printf("GetQueuedCompletionStatus: no packet (0x%08X)\n", (unsigned int) GetLastError());
+		return -1;
+	}
+
+	if ((status != (expectedError == 0)) || (!status && (GetLastError() != expectedError)))
+	{
+		printf("GetQueuedCompletionStatus: unexpected status %d (0x%08X)\n", status, (unsigned int) GetLastError());
+		return -1;
+	}
+
+	if ((key != expectedKey) || (dwBytes != expectedBytes))
+	{
+		printf("GetQueuedCompletionStatus: key %d, %d bytes, expected key %d, %d bytes\n",
+				(int) key, (int) dwBytes, (int) expectedKey, (int) expectedBytes);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_iocp_post(void)
+{
+	HANDLE hPort;
+	ULONG index;
+	ULONG count;
+	DWORD dwBytes;
+	ULONG_PTR key;
+	LPOVERLAPPED lpOverlapped;
+	OVERLAPPED overlapped[3];
+	OVERLAPPED_ENTRY entries[8];
+
+	hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+
+	if (!hPort)
+		return -1;
+
+	for (index = 0; index < 3; index++)
+		PostQueuedCompletionStatus(hPort, index * 10, index + 1, &overlapped[index]);
+
+	if (!GetQueuedCompletionStatusEx(hPort, entries, 8, &count, 0, FALSE) || (count != 3))
+	{
+		printf("GetQueuedCompletionStatusEx did not return the 3 posted packets\n");
+		return -1;
+	}
+
+	for (index = 0; index < 3; index++)
+	{
+		if ((entries[index].lpCompletionKey != index + 1) || (entries[index].lpOverlapped != &overlapped[index]) ||
+			(entries[index].dwNumberOfBytesTransferred != index * 10))
+		{
+			printf("GetQueuedCompletionStatusEx: packet %d out of order\n", (int) index);
+			return -1;
+		}
+	}
+
+	if (GetQueuedCompletionStatus(hPort, &dwBytes, &key, &lpOverlapped, 10) ||
+		(GetLastError() != WAIT_TIMEOUT) || lpOverlapped)
+	{
+		printf("GetQueuedCompletionStatus did not time out on an empty port\n");
+		return -1;
+	}
+
+	CloseHandle(hPort);
+
+	return 0;
+}
+
+static int test_iocp_pipe(void)
+{
+	HANDLE hPort;
+	DWORD dwRead;
+	DWORD dwWritten;
+	HANDLE hReadPipe;
+	HANDLE hWritePipe;
+	BYTE buffer[16];
+	OVERLAPPED readOverlapped;
+	OVERLAPPED writeOverlapped;
+
+	if (!CreatePipe(&hReadPipe, &hWritePipe, NULL, 0))
+		return -1;
+
+	hPort = CreateIoCompletionPort(hReadPipe, NULL, 1, 0);
+
+	if (!hPort || (CreateIoCompletionPort(hWritePipe, hPort, 2, 0) != hPort))
+	{
+		printf("CreateIoCompletionPort failed to associate the pipe\n");
+		return -1;
+	}
+
+	if (CreateIoCompletionPort(hWritePipe, hPort, 3, 0))
+	{
+		printf("CreateIoCompletionPort associated a handle twice\n");
+		return -1;
+	}
+
+	ZeroMemory(&readOverlapped, sizeof(OVERLAPPED));
+	ZeroMemory(&writeOverlapped, sizeof(OVERLAPPED));
+
+	if (ReadFile(hReadPipe, buffer, sizeof(buffer), &dwRead, &readOverlapped) || (GetLastError() != ERROR_IO_PENDING))
+	{
+		printf("ReadFile on an empty pipe did not pend\n");
+		return -1;
+	}
+
+	if (!WriteFile(hWritePipe, "pipe", 4, &dwWritten, &writeOverlapped) || (dwWritten != 4))
+	{
+		printf("WriteFile on a pipe did not complete immediately\n");
+		return -1;
+	}
+
+	if ((test_iocp_dequeue(hPort, 2, 4, 0) < 0) || (test_iocp_dequeue(hPort, 1, 4, 0) < 0))
+		return -1;
+
+	if (memcmp(buffer, "pipe", 4) != 0)
+		return -1;
+
+	/* cancelled and aborted requests still complete through the port */
+
+	ReadFile(hReadPipe, buffer, sizeof(buffer), &dwRead, &readOverlapped);
+
+	if (!CancelIoEx(hReadPipe, &readOverlapped) || (test_iocp_dequeue(hPort, 1, 0, ERROR_OPERATION_ABORTED) < 0))
+	{
+		printf("CancelIoEx failed to abort a pending read\n");
+		return -1;
+	}
+
+	ReadFile(hReadPipe, buffer, sizeof(buffer), &dwRead, &readOverlapped);
+	CloseHandle(hReadPipe);
+
+	if (test_iocp_dequeue(hPort, 1, 0, ERROR_OPERATION_ABORTED) < 0)
+	{
+		printf("CloseHandle did not abort a pending read\n");
+		return -1;
+	}
+
+	CloseHandle(hWritePipe);
+	CloseHandle(hPort);
+
+	return 0;
+}
+
+static int test_iocp_file(void)
+{
+	HANDLE hFile;
+	HANDLE hPort;
+	DWORD dwBytes;
+	BYTE buffer[16];
+	char filename[64];
+	OVERLAPPED overlapped;
+
+	sprintf_s(filename, sizeof(filename), "TestIoCompletionPort.%d.tmp", (int) getpid());
+
+	hFile = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_OVERLAPPED, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printf("CreateFileA failed\n");
+		return -1;
+	}
+
+	hPort = CreateIoCompletionPort(hFile, NULL, 7, 0);
+
+	ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+	overlapped.Offset = 100;
+
+	if (!WriteFile(hFile, "offset", 6, &dwBytes, &overlapped) || (test_iocp_dequeue(hPort, 7, 6, 0) < 0))
+		return -1;
+
+	ZeroMemory(buffer, sizeof(buffer));
+	overlapped.Offset = 98;
+
+	if (!ReadFile(hFile, buffer, sizeof(buffer), &dwBytes, &overlapped) || (test_iocp_dequeue(hPort, 7, 8, 0) < 0))
+		return -1;
+
+	if (memcmp(buffer, "\0\0offset", 8) != 0)
+	{
+		printf("overlapped file read returned the wrong data\n");
+		return -1;
+	}
+
+	overlapped.Offset = 200;
+
+	if (ReadFile(hFile, buffer, sizeof(buffer), &dwBytes, &overlapped) || (GetLastError() != ERROR_HANDLE_EOF))
+	{
+		printf("overlapped read past the end of file did not fail\n");
+		return -1;
+	}
+
+	CloseHandle(hFile);
+	CloseHandle(hPort);
+	remove(filename);
+
+	return 0;
+}
+
+/* echo benchmark: each connection bounces one message back and forth */
+
+static void test_iocp_post_read(TEST_CONNECTION* connection)
+{
+	DWORD dwRead;
+
+	ZeroMemory(&connection->readOverlapped, sizeof(OVERLAPPED));
+	ReadFile(connection->hSocket, connection->readBuffer, sizeof(connection->readBuffer),
+			&dwRead, &connection->readOverlapped);
+}
+
+static void* test_iocp_worker(void* arg)
+{
+	ULONG index;
+	ULONG count;
+	DWORD dwWritten;
+	TEST_CONNECTION* connection;
+	OVERLAPPED_ENTRY entries[16];
+
+	while (GetQueuedCompletionStatusEx(hEchoPort, entries, 16, &count, INFINITE, FALSE))
+	{
+		for (index = 0; index < count; index++)
+		{
+			connection = (TEST_CONNECTION*) entries[index].lpCompletionKey;
+
+			/* pass the shutdown packet on to the next worker */
+
+			if (!connection)
+			{
+				PostQueuedCompletionStatus(hEchoPort, 0, 0, NULL);
+				return NULL;
+			}
+
+			if (entries[index].lpOverlapped != &connection->readOverlapped)
+				continue;
+
+			if (entries[index].dwNumberOfBytesTransferred < 1)
+				continue;
+
+			if (InterlockedIncrement(&messages) <= TEST_IOCP_MESSAGES * TEST_IOCP_CONNECTIONS)
+			{
+				ZeroMemory(&connection->writeOverlapped, sizeof(OVERLAPPED));
+				WriteFile(connection->hSocket, connection->readBuffer, entries[index].dwNumberOfBytesTransferred,
+						&dwWritten, &connection->writeOverlapped);
+			}
+
+			test_iocp_post_read(connection);
+		}
+	}
+
+	return NULL;
+}
+
+static int test_iocp_echo(void)
+{
+	int index;
+	long usec;
+	int fds[2];
+	DWORD dwWritten;
+	struct timeval start;
+	struct timeval end;
+	OVERLAPPED overlapped;
+	pthread_t workers[TEST_IOCP_WORKERS];
+	TEST_CONNECTION connections[TEST_IOCP_CONNECTIONS * 2];
+
+	hEchoPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+
+	for (index = 0; index < TEST_IOCP_CONNECTIONS; index++)
+	{
+		socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+
+		connections[index * 2].hSocket = GetFileHandleForFileDescriptor(fds[0]);
+		connections[index * 2 + 1].hSocket = GetFileHandleForFileDescriptor(fds[1]);
+
+		CreateIoCompletionPort(connections[index * 2].hSocket, hEchoPort, (ULONG_PTR) &connections[index * 2], 0);
+		CreateIoCompletionPort(connections[index * 2 + 1].hSocket, hEchoPort, (ULONG_PTR) &connections[index * 2 + 1], 0);
+
+		test_iocp_post_read(&connections[index * 2]);
+		test_iocp_post_read(&connections[index * 2 + 1]);
+	}
+
+	messages = 0;
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < TEST_IOCP_WORKERS; index++)
+		pthread_create(&workers[index], NULL, test_iocp_worker, NULL);
+
+	for (index = 0; index < TEST_IOCP_CONNECTIONS; index++)
+	{
+		ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+		WriteFile(connections[index * 2].hSocket, "ping", 4, &dwWritten, &overlapped);
+	}
+
+	while (messages < TEST_IOCP_MESSAGES * TEST_IOCP_CONNECTIONS)
+		Sleep(1);
+
+	gettimeofday(&end, NULL);
+
+	PostQueuedCompletionStatus(hEchoPort, 0, 0, NULL);
+
+	for (index = 0; index < TEST_IOCP_WORKERS; index++)
+		pthread_join(workers[index], NULL);
+
+	for (index = 0; index < TEST_IOCP_CONNECTIONS * 2; index++)
+		CloseHandle(connections[index].hSocket);
+
+	CloseHandle(hEchoPort);
+
+	usec = ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+
+	printf("%d workers, %d connections: %d messages in %ld us\n", TEST_IOCP_WORKERS,
+			TEST_IOCP_CONNECTIONS, TEST_IOCP_MESSAGES * TEST_IOCP_CONNECTIONS, usec);
+
+	return 0;
+}
+
+int TestIoCompletionPort(int argc, char* argv[])
+{
+	if (test_iocp_post() < 0)
+		return -1;
+
+	if (test_iocp_pipe() < 0)
+		return -1;
+
+	if (test_iocp_file() < 0)
+		return -1;
+
+	if (test_iocp_echo() < 0)
+		return -1;
+
+	return 0;
+}
@@ -1,10 +1,85 @@
 
 #include <stdio.h>
+#include <pthread.h>
 #include <winpr/io.h>
 #include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/pipe.h>
+#include <winpr/synch.h>
+#include <winpr/handle.h>
 #include <winpr/windows.h>
 
+static HANDLE hWritePipe;
+
+static void* test_writer_thread(void* arg)
+{
+	DWORD dwWritten;
+
+	Sleep(50);
+	WriteFile(hWritePipe, "hello", 5, &dwWritten, NULL);
+
+	return NULL;
+}
+
 int TestIoGetOverlappedResult(int argc, char* argv[])
 {
+	BYTE buffer[16];
+	DWORD dwRead;
+	HANDLE hPort;
+	HANDLE hReadPipe;
+	pthread_t thread;
+	OVERLAPPED overlapped;
+
+	if (!CreatePipe(&hReadPipe, &hWritePipe, NULL, 0))
+		return -1;
+
+	hPort = CreateIoCompletionPort(hReadPipe, NULL, 1, 0);
+
+	if (!hPort)
+	{
+		printf("CreateIoCompletionPort failed\n");
+		return -1;
+	}
+
+	ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+	overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (ReadFile(hReadPipe, buffer, sizeof(buffer), &dwRead, &overlapped) || (GetLastError() != ERROR_IO_PENDING))
+	{
+		printf("ReadFile on an empty pipe did not pend\n");
+		return -1;
+	}
+
+	if (GetOverlappedResult(hReadPipe, &overlapped, &dwRead, FALSE) || (GetLastError() != ERROR_IO_INCOMPLETE))
+	{
+		printf("GetOverlappedResult did not report an incomplete request\n");
+		return -1;
+	}
+
+	/* nobody dequeues the port: waiting for the result has to drive it */
+
+	CloseHandle(overlapped.hEvent);
+	overlapped.hEvent = NULL;
+
+	pthread_create(&thread, NULL, test_writer_thread, NULL);
+
+	if (!GetOverlappedResult(hReadPipe, &overlapped, &dwRead, TRUE))
+	{
+		printf("GetOverlappedResult failed: 0x%08X\n", (unsigned int) GetLastError());
+		return -1;
+	}
+
+	pthread_join(thread, NULL);
+
+	if ((dwRead != 5) || (memcmp(buffer, "hello", 5) != 0))
+	{
+		printf("GetOverlappedResult: unexpected result (%d bytes)\n", (int) dwRead);
+		return -1;
+	}
+
+	CloseHandle(hReadPipe);
+	CloseHandle(hWritePipe);
+	CloseHandle(hPort);
+
 	return 0;
 }
@@ -0,0 +1,113 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Callback)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/interlocked.h>
+
+/**
+ * SetEventWhenCallbackReturns
+ * ReleaseSemaphoreWhenCallbackReturns
+ * ReleaseMutexWhenCallbackReturns
+ * LeaveCriticalSectionWhenCallbackReturns
+ * FreeLibraryWhenCallbackReturns
+ * CallbackMayRunLong
+ * DisassociateCurrentThreadFromCallback
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+VOID SetEventWhenCallbackReturns(PTP_CALLBACK_INSTANCE pci, HANDLE evt)
+{
+	pci->Event = evt;
+}
+
+VOID ReleaseSemaphoreWhenCallbackReturns(PTP_CALLBACK_INSTANCE pci, HANDLE sem, DWORD crel)
+{
+	pci->Semaphore = sem;
+	pci->SemaphoreCount = crel;
+}
+
+VOID ReleaseMutexWhenCallbackReturns(PTP_CALLBACK_INSTANCE pci, HANDLE mut)
+{
+	pci->Mutex = mut;
+}
+
+VOID LeaveCriticalSectionWhenCallbackReturns(PTP_CALLBACK_INSTANCE pci, PCRITICAL_SECTION pcs)
+{
+	pci->CriticalSection = pcs;
+}
+
+VOID FreeLibraryWhenCallbackReturns(PTP_CALLBACK_INSTANCE pci, HMODULE mod)
+{
+	/* libraries are never unloaded from under running callbacks */
+}
+
+/**
+ * Callbacks that may run long do not count against the number of threads
+ * started on demand, so that they cannot starve the other callbacks.
+ */
+
+BOOL CallbackMayRunLong(PTP_CALLBACK_INSTANCE pci)
+{
+	PTP_POOL pool = pci->Object->Pool;
+
+	if (!pci->MayRunLong)
+	{
+		pci->MayRunLong = TRUE;
+		InterlockedIncrement(&pool->LongRunning);
+	}
+
+	return ((pool->Idle > 0) || ((DWORD) pool->ThreadCount < pool->Maximum)) ? TRUE : FALSE;
+}
+
+VOID DisassociateCurrentThreadFromCallback(PTP_CALLBACK_INSTANCE pci)
+{
+	if (pci->Disassociated)
+		return;
+
+	pci->Disassociated = TRUE;
+	winpr_pool_object_complete(pci->Object);
+}
+
+void winpr_pool_instance_finish(PTP_CALLBACK_INSTANCE instance)
+{
+	if (instance->CriticalSection)
+		LeaveCriticalSection(instance->CriticalSection);
+
+	if (instance->Mutex)
+		ReleaseMutex(instance->Mutex);
+
+	if (instance->Semaphore)
+		ReleaseSemaphore(instance->Semaphore, instance->SemaphoreCount, NULL);
+
+	if (instance->Event)
+		SetEvent(instance->Event);
+
+	if (instance->MayRunLong)
+		InterlockedDecrement(&instance->Object->Pool->LongRunning);
+
+	DisassociateCurrentThreadFromCallback(instance);
+}
+
+#endif
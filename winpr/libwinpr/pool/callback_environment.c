@@ -0,0 +1,68 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Callback Environment)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+
+/**
+ * InitializeThreadpoolEnvironment
+ * DestroyThreadpoolEnvironment
+ * SetThreadpoolCallbackPool
+ * SetThreadpoolCallbackCleanupGroup
+ * SetThreadpoolCallbackRunsLong
+ * SetThreadpoolCallbackLibrary
+ */
+
+#ifndef _WIN32
+
+VOID InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON pcbe)
+{
+	ZeroMemory(pcbe, sizeof(TP_CALLBACK_ENVIRON));
+	pcbe->Version = 1;
+}
+
+VOID DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON pcbe)
+{
+
+}
+
+VOID SetThreadpoolCallbackPool(PTP_CALLBACK_ENVIRON pcbe, PTP_POOL ptpp)
+{
+	pcbe->Pool = ptpp;
+}
+
+VOID SetThreadpoolCallbackCleanupGroup(PTP_CALLBACK_ENVIRON pcbe, PTP_CLEANUP_GROUP ptpcg, PTP_CLEANUP_GROUP_CANCEL_CALLBACK pfng)
+{
+	pcbe->CleanupGroup = ptpcg;
+	pcbe->CleanupGroupCancelCallback = pfng;
+}
+
+VOID SetThreadpoolCallbackRunsLong(PTP_CALLBACK_ENVIRON pcbe)
+{
+	pcbe->u.s.LongFunction = 1;
+}
+
+VOID SetThreadpoolCallbackLibrary(PTP_CALLBACK_ENVIRON pcbe, PVOID mod)
+{
+	pcbe->RaceDll = mod;
+}
+
+#endif
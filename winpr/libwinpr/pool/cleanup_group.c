@@ -0,0 +1,137 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Cleanup Group)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/interlocked.h>
+
+/**
+ * CreateThreadpoolCleanupGroup
+ * CloseThreadpoolCleanupGroupMembers
+ * CloseThreadpoolCleanupGroup
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+void winpr_pool_cleanup_group_add(PTP_CLEANUP_GROUP group, TP_OBJECT* object)
+{
+	EnterCriticalSection(&group->Lock);
+
+	object->Group = group;
+	object->GroupPrev = NULL;
+	object->GroupNext = group->Head;
+
+	if (group->Head)
+		group->Head->GroupPrev = object;
+
+	group->Head = object;
+
+	LeaveCriticalSection(&group->Lock);
+}
+
+void winpr_pool_cleanup_group_remove(TP_OBJECT* object)
+{
+	PTP_CLEANUP_GROUP group = object->Environment.CleanupGroup;
+
+	if (!group)
+		return;
+
+	EnterCriticalSection(&group->Lock);
+
+	if (object->Group)
+	{
+		if (object->GroupPrev)
+			object->GroupPrev->GroupNext = object->GroupNext;
+		else
+			group->Head = object->GroupNext;
+
+		if (object->GroupNext)
+			object->GroupNext->GroupPrev = object->GroupPrev;
+
+		object->Group = NULL;
+	}
+
+	LeaveCriticalSection(&group->Lock);
+}
+
+PTP_CLEANUP_GROUP CreateThreadpoolCleanupGroup(void)
+{
+	PTP_CLEANUP_GROUP group;
+
+	group = (PTP_CLEANUP_GROUP) malloc(sizeof(TP_CLEANUP_GROUP));
+
+	if (!group)
+		return NULL;
+
+	group->Head = NULL;
+	InitializeCriticalSection(&group->Lock);
+
+	return group;
+}
+
+/**
+ * Stops the timers and waits of the group, waits for the outstanding
+ * callbacks of each member, or cancels the pending ones and reports them to
+ * the cancel callback of the environment, and closes all members.
+ */
+
+VOID CloseThreadpoolCleanupGroupMembers(PTP_CLEANUP_GROUP ptpcg, BOOL fCancelPendingCallbacks, PVOID pvCleanupContext)
+{
+	TP_OBJECT* object;
+
+	while (1)
+	{
+		EnterCriticalSection(&ptpcg->Lock);
+
+		object = ptpcg->Head;
+
+		if (object)
+			InterlockedIncrement(&object->RefCount);
+
+		LeaveCriticalSection(&ptpcg->Lock);
+
+		if (!object)
+			break;
+
+		winpr_pool_cleanup_group_remove(object);
+
+		if (object->Stop)
+			object->Stop(object);
+
+		winpr_pool_object_wait(object, fCancelPendingCallbacks);
+
+		if (fCancelPendingCallbacks && object->Environment.CleanupGroupCancelCallback)
+			object->Environment.CleanupGroupCancelCallback(object->Context, pvCleanupContext);
+
+		winpr_pool_object_close(object);
+		winpr_pool_object_release(object);
+	}
+}
+
+VOID CloseThreadpoolCleanupGroup(PTP_CLEANUP_GROUP ptpcg)
+{
+	DeleteCriticalSection(&ptpcg->Lock);
+	free(ptpcg);
+}
+
+#endif
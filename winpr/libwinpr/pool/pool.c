@@ -0,0 +1,673 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Pool)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/error.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+/**
+ * CreateThreadpool
+ * CloseThreadpool
+ * SetThreadpoolThreadMinimum
+ * SetThreadpoolThreadMaximum
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+#include <time.h>
+#include <errno.h>
+
+/**
+ * Each worker owns a deque of tasks: callbacks submitted from a worker are
+ * pushed to and popped from the tail of its own deque, so that they run hot
+ * in cache on the thread that queued them, while idle workers steal from the
+ * head of the other deques. Callbacks submitted from outside the pool go to
+ * a global FIFO queue.
+ *
+ * Queued counts the tasks in all deques. A worker only goes to sleep after
+ * announcing itself in Idle and finding Queued empty, and a submitter only
+ * skips the wakeup after queueing its task and finding Idle empty, both
+ * with full barriers in between, so that no wakeup is lost.
+ *
+ * Threads are started on demand, as long as no worker is idle and fewer
+ * threads than processors are busy with callbacks that do not run long, and
+ * workers idle for TP_POOL_IDLE_TIMEOUT seconds exit down to the minimum.
+ */
+
+#define TP_DEQUE_INITIAL_CAPACITY	64
+
+/* Head and Tail change under the deque lock, but thieves peek at them without it */
+#define TP_DEQUE_LOAD(_p)		__atomic_load_n(_p, __ATOMIC_ACQUIRE)
+#define TP_DEQUE_STORE(_p, _v)		__atomic_store_n(_p, _v, __ATOMIC_RELEASE)
+
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+static PTP_POOL default_pool = NULL;
+static pthread_once_t default_pool_once = PTHREAD_ONCE_INIT;
+
+static DWORD processor_count = 0;
+
+static void winpr_pool_worker_key_init(void)
+{
+	SYSTEM_INFO info;
+
+	pthread_key_create(&worker_key, NULL);
+
+	GetSystemInfo(&info);
+	processor_count = (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+}
+
+static void winpr_pool_default_init(void)
+{
+	default_pool = CreateThreadpool(NULL);
+}
+
+PTP_POOL winpr_pool_get(PTP_CALLBACK_ENVIRON pcbe)
+{
+	if (pcbe && pcbe->Pool)
+		return pcbe->Pool;
+
+	pthread_once(&default_pool_once, winpr_pool_default_init);
+
+	return default_pool;
+}
+
+UINT64 winpr_pool_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+ * Negative FILETIMEs are relative to now and positive ones are absolute,
+ * both in 100-nanosecond intervals. Returns the delay in milliseconds.
+ */
+
+INT64 winpr_pool_filetime_to_ms(PFILETIME pft)
+{
+	INT64 due;
+	struct timespec ts;
+
+	due = (INT64) ((((UINT64) pft->dwHighDateTime) << 32) | pft->dwLowDateTime);
+
+	if (due < 0)
+		return (-due) / 10000;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	due = (due - 116444736000000000LL) / 10000;
+	due -= (((INT64) ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+
+	return (due > 0) ? due : 0;
+}
+
+static BOOL winpr_pool_deque_init(TP_DEQUE* deque)
+{
+	deque->Head = deque->Tail = 0;
+	deque->Capacity = TP_DEQUE_INITIAL_CAPACITY;
+	deque->Tasks = (TP_TASK*) malloc(sizeof(TP_TASK) * deque->Capacity);
+
+	if (!deque->Tasks)
+		return FALSE;
+
+	InitializeCriticalSectionAndSpinCount(&deque->Lock, 1000);
+
+	return TRUE;
+}
+
+static void winpr_pool_deque_uninit(TP_DEQUE* deque)
+{
+	TP_TASK* task;
+
+	/* drop the references held by tasks that never ran */
+
+	while (deque->Head != deque->Tail)
+	{
+		task = &deque->Tasks[deque->Head++ & (deque->Capacity - 1)];
+		winpr_pool_object_release(task->Object);
+	}
+
+	DeleteCriticalSection(&deque->Lock);
+	free(deque->Tasks);
+}
+
+static BOOL winpr_pool_deque_push(TP_DEQUE* deque, TP_TASK* task)
+{
+	int index;
+	TP_TASK* tasks;
+
+	EnterCriticalSection(&deque->Lock);
+
+	if (deque->Tail - deque->Head == deque->Capacity)
+	{
+		tasks = (TP_TASK*) malloc(sizeof(TP_TASK) * deque->Capacity * 2);
+
+		if (!tasks)
+		{
+			LeaveCriticalSection(&deque->Lock);
+			return FALSE;
+		}
+
+		for (index = 0; index < deque->Capacity; index++)
+			tasks[index] = deque->Tasks[(deque->Head + index) & (deque->Capacity - 1)];
+
+		free(deque->Tasks);
+		deque->Tasks = tasks;
+		TP_DEQUE_STORE(&deque->Head, 0);
+		TP_DEQUE_STORE(&deque->Tail, deque->Capacity);
+		deque->Capacity *= 2;
+	}
+
+	deque->Tasks[deque->Tail & (deque->Capacity - 1)] = *task;
+	TP_DEQUE_STORE(&deque->Tail, deque->Tail + 1);
+
+	LeaveCriticalSection(&deque->Lock);
+
+	return TRUE;
+}
+
+static BOOL winpr_pool_deque_pop(TP_DEQUE* deque, TP_TASK* task, BOOL fifo)
+{
+	BOOL found = FALSE;
+
+	EnterCriticalSection(&deque->Lock);
+
+	if (deque->Head != deque->Tail)
+	{
+		if (fifo)
+		{
+			*task = deque->Tasks[deque->Head & (deque->Capacity - 1)];
+			TP_DEQUE_STORE(&deque->Head, deque->Head + 1);
+		}
+		else
+		{
+			TP_DEQUE_STORE(&deque->Tail, deque->Tail - 1);
+			*task = deque->Tasks[deque->Tail & (deque->Capacity - 1)];
+		}
+
+		found = TRUE;
+	}
+
+	LeaveCriticalSection(&deque->Lock);
+
+	return found;
+}
+
+static BOOL winpr_pool_get_task(PTP_POOL pool, TP_WORKER* worker, TP_TASK* task)
+{
+	int index;
+	int count;
+	TP_WORKER* victim;
+
+	if (pool->Queued <= 0)
+		return FALSE;
+
+	if (winpr_pool_deque_pop(&worker->Deque, task, FALSE) ||
+			winpr_pool_deque_pop(&pool->Global, task, TRUE))
+	{
+		InterlockedDecrement(&pool->Queued);
+		return TRUE;
+	}
+
+	count = TP_DEQUE_LOAD(&pool->WorkerSlots);
+
+	for (index = 1; index < count; index++)
+	{
+		victim = TP_DEQUE_LOAD(&pool->Workers[(worker->Index + index) % count]);
+
+		/* only lock deques which look non-empty, pop checks again under the lock */
+		if (victim && (TP_DEQUE_LOAD(&victim->Deque.Head) != TP_DEQUE_LOAD(&victim->Deque.Tail)) &&
+				winpr_pool_deque_pop(&victim->Deque, task, TRUE))
+		{
+			InterlockedDecrement(&pool->Queued);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void winpr_pool_execute(TP_TASK* task)
+{
+	BOOL cancelled;
+	TP_OBJECT* object = task->Object;
+	TP_CALLBACK_INSTANCE instance;
+
+	EnterCriticalSection(&object->Lock);
+
+	cancelled = (task->Generation != object->Generation);
+
+	if (!cancelled)
+	{
+		object->Pending--;
+		object->Running++;
+	}
+
+	LeaveCriticalSection(&object->Lock);
+
+	if (!cancelled)
+	{
+		ZeroMemory(&instance, sizeof(TP_CALLBACK_INSTANCE));
+		instance.Object = object;
+
+		if (object->Environment.u.s.LongFunction)
+			CallbackMayRunLong(&instance);
+
+		object->Execute(object, &instance, task->Result);
+
+		winpr_pool_instance_finish(&instance);
+
+		if (object->AutoClose)
+			winpr_pool_object_close(object);
+	}
+
+	winpr_pool_object_release(object);
+}
+
+static void* winpr_pool_worker_thread(void* arg)
+{
+	int status;
+	BOOL exit = FALSE;
+	TP_TASK task;
+	struct timespec timeout;
+	TP_WORKER* worker = (TP_WORKER*) arg;
+	PTP_POOL pool = worker->Pool;
+
+	pthread_setspecific(worker_key, worker);
+
+	while (!exit)
+	{
+		if (winpr_pool_get_task(pool, worker, &task))
+		{
+			winpr_pool_execute(&task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->Mutex);
+
+		InterlockedIncrement(&pool->Idle);
+
+		while ((pool->Queued <= 0) && !pool->Shutdown)
+		{
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_sec += TP_POOL_IDLE_TIMEOUT;
+
+			status = pthread_cond_timedwait(&pool->Cond, &pool->Mutex, &timeout);
+
+			if ((status == ETIMEDOUT) && (pool->Queued <= 0) &&
+					((DWORD) pool->ThreadCount > pool->Minimum))
+			{
+				exit = TRUE;
+				break;
+			}
+		}
+
+		InterlockedDecrement(&pool->Idle);
+
+		if (pool->Shutdown)
+			exit = TRUE;
+
+		if (exit)
+		{
+			worker->Active = FALSE;
+
+			if (InterlockedDecrement(&pool->ThreadCount) == 0)
+				pthread_cond_broadcast(&pool->Exit);
+		}
+
+		pthread_mutex_unlock(&pool->Mutex);
+	}
+
+	return NULL;
+}
+
+/* called with the pool mutex held */
+
+static BOOL winpr_pool_start_worker(PTP_POOL pool)
+{
+	int index;
+	pthread_t thread;
+	pthread_attr_t attr;
+	TP_WORKER* worker = NULL;
+
+	if (pool->Shutdown || ((DWORD) pool->ThreadCount >= pool->Maximum))
+		return FALSE;
+
+	for (index = 0; index < pool->WorkerSlots; index++)
+	{
+		if (!pool->Workers[index]->Active)
+		{
+			worker = pool->Workers[index];
+			break;
+		}
+	}
+
+	if (!worker)
+	{
+		if (pool->WorkerSlots >= TP_POOL_MAX_WORKERS)
+			return FALSE;
+
+		worker = (TP_WORKER*) malloc(sizeof(TP_WORKER));
+
+		if (!worker)
+			return FALSE;
+
+		if (!winpr_pool_deque_init(&worker->Deque))
+		{
+			free(worker);
+			return FALSE;
+		}
+
+		worker->Pool = pool;
+		worker->Index = pool->WorkerSlots;
+		pool->Workers[worker->Index] = worker;
+
+		/* publish the worker before thieves can see the slot */
+		InterlockedIncrement(&pool->WorkerSlots);
+	}
+
+	worker->Active = TRUE;
+	InterlockedIncrement(&pool->ThreadCount);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attr, winpr_pool_worker_thread, worker) != 0)
+	{
+		worker->Active = FALSE;
+		InterlockedDecrement(&pool->ThreadCount);
+		pthread_attr_destroy(&attr);
+		return FALSE;
+	}
+
+	pthread_attr_destroy(&attr);
+
+	return TRUE;
+}
+
+static BOOL winpr_pool_enqueue(PTP_POOL pool, TP_TASK* task)
+{
+	DWORD target;
+	TP_WORKER* worker;
+
+	worker = (TP_WORKER*) pthread_getspecific(worker_key);
+
+	if (!worker || (worker->Pool != pool) || !winpr_pool_deque_push(&worker->Deque, task))
+	{
+		if (!winpr_pool_deque_push(&pool->Global, task))
+			return FALSE;
+	}
+
+	InterlockedIncrement(&pool->Queued);
+
+	if (pool->Idle > 0)
+	{
+		pthread_mutex_lock(&pool->Mutex);
+		pthread_cond_signal(&pool->Cond);
+		pthread_mutex_unlock(&pool->Mutex);
+		return TRUE;
+	}
+
+	target = processor_count + pool->LongRunning;
+
+	if (((DWORD) pool->ThreadCount < target) && ((DWORD) pool->ThreadCount < pool->Maximum))
+	{
+		pthread_mutex_lock(&pool->Mutex);
+
+		if ((pool->Idle == 0) && ((DWORD) pool->ThreadCount < target))
+			winpr_pool_start_worker(pool);
+
+		pthread_mutex_unlock(&pool->Mutex);
+	}
+
+	return TRUE;
+}
+
+void winpr_pool_object_init(TP_OBJECT* object, PVOID context, PTP_CALLBACK_ENVIRON pcbe,
+		void (*execute)(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result))
+{
+	ZeroMemory(object, sizeof(TP_OBJECT));
+
+	if (pcbe)
+		CopyMemory(&object->Environment, pcbe, sizeof(TP_CALLBACK_ENVIRON));
+	else
+		InitializeThreadpoolEnvironment(&object->Environment);
+
+	object->RefCount = 1;
+	object->Context = context;
+	object->Execute = execute;
+	object->Pool = winpr_pool_get(pcbe);
+
+	InitializeCriticalSectionAndSpinCount(&object->Lock, 1000);
+	InitializeConditionVariable(&object->Cond);
+
+	if (object->Environment.CleanupGroup)
+		winpr_pool_cleanup_group_add(object->Environment.CleanupGroup, object);
+}
+
+void winpr_pool_object_release(TP_OBJECT* object)
+{
+	if (InterlockedDecrement(&object->RefCount) != 0)
+		return;
+
+	DeleteCriticalSection(&object->Lock);
+	free(object);
+}
+
+BOOL winpr_pool_object_submit(TP_OBJECT* object, TP_WAIT_RESULT result)
+{
+	TP_TASK task;
+
+	EnterCriticalSection(&object->Lock);
+	object->Pending++;
+	task.Generation = object->Generation;
+	LeaveCriticalSection(&object->Lock);
+
+	task.Object = object;
+	task.Result = result;
+
+	InterlockedIncrement(&object->RefCount);
+
+	if (winpr_pool_enqueue(object->Pool, &task))
+		return TRUE;
+
+	/* the callback will not run, so it must not keep waiters blocked */
+
+	EnterCriticalSection(&object->Lock);
+
+	if (task.Generation == object->Generation)
+		object->Pending--;
+
+	if (!object->Pending && !object->Running)
+		WakeAllConditionVariable(&object->Cond);
+
+	LeaveCriticalSection(&object->Lock);
+
+	winpr_pool_object_release(object);
+	SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+
+	return FALSE;
+}
+
+void winpr_pool_object_wait(TP_OBJECT* object, BOOL fCancelPendingCallbacks)
+{
+	EnterCriticalSection(&object->Lock);
+
+	if (fCancelPendingCallbacks)
+	{
+		object->Generation++;
+		object->Pending = 0;
+	}
+
+	while (object->Pending || object->Running)
+		SleepConditionVariableCS(&object->Cond, &object->Lock, INFINITE);
+
+	LeaveCriticalSection(&object->Lock);
+}
+
+void winpr_pool_object_complete(TP_OBJECT* object)
+{
+	EnterCriticalSection(&object->Lock);
+
+	object->Running--;
+
+	if (!object->Pending && !object->Running)
+		WakeAllConditionVariable(&object->Cond);
+
+	LeaveCriticalSection(&object->Lock);
+}
+
+/**
+ * Drops the reference of the creator, once: objects of a cleanup group may be
+ * closed both by their owner and by CloseThreadpoolCleanupGroupMembers().
+ */
+
+void winpr_pool_object_close(TP_OBJECT* object)
+{
+	if (InterlockedCompareExchange(&object->Closed, 1, 0) != 0)
+		return;
+
+	winpr_pool_cleanup_group_remove(object);
+	winpr_pool_object_release(object);
+}
+
+PTP_POOL CreateThreadpool(PVOID reserved)
+{
+	PTP_POOL pool;
+
+	pthread_once(&worker_key_once, winpr_pool_worker_key_init);
+
+	pool = (PTP_POOL) calloc(1, sizeof(TP_POOL));
+
+	if (!pool)
+		return NULL;
+
+	if (!winpr_pool_deque_init(&pool->Global))
+	{
+		free(pool);
+		return NULL;
+	}
+
+	pool->Minimum = 0;
+	pool->Maximum = 500;
+
+	pthread_mutex_init(&pool->Mutex, NULL);
+	pthread_cond_init(&pool->Cond, NULL);
+	pthread_cond_init(&pool->Exit, NULL);
+
+	InitializeCriticalSection(&pool->WaitLock);
+
+	return pool;
+}
+
+/**
+ * Closing a pool waits for the callbacks already running to return and drops
+ * the ones that did not start yet.
+ */
+
+VOID CloseThreadpool(PTP_POOL ptpp)
+{
+	int index;
+
+	if (!ptpp)
+		return;
+
+	winpr_pool_waiters_free(ptpp);
+
+	if (ptpp->TimerQueue)
+		DeleteTimerQueueEx(ptpp->TimerQueue, INVALID_HANDLE_VALUE);
+
+	pthread_mutex_lock(&ptpp->Mutex);
+
+	ptpp->Shutdown = TRUE;
+	pthread_cond_broadcast(&ptpp->Cond);
+
+	while (ptpp->ThreadCount > 0)
+		pthread_cond_wait(&ptpp->Exit, &ptpp->Mutex);
+
+	pthread_mutex_unlock(&ptpp->Mutex);
+
+	for (index = 0; index < ptpp->WorkerSlots; index++)
+	{
+		winpr_pool_deque_uninit(&ptpp->Workers[index]->Deque);
+		free(ptpp->Workers[index]);
+	}
+
+	winpr_pool_deque_uninit(&ptpp->Global);
+
+	DeleteCriticalSection(&ptpp->WaitLock);
+	pthread_cond_destroy(&ptpp->Exit);
+	pthread_cond_destroy(&ptpp->Cond);
+	pthread_mutex_destroy(&ptpp->Mutex);
+
+	free(ptpp);
+}
+
+BOOL SetThreadpoolThreadMinimum(PTP_POOL ptpp, DWORD cthrdMic)
+{
+	BOOL status = TRUE;
+
+	pthread_mutex_lock(&ptpp->Mutex);
+
+	ptpp->Minimum = cthrdMic;
+
+	if (ptpp->Maximum < cthrdMic)
+		ptpp->Maximum = cthrdMic;
+
+	while ((DWORD) ptpp->ThreadCount < ptpp->Minimum)
+	{
+		if (!winpr_pool_start_worker(ptpp))
+		{
+			status = FALSE;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&ptpp->Mutex);
+
+	return status;
+}
+
+VOID SetThreadpoolThreadMaximum(PTP_POOL ptpp, DWORD cthrdMost)
+{
+	pthread_mutex_lock(&ptpp->Mutex);
+
+	ptpp->Maximum = (cthrdMost < TP_POOL_MAX_WORKERS) ? cthrdMost : TP_POOL_MAX_WORKERS;
+
+	if (ptpp->Maximum < 1)
+		ptpp->Maximum = 1;
+
+	if (ptpp->Minimum > ptpp->Maximum)
+		ptpp->Minimum = ptpp->Maximum;
+
+	pthread_mutex_unlock(&ptpp->Mutex);
+}
+
+#endif
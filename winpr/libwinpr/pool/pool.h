@@ -0,0 +1,193 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_POOL_PRIVATE_H
+#define WINPR_POOL_PRIVATE_H
+
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+#define TP_POOL_MAX_WORKERS		512
+#define TP_POOL_IDLE_TIMEOUT		30
+
+typedef struct _TP_OBJECT TP_OBJECT;
+typedef struct _TP_TASK TP_TASK;
+typedef struct _TP_DEQUE TP_DEQUE;
+typedef struct _TP_WORKER TP_WORKER;
+typedef struct _TP_WAITER TP_WAITER;
+
+/**
+ * Common header of work, timer and wait objects.
+ *
+ * Pending counts the callbacks queued and not yet started, Running the ones
+ * executing. Each queued task holds a reference and the generation it was
+ * queued in: cancelling pending callbacks bumps the generation, and stale
+ * tasks are dropped when a worker dequeues them.
+ */
+
+struct _TP_OBJECT
+{
+	LONG volatile RefCount;
+	LONG volatile Closed;
+	PTP_POOL Pool;
+	PVOID Context;
+	TP_CALLBACK_ENVIRON Environment;
+	void (*Execute)(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result);
+	void (*Stop)(TP_OBJECT* object);
+
+	CRITICAL_SECTION Lock;
+	CONDITION_VARIABLE Cond;
+	DWORD Generation;
+	LONG Pending;
+	LONG Running;
+	BOOL AutoClose;
+
+	PTP_CLEANUP_GROUP Group;
+	TP_OBJECT* GroupPrev;
+	TP_OBJECT* GroupNext;
+};
+
+struct _TP_WORK
+{
+	TP_OBJECT Object;
+	PTP_WORK_CALLBACK Callback;
+	PTP_SIMPLE_CALLBACK SimpleCallback;
+};
+
+struct _TP_TIMER
+{
+	TP_OBJECT Object;
+	PTP_TIMER_CALLBACK Callback;
+	HANDLE TimerQueueTimer;
+};
+
+struct _TP_WAIT
+{
+	TP_OBJECT Object;
+	PTP_WAIT_CALLBACK Callback;
+	HANDLE Handle;
+	UINT64 Deadline;
+	TP_WAITER* Waiter;
+};
+
+struct _TP_CALLBACK_INSTANCE
+{
+	TP_OBJECT* Object;
+	BOOL Disassociated;
+	BOOL MayRunLong;
+
+	HANDLE Event;
+	HANDLE Semaphore;
+	DWORD SemaphoreCount;
+	HANDLE Mutex;
+	PCRITICAL_SECTION CriticalSection;
+};
+
+struct _TP_CLEANUP_GROUP
+{
+	CRITICAL_SECTION Lock;
+	TP_OBJECT* Head;
+};
+
+struct _TP_TASK
+{
+	TP_OBJECT* Object;
+	DWORD Generation;
+	TP_WAIT_RESULT Result;
+};
+
+/* owner pushes and pops at the tail, thieves take from the head */
+
+struct _TP_DEQUE
+{
+	CRITICAL_SECTION Lock;
+	TP_TASK* Tasks;
+	int Capacity;
+	int Head;
+	int Tail;
+};
+
+struct _TP_WORKER
+{
+	PTP_POOL Pool;
+	int Index;
+	BOOL Active;
+	TP_DEQUE Deque;
+};
+
+struct _TP_WAITER
+{
+	PTP_POOL Pool;
+	pthread_t Thread;
+	HANDLE Control;
+	BOOL Shutdown;
+	int Count;
+	PTP_WAIT Waits[MAXIMUM_WAIT_OBJECTS - 1];
+	TP_WAITER* Next;
+};
+
+struct _TP_POOL
+{
+	DWORD Minimum;
+	DWORD Maximum;
+	BOOL Shutdown;
+
+	pthread_mutex_t Mutex;
+	pthread_cond_t Cond;
+	pthread_cond_t Exit;
+
+	LONG volatile Queued;
+	LONG volatile Idle;
+	LONG volatile LongRunning;
+	LONG volatile ThreadCount;
+
+	TP_DEQUE Global;
+	LONG volatile WorkerSlots;
+	TP_WORKER* Workers[TP_POOL_MAX_WORKERS];
+
+	HANDLE TimerQueue;
+
+	CRITICAL_SECTION WaitLock;
+	TP_WAITER* Waiters;
+};
+
+PTP_POOL winpr_pool_get(PTP_CALLBACK_ENVIRON pcbe);
+UINT64 winpr_pool_get_time(void);
+INT64 winpr_pool_filetime_to_ms(PFILETIME pft);
+
+void winpr_pool_object_init(TP_OBJECT* object, PVOID context, PTP_CALLBACK_ENVIRON pcbe,
+		void (*execute)(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result));
+void winpr_pool_object_release(TP_OBJECT* object);
+BOOL winpr_pool_object_submit(TP_OBJECT* object, TP_WAIT_RESULT result);
+void winpr_pool_object_wait(TP_OBJECT* object, BOOL fCancelPendingCallbacks);
+void winpr_pool_object_close(TP_OBJECT* object);
+void winpr_pool_object_complete(TP_OBJECT* object);
+
+void winpr_pool_cleanup_group_add(PTP_CLEANUP_GROUP group, TP_OBJECT* object);
+void winpr_pool_cleanup_group_remove(TP_OBJECT* object);
+
+void winpr_pool_instance_finish(PTP_CALLBACK_INSTANCE instance);
+
+void winpr_pool_waiters_free(PTP_POOL pool);
+
+#endif
+
+#endif /* WINPR_POOL_PRIVATE_H */
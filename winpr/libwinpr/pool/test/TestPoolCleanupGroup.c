@@ -0,0 +1,92 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define TEST_POOL_MEMBERS		16
+
+static LONG volatile executed = 0;
+static LONG volatile cancelled = 0;
+static HANDLE gate = NULL;
+
+static void CALLBACK test_work_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	WaitForSingleObject(gate, INFINITE);
+	InterlockedIncrement(&executed);
+}
+
+static void CALLBACK test_gate_callback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+	Sleep(100);
+	SetEvent(gate);
+}
+
+static void CALLBACK test_cancel_callback(PVOID ObjectContext, PVOID CleanupContext)
+{
+	if (CleanupContext == (PVOID) &cancelled)
+		InterlockedIncrement(&cancelled);
+}
+
+int TestPoolCleanupGroup(int argc, char* argv[])
+{
+	int index;
+	PTP_POOL pool;
+	PTP_WORK work;
+	PTP_CLEANUP_GROUP group;
+	TP_CALLBACK_ENVIRON environment;
+
+	gate = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	pool = CreateThreadpool(NULL);
+	group = CreateThreadpoolCleanupGroup();
+
+	if (!pool || !group)
+	{
+		printf("failed to create thread pool or cleanup group\n");
+		return -1;
+	}
+
+	/* a single thread, blocked by the first callback: the others stay pending */
+
+	SetThreadpoolThreadMaximum(pool, 1);
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+	SetThreadpoolCallbackCleanupGroup(&environment, group, test_cancel_callback);
+
+	for (index = 0; index < TEST_POOL_MEMBERS; index++)
+	{
+		work = CreateThreadpoolWork(test_work_callback, NULL, &environment);
+
+		if (!work)
+		{
+			printf("CreateThreadpoolWork failed\n");
+			return -1;
+		}
+
+		SubmitThreadpoolWork(work);
+	}
+
+	/* the first callback is running, open its gate from the default pool */
+
+	Sleep(50);
+	TrySubmitThreadpoolCallback(test_gate_callback, NULL, NULL);
+
+	CloseThreadpoolCleanupGroupMembers(group, TRUE, (PVOID) &cancelled);
+
+	if ((executed != 1) || (cancelled != TEST_POOL_MEMBERS))
+	{
+		printf("executed: %d, cancelled: %d\n", (int) executed, (int) cancelled);
+		return -1;
+	}
+
+	CloseThreadpoolCleanupGroup(group);
+	DestroyThreadpoolEnvironment(&environment);
+	CloseThreadpool(pool);
+	CloseHandle(gate);
+
+	return 0;
+}
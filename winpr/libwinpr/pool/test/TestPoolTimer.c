@@ -0,0 +1,84 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define TEST_POOL_TIMER_PERIOD		20
+#define TEST_POOL_TIMER_FIRINGS		5
+
+static LONG volatile count = 0;
+
+static void CALLBACK test_timer_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer)
+{
+	if (InterlockedIncrement(&count) == TEST_POOL_TIMER_FIRINGS)
+		SetEventWhenCallbackReturns(instance, (HANDLE) context);
+}
+
+int TestPoolTimer(int argc, char* argv[])
+{
+	HANDLE event;
+	PTP_TIMER timer;
+	FILETIME dueTime;
+	ULONGLONG due;
+
+	event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	timer = CreateThreadpoolTimer(test_timer_callback, event, NULL);
+
+	if (!timer)
+	{
+		printf("CreateThreadpoolTimer failed\n");
+		return -1;
+	}
+
+	if (IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: timer set before SetThreadpoolTimer\n");
+		return -1;
+	}
+
+	/* relative due time of 10 ms */
+
+	due = (ULONGLONG) -100000LL;
+	dueTime.dwLowDateTime = (DWORD) due;
+	dueTime.dwHighDateTime = (DWORD) (due >> 32);
+
+	SetThreadpoolTimer(timer, &dueTime, TEST_POOL_TIMER_PERIOD, 0);
+
+	if (!IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: timer not set\n");
+		return -1;
+	}
+
+	if (WaitForSingleObject(event, 5000) != WAIT_OBJECT_0)
+	{
+		printf("periodic timer fired %d times, expected %d\n", (int) count, TEST_POOL_TIMER_FIRINGS);
+		return -1;
+	}
+
+	SetThreadpoolTimer(timer, NULL, 0, 0);
+	WaitForThreadpoolTimerCallbacks(timer, TRUE);
+
+	if (IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: timer still set after cancellation\n");
+		return -1;
+	}
+
+	count = 0;
+	Sleep(3 * TEST_POOL_TIMER_PERIOD);
+
+	if (count != 0)
+	{
+		printf("cancelled timer fired %d times\n", (int) count);
+		return -1;
+	}
+
+	CloseThreadpoolTimer(timer);
+	CloseHandle(event);
+
+	return 0;
+}
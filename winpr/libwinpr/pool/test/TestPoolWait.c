@@ -0,0 +1,81 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define TEST_POOL_WAITS		100
+
+static LONG volatile count = 0;
+static TP_WAIT_RESULT results[TEST_POOL_WAITS];
+static HANDLE done = NULL;
+
+static void CALLBACK test_wait_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WAIT wait, TP_WAIT_RESULT result)
+{
+	results[(size_t) context] = result;
+
+	if (InterlockedIncrement(&count) == TEST_POOL_WAITS)
+		SetEventWhenCallbackReturns(instance, done);
+}
+
+int TestPoolWait(int argc, char* argv[])
+{
+	int index;
+	FILETIME timeout;
+	ULONGLONG due;
+	PTP_WAIT waits[TEST_POOL_WAITS];
+	HANDLE events[TEST_POOL_WAITS];
+
+	done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	/* enough waits for two waiter threads, half of them timing out after 50 ms */
+
+	due = (ULONGLONG) -500000LL;
+	timeout.dwLowDateTime = (DWORD) due;
+	timeout.dwHighDateTime = (DWORD) (due >> 32);
+
+	for (index = 0; index < TEST_POOL_WAITS; index++)
+	{
+		results[index] = WAIT_FAILED;
+		events[index] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		waits[index] = CreateThreadpoolWait(test_wait_callback, (PVOID) (size_t) index, NULL);
+
+		if (!waits[index])
+		{
+			printf("CreateThreadpoolWait failed\n");
+			return -1;
+		}
+
+		SetThreadpoolWait(waits[index], events[index], (index % 2) ? &timeout : NULL);
+	}
+
+	for (index = 0; index < TEST_POOL_WAITS; index += 2)
+		SetEvent(events[index]);
+
+	if (WaitForSingleObject(done, 5000) != WAIT_OBJECT_0)
+	{
+		printf("wait callbacks: Actual: %d, Expected: %d\n", (int) count, TEST_POOL_WAITS);
+		return -1;
+	}
+
+	for (index = 0; index < TEST_POOL_WAITS; index++)
+	{
+		WaitForThreadpoolWaitCallbacks(waits[index], FALSE);
+
+		if (results[index] != ((index % 2) ? WAIT_TIMEOUT : WAIT_OBJECT_0))
+		{
+			printf("wait %d: Actual: 0x%08X, Expected: 0x%08X\n", index,
+					(unsigned int) results[index], (index % 2) ? WAIT_TIMEOUT : WAIT_OBJECT_0);
+			return -1;
+		}
+
+		CloseThreadpoolWait(waits[index]);
+		CloseHandle(events[index]);
+	}
+
+	CloseHandle(done);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define TEST_POOL_SUBMISSIONS		200000
+#define TEST_POOL_THREADS		2000
+#define TEST_POOL_FANOUT		4096
+
+static LONG volatile count = 0;
+static PTP_WORK fanout_work = NULL;
+
+static void CALLBACK test_work_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	InterlockedIncrement(&count);
+}
+
+/* each callback submits two more, which exercises the per-worker queues */
+
+static void CALLBACK test_fanout_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	LONG depth = InterlockedIncrement(&count);
+
+	if (depth < TEST_POOL_FANOUT)
+	{
+		SubmitThreadpoolWork(fanout_work);
+		SubmitThreadpoolWork(fanout_work);
+	}
+}
+
+static void CALLBACK test_simple_callback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+	InterlockedIncrement(&count);
+	SetEventWhenCallbackReturns(instance, (HANDLE) context);
+}
+
+static void* test_thread_callback(void* arg)
+{
+	InterlockedIncrement(&count);
+	return NULL;
+}
+
+static long test_elapsed(struct timeval* start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+
+	return ((end.tv_sec - start->tv_sec) * 1000000) + (end.tv_usec - start->tv_usec);
+}
+
+int TestPoolWork(int argc, char* argv[])
+{
+	int index;
+	long pool_usec;
+	long thread_usec;
+	HANDLE event;
+	PTP_WORK work;
+	PTP_POOL pool;
+	pthread_t thread;
+	struct timeval start;
+	TP_CALLBACK_ENVIRON environment;
+
+	/* default pool */
+
+	work = CreateThreadpoolWork(test_work_callback, NULL, NULL);
+
+	if (!work)
+	{
+		printf("CreateThreadpoolWork failed\n");
+		return -1;
+	}
+
+	for (index = 0; index < 10; index++)
+		SubmitThreadpoolWork(work);
+
+	WaitForThreadpoolWorkCallbacks(work, FALSE);
+	CloseThreadpoolWork(work);
+
+	if (count != 10)
+	{
+		printf("work callbacks: Actual: %d, Expected: %d\n", (int) count, 10);
+		return -1;
+	}
+
+	/* private pool with a bounded number of threads */
+
+	pool = CreateThreadpool(NULL);
+
+	if (!pool)
+	{
+		printf("CreateThreadpool failed\n");
+		return -1;
+	}
+
+	SetThreadpoolThreadMaximum(pool, 4);
+
+	if (!SetThreadpoolThreadMinimum(pool, 2))
+	{
+		printf("SetThreadpoolThreadMinimum failed\n");
+		return -1;
+	}
+
+	InitializeThreadpoolEnvironment(&environment);
+	SetThreadpoolCallbackPool(&environment, pool);
+
+	count = 0;
+	fanout_work = CreateThreadpoolWork(test_fanout_callback, NULL, &environment);
+
+	SubmitThreadpoolWork(fanout_work);
+	WaitForThreadpoolWorkCallbacks(fanout_work, FALSE);
+	CloseThreadpoolWork(fanout_work);
+
+	if (count != (2 * TEST_POOL_FANOUT) - 1)
+	{
+		printf("fan-out callbacks: Actual: %d, Expected: %d\n", (int) count, (2 * TEST_POOL_FANOUT) - 1);
+		return -1;
+	}
+
+	/* simple callbacks */
+
+	count = 0;
+	event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!TrySubmitThreadpoolCallback(test_simple_callback, event, &environment))
+	{
+		printf("TrySubmitThreadpoolCallback failed\n");
+		return -1;
+	}
+
+	if ((WaitForSingleObject(event, 5000) != WAIT_OBJECT_0) || (count != 1))
+	{
+		printf("simple callback did not run\n");
+		return -1;
+	}
+
+	CloseHandle(event);
+
+	/* submit/complete throughput, against a thread per callback */
+
+	count = 0;
+	work = CreateThreadpoolWork(test_work_callback, NULL, &environment);
+
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < TEST_POOL_SUBMISSIONS; index++)
+		SubmitThreadpoolWork(work);
+
+	WaitForThreadpoolWorkCallbacks(work, FALSE);
+	pool_usec = test_elapsed(&start);
+
+	CloseThreadpoolWork(work);
+
+	if (count != TEST_POOL_SUBMISSIONS)
+	{
+		printf("work callbacks: Actual: %d, Expected: %d\n", (int) count, TEST_POOL_SUBMISSIONS);
+		return -1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < TEST_POOL_THREADS; index++)
+	{
+		pthread_create(&thread, NULL, test_thread_callback, NULL);
+		pthread_join(thread, NULL);
+	}
+
+	thread_usec = test_elapsed(&start);
+
+	printf("thread pool: %d callbacks in %ld us (%.0f/s), thread per callback: %d callbacks in %ld us (%.0f/s)\n",
+			TEST_POOL_SUBMISSIONS, pool_usec, TEST_POOL_SUBMISSIONS * 1000000.0 / (pool_usec ? pool_usec : 1),
+			TEST_POOL_THREADS, thread_usec, TEST_POOL_THREADS * 1000000.0 / (thread_usec ? thread_usec : 1));
+
+	DestroyThreadpoolEnvironment(&environment);
+	CloseThreadpool(pool);
+
+	return 0;
+}
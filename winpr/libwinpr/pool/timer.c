@@ -0,0 +1,169 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Timer)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/error.h>
+#include <winpr/pool.h>
+
+/**
+ * CreateThreadpoolTimer
+ * CloseThreadpoolTimer
+ * SetThreadpoolTimer
+ * IsThreadpoolTimerSet
+ * WaitForThreadpoolTimerCallbacks
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+/**
+ * Pool timers are timer queue timers on a timer queue of the pool, whose
+ * callback only queues the pool timer callback to the workers.
+ */
+
+static HANDLE winpr_pool_timer_queue(PTP_POOL pool)
+{
+	HANDLE queue;
+
+	pthread_mutex_lock(&pool->Mutex);
+
+	if (!pool->TimerQueue)
+		pool->TimerQueue = CreateTimerQueue();
+
+	queue = pool->TimerQueue;
+
+	pthread_mutex_unlock(&pool->Mutex);
+
+	return queue;
+}
+
+static VOID CALLBACK winpr_pool_timer_fired(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+{
+	PTP_TIMER timer = (PTP_TIMER) lpParameter;
+
+	winpr_pool_object_submit(&timer->Object, 0);
+}
+
+static void winpr_pool_timer_execute(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result)
+{
+	PTP_TIMER timer = (PTP_TIMER) object;
+
+	timer->Callback(instance, object->Context, timer);
+}
+
+static void winpr_pool_timer_swap(PTP_TIMER timer, HANDLE hTimer)
+{
+	HANDLE hOldTimer;
+
+	EnterCriticalSection(&timer->Object.Lock);
+	hOldTimer = timer->TimerQueueTimer;
+	timer->TimerQueueTimer = hTimer;
+	LeaveCriticalSection(&timer->Object.Lock);
+
+	/* wait for a firing in progress, which must not hold the object lock */
+
+	if (hOldTimer)
+		DeleteTimerQueueTimer(timer->Object.Pool->TimerQueue, hOldTimer, INVALID_HANDLE_VALUE);
+}
+
+static void winpr_pool_timer_stop(TP_OBJECT* object)
+{
+	winpr_pool_timer_swap((PTP_TIMER) object, NULL);
+}
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+	PTP_TIMER timer;
+
+	timer = (PTP_TIMER) malloc(sizeof(TP_TIMER));
+
+	if (!timer)
+		return NULL;
+
+	winpr_pool_object_init(&timer->Object, pv, pcbe, winpr_pool_timer_execute);
+	timer->Object.Stop = winpr_pool_timer_stop;
+
+	timer->Callback = pfnti;
+	timer->TimerQueueTimer = NULL;
+
+	if (!timer->Object.Pool || !winpr_pool_timer_queue(timer->Object.Pool))
+	{
+		winpr_pool_object_close(&timer->Object);
+		return NULL;
+	}
+
+	return timer;
+}
+
+VOID CloseThreadpoolTimer(PTP_TIMER pti)
+{
+	winpr_pool_timer_stop(&pti->Object);
+	winpr_pool_object_close(&pti->Object);
+}
+
+/**
+ * A NULL due time cancels the timer, without cancelling the callbacks that
+ * are already queued. The window length is ignored: timers are not coalesced.
+ */
+
+VOID SetThreadpoolTimer(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength)
+{
+	INT64 due;
+	HANDLE hTimer = NULL;
+
+	if (pftDueTime)
+	{
+		due = winpr_pool_filetime_to_ms(pftDueTime);
+
+		if (due > 0xFFFFFFFE)
+			due = 0xFFFFFFFE;
+
+		if (!CreateTimerQueueTimer(&hTimer, pti->Object.Pool->TimerQueue, winpr_pool_timer_fired,
+				pti, (DWORD) due, msPeriod, WT_EXECUTEINTIMERTHREAD))
+		{
+			/* SetThreadpoolTimer cannot fail, the timer stays unset and the error is kept */
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			hTimer = NULL;
+		}
+	}
+
+	winpr_pool_timer_swap(pti, hTimer);
+}
+
+BOOL IsThreadpoolTimerSet(PTP_TIMER pti)
+{
+	BOOL status;
+
+	EnterCriticalSection(&pti->Object.Lock);
+	status = (pti->TimerQueueTimer != NULL) ? TRUE : FALSE;
+	LeaveCriticalSection(&pti->Object.Lock);
+
+	return status;
+}
+
+VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER pti, BOOL fCancelPendingCallbacks)
+{
+	winpr_pool_object_wait(&pti->Object, fCancelPendingCallbacks);
+}
+
+#endif
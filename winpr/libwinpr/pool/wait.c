@@ -0,0 +1,319 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Wait)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+#include <winpr/error.h>
+
+/**
+ * CreateThreadpoolWait
+ * CloseThreadpoolWait
+ * SetThreadpoolWait
+ * WaitForThreadpoolWaitCallbacks
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+/**
+ * Registered waits are spread over waiter threads, each one waiting with
+ * WaitForMultipleObjects() on a control event and up to 63 handles. The
+ * waits are one-shot: a signaled or timed out wait is unregistered and its
+ * callback queued to the workers. Registrations are protected by the wait
+ * lock of the pool, and the control event makes the waiter pick them up.
+ */
+
+static void winpr_pool_waiter_remove(TP_WAITER* waiter, int index)
+{
+	waiter->Waits[index]->Waiter = NULL;
+	waiter->Waits[index] = waiter->Waits[--waiter->Count];
+}
+
+static void* winpr_pool_waiter_thread(void* arg)
+{
+	int index;
+	int count;
+	DWORD status;
+	UINT64 now;
+	UINT64 deadline;
+	DWORD dwMilliseconds;
+	TP_WAITER* waiter = (TP_WAITER*) arg;
+	PTP_POOL pool = waiter->Pool;
+	PTP_WAIT waits[MAXIMUM_WAIT_OBJECTS - 1];
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+
+	while (1)
+	{
+		EnterCriticalSection(&pool->WaitLock);
+
+		if (waiter->Shutdown)
+		{
+			LeaveCriticalSection(&pool->WaitLock);
+			break;
+		}
+
+		deadline = 0;
+		count = waiter->Count;
+		handles[0] = waiter->Control;
+
+		for (index = 0; index < count; index++)
+		{
+			waits[index] = waiter->Waits[index];
+			handles[index + 1] = waits[index]->Handle;
+
+			if (waits[index]->Deadline && (!deadline || (waits[index]->Deadline < deadline)))
+				deadline = waits[index]->Deadline;
+		}
+
+		LeaveCriticalSection(&pool->WaitLock);
+
+		dwMilliseconds = INFINITE;
+
+		if (deadline)
+		{
+			now = winpr_pool_get_time();
+			dwMilliseconds = (deadline > now) ? (DWORD) (deadline - now) : 0;
+		}
+
+		status = WaitForMultipleObjects(count + 1, handles, FALSE, dwMilliseconds);
+
+		if (status == WAIT_FAILED)
+		{
+			/* a registered handle was closed, which is not allowed */
+			Sleep(10);
+			continue;
+		}
+
+		EnterCriticalSection(&pool->WaitLock);
+
+		if ((status > WAIT_OBJECT_0) && (status <= WAIT_OBJECT_0 + count))
+		{
+			index = status - WAIT_OBJECT_0 - 1;
+
+			/* the wait may have been changed while we were waiting */
+
+			for (count = 0; count < waiter->Count; count++)
+			{
+				if ((waiter->Waits[count] == waits[index]) && (waits[index]->Handle == handles[index + 1]))
+				{
+					winpr_pool_waiter_remove(waiter, count);
+					winpr_pool_object_submit(&waits[index]->Object, WAIT_OBJECT_0);
+					break;
+				}
+			}
+		}
+
+		now = winpr_pool_get_time();
+
+		for (index = 0; index < waiter->Count; )
+		{
+			if (waiter->Waits[index]->Deadline && (waiter->Waits[index]->Deadline <= now))
+			{
+				PTP_WAIT wait = waiter->Waits[index];
+
+				winpr_pool_waiter_remove(waiter, index);
+				winpr_pool_object_submit(&wait->Object, WAIT_TIMEOUT);
+				continue;
+			}
+
+			index++;
+		}
+
+		LeaveCriticalSection(&pool->WaitLock);
+	}
+
+	return NULL;
+}
+
+/* called with the wait lock held */
+
+static TP_WAITER* winpr_pool_waiter_get(PTP_POOL pool)
+{
+	TP_WAITER* waiter;
+
+	for (waiter = pool->Waiters; waiter; waiter = waiter->Next)
+	{
+		if (waiter->Count < MAXIMUM_WAIT_OBJECTS - 1)
+			return waiter;
+	}
+
+	waiter = (TP_WAITER*) calloc(1, sizeof(TP_WAITER));
+
+	if (!waiter)
+		return NULL;
+
+	waiter->Pool = pool;
+	waiter->Control = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (!waiter->Control)
+	{
+		free(waiter);
+		return NULL;
+	}
+
+	if (pthread_create(&waiter->Thread, NULL, winpr_pool_waiter_thread, waiter) != 0)
+	{
+		CloseHandle(waiter->Control);
+		free(waiter);
+		return NULL;
+	}
+
+	waiter->Next = pool->Waiters;
+	pool->Waiters = waiter;
+
+	return waiter;
+}
+
+void winpr_pool_waiters_free(PTP_POOL pool)
+{
+	TP_WAITER* waiter;
+
+	EnterCriticalSection(&pool->WaitLock);
+
+	for (waiter = pool->Waiters; waiter; waiter = waiter->Next)
+	{
+		waiter->Shutdown = TRUE;
+		SetEvent(waiter->Control);
+	}
+
+	LeaveCriticalSection(&pool->WaitLock);
+
+	while (pool->Waiters)
+	{
+		waiter = pool->Waiters;
+		pool->Waiters = waiter->Next;
+
+		pthread_join(waiter->Thread, NULL);
+
+		while (waiter->Count > 0)
+			winpr_pool_waiter_remove(waiter, 0);
+
+		CloseHandle(waiter->Control);
+		free(waiter);
+	}
+}
+
+static void winpr_pool_wait_execute(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result)
+{
+	PTP_WAIT wait = (PTP_WAIT) object;
+
+	wait->Callback(instance, object->Context, wait, result);
+}
+
+static void winpr_pool_wait_stop(TP_OBJECT* object)
+{
+	SetThreadpoolWait((PTP_WAIT) object, NULL, NULL);
+}
+
+PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK pfnwa, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+	PTP_WAIT wait;
+
+	wait = (PTP_WAIT) malloc(sizeof(TP_WAIT));
+
+	if (!wait)
+		return NULL;
+
+	winpr_pool_object_init(&wait->Object, pv, pcbe, winpr_pool_wait_execute);
+	wait->Object.Stop = winpr_pool_wait_stop;
+
+	wait->Callback = pfnwa;
+	wait->Handle = NULL;
+	wait->Deadline = 0;
+	wait->Waiter = NULL;
+
+	if (!wait->Object.Pool)
+	{
+		winpr_pool_object_close(&wait->Object);
+		return NULL;
+	}
+
+	return wait;
+}
+
+VOID CloseThreadpoolWait(PTP_WAIT pwa)
+{
+	winpr_pool_wait_stop(&pwa->Object);
+	winpr_pool_object_close(&pwa->Object);
+}
+
+/**
+ * A NULL handle unregisters the wait. A NULL timeout waits forever, and a
+ * zero timeout only tests the handle.
+ */
+
+VOID SetThreadpoolWait(PTP_WAIT pwa, HANDLE h, PFILETIME pftTimeout)
+{
+	int index;
+	TP_WAITER* waiter;
+	PTP_POOL pool = pwa->Object.Pool;
+
+	EnterCriticalSection(&pool->WaitLock);
+
+	waiter = pwa->Waiter;
+
+	if (waiter)
+	{
+		for (index = 0; index < waiter->Count; index++)
+		{
+			if (waiter->Waits[index] == pwa)
+			{
+				winpr_pool_waiter_remove(waiter, index);
+				break;
+			}
+		}
+
+		SetEvent(waiter->Control);
+	}
+
+	pwa->Handle = h;
+	pwa->Deadline = 0;
+
+	if (h)
+	{
+		if (pftTimeout)
+			pwa->Deadline = winpr_pool_get_time() + winpr_pool_filetime_to_ms(pftTimeout);
+
+		waiter = winpr_pool_waiter_get(pool);
+
+		if (waiter)
+		{
+			pwa->Waiter = waiter;
+			waiter->Waits[waiter->Count++] = pwa;
+			SetEvent(waiter->Control);
+		}
+		else
+		{
+			/* SetThreadpoolWait cannot fail, the wait stays unset and the error is kept */
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		}
+	}
+
+	LeaveCriticalSection(&pool->WaitLock);
+}
+
+VOID WaitForThreadpoolWaitCallbacks(PTP_WAIT pwa, BOOL fCancelPendingCallbacks)
+{
+	winpr_pool_object_wait(&pwa->Object, fCancelPendingCallbacks);
+}
+
+#endif
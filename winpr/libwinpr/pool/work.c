@@ -0,0 +1,111 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Thread Pool API (Work)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/pool.h>
+
+/**
+ * CreateThreadpoolWork
+ * CloseThreadpoolWork
+ * SubmitThreadpoolWork
+ * TrySubmitThreadpoolCallback
+ * WaitForThreadpoolWorkCallbacks
+ */
+
+#ifndef _WIN32
+
+#include "pool.h"
+
+static void winpr_pool_work_execute(TP_OBJECT* object, PTP_CALLBACK_INSTANCE instance, TP_WAIT_RESULT result)
+{
+	PTP_WORK work = (PTP_WORK) object;
+
+	if (work->SimpleCallback)
+		work->SimpleCallback(instance, object->Context);
+	else
+		work->Callback(instance, object->Context, work);
+}
+
+PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+	PTP_WORK work;
+
+	work = (PTP_WORK) malloc(sizeof(TP_WORK));
+
+	if (!work)
+		return NULL;
+
+	winpr_pool_object_init(&work->Object, pv, pcbe, winpr_pool_work_execute);
+
+	if (!work->Object.Pool)
+	{
+		winpr_pool_object_close(&work->Object);
+		return NULL;
+	}
+
+	work->Callback = pfnwk;
+	work->SimpleCallback = NULL;
+
+	return work;
+}
+
+VOID CloseThreadpoolWork(PTP_WORK pwk)
+{
+	winpr_pool_object_close(&pwk->Object);
+}
+
+VOID SubmitThreadpoolWork(PTP_WORK pwk)
+{
+	winpr_pool_object_submit(&pwk->Object, 0);
+}
+
+/**
+ * Simple callbacks are work objects that close themselves once their
+ * callback returned.
+ */
+
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfns, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+	PTP_WORK work;
+
+	work = CreateThreadpoolWork(NULL, pv, pcbe);
+
+	if (!work)
+		return FALSE;
+
+	work->SimpleCallback = pfns;
+	work->Object.AutoClose = TRUE;
+
+	if (!winpr_pool_object_submit(&work->Object, 0))
+	{
+		CloseThreadpoolWork(work);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+VOID WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallbacks)
+{
+	winpr_pool_object_wait(&pwk->Object, fCancelPendingCallbacks);
+}
+
+#endif
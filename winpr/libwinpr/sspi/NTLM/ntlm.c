@@ -621,10 +621,8 @@ SECURITY_STATUS SEC_ENTRY ntlm_EncryptMessage(PCtxtHandle phContext, ULONG fQOP,
 	if (!signature_buffer)
 		return SEC_E_INVALID_TOKEN;
 
-	/* Copy original data buffer */
 	length = data_buffer->cbBuffer;
-	data = malloc(length);
-	CopyMemory(data, data_buffer->pvBuffer, length);
+	data = data_buffer->pvBuffer;
 
 	/* Compute the HMAC-MD5 hash of ConcatenationOf(seq_num,data) using the client signing key */
 	HMAC_CTX_init(&hmac);
@@ -634,25 +632,23 @@ SECURITY_STATUS SEC_ENTRY ntlm_EncryptMessage(PCtxtHandle phContext, ULONG fQOP,
 	HMAC_Final(&hmac, digest, NULL);
 	HMAC_CTX_cleanup(&hmac);
 
-	/* Encrypt message using with RC4, result overwrites original buffer */
-
-	if (context->confidentiality)
-		RC4(&context->SendRc4Seal, length, data, data_buffer->pvBuffer);
-	else
-		CopyMemory(data_buffer->pvBuffer, data, length);
-
 #ifdef WITH_DEBUG_NTLM
 	printf("Data Buffer (length = %d)\n", length);
 	winpr_HexDump(data, length);
 	printf("\n");
+#endif
+
+	/* Encrypt message in place using RC4, the data buffer is left as is without confidentiality */
+
+	if (context->confidentiality)
+		RC4(&context->SendRc4Seal, length, data, data);
 
+#ifdef WITH_DEBUG_NTLM
 	printf("Encrypted Data Buffer (length = %d)\n", (int) data_buffer->cbBuffer);
 	winpr_HexDump(data_buffer->pvBuffer, data_buffer->cbBuffer);
 	printf("\n");
 #endif
 
-	free(data);
-
 	/* RC4-encrypt first 8 bytes of digest */
 	RC4(&context->SendRc4Seal, 8, digest, checksum);
 
@@ -237,27 +237,12 @@ void ntlm_fetch_ntlm_v2_hash(NTLM_CONTEXT* context, char* hash)
 			(LPWSTR) context->identity.User, context->identity.UserLength * 2,
 			(LPWSTR) context->identity.Domain, context->identity.DomainLength * 2);
 
-	if (entry != NULL)
+	if (entry == NULL)
 	{
-#ifdef WITH_DEBUG_NTLM
-		printf("NTLM Hash:\n");
-		winpr_HexDump(entry->NtHash, 16);
-#endif
-
-		NTOWFv2FromHashW(entry->NtHash,
-			(LPWSTR) context->identity.User, context->identity.UserLength * 2,
-			(LPWSTR) context->identity.Domain, context->identity.DomainLength * 2,
-			(BYTE*) hash);
-
-		SamFreeEntry(sam, entry);
-		SamClose(sam);
-
-		return;
+		entry = SamLookupUserW(sam,
+			(LPWSTR) context->identity.User, context->identity.UserLength * 2, NULL, 0);
 	}
 
-	entry = SamLookupUserW(sam,
-		(LPWSTR) context->identity.User, context->identity.UserLength * 2, NULL, 0);
-
 	if (entry != NULL)
 	{
 #ifdef WITH_DEBUG_NTLM
@@ -271,14 +256,13 @@ void ntlm_fetch_ntlm_v2_hash(NTLM_CONTEXT* context, char* hash)
 			(BYTE*) hash);
 
 		SamFreeEntry(sam, entry);
-		SamClose(sam);
-
-		return;
 	}
 	else
 	{
 		printf("Error: Could not find user in SAM database\n");
 	}
+
+	SamClose(sam);
 }
 
 void ntlm_compute_ntlm_v2_hash(NTLM_CONTEXT* context, char* hash)
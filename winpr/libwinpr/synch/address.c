@@ -23,6 +23,8 @@
 
 #include <winpr/synch.h>
 
+#include "synch.h"
+
 /**
  * WakeByAddressAll
  * WakeByAddressSingle
@@ -31,18 +33,163 @@
 
 #ifndef _WIN32
 
-VOID WakeByAddressAll(PVOID Address)
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/**
+ * Waiters which cannot use a futex park on one of a fixed set of buckets,
+ * hashed by address. A bucket lock is held between checking the value and
+ * going to sleep, and wakers take it before signaling, so no wakeup is lost.
+ * Unrelated addresses may share a bucket, which only causes spurious wakeups.
+ */
+
+#define WINPR_PARKING_BUCKETS		64
+
+struct winpr_parking_bucket
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+typedef struct winpr_parking_bucket WINPR_PARKING_BUCKET;
+
+static pthread_once_t parking_once = PTHREAD_ONCE_INIT;
+static WINPR_PARKING_BUCKET parking_buckets[WINPR_PARKING_BUCKETS];
+
+static void winpr_parking_init(void)
 {
+	int index;
 
+	for (index = 0; index < WINPR_PARKING_BUCKETS; index++)
+	{
+		pthread_mutex_init(&parking_buckets[index].mutex, NULL);
+		pthread_cond_init(&parking_buckets[index].cond, NULL);
+	}
 }
 
-VOID WakeByAddressSingle(PVOID Address)
+static WINPR_PARKING_BUCKET* winpr_parking_bucket(VOID volatile* address)
 {
+	ULONG_PTR key = (ULONG_PTR) address;
+
+	pthread_once(&parking_once, winpr_parking_init);
+
+	key = (key >> 3) ^ (key >> 11);
 
+	return &parking_buckets[key % WINPR_PARKING_BUCKETS];
+}
+
+static void winpr_abs_timeout(struct timespec* ts, DWORD dwMilliseconds)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	ts->tv_sec = tv.tv_sec + (dwMilliseconds / 1000);
+	ts->tv_nsec = (tv.tv_usec * 1000) + ((dwMilliseconds % 1000) * 1000000);
+
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static int winpr_parking_wait(VOID volatile* address, PVOID CompareAddress, SIZE_T AddressSize, DWORD dwMilliseconds)
+{
+	int status = 0;
+	struct timespec timeout;
+	WINPR_PARKING_BUCKET* bucket;
+
+	bucket = winpr_parking_bucket(address);
+
+	if (dwMilliseconds != INFINITE)
+		winpr_abs_timeout(&timeout, dwMilliseconds);
+
+	pthread_mutex_lock(&bucket->mutex);
+
+	if (memcmp((void*) address, CompareAddress, AddressSize) == 0)
+	{
+		if (dwMilliseconds == INFINITE)
+			status = pthread_cond_wait(&bucket->cond, &bucket->mutex);
+		else
+			status = pthread_cond_timedwait(&bucket->cond, &bucket->mutex, &timeout);
+	}
+
+	pthread_mutex_unlock(&bucket->mutex);
+
+	return (status == ETIMEDOUT) ? WINPR_FUTEX_TIMEOUT : 0;
+}
+
+static void winpr_parking_wake(VOID volatile* address)
+{
+	WINPR_PARKING_BUCKET* bucket;
+
+	bucket = winpr_parking_bucket(address);
+
+	pthread_mutex_lock(&bucket->mutex);
+	pthread_cond_broadcast(&bucket->cond);
+	pthread_mutex_unlock(&bucket->mutex);
+}
+
+int winpr_futex_wait(INT32 volatile* address, INT32 value, DWORD dwMilliseconds)
+{
+#ifdef __linux__
+	int status;
+	struct timespec timeout;
+
+	if (dwMilliseconds != INFINITE)
+	{
+		timeout.tv_sec = dwMilliseconds / 1000;
+		timeout.tv_nsec = (dwMilliseconds % 1000) * 1000000;
+	}
+
+	status = syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value,
+			(dwMilliseconds == INFINITE) ? NULL : &timeout, NULL, 0);
+
+	if ((status < 0) && (errno == ETIMEDOUT))
+		return WINPR_FUTEX_TIMEOUT;
+
+	return 0;
+#else
+	return winpr_parking_wait(address, &value, sizeof(INT32), dwMilliseconds);
+#endif
+}
+
+void winpr_futex_wake(INT32 volatile* address, int count)
+{
+#ifdef __linux__
+	syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+	winpr_parking_wake(address);
+#endif
+}
+
+VOID WakeByAddressAll(PVOID Address)
+{
+	winpr_parking_wake(Address);
+}
+
+VOID WakeByAddressSingle(PVOID Address)
+{
+	/* waiters on a bucket cannot be told apart, wake them all and let them recheck */
+	winpr_parking_wake(Address);
 }
 
 BOOL WaitOnAddress(VOID volatile *Address, PVOID CompareAddress, SIZE_T AddressSize, DWORD dwMilliseconds)
 {
+	if ((AddressSize != 1) && (AddressSize != 2) && (AddressSize != 4) && (AddressSize != 8))
+		return FALSE;
+
+	if (winpr_parking_wait(Address, CompareAddress, AddressSize, dwMilliseconds) == WINPR_FUTEX_TIMEOUT)
+		return FALSE;
+
 	return TRUE;
 }
 
@@ -35,29 +35,74 @@
 
 #ifndef _WIN32
 
+#include <limits.h>
+
+/**
+ * The condition variable holds a 32-bit wakeup sequence number. Sleepers
+ * sample it before releasing their lock and wait for it to change, so that
+ * a wake issued between the release and the wait is never lost.
+ */
+
+#define CONDITION_SEQUENCE(_cv)		((INT32 volatile*) &(_cv)->Sequence)
+
 VOID InitializeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
 {
-
+	ConditionVariable->Ptr = NULL;
 }
 
 BOOL SleepConditionVariableCS(PCONDITION_VARIABLE ConditionVariable, PCRITICAL_SECTION CriticalSection, DWORD dwMilliseconds)
 {
-	return TRUE;
+	int status;
+	INT32 sequence;
+	LONG RecursionCount;
+
+	sequence = *CONDITION_SEQUENCE(ConditionVariable);
+
+	/* release the critical section completely, even if entered recursively */
+	RecursionCount = CriticalSection->RecursionCount;
+	CriticalSection->RecursionCount = 1;
+	LeaveCriticalSection(CriticalSection);
+
+	status = winpr_futex_wait(CONDITION_SEQUENCE(ConditionVariable), sequence, dwMilliseconds);
+
+	EnterCriticalSection(CriticalSection);
+	CriticalSection->RecursionCount = RecursionCount;
+
+	return (status == WINPR_FUTEX_TIMEOUT) ? FALSE : TRUE;
 }
 
 BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE ConditionVariable, PSRWLOCK SRWLock, DWORD dwMilliseconds, ULONG Flags)
 {
-	return TRUE;
+	int status;
+	INT32 sequence;
+
+	sequence = *CONDITION_SEQUENCE(ConditionVariable);
+
+	if (Flags & CONDITION_VARIABLE_LOCKMODE_SHARED)
+		ReleaseSRWLockShared(SRWLock);
+	else
+		ReleaseSRWLockExclusive(SRWLock);
+
+	status = winpr_futex_wait(CONDITION_SEQUENCE(ConditionVariable), sequence, dwMilliseconds);
+
+	if (Flags & CONDITION_VARIABLE_LOCKMODE_SHARED)
+		AcquireSRWLockShared(SRWLock);
+	else
+		AcquireSRWLockExclusive(SRWLock);
+
+	return (status == WINPR_FUTEX_TIMEOUT) ? FALSE : TRUE;
 }
 
 VOID WakeAllConditionVariable(PCONDITION_VARIABLE ConditionVariable)
 {
-
+	winpr_atomic_add(CONDITION_SEQUENCE(ConditionVariable), 1);
+	winpr_futex_wake(CONDITION_SEQUENCE(ConditionVariable), INT_MAX);
 }
 
 VOID WakeConditionVariable(PCONDITION_VARIABLE ConditionVariable)
 {
-
+	winpr_atomic_add(CONDITION_SEQUENCE(ConditionVariable), 1);
+	winpr_futex_wake(CONDITION_SEQUENCE(ConditionVariable), 1);
 }
 
 #endif
@@ -21,6 +21,7 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
 #include <winpr/synch.h>
 
 /**
@@ -36,44 +37,164 @@
 
 #ifndef _WIN32
 
-VOID InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+#include <unistd.h>
+
+#include "synch.h"
+
+/**
+ * LockCount is the 32-bit futex word: 0 when free, 1 when held and 2 when
+ * held with possible sleepers, so that leaving an uncontended critical
+ * section never enters the kernel. RecursionCount and OwningThread are only
+ * written by the owner and give Windows recursion semantics.
+ *
+ * Before sleeping, EnterCriticalSection spins up to SpinCount times while
+ * the owner is still running, but not once other threads are already queued.
+ */
+
+#define CRITICAL_SECTION_SPIN_MASK		0x00FFFFFF
+#define CRITICAL_SECTION_DEFAULT_SPIN		4000
+
+#define winpr_current_thread()			((PVOID) (ULONG_PTR) pthread_self())
+
+DWORD winpr_synch_default_spin_count(void)
 {
+	static long processors = 0;
+
+	if (processors == 0)
+	{
+#if defined(_SC_NPROCESSORS_ONLN)
+		processors = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (processors < 1)
+			processors = 1;
+	}
 
+	/* spinning only helps when the owner can run at the same time */
+	return (processors > 1) ? CRITICAL_SECTION_DEFAULT_SPIN : 0;
+}
+
+VOID InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	InitializeCriticalSectionEx(lpCriticalSection, winpr_synch_default_spin_count(), 0);
 }
 
 BOOL InitializeCriticalSectionEx(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount, DWORD Flags)
 {
+	ZeroMemory(lpCriticalSection, sizeof(CRITICAL_SECTION));
+	SetCriticalSectionSpinCount(lpCriticalSection, dwSpinCount);
 	return TRUE;
 }
 
 BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount)
 {
-	return TRUE;
+	return InitializeCriticalSectionEx(lpCriticalSection, dwSpinCount, 0);
 }
 
 DWORD SetCriticalSectionSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount)
 {
-	return 0;
+	DWORD dwPreviousSpinCount = lpCriticalSection->SpinCount;
+
+	/* like Windows, ignore the spin count on single processor systems */
+	if (winpr_synch_default_spin_count() == 0)
+		dwSpinCount = 0;
+
+	lpCriticalSection->SpinCount = dwSpinCount & CRITICAL_SECTION_SPIN_MASK;
+
+	return dwPreviousSpinCount;
 }
 
-VOID EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+static BOOL winpr_critical_section_spin(LPCRITICAL_SECTION lpCriticalSection)
 {
+	ULONG spin;
+	INT32 volatile* lock = &lpCriticalSection->LockCount;
+
+	for (spin = lpCriticalSection->SpinCount; spin > 0; spin--)
+	{
+		INT32 state = *lock;
+
+		if (state == 0)
+		{
+			if (winpr_atomic_cas(lock, 1, 0) == 0)
+				return TRUE;
+		}
+		else if (state == 2)
+		{
+			/* others are already sleeping, spinning would only delay them */
+			break;
+		}
+
+		YieldProcessor();
+	}
+
+	return FALSE;
+}
 
+VOID EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	INT32 state;
+	PVOID current = winpr_current_thread();
+	INT32 volatile* lock = &lpCriticalSection->LockCount;
+
+	if (lpCriticalSection->OwningThread == current)
+	{
+		lpCriticalSection->RecursionCount++;
+		return;
+	}
+
+	state = winpr_atomic_cas(lock, 1, 0);
+
+	if ((state != 0) && !winpr_critical_section_spin(lpCriticalSection))
+	{
+		if (state != 2)
+			state = winpr_atomic_swap(lock, 2);
+
+		while (state != 0)
+		{
+			winpr_futex_wait(lock, 2, INFINITE);
+			state = winpr_atomic_swap(lock, 2);
+		}
+	}
+
+	lpCriticalSection->OwningThread = current;
+	lpCriticalSection->RecursionCount = 1;
 }
 
 BOOL TryEnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
+	PVOID current = winpr_current_thread();
+
+	if (lpCriticalSection->OwningThread == current)
+	{
+		lpCriticalSection->RecursionCount++;
+		return TRUE;
+	}
+
+	if (winpr_atomic_cas(&lpCriticalSection->LockCount, 1, 0) != 0)
+		return FALSE;
+
+	lpCriticalSection->OwningThread = current;
+	lpCriticalSection->RecursionCount = 1;
+
 	return TRUE;
 }
 
 VOID LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
+	if (--lpCriticalSection->RecursionCount > 0)
+		return;
+
+	lpCriticalSection->OwningThread = NULL;
 
+	if (winpr_atomic_add(&lpCriticalSection->LockCount, -1) != 0)
+	{
+		lpCriticalSection->LockCount = 0;
+		winpr_futex_wake(&lpCriticalSection->LockCount, 1);
+	}
 }
 
 VOID DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
-
+	ZeroMemory(lpCriticalSection, sizeof(CRITICAL_SECTION));
 }
 
 #endif
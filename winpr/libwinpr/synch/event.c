@@ -38,54 +38,139 @@
 
 #include "synch.h"
 
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 
-HANDLE CreateEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpName)
+#ifdef HAVE_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+static BOOL winpr_event_create_fd(WINPR_EVENT* event)
 {
-	WINPR_EVENT* event;
-	HANDLE handle = NULL;
+	event->pipe_fd[0] = -1;
+	event->pipe_fd[1] = -1;
 
-	event = (WINPR_EVENT*) malloc(sizeof(WINPR_EVENT));
+#ifdef HAVE_EVENTFD_H
+	event->pipe_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (event->pipe_fd[0] < 0)
+		return FALSE;
+#else
+	if (pipe(event->pipe_fd) < 0)
+		return FALSE;
+
+	fcntl(event->pipe_fd[0], F_SETFL, fcntl(event->pipe_fd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(event->pipe_fd[1], F_SETFL, fcntl(event->pipe_fd[1], F_GETFL) | O_NONBLOCK);
+#endif
+
+	return TRUE;
+}
+
+#ifndef HAVE_EVENTFD_H
+static BOOL winpr_event_is_set(WINPR_EVENT* event)
+{
+	struct pollfd pfd;
+
+	pfd.fd = event->pipe_fd[0];
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return (poll(&pfd, 1, 0) == 1);
+}
+#endif
+
+static BOOL winpr_event_signal(WINPR_EVENT* event)
+{
+#ifdef HAVE_EVENTFD_H
+	eventfd_t value = 1;
 
-	if (event)
+	if ((write(event->pipe_fd[0], &value, sizeof(value)) != sizeof(value)) && (errno != EAGAIN))
+		return FALSE;
+#else
+	if (winpr_event_is_set(event))
+		return TRUE;
+
+	if ((write(event->pipe_fd[1], "", 1) != 1) && (errno != EAGAIN))
+		return FALSE;
+#endif
+
+	return TRUE;
+}
+
+/**
+ * Consume the signal of an event whose descriptor polled readable.
+ * Manual-reset events stay signaled, auto-reset events are reset by the
+ * first waiter to get here: the others see FALSE and go back to waiting.
+ */
+
+BOOL winpr_event_acquire(WINPR_EVENT* event)
+{
+	if (event->bManualReset || event->bAttached)
+		return TRUE;
+
+#ifdef HAVE_EVENTFD_H
+	{
+		eventfd_t value;
+		return (read(event->pipe_fd[0], &value, sizeof(value)) == sizeof(value));
+	}
+#else
 	{
-		event->bManualReset = bManualReset;
+		BYTE buffer[32];
+		return (read(event->pipe_fd[0], buffer, sizeof(buffer)) > 0);
+	}
+#endif
+}
+
+static HANDLE winpr_event_new(BOOL bManualReset, BOOL bInitialState)
+{
+	WINPR_EVENT* event;
 
-		if (!event->bManualReset)
-		{
-			printf("CreateEventW: auto-reset events not yet implemented\n");
-		}
+	event = (WINPR_EVENT*) malloc(sizeof(WINPR_EVENT));
 
-		event->pipe_fd[0] = -1;
-		event->pipe_fd[1] = -1;
+	if (!event)
+		return NULL;
 
-		if (pipe(event->pipe_fd) < 0)
-		{
-			printf("CreateEventW: failed to create event\n");
-			return NULL;
-		}
+	event->bManualReset = bManualReset;
+	event->bAttached = FALSE;
 
-		handle = winpr_Handle_Insert(HANDLE_TYPE_EVENT, event);
+	if (!winpr_event_create_fd(event))
+	{
+		printf("CreateEventW: failed to create event\n");
+		free(event);
+		return NULL;
 	}
 
-	return handle;
+	if (bInitialState)
+		winpr_event_signal(event);
+
+	return winpr_Handle_Insert(HANDLE_TYPE_EVENT, event);
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpName)
+{
+	return winpr_event_new(bManualReset, bInitialState);
 }
 
 HANDLE CreateEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName)
 {
-	return CreateEventW(lpEventAttributes, bManualReset, bInitialState, NULL);
+	return winpr_event_new(bManualReset, bInitialState);
 }
 
 HANDLE CreateEventExW(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess)
 {
-	return NULL;
+	return winpr_event_new((dwFlags & CREATE_EVENT_MANUAL_RESET) ? TRUE : FALSE,
+			(dwFlags & CREATE_EVENT_INITIAL_SET) ? TRUE : FALSE);
 }
 
 HANDLE CreateEventExA(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess)
 {
-	return NULL;
+	return winpr_event_new((dwFlags & CREATE_EVENT_MANUAL_RESET) ? TRUE : FALSE,
+			(dwFlags & CREATE_EVENT_INITIAL_SET) ? TRUE : FALSE);
 }
 
 HANDLE OpenEventW(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCWSTR lpName)
@@ -102,46 +187,89 @@ BOOL SetEvent(HANDLE hEvent)
 {
 	ULONG Type;
 	PVOID Object;
-	int length;
 	WINPR_EVENT* event;
 
-	if (!winpr_Handle_GetInfo(hEvent, &Type, &Object))
+	if (!winpr_Handle_GetInfo(hEvent, &Type, &Object) || (Type != HANDLE_TYPE_EVENT))
 		return FALSE;
 
 	event = (WINPR_EVENT*) Object;
 
-	if (WaitForSingleObject(hEvent, 0) == WAIT_OBJECT_0)
-		return TRUE;
-
-	length = write(event->pipe_fd[1], "sig", 4);
-
-	if (length != 4)
+	if (event->bAttached)
 		return FALSE;
 
-	return TRUE;
+	return winpr_event_signal(event);
 }
 
 BOOL ResetEvent(HANDLE hEvent)
 {
 	ULONG Type;
 	PVOID Object;
-	int length;
 	WINPR_EVENT* event;
 
-	if (!winpr_Handle_GetInfo(hEvent, &Type, &Object))
+	if (!winpr_Handle_GetInfo(hEvent, &Type, &Object) || (Type != HANDLE_TYPE_EVENT))
 		return FALSE;
 
 	event = (WINPR_EVENT*) Object;
 
-	while (WaitForSingleObject(hEvent, 0) == WAIT_OBJECT_0)
+	if (event->bAttached)
+		return FALSE;
+
+#ifdef HAVE_EVENTFD_H
 	{
-		length = read(event->pipe_fd[0], &length, 4);
+		eventfd_t value;
 
-		if (length != 4)
+		if ((read(event->pipe_fd[0], &value, sizeof(value)) < 0) && (errno != EAGAIN))
 			return FALSE;
 	}
+#else
+	{
+		BYTE buffer[32];
+
+		while (read(event->pipe_fd[0], buffer, sizeof(buffer)) > 0);
+	}
+#endif
 
 	return TRUE;
 }
 
+/**
+ * Wrap an existing file descriptor (typically a socket) in an event handle
+ * so that it can be passed to WaitForMultipleObjects() along with other
+ * objects. The event is signaled while the descriptor is readable, it cannot
+ * be set or reset, and closing the handle leaves the descriptor open.
+ */
+
+HANDLE CreateFileDescriptorEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, int FileDescriptor)
+{
+	WINPR_EVENT* event;
+
+	event = (WINPR_EVENT*) malloc(sizeof(WINPR_EVENT));
+
+	if (!event)
+		return NULL;
+
+	event->bManualReset = TRUE;
+	event->bAttached = TRUE;
+	event->pipe_fd[0] = FileDescriptor;
+	event->pipe_fd[1] = -1;
+
+	return winpr_Handle_Insert(HANDLE_TYPE_EVENT, event);
+}
+
+HANDLE CreateFileDescriptorEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, int FileDescriptor)
+{
+	return CreateFileDescriptorEventW(lpEventAttributes, bManualReset, bInitialState, FileDescriptor);
+}
+
+int GetEventFileDescriptor(HANDLE hEvent)
+{
+	ULONG Type;
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(hEvent, &Type, &Object) || (Type != HANDLE_TYPE_EVENT))
+		return -1;
+
+	return ((WINPR_EVENT*) Object)->pipe_fd[0];
+}
+
 #endif
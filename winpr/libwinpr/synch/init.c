@@ -32,6 +32,16 @@
 
 #ifndef _WIN32
 
+#include <pthread.h>
+
+/**
+ * One-time initializations are run under a single lock: they are rare, and
+ * a caller arriving while one runs waits for it to complete. The callback
+ * must not start another one-time initialization.
+ */
+
+static pthread_mutex_t init_once_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 BOOL InitOnceBeginInitialize(LPINIT_ONCE lpInitOnce, DWORD dwFlags, PBOOL fPending, LPVOID* lpContext)
 {
 	return TRUE;
@@ -44,12 +54,27 @@ BOOL InitOnceComplete(LPINIT_ONCE lpInitOnce, DWORD dwFlags, LPVOID lpContext)
 
 BOOL InitOnceExecuteOnce(PINIT_ONCE InitOnce, PINIT_ONCE_FN InitFn, PVOID Parameter, LPVOID* Context)
 {
-	return TRUE;
+	BOOL status = TRUE;
+
+	pthread_mutex_lock(&init_once_mutex);
+
+	/* a failed initialization is attempted again by the next caller */
+	if (!InitOnce->Ptr)
+	{
+		status = InitFn(InitOnce, Parameter, Context);
+
+		if (status)
+			InitOnce->Ptr = (PVOID) 1;
+	}
+
+	pthread_mutex_unlock(&init_once_mutex);
+
+	return status;
 }
 
 VOID InitOnceInitialize(PINIT_ONCE InitOnce)
 {
-
+	InitOnce->Ptr = NULL;
 }
 
 #endif
@@ -22,6 +22,7 @@
 #endif
 
 #include <winpr/synch.h>
+#include <winpr/error.h>
 
 #include "synch.h"
 
@@ -35,24 +36,61 @@
 
 #ifndef _WIN32
 
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+/**
+ * The semaphore count lives in the kernel: an eventfd in semaphore mode,
+ * where each read takes one unit, or a pipe holding one byte per unit.
+ * lCount only mirrors it for ReleaseSemaphore's lpPreviousCount.
+ */
+
 HANDLE CreateSemaphoreW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCWSTR lpName)
 {
 	HANDLE handle;
-	winpr_sem_t* semaphore;
+	WINPR_SEMAPHORE* semaphore;
 
-	semaphore = (winpr_sem_t*) malloc(sizeof(winpr_sem_t));
+	semaphore = (WINPR_SEMAPHORE*) malloc(sizeof(WINPR_SEMAPHORE));
 
-	if (semaphore)
-	{
-#if defined __APPLE__
-		semaphore_create(mach_task_self(), semaphore, SYNC_POLICY_FIFO, lMaximumCount);
+	if (!semaphore)
+		return NULL;
+
+	semaphore->lCount = 0;
+	semaphore->lMaximumCount = lMaximumCount;
+	semaphore->pipe_fd[0] = -1;
+	semaphore->pipe_fd[1] = -1;
+
+#ifdef HAVE_EVENTFD_H
+	semaphore->pipe_fd[0] = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (semaphore->pipe_fd[0] < 0)
 #else
-		sem_init(semaphore, 0, lMaximumCount);
+	if (pipe(semaphore->pipe_fd) < 0)
 #endif
+	{
+		printf("CreateSemaphoreW: failed to create semaphore\n");
+		free(semaphore);
+		return NULL;
 	}
 
+#ifndef HAVE_EVENTFD_H
+	fcntl(semaphore->pipe_fd[0], F_SETFL, fcntl(semaphore->pipe_fd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(semaphore->pipe_fd[1], F_SETFL, fcntl(semaphore->pipe_fd[1], F_GETFL) | O_NONBLOCK);
+#endif
+
 	handle = winpr_Handle_Insert(HANDLE_TYPE_SEMAPHORE, (PVOID) semaphore);
 
+	if (lInitialCount > 0)
+		ReleaseSemaphore(handle, lInitialCount, NULL);
+
 	return handle;
 }
 
@@ -71,25 +109,88 @@ HANDLE OpenSemaphoreA(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCSTR lpName)
 	return NULL;
 }
 
+/**
+ * Take one unit from a semaphore whose descriptor polled readable,
+ * FALSE if another waiter took the last one first.
+ */
+
+BOOL winpr_semaphore_acquire(WINPR_SEMAPHORE* semaphore)
+{
+#ifdef HAVE_EVENTFD_H
+	eventfd_t value;
+
+	if (read(semaphore->pipe_fd[0], &value, sizeof(value)) != sizeof(value))
+		return FALSE;
+#else
+	BYTE value;
+
+	if (read(semaphore->pipe_fd[0], &value, 1) != 1)
+		return FALSE;
+#endif
+
+	winpr_atomic_add(&semaphore->lCount, -1);
+
+	return TRUE;
+}
+
 BOOL ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG lpPreviousCount)
 {
+	LONG count;
 	ULONG Type;
 	PVOID Object;
+	WINPR_SEMAPHORE* semaphore;
 
 	if (!winpr_Handle_GetInfo(hSemaphore, &Type, &Object))
 		return FALSE;
 
-	if (Type == HANDLE_TYPE_SEMAPHORE)
+	if (Type != HANDLE_TYPE_SEMAPHORE)
+		return FALSE;
+
+	semaphore = (WINPR_SEMAPHORE*) Object;
+
+	if (lReleaseCount <= 0)
+		return FALSE;
+
+	/* like on Windows, a release past the maximum count fails and leaves the count alone */
+	do
 	{
-#if defined __APPLE__
-		semaphore_signal(*((winpr_sem_t*) Object));
+		count = semaphore->lCount;
+
+		if (lReleaseCount > semaphore->lMaximumCount - count)
+		{
+			SetLastError(ERROR_TOO_MANY_POSTS);
+			return FALSE;
+		}
+	}
+	while (winpr_atomic_cas(&semaphore->lCount, count + lReleaseCount, count) != count);
+
+	if (lpPreviousCount)
+		*lpPreviousCount = count;
+
+#ifdef HAVE_EVENTFD_H
+	{
+		eventfd_t value = (eventfd_t) lReleaseCount;
+
+		if (write(semaphore->pipe_fd[0], &value, sizeof(value)) != sizeof(value))
+		{
+			winpr_atomic_add(&semaphore->lCount, -lReleaseCount);
+			return FALSE;
+		}
+	}
 #else
-		sem_post((winpr_sem_t*) Object);
-#endif
-		return TRUE;
+	while (lReleaseCount > 0)
+	{
+		if (write(semaphore->pipe_fd[1], "", 1) != 1)
+		{
+			winpr_atomic_add(&semaphore->lCount, -lReleaseCount);
+			return FALSE;
+		}
+
+		lReleaseCount--;
 	}
+#endif
 
-	return FALSE;
+	return TRUE;
 }
 
 #endif
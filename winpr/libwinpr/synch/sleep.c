@@ -30,14 +30,23 @@
 
 #ifndef _WIN32
 
+#include <time.h>
+#include <errno.h>
+
 VOID Sleep(DWORD dwMilliseconds)
 {
+	struct timespec ts;
+
+	ts.tv_sec = dwMilliseconds / 1000;
+	ts.tv_nsec = (dwMilliseconds % 1000) * 1000000;
 
+	while ((nanosleep(&ts, &ts) < 0) && (errno == EINTR));
 }
 
 DWORD SleepEx(DWORD dwMilliseconds, BOOL bAlertable)
 {
-	return TRUE;
+	Sleep(dwMilliseconds);
+	return 0;
 }
 
 #endif
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
+
 #include <winpr/synch.h>
 
 /**
@@ -35,39 +37,173 @@
 
 #ifndef _WIN32
 
+#include "synch.h"
+
+/**
+ * The lock state is the 32-bit futex word of the SRWLOCK:
+ *
+ * bit 0:	held exclusively
+ * bit 1:	readers are sleeping, waiting for writers to be done
+ * bits 2-15:	number of writers waiting
+ * bits 16-31:	number of readers holding the lock
+ *
+ * Writers are preferred: new readers queue up as soon as a writer is waiting.
+ * Releases only enter the kernel when somebody may be sleeping.
+ */
+
+#define SRW_WRITER		0x00000001
+#define SRW_READERS_WAITING	0x00000002
+#define SRW_WRITER_WAITING	0x00000004
+#define SRW_WRITERS_MASK	0x0000FFFC
+#define SRW_READER		0x00010000
+
+#define SRW_READERS(_s)		(((UINT32) (_s)) >> 16)
+#define SRW_SPIN_COUNT		100
+
+#define SRW_STATE(_lock)	((INT32 volatile*) &(_lock)->State)
+
 VOID InitializeSRWLock(PSRWLOCK SRWLock)
 {
-
+	SRWLock->Ptr = NULL;
 }
 
 VOID AcquireSRWLockExclusive(PSRWLOCK SRWLock)
 {
-
+	INT32 state;
+	int spin = SRW_SPIN_COUNT;
+	BOOL waiting = FALSE;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
+
+	while (1)
+	{
+		state = *lock;
+
+		if (!(state & SRW_WRITER) && (SRW_READERS(state) == 0))
+		{
+			INT32 next = state | SRW_WRITER;
+
+			if (waiting)
+				next -= SRW_WRITER_WAITING;
+
+			if (winpr_atomic_cas(lock, next, state) == state)
+				return;
+
+			continue;
+		}
+
+		if (spin > 0)
+		{
+			spin--;
+			YieldProcessor();
+			continue;
+		}
+
+		if (!waiting)
+		{
+			/* register, so that new readers hold back and releases wake us */
+			if (winpr_atomic_cas(lock, state + SRW_WRITER_WAITING, state) != state)
+				continue;
+
+			waiting = TRUE;
+			state += SRW_WRITER_WAITING;
+		}
+
+		winpr_futex_wait(lock, state, INFINITE);
+	}
 }
 
 VOID AcquireSRWLockShared(PSRWLOCK SRWLock)
 {
-
+	INT32 state;
+	int spin = SRW_SPIN_COUNT;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
+
+	while (1)
+	{
+		state = *lock;
+
+		if (!(state & (SRW_WRITER | SRW_WRITERS_MASK)))
+		{
+			if (winpr_atomic_cas(lock, state + SRW_READER, state) == state)
+				return;
+
+			continue;
+		}
+
+		if (spin > 0)
+		{
+			spin--;
+			YieldProcessor();
+			continue;
+		}
+
+		if (!(state & SRW_READERS_WAITING))
+		{
+			if (winpr_atomic_cas(lock, state | SRW_READERS_WAITING, state) != state)
+				continue;
+
+			state |= SRW_READERS_WAITING;
+		}
+
+		winpr_futex_wait(lock, state, INFINITE);
+	}
 }
 
 BOOL TryAcquireSRWLockExclusive(PSRWLOCK SRWLock)
 {
-	return TRUE;
+	INT32 state;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
+
+	state = *lock;
+
+	if ((state & SRW_WRITER) || (SRW_READERS(state) != 0))
+		return FALSE;
+
+	return (winpr_atomic_cas(lock, state | SRW_WRITER, state) == state) ? TRUE : FALSE;
 }
 
 BOOL TryAcquireSRWLockShared(PSRWLOCK SRWLock)
 {
+	INT32 state;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
+
+	do
+	{
+		state = *lock;
+
+		if (state & (SRW_WRITER | SRW_WRITERS_MASK))
+			return FALSE;
+	}
+	while (winpr_atomic_cas(lock, state + SRW_READER, state) != state);
+
 	return TRUE;
 }
 
 VOID ReleaseSRWLockExclusive(PSRWLOCK SRWLock)
 {
+	INT32 state;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
 
+	do
+	{
+		state = *lock;
+	}
+	while (winpr_atomic_cas(lock, state & ~(SRW_WRITER | SRW_READERS_WAITING), state) != state);
+
+	if (state & (SRW_READERS_WAITING | SRW_WRITERS_MASK))
+		winpr_futex_wake(lock, INT_MAX);
 }
 
 VOID ReleaseSRWLockShared(PSRWLOCK SRWLock)
 {
+	INT32 state;
+	INT32 volatile* lock = SRW_STATE(SRWLock);
+
+	state = winpr_atomic_add(lock, -SRW_READER);
 
+	/* the last reader out lets a waiting writer in */
+	if ((SRW_READERS(state) == 0) && (state & SRW_WRITERS_MASK))
+		winpr_futex_wake(lock, INT_MAX);
 }
 
 #endif
@@ -24,26 +24,70 @@
 
 #ifndef _WIN32
 
-#if defined __APPLE__
 #include <pthread.h>
-#include <semaphore.h>
-#include <mach/mach.h>
-#include <mach/semaphore.h>
-#include <mach/task.h>
-#define winpr_sem_t semaphore_t
-#else
-#include <pthread.h>
-#include <semaphore.h>
-#define winpr_sem_t sem_t
-#endif
+
+/**
+ * Events and semaphores are backed by a file descriptor so that any number
+ * of them can be waited on with a single poll() call. On Linux this is an
+ * eventfd (pipe_fd[1] is then -1), elsewhere a non-blocking pipe.
+ */
 
 struct winpr_event
 {
 	int pipe_fd[2];
 	BOOL bManualReset;
+	BOOL bAttached;
 };
 typedef struct winpr_event WINPR_EVENT;
 
+struct winpr_semaphore
+{
+	int pipe_fd[2];
+	LONG volatile lCount;
+	LONG lMaximumCount;
+};
+typedef struct winpr_semaphore WINPR_SEMAPHORE;
+
+struct winpr_timer
+{
+	int fd;
+	BOOL bManualReset;
+	LONG lPeriod;
+};
+typedef struct winpr_timer WINPR_TIMER;
+
+BOOL winpr_event_acquire(WINPR_EVENT* event);
+BOOL winpr_semaphore_acquire(WINPR_SEMAPHORE* semaphore);
+BOOL winpr_timer_acquire(WINPR_TIMER* timer);
+
+/**
+ * Futex-style primitives used by the slim synchronization objects
+ * (critical sections, SRW locks and condition variables).
+ *
+ * winpr_futex_wait() sleeps as long as *address still holds value and nobody
+ * calls winpr_futex_wake() on it. It may return spuriously, and returns
+ * WINPR_FUTEX_TIMEOUT once dwMilliseconds have elapsed.
+ */
+
+#define WINPR_FUTEX_TIMEOUT		1
+
+int winpr_futex_wait(INT32 volatile* address, INT32 value, DWORD dwMilliseconds);
+void winpr_futex_wake(INT32 volatile* address, int count);
+
+#define winpr_atomic_cas(_p, _new, _old)	__sync_val_compare_and_swap(_p, _old, _new)
+#define winpr_atomic_add(_p, _v)		__sync_add_and_fetch(_p, _v)
+#define winpr_atomic_swap(_p, _v)		__sync_lock_test_and_set(_p, _v)
+
+#if defined(__i386__) || defined(__x86_64__)
+#define YieldProcessor()	__asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH_7A__))
+#define YieldProcessor()	__asm__ __volatile__("yield" ::: "memory")
+#else
+#define YieldProcessor()	__sync_synchronize()
+#endif
+
+DWORD winpr_synch_default_spin_count(void);
+
 #endif
 
 #endif /* WINPR_SYNCH_PRIVATE_H */
@@ -0,0 +1,126 @@
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#define TEST_SYNCH_OPERATIONS		400000
+
+static CRITICAL_SECTION critical;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int iterations;
+static LONG volatile counter;
+
+static void* test_critical_thread(void* arg)
+{
+	int index;
+
+	for (index = 0; index < iterations; index++)
+	{
+		EnterCriticalSection(&critical);
+		counter++;
+		LeaveCriticalSection(&critical);
+	}
+
+	return NULL;
+}
+
+static void* test_mutex_thread(void* arg)
+{
+	int index;
+
+	for (index = 0; index < iterations; index++)
+	{
+		pthread_mutex_lock(&mutex);
+		counter++;
+		pthread_mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
+
+static long test_contention(void* (*thread_fn)(void*), int nThreads)
+{
+	int index;
+	struct timeval start;
+	struct timeval end;
+	pthread_t threads[16];
+
+	counter = 0;
+	iterations = TEST_SYNCH_OPERATIONS / nThreads;
+
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < nThreads; index++)
+		pthread_create(&threads[index], NULL, thread_fn, NULL);
+
+	for (index = 0; index < nThreads; index++)
+		pthread_join(threads[index], NULL);
+
+	gettimeofday(&end, NULL);
+
+	if (counter != iterations * nThreads)
+		return -1;
+
+	return ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+}
+
+int TestSynchCritical(int argc, char* argv[])
+{
+	int nThreads;
+	long critical_usec;
+	long mutex_usec;
+
+	/* recursion */
+
+	InitializeCriticalSectionAndSpinCount(&critical, 100);
+
+	EnterCriticalSection(&critical);
+	EnterCriticalSection(&critical);
+
+	if (!TryEnterCriticalSection(&critical))
+	{
+		printf("TryEnterCriticalSection failed on a recursively owned critical section\n");
+		return -1;
+	}
+
+	if (critical.RecursionCount != 3)
+	{
+		printf("RecursionCount: Actual: %d, Expected: %d\n", (int) critical.RecursionCount, 3);
+		return -1;
+	}
+
+	LeaveCriticalSection(&critical);
+	LeaveCriticalSection(&critical);
+	LeaveCriticalSection(&critical);
+
+	if ((critical.LockCount != 0) || (critical.OwningThread != NULL))
+	{
+		printf("critical section still owned after leaving it\n");
+		return -1;
+	}
+
+	/* mutual exclusion and contention against pthread_mutex */
+
+	for (nThreads = 1; nThreads <= 16; nThreads *= 2)
+	{
+		critical_usec = test_contention(test_critical_thread, nThreads);
+		mutex_usec = test_contention(test_mutex_thread, nThreads);
+
+		if ((critical_usec < 0) || (mutex_usec < 0))
+		{
+			printf("lost updates with %d threads\n", nThreads);
+			return -1;
+		}
+
+		printf("%2d threads, %d operations: critical section %ld us, pthread_mutex %ld us\n",
+				nThreads, TEST_SYNCH_OPERATIONS, critical_usec, mutex_usec);
+	}
+
+	DeleteCriticalSection(&critical);
+
+	return 0;
+}
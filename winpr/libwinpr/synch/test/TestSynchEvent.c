@@ -0,0 +1,175 @@
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#define TEST_EVENT_WAITERS		4
+
+static HANDLE event;
+static LONG volatile woken = 0;
+
+static void* test_event_waiter(void* arg)
+{
+	if (WaitForSingleObject(event, INFINITE) == WAIT_OBJECT_0)
+		InterlockedIncrement(&woken);
+
+	return NULL;
+}
+
+static long test_event_elapsed(struct timeval* start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+
+	return ((end.tv_sec - start->tv_sec) * 1000) + ((end.tv_usec - start->tv_usec) / 1000);
+}
+
+int TestSynchEvent(int argc, char* argv[])
+{
+	int index;
+	long elapsed;
+	int pipe_fd[2];
+	struct timeval start;
+	HANDLE threads[TEST_EVENT_WAITERS];
+
+	/* manual-reset events stay signaled until reset */
+
+	event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (WaitForSingleObject(event, 0) != WAIT_TIMEOUT)
+	{
+		printf("manual-reset event signaled after creation\n");
+		return -1;
+	}
+
+	SetEvent(event);
+	SetEvent(event);
+
+	if ((WaitForSingleObject(event, 0) != WAIT_OBJECT_0) || (WaitForSingleObject(event, 0) != WAIT_OBJECT_0))
+	{
+		printf("manual-reset event not signaled after SetEvent\n");
+		return -1;
+	}
+
+	ResetEvent(event);
+
+	if (WaitForSingleObject(event, 0) != WAIT_TIMEOUT)
+	{
+		printf("manual-reset event signaled after ResetEvent\n");
+		return -1;
+	}
+
+	CloseHandle(event);
+
+	/* auto-reset events are reset by the wait that consumes them */
+
+	event = CreateEventEx(NULL, NULL, CREATE_EVENT_INITIAL_SET, 0);
+
+	if (WaitForSingleObject(event, 0) != WAIT_OBJECT_0)
+	{
+		printf("initially set auto-reset event not signaled\n");
+		return -1;
+	}
+
+	if (WaitForSingleObject(event, 0) != WAIT_TIMEOUT)
+	{
+		printf("auto-reset event still signaled after a wait\n");
+		return -1;
+	}
+
+	/* timeouts longer than a second are honored */
+
+	gettimeofday(&start, NULL);
+
+	if (WaitForSingleObject(event, 1100) != WAIT_TIMEOUT)
+	{
+		printf("wait on an unsignaled event did not time out\n");
+		return -1;
+	}
+
+	elapsed = test_event_elapsed(&start);
+
+	if ((elapsed < 1090) || (elapsed > 3000))
+	{
+		printf("1100 ms wait took %ld ms\n", elapsed);
+		return -1;
+	}
+
+	/* each SetEvent on an auto-reset event releases exactly one waiter */
+
+	for (index = 0; index < TEST_EVENT_WAITERS; index++)
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_event_waiter, NULL, 0, NULL);
+
+	Sleep(50);
+	SetEvent(event);
+	Sleep(100);
+
+	if (woken != 1)
+	{
+		printf("SetEvent on an auto-reset event woke %d waiters\n", (int) woken);
+		return -1;
+	}
+
+	for (index = 1; index < TEST_EVENT_WAITERS; index++)
+	{
+		SetEvent(event);
+		Sleep(10);
+	}
+
+	if (WaitForMultipleObjects(TEST_EVENT_WAITERS, threads, TRUE, 5000) != WAIT_OBJECT_0)
+	{
+		printf("waiter threads did not exit\n");
+		return -1;
+	}
+
+	if (woken != TEST_EVENT_WAITERS)
+	{
+		printf("woken: Actual: %d, Expected: %d\n", (int) woken, TEST_EVENT_WAITERS);
+		return -1;
+	}
+
+	for (index = 0; index < TEST_EVENT_WAITERS; index++)
+		CloseHandle(threads[index]);
+
+	CloseHandle(event);
+
+	/* file descriptor events follow the readability of the descriptor */
+
+	if (pipe(pipe_fd) < 0)
+		return -1;
+
+	event = CreateFileDescriptorEvent(NULL, TRUE, FALSE, pipe_fd[0]);
+
+	if (WaitForSingleObject(event, 0) != WAIT_TIMEOUT)
+	{
+		printf("file descriptor event signaled on an empty pipe\n");
+		return -1;
+	}
+
+	if (write(pipe_fd[1], "x", 1) != 1)
+		return -1;
+
+	if (WaitForSingleObject(event, 0) != WAIT_OBJECT_0)
+	{
+		printf("file descriptor event not signaled on a readable pipe\n");
+		return -1;
+	}
+
+	if (GetEventFileDescriptor(event) != pipe_fd[0])
+	{
+		printf("GetEventFileDescriptor returned the wrong descriptor\n");
+		return -1;
+	}
+
+	CloseHandle(event);
+	close(pipe_fd[0]);
+	close(pipe_fd[1]);
+
+	return 0;
+}
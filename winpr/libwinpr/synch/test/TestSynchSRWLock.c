@@ -0,0 +1,139 @@
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#define TEST_SRW_READERS		4
+#define TEST_SRW_WRITERS		2
+#define TEST_SRW_ITERATIONS		20000
+
+static SRWLOCK lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE cond = CONDITION_VARIABLE_INIT;
+
+static int values[2];
+static BOOL torn = FALSE;
+static int produced = 0;
+
+static void* test_srw_reader(void* arg)
+{
+	int index;
+
+	for (index = 0; index < TEST_SRW_ITERATIONS; index++)
+	{
+		AcquireSRWLockShared(&lock);
+
+		if (values[0] != values[1])
+			torn = TRUE;
+
+		ReleaseSRWLockShared(&lock);
+	}
+
+	return NULL;
+}
+
+static void* test_srw_writer(void* arg)
+{
+	int index;
+
+	for (index = 0; index < TEST_SRW_ITERATIONS; index++)
+	{
+		AcquireSRWLockExclusive(&lock);
+		values[0]++;
+		values[1]++;
+		ReleaseSRWLockExclusive(&lock);
+	}
+
+	return NULL;
+}
+
+static void* test_srw_producer(void* arg)
+{
+	AcquireSRWLockExclusive(&lock);
+	produced = 1;
+	ReleaseSRWLockExclusive(&lock);
+
+	WakeAllConditionVariable(&cond);
+
+	return NULL;
+}
+
+int TestSynchSRWLock(int argc, char* argv[])
+{
+	int index;
+	pthread_t threads[TEST_SRW_READERS + TEST_SRW_WRITERS];
+
+	/* exclusive access excludes shared access */
+
+	if (!TryAcquireSRWLockExclusive(&lock))
+	{
+		printf("TryAcquireSRWLockExclusive failed on a free lock\n");
+		return -1;
+	}
+
+	if (TryAcquireSRWLockShared(&lock))
+	{
+		printf("TryAcquireSRWLockShared succeeded on an exclusively held lock\n");
+		return -1;
+	}
+
+	ReleaseSRWLockExclusive(&lock);
+
+	/* shared access is shared */
+
+	AcquireSRWLockShared(&lock);
+
+	if (!TryAcquireSRWLockShared(&lock))
+	{
+		printf("TryAcquireSRWLockShared failed on a shared lock\n");
+		return -1;
+	}
+
+	if (TryAcquireSRWLockExclusive(&lock))
+	{
+		printf("TryAcquireSRWLockExclusive succeeded on a shared lock\n");
+		return -1;
+	}
+
+	ReleaseSRWLockShared(&lock);
+	ReleaseSRWLockShared(&lock);
+
+	/* concurrent readers never observe a half-done write */
+
+	for (index = 0; index < TEST_SRW_READERS; index++)
+		pthread_create(&threads[index], NULL, test_srw_reader, NULL);
+
+	for (index = 0; index < TEST_SRW_WRITERS; index++)
+		pthread_create(&threads[TEST_SRW_READERS + index], NULL, test_srw_writer, NULL);
+
+	for (index = 0; index < TEST_SRW_READERS + TEST_SRW_WRITERS; index++)
+		pthread_join(threads[index], NULL);
+
+	if (torn || (values[0] != TEST_SRW_WRITERS * TEST_SRW_ITERATIONS))
+	{
+		printf("SRW lock failed to serialize writers\n");
+		return -1;
+	}
+
+	/* condition variable */
+
+	AcquireSRWLockExclusive(&lock);
+
+	if (SleepConditionVariableSRW(&cond, &lock, 10, 0))
+	{
+		printf("SleepConditionVariableSRW did not time out\n");
+		return -1;
+	}
+
+	pthread_create(&threads[0], NULL, test_srw_producer, NULL);
+
+	while (!produced)
+		SleepConditionVariableSRW(&cond, &lock, INFINITE, 0);
+
+	ReleaseSRWLockExclusive(&lock);
+
+	pthread_join(threads[0], NULL);
+
+	return 0;
+}
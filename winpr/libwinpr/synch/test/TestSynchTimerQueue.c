@@ -0,0 +1,152 @@
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+#define TEST_TIMER_COUNT		2000
+#define TEST_TIMER_PERIOD		20
+#define TEST_TIMER_DURATION		500
+
+static LONG volatile fired[TEST_TIMER_COUNT];
+static LONG volatile total = 0;
+
+static HANDLE self_timer;
+static HANDLE self_queue;
+static HANDLE self_done;
+
+static void test_timer_callback(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+{
+	InterlockedIncrement(&fired[(size_t) lpParameter]);
+	InterlockedIncrement(&total);
+}
+
+static void test_timer_self_delete(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
+{
+	DeleteTimerQueueTimer(self_queue, self_timer, NULL);
+	SetEvent(self_done);
+}
+
+int TestSynchTimerQueue(int argc, char* argv[])
+{
+	int index;
+	LONG expected;
+	HANDLE hTimer;
+	HANDLE hTimerQueue;
+	HANDLE handles[2];
+	LARGE_INTEGER due;
+	HANDLE timers[TEST_TIMER_COUNT];
+
+	/* waitable timers can be waited on along with other objects */
+
+	hTimer = CreateWaitableTimer(NULL, FALSE, NULL);
+	handles[0] = CreateEvent(NULL, TRUE, FALSE, NULL);
+	handles[1] = hTimer;
+
+	due.QuadPart = -50 * 10000;
+
+	if (!SetWaitableTimer(hTimer, &due, 10, NULL, NULL, FALSE))
+	{
+		printf("SetWaitableTimer failed\n");
+		return -1;
+	}
+
+	if (WaitForMultipleObjects(2, handles, FALSE, 20) != WAIT_TIMEOUT)
+	{
+		printf("waitable timer signaled before its due time\n");
+		return -1;
+	}
+
+	for (index = 0; index < 5; index++)
+	{
+		if (WaitForMultipleObjects(2, handles, FALSE, 1000) != WAIT_OBJECT_0 + 1)
+		{
+			printf("periodic waitable timer did not fire (period %d)\n", index);
+			return -1;
+		}
+	}
+
+	CancelWaitableTimer(hTimer);
+
+	if (WaitForSingleObject(hTimer, 50) != WAIT_TIMEOUT)
+	{
+		printf("cancelled waitable timer fired\n");
+		return -1;
+	}
+
+	CloseHandle(hTimer);
+	CloseHandle(handles[0]);
+
+	/* one queue thread services thousands of periodic timers */
+
+	hTimerQueue = CreateTimerQueue();
+
+	for (index = 0; index < TEST_TIMER_COUNT; index++)
+	{
+		if (!CreateTimerQueueTimer(&timers[index], hTimerQueue, test_timer_callback,
+				(PVOID) (size_t) index, index % TEST_TIMER_PERIOD, TEST_TIMER_PERIOD, 0))
+		{
+			printf("CreateTimerQueueTimer failed\n");
+			return -1;
+		}
+	}
+
+	Sleep(TEST_TIMER_DURATION);
+
+	for (index = 0; index < TEST_TIMER_COUNT; index++)
+		DeleteTimerQueueTimer(hTimerQueue, timers[index], INVALID_HANDLE_VALUE);
+
+	expected = TEST_TIMER_DURATION / TEST_TIMER_PERIOD;
+
+	for (index = 0; index < TEST_TIMER_COUNT; index++)
+	{
+		if ((fired[index] < expected / 2) || (fired[index] > expected + 2))
+		{
+			printf("timer %d fired %d times, expected about %d\n", index, (int) fired[index], (int) expected);
+			return -1;
+		}
+	}
+
+	printf("%d timers fired %d times in %d ms\n", TEST_TIMER_COUNT, (int) total, TEST_TIMER_DURATION);
+
+	/* deleted timers no longer fire */
+
+	expected = total;
+	Sleep(3 * TEST_TIMER_PERIOD);
+
+	if (total != expected)
+	{
+		printf("deleted timers kept firing\n");
+		return -1;
+	}
+
+	/* a one-shot timer may delete itself from its callback */
+
+	self_queue = hTimerQueue;
+	self_done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	CreateTimerQueueTimer(&self_timer, hTimerQueue, test_timer_self_delete, NULL, 10, 0, WT_EXECUTEONLYONCE);
+
+	if (WaitForSingleObject(self_done, 1000) != WAIT_OBJECT_0)
+	{
+		printf("one-shot timer did not fire\n");
+		return -1;
+	}
+
+	CloseHandle(self_done);
+
+	/* deleting the queue frees the one-shot timers which already fired */
+
+	total = 0;
+	CreateTimerQueueTimer(&hTimer, hTimerQueue, test_timer_callback, NULL, 0, 0, WT_EXECUTEONLYONCE);
+
+	while (total == 0)
+		Sleep(1);
+
+	DeleteTimerQueue(hTimerQueue);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/error.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+static HANDLE start;
+
+static void* test_wait_thread(void* arg)
+{
+	WaitForSingleObject(start, INFINITE);
+	return NULL;
+}
+
+int TestSynchWaitForMultipleObjects(int argc, char* argv[])
+{
+	int index;
+	DWORD status;
+	LONG previous;
+	HANDLE handles[4];
+
+	handles[0] = CreateEvent(NULL, FALSE, FALSE, NULL);
+	handles[1] = CreateEvent(NULL, FALSE, FALSE, NULL);
+	handles[2] = CreateSemaphore(NULL, 0, 8, NULL);
+	handles[3] = CreateMutex(NULL, FALSE, NULL);
+
+	/* the lowest signaled index wins */
+
+	SetEvent(handles[1]);
+	ReleaseSemaphore(handles[2], 2, &previous);
+
+	status = WaitForMultipleObjects(3, handles, FALSE, 0);
+
+	if (status != WAIT_OBJECT_0 + 1)
+	{
+		printf("WaitForMultipleObjects: Actual: 0x%04X, Expected: 0x%04X\n", status, WAIT_OBJECT_0 + 1);
+		return -1;
+	}
+
+	/* the semaphore hands out exactly its count */
+
+	if ((WaitForMultipleObjects(3, handles, FALSE, 0) != WAIT_OBJECT_0 + 2) ||
+			(WaitForMultipleObjects(3, handles, FALSE, 0) != WAIT_OBJECT_0 + 2) ||
+			(WaitForMultipleObjects(3, handles, FALSE, 10) != WAIT_TIMEOUT))
+	{
+		printf("semaphore count not honored\n");
+		return -1;
+	}
+
+	/* waiting for all objects does not consume any of them until all are signaled */
+
+	SetEvent(handles[0]);
+	ReleaseSemaphore(handles[2], 1, &previous);
+
+	if (previous != 0)
+	{
+		printf("ReleaseSemaphore: previous count %d, expected 0\n", (int) previous);
+		return -1;
+	}
+
+	if (WaitForMultipleObjects(4, handles, TRUE, 20) != WAIT_TIMEOUT)
+	{
+		printf("wait for all completed with an unsignaled event\n");
+		return -1;
+	}
+
+	if (WaitForSingleObject(handles[0], 0) != WAIT_OBJECT_0)
+	{
+		printf("wait for all consumed an auto-reset event\n");
+		return -1;
+	}
+
+	SetEvent(handles[0]);
+	SetEvent(handles[1]);
+
+	if (WaitForMultipleObjects(4, handles, TRUE, 1000) != WAIT_OBJECT_0)
+	{
+		printf("wait for all failed with every object signaled\n");
+		return -1;
+	}
+
+	if ((WaitForSingleObject(handles[0], 0) != WAIT_TIMEOUT) ||
+			(WaitForSingleObject(handles[2], 0) != WAIT_TIMEOUT))
+	{
+		printf("wait for all did not acquire every object\n");
+		return -1;
+	}
+
+	ReleaseMutex(handles[3]);
+
+	/* releases past the maximum count fail without changing the count */
+
+	if (!ReleaseSemaphore(handles[2], 8, &previous) || ReleaseSemaphore(handles[2], 1, &previous) ||
+			(GetLastError() != ERROR_TOO_MANY_POSTS))
+	{
+		printf("ReleaseSemaphore: maximum count not honored\n");
+		return -1;
+	}
+
+	for (index = 0; index < 8; index++)
+	{
+		if (WaitForSingleObject(handles[2], 0) != WAIT_OBJECT_0)
+		{
+			printf("semaphore lost units on a failed release\n");
+			return -1;
+		}
+	}
+
+	/* thread handles are signaled once the thread exits */
+
+	CloseHandle(handles[1]);
+
+	start = CreateEvent(NULL, TRUE, FALSE, NULL);
+	handles[1] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_wait_thread, NULL, 0, NULL);
+
+	if (WaitForSingleObject(handles[1], 20) != WAIT_TIMEOUT)
+	{
+		printf("thread handle signaled while the thread runs\n");
+		return -1;
+	}
+
+	status = SignalObjectAndWait(start, handles[1], 5000, FALSE);
+
+	if (status != WAIT_OBJECT_0)
+	{
+		printf("SignalObjectAndWait: Actual: 0x%04X, Expected: 0x%04X\n", status, WAIT_OBJECT_0);
+		return -1;
+	}
+
+	CloseHandle(handles[0]);
+	CloseHandle(handles[1]);
+	CloseHandle(handles[2]);
+	CloseHandle(handles[3]);
+	CloseHandle(start);
+
+	return 0;
+}
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <winpr/crt.h>
+#include <winpr/file.h>
 #include <winpr/synch.h>
 
 /**
@@ -29,30 +31,167 @@
  * SetWaitableTimer
  * SetWaitableTimerEx
  * CancelWaitableTimer
+ * CreateTimerQueue
+ * DeleteTimerQueue
+ * DeleteTimerQueueEx
+ * CreateTimerQueueTimer
+ * ChangeTimerQueueTimer
+ * DeleteTimerQueueTimer
  */
 
 #ifndef _WIN32
 
-HANDLE CreateWaitableTimerExA(LPSECURITY_ATTRIBUTES lpTimerAttributes, LPCSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess)
+#include "synch.h"
+
+#include <time.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+#ifndef HAVE_PTHREAD_CONDATTR_SETCLOCK
+#include <sys/time.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+/**
+ * Waitable timers are timerfds, readable once the timer expired, which lets
+ * WaitForMultipleObjects() wait on them along with events and semaphores.
+ * Completion routines (APCs) are not supported and are ignored.
+ */
+
+static HANDLE winpr_timer_new(BOOL bManualReset)
 {
+#ifdef HAVE_TIMERFD_H
+	WINPR_TIMER* timer;
+
+	timer = (WINPR_TIMER*) malloc(sizeof(WINPR_TIMER));
+
+	if (!timer)
+		return NULL;
+
+	timer->lPeriod = 0;
+	timer->bManualReset = bManualReset;
+	timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (timer->fd < 0)
+	{
+		printf("CreateWaitableTimer: failed to create timer\n");
+		free(timer);
+		return NULL;
+	}
+
+	return winpr_Handle_Insert(HANDLE_TYPE_TIMER, timer);
+#else
+	printf("CreateWaitableTimer: not supported on this platform\n");
 	return NULL;
+#endif
+}
+
+HANDLE CreateWaitableTimerA(LPSECURITY_ATTRIBUTES lpTimerAttributes, BOOL bManualReset, LPCSTR lpTimerName)
+{
+	return winpr_timer_new(bManualReset);
+}
+
+HANDLE CreateWaitableTimerW(LPSECURITY_ATTRIBUTES lpTimerAttributes, BOOL bManualReset, LPCWSTR lpTimerName)
+{
+	return winpr_timer_new(bManualReset);
+}
+
+HANDLE CreateWaitableTimerExA(LPSECURITY_ATTRIBUTES lpTimerAttributes, LPCSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess)
+{
+	return winpr_timer_new((dwFlags & CREATE_WAITABLE_TIMER_MANUAL_RESET) ? TRUE : FALSE);
 }
 
 HANDLE CreateWaitableTimerExW(LPSECURITY_ATTRIBUTES lpTimerAttributes, LPCWSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess)
 {
-	return NULL;
+	return winpr_timer_new((dwFlags & CREATE_WAITABLE_TIMER_MANUAL_RESET) ? TRUE : FALSE);
+}
+
+/**
+ * Consume the expiration of a timer whose descriptor polled readable.
+ * Manual-reset timers stay signaled until they are set again.
+ */
+
+BOOL winpr_timer_acquire(WINPR_TIMER* timer)
+{
+	UINT64 expirations;
+
+	if (timer->bManualReset)
+		return TRUE;
+
+	return (read(timer->fd, &expirations, sizeof(expirations)) == sizeof(expirations));
 }
 
 BOOL SetWaitableTimer(HANDLE hTimer, const LARGE_INTEGER* lpDueTime, LONG lPeriod,
 		PTIMERAPCROUTINE pfnCompletionRoutine, LPVOID lpArgToCompletionRoutine, BOOL fResume)
 {
+#ifdef HAVE_TIMERFD_H
+	ULONG Type;
+	PVOID Object;
+	INT64 dueTime;
+	WINPR_TIMER* timer;
+	struct timespec now;
+	struct itimerspec spec;
+
+	if (!winpr_Handle_GetInfo(hTimer, &Type, &Object) || (Type != HANDLE_TYPE_TIMER))
+		return FALSE;
+
+	if (!lpDueTime || (lPeriod < 0))
+		return FALSE;
+
+	timer = (WINPR_TIMER*) Object;
+	timer->lPeriod = lPeriod;
+
+	/* negative due times are relative, positive ones absolute, both in 100 ns units */
+
+	dueTime = lpDueTime->QuadPart;
+
+	if (dueTime >= 0)
+	{
+		/* 116444736000000000 is the FILETIME of the unix epoch */
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		dueTime -= 116444736000000000LL + (((INT64) now.tv_sec) * 10000000) + (now.tv_nsec / 100);
+		dueTime = (dueTime > 0) ? -dueTime : 0;
+	}
+
+	dueTime = -dueTime;
+
+	ZeroMemory(&spec, sizeof(spec));
+
+	/* a zero it_value would disarm the timer instead of firing it right away */
+
+	spec.it_value.tv_sec = dueTime / 10000000;
+	spec.it_value.tv_nsec = (dueTime % 10000000) * 100;
+
+	if ((spec.it_value.tv_sec == 0) && (spec.it_value.tv_nsec == 0))
+		spec.it_value.tv_nsec = 1;
+
+	spec.it_interval.tv_sec = lPeriod / 1000;
+	spec.it_interval.tv_nsec = (lPeriod % 1000) * 1000000;
+
+	if (timerfd_settime(timer->fd, 0, &spec, NULL) < 0)
+		return FALSE;
+
 	return TRUE;
+#else
+	return FALSE;
+#endif
 }
 
 BOOL SetWaitableTimerEx(HANDLE hTimer, const LARGE_INTEGER* lpDueTime, LONG lPeriod,
 		PTIMERAPCROUTINE pfnCompletionRoutine, LPVOID lpArgToCompletionRoutine, PREASON_CONTEXT WakeContext, ULONG TolerableDelay)
 {
-	return TRUE;
+	return SetWaitableTimer(hTimer, lpDueTime, lPeriod, pfnCompletionRoutine, lpArgToCompletionRoutine, FALSE);
 }
 
 HANDLE OpenWaitableTimerA(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCSTR lpTimerName)
@@ -67,6 +206,536 @@ HANDLE OpenWaitableTimerW(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCWSTR lp
 
 BOOL CancelWaitableTimer(HANDLE hTimer)
 {
+#ifdef HAVE_TIMERFD_H
+	ULONG Type;
+	PVOID Object;
+	struct itimerspec spec;
+
+	if (!winpr_Handle_GetInfo(hTimer, &Type, &Object) || (Type != HANDLE_TYPE_TIMER))
+		return FALSE;
+
+	ZeroMemory(&spec, sizeof(spec));
+
+	if (timerfd_settime(((WINPR_TIMER*) Object)->fd, 0, &spec, NULL) < 0)
+		return FALSE;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Timer queues run the callbacks of any number of timers from a single
+ * thread. Pending timers are kept in a binary min-heap ordered by due time,
+ * so adding, changing or deleting a timer is O(log n) and the queue thread
+ * only ever sleeps until the earliest due time.
+ *
+ * Callbacks run on the queue thread with the queue unlocked and must not
+ * block: a slow callback delays every other timer of the queue.
+ */
+
+typedef struct winpr_timer_queue WINPR_TIMER_QUEUE;
+typedef struct winpr_timer_queue_timer WINPR_TIMER_QUEUE_TIMER;
+
+struct winpr_timer_queue_timer
+{
+	UINT64 DueTime;
+	DWORD Period;
+	ULONG Flags;
+	PVOID Parameter;
+	WAITORTIMERCALLBACK Callback;
+
+	int index;
+	BOOL bChanged;
+	BOOL bDeleted;
+	HANDLE CompletionEvent;
+	WINPR_TIMER_QUEUE* queue;
+
+	WINPR_TIMER_QUEUE_TIMER* prev;
+	WINPR_TIMER_QUEUE_TIMER* next;
+};
+
+struct winpr_timer_queue
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_cond_t done;
+	BOOL bCancelled;
+
+	int count;
+	int size;
+	WINPR_TIMER_QUEUE_TIMER** heap;
+	WINPR_TIMER_QUEUE_TIMER* current;
+
+	/* every timer not deleted yet, including one-shot timers which already fired */
+	WINPR_TIMER_QUEUE_TIMER* timers;
+};
+
+static pthread_once_t default_queue_once = PTHREAD_ONCE_INIT;
+static WINPR_TIMER_QUEUE* default_queue = NULL;
+
+static UINT64 timer_queue_get_time(void)
+{
+#ifdef __APPLE__
+	mach_timebase_info_data_t timebase;
+
+	mach_timebase_info(&timebase);
+
+	return ((mach_absolute_time() * timebase.numer) / timebase.denom) / 1000000;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+#endif
+}
+
+/**
+ * The queue thread waits on a monotonic condition variable where
+ * pthread_condattr_setclock() exists, and on a realtime deadline
+ * computed from the time left otherwise (Mac OS X).
+ */
+
+static void timer_queue_get_deadline(UINT64 dueTime, UINT64 now, struct timespec* deadline)
+{
+#ifndef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	dueTime = (((UINT64) tv.tv_sec) * 1000) + (tv.tv_usec / 1000) + (dueTime - now);
+#endif
+
+	deadline->tv_sec = dueTime / 1000;
+	deadline->tv_nsec = (dueTime % 1000) * 1000000;
+}
+
+static void timer_queue_heap_swap(WINPR_TIMER_QUEUE* queue, int i, int j)
+{
+	WINPR_TIMER_QUEUE_TIMER* timer;
+
+	timer = queue->heap[i];
+	queue->heap[i] = queue->heap[j];
+	queue->heap[j] = timer;
+
+	queue->heap[i]->index = i;
+	queue->heap[j]->index = j;
+}
+
+static void timer_queue_heap_sift(WINPR_TIMER_QUEUE* queue, int index)
+{
+	int child;
+	int parent;
+
+	while (index > 0)
+	{
+		parent = (index - 1) / 2;
+
+		if (queue->heap[parent]->DueTime <= queue->heap[index]->DueTime)
+			break;
+
+		timer_queue_heap_swap(queue, parent, index);
+		index = parent;
+	}
+
+	while (1)
+	{
+		child = (2 * index) + 1;
+
+		if (child >= queue->count)
+			break;
+
+		if ((child + 1 < queue->count) && (queue->heap[child + 1]->DueTime < queue->heap[child]->DueTime))
+			child++;
+
+		if (queue->heap[index]->DueTime <= queue->heap[child]->DueTime)
+			break;
+
+		timer_queue_heap_swap(queue, index, child);
+		index = child;
+	}
+}
+
+static BOOL timer_queue_heap_insert(WINPR_TIMER_QUEUE* queue, WINPR_TIMER_QUEUE_TIMER* timer)
+{
+	if (queue->count >= queue->size)
+	{
+		int size = queue->size * 2;
+		WINPR_TIMER_QUEUE_TIMER** heap;
+
+		heap = (WINPR_TIMER_QUEUE_TIMER**) realloc(queue->heap, sizeof(WINPR_TIMER_QUEUE_TIMER*) * size);
+
+		if (!heap)
+			return FALSE;
+
+		queue->heap = heap;
+		queue->size = size;
+	}
+
+	timer->index = queue->count++;
+	queue->heap[timer->index] = timer;
+	timer_queue_heap_sift(queue, timer->index);
+
+	return TRUE;
+}
+
+static void timer_queue_heap_remove(WINPR_TIMER_QUEUE* queue, WINPR_TIMER_QUEUE_TIMER* timer)
+{
+	int index = timer->index;
+
+	if (index < 0)
+		return;
+
+	timer->index = -1;
+	queue->count--;
+
+	if (index == queue->count)
+		return;
+
+	queue->heap[index] = queue->heap[queue->count];
+	queue->heap[index]->index = index;
+	timer_queue_heap_sift(queue, index);
+}
+
+static void timer_queue_link(WINPR_TIMER_QUEUE* queue, WINPR_TIMER_QUEUE_TIMER* timer)
+{
+	timer->prev = NULL;
+	timer->next = queue->timers;
+
+	if (queue->timers)
+		queue->timers->prev = timer;
+
+	queue->timers = timer;
+}
+
+static void timer_queue_unlink(WINPR_TIMER_QUEUE* queue, WINPR_TIMER_QUEUE_TIMER* timer)
+{
+	if (timer->prev)
+		timer->prev->next = timer->next;
+	else
+		queue->timers = timer->next;
+
+	if (timer->next)
+		timer->next->prev = timer->prev;
+}
+
+static void timer_queue_timer_free(WINPR_TIMER_QUEUE_TIMER* timer)
+{
+	HANDLE CompletionEvent = timer->CompletionEvent;
+
+	free(timer);
+
+	if (CompletionEvent && (CompletionEvent != INVALID_HANDLE_VALUE))
+		SetEvent(CompletionEvent);
+}
+
+static void* timer_queue_thread(void* arg)
+{
+	UINT64 now;
+	struct timespec due;
+	WINPR_TIMER_QUEUE_TIMER* timer;
+	WINPR_TIMER_QUEUE* queue = (WINPR_TIMER_QUEUE*) arg;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	while (!queue->bCancelled)
+	{
+		if (queue->count < 1)
+		{
+			pthread_cond_wait(&queue->cond, &queue->mutex);
+			continue;
+		}
+
+		timer = queue->heap[0];
+		now = timer_queue_get_time();
+
+		if (timer->DueTime > now)
+		{
+			timer_queue_get_deadline(timer->DueTime, now, &due);
+			pthread_cond_timedwait(&queue->cond, &queue->mutex, &due);
+			continue;
+		}
+
+		timer_queue_heap_remove(queue, timer);
+		queue->current = timer;
+		timer->bChanged = FALSE;
+
+		pthread_mutex_unlock(&queue->mutex);
+		timer->Callback(timer->Parameter, TRUE);
+		pthread_mutex_lock(&queue->mutex);
+
+		queue->current = NULL;
+
+		if (timer->bDeleted)
+		{
+			/* deleted from its own callback or without waiting: nobody else will free it */
+
+			if (timer->CompletionEvent != INVALID_HANDLE_VALUE)
+			{
+				timer_queue_unlink(queue, timer);
+				timer_queue_timer_free(timer);
+			}
+		}
+		else if (timer->bChanged)
+		{
+			timer_queue_heap_insert(queue, timer);
+		}
+		else if (timer->Period && !(timer->Flags & WT_EXECUTEONLYONCE))
+		{
+			/* skip missed periods rather than firing them back to back */
+
+			timer->DueTime += timer->Period;
+
+			if (timer->DueTime < now)
+				timer->DueTime = now + timer->Period;
+
+			timer_queue_heap_insert(queue, timer);
+		}
+
+		pthread_cond_broadcast(&queue->done);
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	return NULL;
+}
+
+HANDLE CreateTimerQueue(void)
+{
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	pthread_condattr_t attr;
+#endif
+	WINPR_TIMER_QUEUE* queue;
+
+	queue = (WINPR_TIMER_QUEUE*) malloc(sizeof(WINPR_TIMER_QUEUE));
+
+	if (!queue)
+		return NULL;
+
+	ZeroMemory(queue, sizeof(WINPR_TIMER_QUEUE));
+
+	queue->size = 64;
+	queue->heap = (WINPR_TIMER_QUEUE_TIMER**) malloc(sizeof(WINPR_TIMER_QUEUE_TIMER*) * queue->size);
+
+	if (!queue->heap)
+	{
+		free(queue);
+		return NULL;
+	}
+
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->done, NULL);
+
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&queue->cond, &attr);
+	pthread_condattr_destroy(&attr);
+#else
+	pthread_cond_init(&queue->cond, NULL);
+#endif
+
+	if (pthread_create(&queue->thread, NULL, timer_queue_thread, queue) != 0)
+	{
+		pthread_cond_destroy(&queue->cond);
+		pthread_cond_destroy(&queue->done);
+		pthread_mutex_destroy(&queue->mutex);
+		free(queue->heap);
+		free(queue);
+		return NULL;
+	}
+
+	return (HANDLE) queue;
+}
+
+BOOL DeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
+{
+	WINPR_TIMER_QUEUE_TIMER* timer;
+	WINPR_TIMER_QUEUE* queue = (WINPR_TIMER_QUEUE*) TimerQueue;
+
+	if (!queue || (queue == default_queue))
+		return FALSE;
+
+	pthread_mutex_lock(&queue->mutex);
+	queue->bCancelled = TRUE;
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+
+	/* the queue thread finishes the callback it may be running before exiting */
+
+	pthread_join(queue->thread, NULL);
+
+	while (queue->timers)
+	{
+		timer = queue->timers;
+		timer_queue_unlink(queue, timer);
+		timer_queue_timer_free(timer);
+	}
+
+	pthread_cond_destroy(&queue->cond);
+	pthread_cond_destroy(&queue->done);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue->heap);
+	free(queue);
+
+	if (CompletionEvent && (CompletionEvent != INVALID_HANDLE_VALUE))
+		SetEvent(CompletionEvent);
+
+	return TRUE;
+}
+
+BOOL DeleteTimerQueue(HANDLE TimerQueue)
+{
+	return DeleteTimerQueueEx(TimerQueue, NULL);
+}
+
+static void timer_queue_create_default(void)
+{
+	default_queue = (WINPR_TIMER_QUEUE*) CreateTimerQueue();
+}
+
+static WINPR_TIMER_QUEUE* timer_queue_get(HANDLE TimerQueue)
+{
+	if (TimerQueue)
+		return (WINPR_TIMER_QUEUE*) TimerQueue;
+
+	pthread_once(&default_queue_once, timer_queue_create_default);
+
+	return default_queue;
+}
+
+BOOL CreateTimerQueueTimer(PHANDLE phNewTimer, HANDLE TimerQueue,
+		WAITORTIMERCALLBACK Callback, PVOID Parameter, DWORD DueTime, DWORD Period, ULONG Flags)
+{
+	WINPR_TIMER_QUEUE* queue;
+	WINPR_TIMER_QUEUE_TIMER* timer;
+
+	queue = timer_queue_get(TimerQueue);
+
+	if (!phNewTimer || !queue || !Callback)
+		return FALSE;
+
+	timer = (WINPR_TIMER_QUEUE_TIMER*) malloc(sizeof(WINPR_TIMER_QUEUE_TIMER));
+
+	if (!timer)
+		return FALSE;
+
+	ZeroMemory(timer, sizeof(WINPR_TIMER_QUEUE_TIMER));
+
+	timer->index = -1;
+	timer->queue = queue;
+	timer->Flags = Flags;
+	timer->Period = Period;
+	timer->Callback = Callback;
+	timer->Parameter = Parameter;
+	timer->DueTime = timer_queue_get_time() + DueTime;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	if (!timer_queue_heap_insert(queue, timer))
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		free(timer);
+		return FALSE;
+	}
+
+	timer_queue_link(queue, timer);
+
+	if (timer->index == 0)
+		pthread_cond_signal(&queue->cond);
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	*phNewTimer = (HANDLE) timer;
+
+	return TRUE;
+}
+
+BOOL ChangeTimerQueueTimer(HANDLE TimerQueue, HANDLE Timer, ULONG DueTime, ULONG Period)
+{
+	WINPR_TIMER_QUEUE* queue;
+	WINPR_TIMER_QUEUE_TIMER* timer = (WINPR_TIMER_QUEUE_TIMER*) Timer;
+
+	if (!timer)
+		return FALSE;
+
+	queue = timer->queue;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	if (timer->bDeleted)
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		return FALSE;
+	}
+
+	timer->Period = Period;
+	timer->DueTime = timer_queue_get_time() + DueTime;
+
+	/* a timer whose callback is running is put back by the queue thread */
+
+	if (timer->index >= 0)
+		timer_queue_heap_sift(queue, timer->index);
+	else if (queue->current == timer)
+		timer->bChanged = TRUE;
+	else
+		timer_queue_heap_insert(queue, timer);
+
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+
+	return TRUE;
+}
+
+/**
+ * CompletionEvent INVALID_HANDLE_VALUE waits for a running callback to return,
+ * NULL returns right away, and an event handle is set once the callback returned.
+ */
+
+BOOL DeleteTimerQueueTimer(HANDLE TimerQueue, HANDLE Timer, HANDLE CompletionEvent)
+{
+	WINPR_TIMER_QUEUE* queue;
+	WINPR_TIMER_QUEUE_TIMER* timer = (WINPR_TIMER_QUEUE_TIMER*) Timer;
+
+	if (!timer)
+		return FALSE;
+
+	queue = timer->queue;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	timer_queue_heap_remove(queue, timer);
+	timer->bDeleted = TRUE;
+	timer->CompletionEvent = CompletionEvent;
+
+	if (queue->current == timer)
+	{
+		if (pthread_equal(pthread_self(), queue->thread))
+		{
+			/* deleted from its own callback: the queue thread frees it on return */
+
+			timer->CompletionEvent = NULL;
+			pthread_mutex_unlock(&queue->mutex);
+			return TRUE;
+		}
+
+		if (CompletionEvent != INVALID_HANDLE_VALUE)
+		{
+			pthread_mutex_unlock(&queue->mutex);
+			return TRUE;
+		}
+
+		while (queue->current == timer)
+			pthread_cond_wait(&queue->done, &queue->mutex);
+	}
+
+	timer_queue_unlink(queue, timer);
+	pthread_mutex_unlock(&queue->mutex);
+
+	timer_queue_timer_free(timer);
+
 	return TRUE;
 }
 
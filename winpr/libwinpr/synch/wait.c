@@ -39,85 +39,345 @@
 
 #ifndef _WIN32
 
-DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+#include "../thread/thread.h"
+
+/**
+ * Every waitable object except mutexes exposes a file descriptor that is
+ * readable while the object is signaled, so a wait on any number of them
+ * is a single poll() call. Once poll() reports an object signaled the wait
+ * still has to acquire it (consume an auto-reset event or a semaphore unit),
+ * which can fail if another thread got there first: the wait then resumes.
+ * Mutexes have no descriptor and are retried with a short backoff.
+ */
+
+#define WAIT_BACKOFF_MAX	16
+
+struct winpr_wait_object
 {
 	ULONG Type;
 	PVOID Object;
+	HANDLE handle;
+	int fd;
+};
+typedef struct winpr_wait_object WINPR_WAIT_OBJECT;
 
-	if (!winpr_Handle_GetInfo(hHandle, &Type, &Object))
-		return WAIT_FAILED;
+static BOOL winpr_wait_resolve(HANDLE handle, WINPR_WAIT_OBJECT* waitObject)
+{
+	ULONG Type;
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+		return FALSE;
 
 	if (Type == HANDLE_TYPE_THREAD)
 	{
-		if (dwMilliseconds != INFINITE)
-			printf("WaitForSingleObject: timeout not implemented for thread wait\n");
+		handle = ((WINPR_THREAD*) Object)->hExitEvent;
 
-		pthread_join((pthread_t) Object, NULL);
+		if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+			return FALSE;
 	}
-	if (Type == HANDLE_TYPE_MUTEX)
+
+	waitObject->Type = Type;
+	waitObject->Object = Object;
+	waitObject->handle = handle;
+
+	switch (Type)
 	{
-		if (dwMilliseconds != INFINITE)
-			printf("WaitForSingleObject: timeout not implemented for mutex wait\n");
+		case HANDLE_TYPE_EVENT:
+			waitObject->fd = ((WINPR_EVENT*) Object)->pipe_fd[0];
+			break;
+
+		case HANDLE_TYPE_SEMAPHORE:
+			waitObject->fd = ((WINPR_SEMAPHORE*) Object)->pipe_fd[0];
+			break;
+
+		case HANDLE_TYPE_TIMER:
+			waitObject->fd = ((WINPR_TIMER*) Object)->fd;
+			break;
+
+		case HANDLE_TYPE_ANONYMOUS_PIPE:
+			waitObject->fd = (int) ((ULONG_PTR) Object);
+			break;
 
-		pthread_mutex_lock((pthread_mutex_t*) Object);
+		case HANDLE_TYPE_MUTEX:
+			waitObject->fd = -1;
+			break;
+
+		default:
+			return FALSE;
 	}
-	else if (Type == HANDLE_TYPE_EVENT)
-	{
-		int status;
-		fd_set rfds;
-		WINPR_EVENT* event;
-		struct timeval timeout;
 
-		event = (WINPR_EVENT*) Object;
+	return TRUE;
+}
 
-		FD_ZERO(&rfds);
-		FD_SET(event->pipe_fd[0], &rfds);
-		ZeroMemory(&timeout, sizeof(timeout));
+static BOOL winpr_wait_acquire(WINPR_WAIT_OBJECT* waitObject)
+{
+	switch (waitObject->Type)
+	{
+		case HANDLE_TYPE_EVENT:
+			return winpr_event_acquire((WINPR_EVENT*) waitObject->Object);
 
-		if ((dwMilliseconds != INFINITE) && (dwMilliseconds != 0))
-		{
-			timeout.tv_usec = dwMilliseconds * 1000;
-		}
+		case HANDLE_TYPE_SEMAPHORE:
+			return winpr_semaphore_acquire((WINPR_SEMAPHORE*) waitObject->Object);
 
-		status = select(event->pipe_fd[0] + 1, &rfds, 0, 0,
-				(dwMilliseconds == INFINITE) ? NULL : &timeout);
+		case HANDLE_TYPE_TIMER:
+			return winpr_timer_acquire((WINPR_TIMER*) waitObject->Object);
 
-		if (status < 0)
-			return WAIT_FAILED;
+		case HANDLE_TYPE_MUTEX:
+			return (pthread_mutex_trylock((pthread_mutex_t*) waitObject->Object) == 0);
 
-		if (status != 1)
-			return WAIT_TIMEOUT;
+		default:
+			return TRUE;
 	}
-	else if (Type == HANDLE_TYPE_SEMAPHORE)
+}
+
+/**
+ * Give back an object acquired by a wait-all that could not complete.
+ * An auto-reset timer expiration cannot be given back and is lost.
+ */
+
+static void winpr_wait_release(WINPR_WAIT_OBJECT* waitObject)
+{
+	switch (waitObject->Type)
 	{
-#if defined __APPLE__
-		semaphore_wait(*((winpr_sem_t*) Object));
+		case HANDLE_TYPE_EVENT:
+			if (!((WINPR_EVENT*) waitObject->Object)->bManualReset)
+				SetEvent(waitObject->handle);
+			break;
+
+		case HANDLE_TYPE_SEMAPHORE:
+			ReleaseSemaphore(waitObject->handle, 1, NULL);
+			break;
+
+		case HANDLE_TYPE_MUTEX:
+			pthread_mutex_unlock((pthread_mutex_t*) waitObject->Object);
+			break;
+	}
+}
+
+/* clock_gettime() only appeared in Mac OS X 10.12 */
+
+static UINT64 winpr_wait_get_time(void)
+{
+#ifdef __APPLE__
+	mach_timebase_info_data_t timebase;
+
+	mach_timebase_info(&timebase);
+
+	return ((mach_absolute_time() * timebase.numer) / timebase.denom) / 1000000;
 #else
-		sem_wait((winpr_sem_t*) Object);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((UINT64) ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
 #endif
+}
+
+static int winpr_wait_get_timeout(UINT64 deadline, DWORD dwMilliseconds)
+{
+	UINT64 now;
+
+	if (dwMilliseconds == INFINITE)
+		return -1;
+
+	now = winpr_wait_get_time();
+
+	return (now >= deadline) ? 0 : (int) (deadline - now);
+}
+
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+	ULONG Type;
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(hHandle, &Type, &Object))
+		return WAIT_FAILED;
+
+	if ((Type == HANDLE_TYPE_MUTEX) && (dwMilliseconds == INFINITE))
+	{
+		if (pthread_mutex_lock((pthread_mutex_t*) Object) != 0)
+			return WAIT_FAILED;
+
+		return WAIT_OBJECT_0;
 	}
 
-	return WAIT_OBJECT_0;
+	return WaitForMultipleObjects(1, &hHandle, FALSE, dwMilliseconds);
 }
 
 DWORD WaitForSingleObjectEx(HANDLE hHandle, DWORD dwMilliseconds, BOOL bAlertable)
 {
-	return WAIT_OBJECT_0;
+	return WaitForSingleObject(hHandle, dwMilliseconds);
 }
 
 DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds)
 {
-	return 0;
+	int status;
+	int timeout;
+	int backoff;
+	BOOL pending;
+	UINT64 deadline;
+	DWORD index;
+	DWORD acquired;
+	DWORD nPollCount;
+	DWORD nPollIndex[MAXIMUM_WAIT_OBJECTS];
+	BOOL bSignaled[MAXIMUM_WAIT_OBJECTS];
+	struct pollfd pollfds[MAXIMUM_WAIT_OBJECTS];
+	WINPR_WAIT_OBJECT waitObjects[MAXIMUM_WAIT_OBJECTS];
+
+	if ((nCount < 1) || (nCount > MAXIMUM_WAIT_OBJECTS))
+		return WAIT_FAILED;
+
+	pending = FALSE;
+
+	for (index = 0; index < nCount; index++)
+	{
+		if (!winpr_wait_resolve(lpHandles[index], &waitObjects[index]))
+			return WAIT_FAILED;
+
+		if (waitObjects[index].fd < 0)
+			pending = TRUE;
+
+		bSignaled[index] = FALSE;
+	}
+
+	backoff = 0;
+	deadline = (dwMilliseconds == INFINITE) ? 0 : winpr_wait_get_time() + dwMilliseconds;
+
+	while (1)
+	{
+		/* when waiting for all objects, only poll the ones not yet seen signaled */
+
+		nPollCount = 0;
+
+		for (index = 0; index < nCount; index++)
+		{
+			if (!bWaitAll)
+				bSignaled[index] = FALSE;
+
+			if ((waitObjects[index].fd < 0) || bSignaled[index])
+				continue;
+
+			pollfds[nPollCount].fd = waitObjects[index].fd;
+			pollfds[nPollCount].events = POLLIN;
+			pollfds[nPollCount].revents = 0;
+			nPollIndex[nPollCount++] = index;
+		}
+
+		timeout = winpr_wait_get_timeout(deadline, dwMilliseconds);
+
+		if (pending && ((timeout < 0) || (timeout > backoff)))
+		{
+			timeout = backoff;
+			backoff = (backoff < 1) ? 1 : backoff * 2;
+
+			if (backoff > WAIT_BACKOFF_MAX)
+				backoff = WAIT_BACKOFF_MAX;
+		}
+
+		status = poll(pollfds, nPollCount, timeout);
+
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return WAIT_FAILED;
+		}
+
+		for (index = 0; index < nPollCount; index++)
+		{
+			if (pollfds[index].revents & (POLLIN | POLLHUP | POLLERR))
+				bSignaled[nPollIndex[index]] = TRUE;
+		}
+
+		if (!bWaitAll)
+		{
+			for (index = 0; index < nCount; index++)
+			{
+				if ((waitObjects[index].fd >= 0) && !bSignaled[index])
+					continue;
+
+				if (winpr_wait_acquire(&waitObjects[index]))
+					return (WAIT_OBJECT_0 + index);
+			}
+		}
+		else
+		{
+			for (index = 0; index < nCount; index++)
+			{
+				if ((waitObjects[index].fd >= 0) && !bSignaled[index])
+					break;
+			}
+
+			if (index == nCount)
+			{
+				for (acquired = 0; acquired < nCount; acquired++)
+				{
+					if (!winpr_wait_acquire(&waitObjects[acquired]))
+						break;
+				}
+
+				if (acquired == nCount)
+					return WAIT_OBJECT_0;
+
+				/* lost a race for one of the objects: give back the others and start over */
+
+				while (acquired > 0)
+					winpr_wait_release(&waitObjects[--acquired]);
+
+				for (index = 0; index < nCount; index++)
+					bSignaled[index] = FALSE;
+			}
+		}
+
+		if (winpr_wait_get_timeout(deadline, dwMilliseconds) == 0)
+			return WAIT_TIMEOUT;
+	}
+
+	return WAIT_FAILED;
 }
 
 DWORD WaitForMultipleObjectsEx(DWORD nCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds, BOOL bAlertable)
 {
-	return 0;
+	return WaitForMultipleObjects(nCount, lpHandles, bWaitAll, dwMilliseconds);
 }
 
 DWORD SignalObjectAndWait(HANDLE hObjectToSignal, HANDLE hObjectToWaitOn, DWORD dwMilliseconds, BOOL bAlertable)
 {
-	return 0;
+	BOOL status;
+
+	switch (winpr_Handle_GetType(hObjectToSignal))
+	{
+		case HANDLE_TYPE_EVENT:
+			status = SetEvent(hObjectToSignal);
+			break;
+
+		case HANDLE_TYPE_SEMAPHORE:
+			status = ReleaseSemaphore(hObjectToSignal, 1, NULL);
+			break;
+
+		case HANDLE_TYPE_MUTEX:
+			status = ReleaseMutex(hObjectToSignal);
+			break;
+
+		default:
+			status = FALSE;
+			break;
+	}
+
+	if (!status)
+		return WAIT_FAILED;
+
+	return WaitForSingleObject(hObjectToWaitOn, dwMilliseconds);
 }
 
 #endif
@@ -71,6 +71,61 @@
 #include <unistd.h>
 #include <winpr/crt.h>
 
+static DWORD GetProcessorArchitecture()
+{
+#if defined(__x86_64__) || defined(_M_AMD64)
+	return PROCESSOR_ARCHITECTURE_AMD64;
+#elif defined(__i386__) || defined(_M_IX86)
+	return PROCESSOR_ARCHITECTURE_INTEL;
+#elif defined(__arm__) || defined(__aarch64__)
+	return PROCESSOR_ARCHITECTURE_ARM;
+#elif defined(__ia64__)
+	return PROCESSOR_ARCHITECTURE_IA64;
+#else
+	return PROCESSOR_ARCHITECTURE_UNKNOWN;
+#endif
+}
+
+static DWORD GetNumberOfProcessors()
+{
+	long count = 1;
+
+#if defined(_SC_NPROCESSORS_ONLN)
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if (count < 1)
+		count = 1;
+
+	return (DWORD) count;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo)
+{
+	long page_size = 4096;
+
+#if defined(_SC_PAGESIZE)
+	page_size = sysconf(_SC_PAGESIZE);
+
+	if (page_size < 1)
+		page_size = 4096;
+#endif
+
+	ZeroMemory(lpSystemInfo, sizeof(SYSTEM_INFO));
+
+	lpSystemInfo->wProcessorArchitecture = (WORD) GetProcessorArchitecture();
+	lpSystemInfo->dwPageSize = (DWORD) page_size;
+	lpSystemInfo->dwNumberOfProcessors = GetNumberOfProcessors();
+	lpSystemInfo->dwActiveProcessorMask = (lpSystemInfo->dwNumberOfProcessors >= (sizeof(DWORD_PTR) * 8)) ?
+			((DWORD_PTR) -1) : ((((DWORD_PTR) 1) << lpSystemInfo->dwNumberOfProcessors) - 1);
+	lpSystemInfo->dwAllocationGranularity = (DWORD) page_size;
+}
+
+void GetNativeSystemInfo(LPSYSTEM_INFO lpSystemInfo)
+{
+	GetSystemInfo(lpSystemInfo);
+}
+
 BOOL GetComputerNameExA(COMPUTER_NAME_FORMAT NameType, LPSTR lpBuffer, LPDWORD nSize)
 {
 	char hostname[256];
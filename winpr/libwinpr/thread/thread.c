@@ -76,19 +76,43 @@
  * http://stackoverflow.com/questions/3140867/suspend-pthreads-without-using-condition
  */
 
+#include <winpr/synch.h>
+
+#include "thread.h"
+
 typedef void *(*pthread_start_routine)(void*);
 
-struct winpr_thread
+static void winpr_thread_exit(void* arg)
 {
-	BOOL started;
-	pthread_t thread;
-	SIZE_T dwStackSize;
-	LPVOID lpParameter;
-	pthread_mutex_t mutex;
-	LPTHREAD_START_ROUTINE lpStartAddress;
-	LPSECURITY_ATTRIBUTES lpThreadAttributes;
-};
-typedef struct winpr_thread WINPR_THREAD;
+	BOOL closed;
+	WINPR_THREAD* thread = (WINPR_THREAD*) arg;
+
+	SetEvent(thread->hExitEvent);
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->exited = TRUE;
+	closed = thread->closed;
+	pthread_mutex_unlock(&thread->mutex);
+
+	if (closed)
+	{
+		CloseHandle(thread->hExitEvent);
+		pthread_mutex_destroy(&thread->mutex);
+		free(thread);
+	}
+}
+
+static void* winpr_thread_launcher(void* arg)
+{
+	void* status;
+	WINPR_THREAD* thread = (WINPR_THREAD*) arg;
+
+	pthread_cleanup_push(winpr_thread_exit, thread);
+	status = ((pthread_start_routine) thread->lpStartAddress)(thread->lpParameter);
+	pthread_cleanup_pop(1);
+
+	return status;
+}
 
 void winpr_StartThread(WINPR_THREAD* thread)
 {
@@ -101,7 +125,7 @@ void winpr_StartThread(WINPR_THREAD* thread)
 		pthread_attr_setstacksize(&attr, (size_t) thread->dwStackSize);
 
 	thread->started = TRUE;
-	pthread_create(&thread->thread, &attr, (pthread_start_routine) thread->lpStartAddress, thread->lpParameter);
+	pthread_create(&thread->thread, &attr, winpr_thread_launcher, thread);
 
 	pthread_attr_destroy(&attr);
 }
@@ -120,6 +144,7 @@ HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize
 	thread->lpParameter = lpParameter;
 	thread->lpStartAddress = lpStartAddress;
 	thread->lpThreadAttributes = lpThreadAttributes;
+	thread->hExitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
 	pthread_mutex_init(&thread->mutex, 0);
 
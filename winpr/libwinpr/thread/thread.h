@@ -0,0 +1,50 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Process Thread Functions
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_THREAD_PRIVATE_H
+#define WINPR_THREAD_PRIVATE_H
+
+#include <winpr/thread.h>
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+/**
+ * hExitEvent is a manual-reset event set when the thread routine returns,
+ * calls ExitThread() or is terminated: waiting on a thread handle waits on it.
+ * The structure is freed by whichever of thread exit and CloseHandle() comes last.
+ */
+
+struct winpr_thread
+{
+	BOOL started;
+	BOOL exited;
+	BOOL closed;
+	pthread_t thread;
+	SIZE_T dwStackSize;
+	LPVOID lpParameter;
+	pthread_mutex_t mutex;
+	HANDLE hExitEvent;
+	LPTHREAD_START_ROUTINE lpStartAddress;
+	LPSECURITY_ATTRIBUTES lpThreadAttributes;
+};
+typedef struct winpr_thread WINPR_THREAD;
+
+#endif
+
+#endif /* WINPR_THREAD_PRIVATE_H */
@@ -24,6 +24,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <winpr/crt.h>
 #include <winpr/sam.h>
@@ -39,150 +41,378 @@
 #define WINPR_SAM_FILE		"/etc/winpr/SAM"
 #endif
 
-WINPR_SAM* SamOpen(BOOL read_only)
+/**
+ * The SAM file is parsed once into an immutable, reference counted
+ * database indexed by user name. SamOpen() compares the file identity
+ * (inode, size, modification and change times) with the one the current
+ * database was built from and reloads it when the file was replaced or
+ * modified. Lookups never take a lock: an open WINPR_SAM keeps its
+ * database alive even if a newer one has been loaded in the meantime.
+ */
+
+struct winpr_sam_record
 {
-	FILE* fp = NULL;
-	WINPR_SAM* sam = NULL;
+	LPSTR User;
+	UINT32 UserLength;
+	LPSTR Domain;
+	UINT32 DomainLength;
+	BYTE LmHash[16];
+	BYTE NtHash[16];
+	UINT32 Next;
+};
+typedef struct winpr_sam_record WINPR_SAM_RECORD;
+
+struct winpr_sam_database
+{
+	char* Filename;
+	int RefCount;
+
+	dev_t Device;
+	ino_t Inode;
+	off_t Size;
+	time_t ModificationTime;
+	time_t ChangeTime;
+	long ModificationTimeNsec;
+
+	char* Buffer;
+	UINT32 Count;
+	WINPR_SAM_RECORD* Records;
+	UINT32 BucketMask;
+	UINT32* Buckets;
+
+	WINPR_SAM_DATABASE* Next;
+};
+
+static pthread_mutex_t sam_mutex = PTHREAD_MUTEX_INITIALIZER;
+static WINPR_SAM_DATABASE* sam_databases = NULL;
+
+#if defined(__linux__)
+#define WINPR_SAM_MTIME_NSEC(_st)	((_st)->st_mtim.tv_nsec)
+#else
+#define WINPR_SAM_MTIME_NSEC(_st)	0
+#endif
 
-	if (read_only)
-	{
-		fp = fopen(WINPR_SAM_FILE, "r");
-	}
-	else
+void HexStrToBin(char* str, BYTE* bin, int length)
+{
+	int i;
+
+	CharUpperBuffA(str, length * 2);
+
+	for (i = 0; i < length; i++)
 	{
-		fp = fopen(WINPR_SAM_FILE, "r+");
+		bin[i] = 0;
+
+		if ((str[i * 2] >= '0') && (str[i * 2] <= '9'))
+			bin[i] |= (str[i * 2] - '0') << 4;
+
+		if ((str[i * 2] >= 'A') && (str[i * 2] <= 'F'))
+			bin[i] |= (str[i * 2] - 'A' + 10) << 4;
+
+		if ((str[i * 2 + 1] >= '0') && (str[i * 2 + 1] <= '9'))
+			bin[i] |= (str[i * 2 + 1] - '0');
 
-		if (!fp)
-			fp = fopen(WINPR_SAM_FILE, "w+");
+		if ((str[i * 2 + 1] >= 'A') && (str[i * 2 + 1] <= 'F'))
+			bin[i] |= (str[i * 2 + 1] - 'A' + 10);
 	}
+}
+
+static UINT32 winpr_sam_hash(const char* str, UINT32 length)
+{
+	UINT32 index;
+	UINT32 hash = 2166136261U;
 
-	if (fp)
+	for (index = 0; index < length; index++)
 	{
-		sam = (WINPR_SAM*) malloc(sizeof(WINPR_SAM));
-		sam->read_only = read_only;
-		sam->fp = fp;
+		hash ^= (BYTE) str[index];
+		hash *= 16777619U;
 	}
-	else
-		printf("Could not open SAM file!\n");
 
-	return sam;
+	return hash;
 }
 
-BOOL SamLookupStart(WINPR_SAM* sam)
+static BOOL winpr_sam_same_file(WINPR_SAM_DATABASE* db, struct stat* st)
 {
-	size_t read_size;
-	long int file_size;
-
-	fseek(sam->fp, 0, SEEK_END);
-	file_size = ftell(sam->fp);
-	fseek(sam->fp, 0, SEEK_SET);
+	return (db->Device == st->st_dev) && (db->Inode == st->st_ino) &&
+		(db->Size == st->st_size) && (db->ModificationTime == st->st_mtime) &&
+		(db->ChangeTime == st->st_ctime) && (db->ModificationTimeNsec == WINPR_SAM_MTIME_NSEC(st));
+}
 
-	if (file_size < 1)
-		return FALSE;
+/**
+ * Split a "User:Domain:LmHash:NtHash:::" line in place.
+ * Malformed lines are skipped instead of being dereferenced.
+ */
 
-	sam->buffer = (char*) malloc(file_size + 2);
+static BOOL winpr_sam_parse_line(char* line, WINPR_SAM_RECORD* record)
+{
+	int index;
+	char* p[4];
+	int length[4];
 
-	read_size = fread(sam->buffer, file_size, 1, sam->fp);
+	p[0] = line;
 
-	if (!read_size)
+	for (index = 1; index < 4; index++)
 	{
-		if (!ferror(sam->fp))
-			read_size = file_size;
+		p[index] = strchr(p[index - 1], ':');
+
+		if (!p[index])
+			return FALSE;
+
+		*p[index]++ = '\0';
+		length[index - 1] = p[index] - p[index - 1] - 1;
 	}
 
-	if (read_size < 1)
-	{
-		free(sam->buffer);
-		sam->buffer = NULL;
+	length[3] = strcspn(p[3], ":");
+	p[3][length[3]] = '\0';
+
+	if (length[0] < 1)
 		return FALSE;
-	}
 
-	sam->buffer[file_size] = '\n';
-	sam->buffer[file_size + 1] = '\0';
+	ZeroMemory(record, sizeof(WINPR_SAM_RECORD));
+
+	record->User = p[0];
+	record->UserLength = length[0];
+	record->Domain = p[1];
+	record->DomainLength = length[1];
+
+	if (length[2] == 32)
+		HexStrToBin(p[2], record->LmHash, 16);
 
-	sam->line = strtok(sam->buffer, "\n");
+	if (length[3] == 32)
+		HexStrToBin(p[3], record->NtHash, 16);
 
 	return TRUE;
 }
 
-void SamLookupFinish(WINPR_SAM* sam)
+static void winpr_sam_database_free(WINPR_SAM_DATABASE* db)
 {
-	free(sam->buffer);
-
-	sam->buffer = NULL;
-	sam->line = NULL;
+	free(db->Filename);
+	free(db->Buffer);
+	free(db->Records);
+	free(db->Buckets);
+	free(db);
 }
 
-void HexStrToBin(char* str, BYTE* bin, int length)
+static WINPR_SAM_DATABASE* winpr_sam_database_load(LPCSTR filename)
 {
-	int i;
+	FILE* fp;
+	char* line;
+	char* next;
+	UINT32 index;
+	UINT32 bucket;
+	UINT32 capacity;
+	size_t file_size;
+	struct stat st;
+	WINPR_SAM_DATABASE* db;
+
+	fp = fopen(filename, "r");
+
+	if (!fp)
+		return NULL;
 
-	CharUpperBuffA(str, length * 2);
+	if (fstat(fileno(fp), &st) != 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
 
-	for (i = 0; i < length; i++)
+	db = (WINPR_SAM_DATABASE*) calloc(1, sizeof(WINPR_SAM_DATABASE));
+
+	if (!db)
 	{
-		bin[i] = 0;
+		fclose(fp);
+		return NULL;
+	}
 
-		if ((str[i * 2] >= '0') && (str[i * 2] <= '9'))
-			bin[i] |= (str[i * 2] - '0') << 4;
+	db->Filename = _strdup(filename);
+	db->Device = st.st_dev;
+	db->Inode = st.st_ino;
+	db->Size = st.st_size;
+	db->ModificationTime = st.st_mtime;
+	db->ChangeTime = st.st_ctime;
+	db->ModificationTimeNsec = WINPR_SAM_MTIME_NSEC(&st);
 
-		if ((str[i * 2] >= 'A') && (str[i * 2] <= 'F'))
-			bin[i] |= (str[i * 2] - 'A' + 10) << 4;
+	file_size = (size_t) st.st_size;
+	db->Buffer = (char*) malloc(file_size + 1);
 
-		if ((str[i * 2 + 1] >= '0') && (str[i * 2 + 1] <= '9'))
-			bin[i] |= (str[i * 2 + 1] - '0');
+	if (!db->Filename || !db->Buffer)
+	{
+		fclose(fp);
+		winpr_sam_database_free(db);
+		return NULL;
+	}
 
-		if ((str[i * 2 + 1] >= 'A') && (str[i * 2 + 1] <= 'F'))
-			bin[i] |= (str[i * 2 + 1] - 'A' + 10);
+	file_size = fread(db->Buffer, 1, file_size, fp);
+	db->Buffer[file_size] = '\0';
+	fclose(fp);
+
+	/* one record per line at most */
+
+	capacity = 1;
+
+	for (index = 0; index < file_size; index++)
+	{
+		if (db->Buffer[index] == '\n')
+			capacity++;
+	}
+
+	db->Records = (WINPR_SAM_RECORD*) malloc(sizeof(WINPR_SAM_RECORD) * capacity);
+
+	if (!db->Records)
+	{
+		winpr_sam_database_free(db);
+		return NULL;
+	}
+
+	for (line = db->Buffer; line; line = next)
+	{
+		next = strchr(line, '\n');
+
+		if (next)
+			*next++ = '\0';
+
+		line[strcspn(line, "\r")] = '\0';
+
+		if ((line[0] == '\0') || (line[0] == '#'))
+			continue;
+
+		if (winpr_sam_parse_line(line, &db->Records[db->Count]))
+			db->Count++;
+	}
+
+	capacity = 16;
+
+	while (capacity < db->Count * 2)
+		capacity <<= 1;
+
+	db->BucketMask = capacity - 1;
+	db->Buckets = (UINT32*) calloc(capacity, sizeof(UINT32));
+
+	if (!db->Buckets)
+	{
+		winpr_sam_database_free(db);
+		return NULL;
+	}
+
+	/* chains are built backwards so that they keep the file order */
+
+	for (index = db->Count; index > 0; index--)
+	{
+		WINPR_SAM_RECORD* record = &db->Records[index - 1];
+
+		bucket = winpr_sam_hash(record->User, record->UserLength) & db->BucketMask;
+		record->Next = db->Buckets[bucket];
+		db->Buckets[bucket] = index;
 	}
+
+	return db;
 }
 
-WINPR_SAM_ENTRY* SamReadEntry(WINPR_SAM* sam, WINPR_SAM_ENTRY* entry)
+static void winpr_sam_database_release(WINPR_SAM_DATABASE* db)
 {
-	char* p[7];
-	int LmHashLength;
-	int NtHashLength;
+	BOOL last;
 
-	p[0] = sam->line;
-	p[1] = strchr(p[0], ':') + 1;
-	p[2] = strchr(p[1], ':') + 1;
-	p[3] = strchr(p[2], ':') + 1;
-	p[4] = strchr(p[3], ':') + 1;
-	p[5] = strchr(p[4], ':') + 1;
-	p[6] = p[0] + strlen(p[0]);
+	pthread_mutex_lock(&sam_mutex);
+	last = (--db->RefCount == 0);
+	pthread_mutex_unlock(&sam_mutex);
 
-	entry->UserLength = p[1] - p[0] - 1;
-	entry->DomainLength = p[2] - p[1] - 1;
+	if (last)
+		winpr_sam_database_free(db);
+}
 
-	LmHashLength = p[3] - p[2] - 1;
-	NtHashLength = p[4] - p[3] - 1;
+static WINPR_SAM_DATABASE* winpr_sam_database_acquire(LPCSTR filename)
+{
+	struct stat st;
+	WINPR_SAM_DATABASE* db;
+	WINPR_SAM_DATABASE* stale = NULL;
+	WINPR_SAM_DATABASE** link;
 
-	entry->User = (LPSTR) malloc(entry->UserLength + 1);
-	memcpy(entry->User, p[0], entry->UserLength);
-	entry->User[entry->UserLength] = '\0';
+	if (stat(filename, &st) != 0)
+		return NULL;
 
-	if (entry->DomainLength > 0)
+	pthread_mutex_lock(&sam_mutex);
+
+	for (link = &sam_databases; *link; link = &(*link)->Next)
 	{
-		entry->Domain = (LPSTR) malloc(entry->DomainLength + 1);
-		memcpy(entry->Domain, p[1], entry->DomainLength);
-		entry->Domain[entry->DomainLength] = '\0';
+		if (strcmp((*link)->Filename, filename) == 0)
+			break;
 	}
-	else
+
+	db = *link;
+
+	if (db && !winpr_sam_same_file(db, &st))
+	{
+		*link = db->Next;
+
+		if (--db->RefCount == 0)
+			stale = db;
+
+		db = NULL;
+	}
+
+	if (!db)
 	{
-		entry->Domain = NULL;
+		db = winpr_sam_database_load(filename);
+
+		if (db)
+		{
+			/* one reference is held by the cache itself */
+			db->RefCount = 1;
+			db->Next = sam_databases;
+			sam_databases = db;
+		}
 	}
 
-	if (LmHashLength == 32)
+	if (db)
+		db->RefCount++;
+
+	pthread_mutex_unlock(&sam_mutex);
+
+	if (stale)
+		winpr_sam_database_free(stale);
+
+	return db;
+}
+
+WINPR_SAM* SamOpenFile(LPCSTR filename, BOOL read_only)
+{
+	FILE* fp;
+	WINPR_SAM* sam = NULL;
+	WINPR_SAM_DATABASE* db;
+
+	if (!read_only)
 	{
-		HexStrToBin(p[2], (BYTE*) entry->LmHash, 16);
+		/* create the file if it does not exist yet */
+
+		fp = fopen(filename, "a+");
+
+		if (fp)
+			fclose(fp);
 	}
 
-	if (NtHashLength == 32)
+	db = winpr_sam_database_acquire(filename);
+
+	if (db)
 	{
-		HexStrToBin(p[3], (BYTE*) entry->NtHash, 16);
+		sam = (WINPR_SAM*) malloc(sizeof(WINPR_SAM));
+
+		if (!sam)
+		{
+			winpr_sam_database_release(db);
+			return NULL;
+		}
+
+		sam->read_only = read_only;
+		sam->db = db;
 	}
+	else
+		printf("Could not open SAM file!\n");
 
-	return entry;
+	return sam;
+}
+
+WINPR_SAM* SamOpen(BOOL read_only)
+{
+	return SamOpenFile(WINPR_SAM_FILE, read_only);
 }
 
 void SamFreeEntry(WINPR_SAM* sam, WINPR_SAM_ENTRY* entry)
@@ -199,140 +429,111 @@ void SamFreeEntry(WINPR_SAM* sam, WINPR_SAM_ENTRY* entry)
 	}
 }
 
-WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPSTR User, UINT32 UserLength, LPSTR Domain, UINT32 DomainLength)
+static WINPR_SAM_ENTRY* winpr_sam_lookup(WINPR_SAM* sam, const char* User, UINT32 UserLength,
+		const char* Domain, UINT32 DomainLength)
 {
-	int length;
-	BOOL found = 0;
+	UINT32 index;
+	WINPR_SAM_RECORD* record = NULL;
 	WINPR_SAM_ENTRY* entry;
+	WINPR_SAM_DATABASE* db = sam->db;
 
-	entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
-
-	SamLookupStart(sam);
+	index = db->Buckets[winpr_sam_hash(User, UserLength) & db->BucketMask];
 
-	while (sam->line != NULL)
+	while (index)
 	{
-		length = strlen(sam->line);
+		record = &db->Records[index - 1];
 
-		if (length > 1)
+		if ((record->UserLength == UserLength) && (memcmp(record->User, User, UserLength) == 0))
 		{
-			if (sam->line[0] != '#')
-			{
-				SamReadEntry(sam, entry);
-
-				if (strcmp(User, entry->User) == 0)
-				{
-					found = 1;
-					break;
-				}
-			}
+			if (DomainLength < 1)
+				break;
+
+			if ((record->DomainLength == DomainLength) && (memcmp(record->Domain, Domain, DomainLength) == 0))
+				break;
 		}
 
-		sam->line = strtok(NULL, "\n");
+		index = record->Next;
 	}
 
-	SamLookupFinish(sam);
+	if (!index)
+		return NULL;
+
+	entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
+
+	entry->UserLength = record->UserLength;
+	entry->User = (LPSTR) malloc(entry->UserLength + 1);
+	CopyMemory(entry->User, record->User, entry->UserLength + 1);
+
+	entry->DomainLength = record->DomainLength;
+	entry->Domain = NULL;
 
-	if (!found)
+	if (entry->DomainLength > 0)
 	{
-		free(entry);
-		return NULL;
+		entry->Domain = (LPSTR) malloc(entry->DomainLength + 1);
+		CopyMemory(entry->Domain, record->Domain, entry->DomainLength + 1);
 	}
 
+	CopyMemory(entry->LmHash, record->LmHash, 16);
+	CopyMemory(entry->NtHash, record->NtHash, 16);
+
 	return entry;
 }
 
-WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPSTR User, UINT32 UserLength, LPSTR Domain, UINT32 DomainLength)
 {
-	int length;
-	BOOL Found = 0;
-	BOOL UserMatch;
-	BOOL DomainMatch;
-	LPWSTR EntryUser;
-	UINT32 EntryUserLength;
-	LPWSTR EntryDomain;
-	UINT32 EntryDomainLength;
-	WINPR_SAM_ENTRY* entry;
+	if (!User)
+		return NULL;
 
-	entry = (WINPR_SAM_ENTRY*) malloc(sizeof(WINPR_SAM_ENTRY));
+	if (UserLength < 1)
+		UserLength = strlen(User);
 
-	SamLookupStart(sam);
+	if (!Domain)
+		DomainLength = 0;
 
-	while (sam->line != NULL)
-	{
-		length = strlen(sam->line);
+	return winpr_sam_lookup(sam, User, UserLength, Domain, DomainLength);
+}
 
-		if (length > 1)
-		{
-			if (sam->line[0] != '#')
-			{
-				DomainMatch = 0;
-				UserMatch = 0;
-
-				entry = SamReadEntry(sam, entry);
-
-				if (DomainLength > 0)
-				{
-					if (entry->DomainLength > 0)
-					{
-						EntryDomainLength = strlen(entry->Domain) * 2;
-						EntryDomain = (LPWSTR) malloc(EntryDomainLength + 2);
-						MultiByteToWideChar(CP_ACP, 0, entry->Domain, EntryDomainLength / 2,
-								(LPWSTR) EntryDomain, EntryDomainLength / 2);
-
-						if (DomainLength == EntryDomainLength)
-						{
-							if (memcmp(Domain, EntryDomain, DomainLength) == 0)
-							{
-								DomainMatch = 1;
-							}
-						}
-					}
-					else
-					{
-						DomainMatch = 0;
-					}
-				}
-				else
-				{
-					DomainMatch = 1;
-				}
-
-				if (DomainMatch)
-				{
-					EntryUserLength = strlen(entry->User) * 2;
-					EntryUser = (LPWSTR) malloc(EntryUserLength + 2);
-					MultiByteToWideChar(CP_ACP, 0, entry->User, EntryUserLength / 2,
-							(LPWSTR) EntryUser, EntryUserLength / 2);
-
-					if (UserLength == EntryUserLength)
-					{
-						if (memcmp(User, EntryUser, UserLength) == 0)
-						{
-							UserMatch = 1;
-						}
-					}
-
-					free(EntryUser);
-
-					if (UserMatch && DomainMatch)
-					{
-						Found = 1;
-						break;
-					}
-				}
-			}
-		}
+/**
+ * User and Domain lengths are in bytes, as passed by the NTLM module.
+ */
 
-		sam->line = strtok(NULL, "\n");
-	}
+static char* winpr_sam_to_utf8(LPWSTR str, UINT32 length, UINT32* utf8Length)
+{
+	int size;
+	char* utf8;
 
-	SamLookupFinish(sam);
+	*utf8Length = 0;
 
-	if (!Found)
-	{
-		free(entry);
+	if (!str || (length < 2))
 		return NULL;
-	}
+
+	size = WideCharToMultiByte(CP_UTF8, 0, str, length / 2, NULL, 0, NULL, NULL);
+
+	if (size < 1)
+		return NULL;
+
+	utf8 = (char*) malloc(size);
+	*utf8Length = WideCharToMultiByte(CP_UTF8, 0, str, length / 2, utf8, size, NULL, NULL);
+
+	return utf8;
+}
+
+WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPWSTR User, UINT32 UserLength, LPWSTR Domain, UINT32 DomainLength)
+{
+	char* utf8User;
+	char* utf8Domain;
+	UINT32 utf8UserLength;
+	UINT32 utf8DomainLength;
+	WINPR_SAM_ENTRY* entry = NULL;
+
+	utf8User = winpr_sam_to_utf8(User, UserLength, &utf8UserLength);
+	utf8Domain = winpr_sam_to_utf8(Domain, DomainLength, &utf8DomainLength);
+
+	if (utf8User)
+		entry = winpr_sam_lookup(sam, utf8User, utf8UserLength, utf8Domain, utf8DomainLength);
+
+	free(utf8User);
+	free(utf8Domain);
 
 	return entry;
 }
@@ -341,7 +542,7 @@ void SamClose(WINPR_SAM* sam)
 {
 	if (sam != NULL)
 	{
-		fclose(sam->fp);
+		winpr_sam_database_release(sam->db);
 		free(sam);
 	}
 }
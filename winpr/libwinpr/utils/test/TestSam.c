@@ -0,0 +1,213 @@
+
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <winpr/crt.h>
+#include <winpr/sam.h>
+
+#define TEST_SAM_USERS			2000
+#define TEST_SAM_THREADS		4
+#define TEST_SAM_LOOKUPS		50000
+
+static char test_sam_file[256];
+
+static const BYTE test_nt_hash[16] =
+{
+	0x8C, 0x76, 0xF7, 0xB5, 0x5D, 0x4F, 0x93, 0x5A,
+	0x8C, 0x76, 0xF7, 0xB5, 0x5D, 0x4F, 0x93, 0x5A
+};
+
+static BOOL test_sam_write(int users, const char* extra)
+{
+	int index;
+	FILE* fp;
+
+	fp = fopen(test_sam_file, "w");
+
+	if (!fp)
+		return FALSE;
+
+	fprintf(fp, "# comment line\n\n");
+	fprintf(fp, "malformed line without separators\n");
+
+	for (index = 0; index < users; index++)
+	{
+		fprintf(fp, "User%d:DOMAIN:00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\n",
+				index);
+	}
+
+	fprintf(fp, "%s", extra);
+	fclose(fp);
+
+	return TRUE;
+}
+
+static BOOL test_sam_lookup(WINPR_SAM* sam, const char* user, const char* domain, const char* expectedDomain)
+{
+	BOOL status;
+	WCHAR wUser[64];
+	WCHAR wDomain[64];
+	int wUserLength;
+	int wDomainLength = 0;
+	WINPR_SAM_ENTRY* entry;
+
+	wUserLength = MultiByteToWideChar(CP_UTF8, 0, user, -1, wUser, 64) - 1;
+
+	if (domain)
+		wDomainLength = MultiByteToWideChar(CP_UTF8, 0, domain, -1, wDomain, 64) - 1;
+
+	entry = SamLookupUserW(sam, wUser, wUserLength * 2, domain ? wDomain : NULL, wDomainLength * 2);
+
+	if (!expectedDomain)
+	{
+		SamFreeEntry(sam, entry);
+		return (entry == NULL);
+	}
+
+	if (!entry)
+		return FALSE;
+
+	status = (strcmp(entry->User, user) == 0) &&
+		(strcmp(entry->Domain ? entry->Domain : "", expectedDomain) == 0) &&
+		(memcmp(entry->NtHash, test_nt_hash, 16) == 0);
+
+	SamFreeEntry(sam, entry);
+
+	return status;
+}
+
+static void* test_sam_thread(void* arg)
+{
+	int index;
+	char user[32];
+	WINPR_SAM* sam;
+	WINPR_SAM_ENTRY* entry;
+	int* failures = (int*) arg;
+
+	for (index = 0; index < TEST_SAM_LOOKUPS; index++)
+	{
+		sam = SamOpenFile(test_sam_file, TRUE);
+
+		if (!sam)
+		{
+			(*failures)++;
+			break;
+		}
+
+		sprintf_s(user, sizeof(user), "User%d", (index * 7919) % TEST_SAM_USERS);
+		entry = SamLookupUserA(sam, user, 0, "DOMAIN", 6);
+
+		if (!entry)
+			(*failures)++;
+
+		SamFreeEntry(sam, entry);
+		SamClose(sam);
+	}
+
+	return NULL;
+}
+
+int TestSam(int argc, char* argv[])
+{
+	int index;
+	long usec;
+	WINPR_SAM* sam;
+	WINPR_SAM* old;
+	struct timeval start;
+	struct timeval end;
+	int failures[TEST_SAM_THREADS];
+	pthread_t threads[TEST_SAM_THREADS];
+
+	sprintf_s(test_sam_file, sizeof(test_sam_file), "TestSam.%d.sam", (int) getpid());
+
+	if (!test_sam_write(TEST_SAM_USERS,
+			"Shared:FIRST:00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\n"
+			"Shared:SECOND:00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\n"
+			"Local::00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\n"
+			"J\xC3\xA9r\xC3\xB4me:DOMAIN:00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\r\n"))
+	{
+		printf("failed to write %s\n", test_sam_file);
+		return -1;
+	}
+
+	sam = SamOpenFile(test_sam_file, TRUE);
+
+	if (!sam)
+		return -1;
+
+	if (!test_sam_lookup(sam, "User0", "DOMAIN", "DOMAIN") ||
+		!test_sam_lookup(sam, "User1999", "DOMAIN", "DOMAIN") ||
+		!test_sam_lookup(sam, "User1999", NULL, "DOMAIN") ||
+		!test_sam_lookup(sam, "User1999", "OTHER", NULL) ||
+		!test_sam_lookup(sam, "user0", "DOMAIN", NULL) ||
+		!test_sam_lookup(sam, "Missing", NULL, NULL) ||
+		!test_sam_lookup(sam, "Shared", NULL, "FIRST") ||
+		!test_sam_lookup(sam, "Shared", "SECOND", "SECOND") ||
+		!test_sam_lookup(sam, "Local", NULL, "") ||
+		!test_sam_lookup(sam, "J\xC3\xA9r\xC3\xB4me", "DOMAIN", "DOMAIN"))
+	{
+		printf("SAM lookup mismatch\n");
+		return -1;
+	}
+
+	/* a modified file is picked up by the next SamOpen, open handles keep their view */
+
+	old = sam;
+
+	if (!test_sam_write(10, "Added:DOMAIN:00000000000000000000000000000000:8c76f7b55d4f935a8c76f7b55d4f935a:::\n"))
+		return -1;
+
+	sam = SamOpenFile(test_sam_file, TRUE);
+
+	if (!sam)
+		return -1;
+
+	if (!test_sam_lookup(sam, "Added", "DOMAIN", "DOMAIN") ||
+		!test_sam_lookup(sam, "User1999", NULL, NULL) ||
+		!test_sam_lookup(old, "User1999", NULL, "DOMAIN") ||
+		!test_sam_lookup(old, "Added", NULL, NULL))
+	{
+		printf("SAM file change was not picked up\n");
+		return -1;
+	}
+
+	SamClose(old);
+	SamClose(sam);
+
+	/* concurrent logons */
+
+	test_sam_write(TEST_SAM_USERS, "");
+
+	gettimeofday(&start, NULL);
+
+	for (index = 0; index < TEST_SAM_THREADS; index++)
+	{
+		failures[index] = 0;
+		pthread_create(&threads[index], NULL, test_sam_thread, &failures[index]);
+	}
+
+	for (index = 0; index < TEST_SAM_THREADS; index++)
+		pthread_join(threads[index], NULL);
+
+	gettimeofday(&end, NULL);
+
+	remove(test_sam_file);
+
+	for (index = 0; index < TEST_SAM_THREADS; index++)
+	{
+		if (failures[index])
+		{
+			printf("%d concurrent lookups failed\n", failures[index]);
+			return -1;
+		}
+	}
+
+	usec = ((end.tv_sec - start.tv_sec) * 1000000) + (end.tv_usec - start.tv_usec);
+
+	printf("%d threads, %d users: %d open/lookup/close in %ld us\n",
+			TEST_SAM_THREADS, TEST_SAM_USERS, TEST_SAM_THREADS * TEST_SAM_LOOKUPS, usec);
+
+	return 0;
+}